@@ -445,6 +445,7 @@ string t_php_generator::php_includes() {
                     "use Thrift\\Exception\\TProtocolException;\n"
                     "use Thrift\\Protocol\\TProtocol;\n"
                     "use Thrift\\Protocol\\TBinaryProtocolAccelerated;\n"
+                    "use Thrift\\Protocol\\TCompactProtocolAccelerated;\n"
                     "use Thrift\\Exception\\TApplicationException;\n";
 
   if (json_serializable_) {
@@ -1400,6 +1401,9 @@ void t_php_generator::generate_process_function(std::ostream& out, t_service* ts
   out << indent() << "$bin_accel = ($input instanceof "
              << "TBinaryProtocolAccelerated) && function_exists('thrift_protocol_read_binary_after_message_begin');"
              << endl;
+  out << indent() << "$compact_accel = ($input instanceof "
+             << "TCompactProtocolAccelerated) && function_exists('thrift_protocol_read_compact_after_message_begin');"
+             << endl;
   out << indent() << "if ($bin_accel) {" << endl;
   indent_up();
 
@@ -1413,6 +1417,19 @@ void t_php_generator::generate_process_function(std::ostream& out, t_service* ts
   indent_down();
   out << indent() <<");" << endl;
 
+  indent_down();
+  out << indent() << "} elseif ($compact_accel) {" << endl;
+  indent_up();
+
+  out << indent() << "$args = thrift_protocol_read_compact_after_message_begin(" <<endl;
+
+  indent_up();
+  out << indent() << "$input,"<<endl
+      << indent() << "'" << argsname << "'" << endl;
+
+  indent_down();
+  out << indent() <<");" << endl;
+
   indent_down();
   out << indent() << "} else {" << endl;
 
@@ -1492,6 +1509,9 @@ void t_php_generator::generate_process_function(std::ostream& out, t_service* ts
   out << indent() << "$bin_accel = ($output instanceof "
              << "TBinaryProtocolAccelerated) && function_exists('thrift_protocol_write_binary');"
              << endl;
+  out << indent() << "$compact_accel = ($output instanceof "
+             << "TCompactProtocolAccelerated) && function_exists('thrift_protocol_write_compact');"
+             << endl;
 
   out << indent() << "if ($bin_accel) {" << endl;
   indent_up();
@@ -1509,6 +1529,22 @@ void t_php_generator::generate_process_function(std::ostream& out, t_service* ts
   indent_down();
   out << indent() << ");" << endl;
 
+  indent_down();
+  out << indent() << "} elseif ($compact_accel) {" << endl;
+  indent_up();
+
+  out << indent() << "thrift_protocol_write_compact(" << endl;
+
+  indent_up();
+  out << indent() << "$output,"<<endl
+      << indent() << "'" << tfunction->get_name()<< "'," <<endl
+      << indent() << "TMessageType::REPLY,"<< endl
+      << indent() << "$result," << endl
+      << indent() << "$seqid"<<endl;
+
+  indent_down();
+  out << indent() << ");" << endl;
+
   indent_down();
   out << indent() << "} else {" << endl;
   indent_up();
@@ -1824,6 +1860,9 @@ void t_php_generator::generate_service_client(t_service* tservice) {
     f_service_client << indent() << "$bin_accel = ($this->output_ instanceof "
                << "TBinaryProtocolAccelerated) && function_exists('thrift_protocol_write_binary');"
                << endl;
+    f_service_client << indent() << "$compact_accel = ($this->output_ instanceof "
+               << "TCompactProtocolAccelerated) && function_exists('thrift_protocol_write_compact');"
+               << endl;
 
     f_service_client << indent() << "if ($bin_accel) {" << endl;
     indent_up();
@@ -1843,6 +1882,22 @@ void t_php_generator::generate_service_client(t_service* tservice) {
     indent_down();
     f_service_client << indent() << ");" << endl;
 
+    indent_down();
+    f_service_client << indent() << "} elseif ($compact_accel) {" << endl;
+    indent_up();
+
+    f_service_client << indent() << "thrift_protocol_write_compact(" << endl;
+
+    indent_up();
+    f_service_client << indent() << "$this->output_," << endl
+               << indent() << "'" << (*f_iter)->get_name() << "'," << endl
+               << indent() << messageType << "," << endl
+               << indent() << "$args," << endl
+               << indent() << "$this->seqid_" << endl;
+
+    indent_down();
+    f_service_client << indent() << ");" << endl;
+
     indent_down();
     f_service_client << indent() << "} else {" << endl;
     indent_up();
@@ -1889,6 +1944,9 @@ void t_php_generator::generate_service_client(t_service* tservice) {
       f_service_client << indent() << "$bin_accel = ($this->input_ instanceof "
                        << "TBinaryProtocolAccelerated)"
                        << " && function_exists('thrift_protocol_read_binary');" << endl;
+      f_service_client << indent() << "$compact_accel = ($this->input_ instanceof "
+                       << "TCompactProtocolAccelerated)"
+                       << " && function_exists('thrift_protocol_read_compact');" << endl;
 
       f_service_client << indent() << "if ($bin_accel) {" << endl;
 
@@ -1903,6 +1961,19 @@ void t_php_generator::generate_service_client(t_service* tservice) {
       indent_down();
       f_service_client << indent() << ");" << endl;
 
+      indent_down();
+      f_service_client << indent() << "} elseif ($compact_accel) {" << endl;
+
+      indent_up();
+      f_service_client << indent() << "$result = thrift_protocol_read_compact(" << endl;
+
+      indent_up();
+      f_service_client << indent() << "$this->input_," << endl
+                       << indent() << "'" << resultname << "'" << endl;
+
+      indent_down();
+      f_service_client << indent() << ");" << endl;
+
       indent_down();
       f_service_client << indent() << "} else {" << endl;
 
@@ -0,0 +1,491 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_TCLIENTPOOL_H_
+#define _THRIFT_ASYNC_TCLIENTPOOL_H_ 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/TTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+/**
+ * Thread safe pool of connected generated clients, e.g.
+ *
+ *   TClientPool<CalculatorClient> pool(hosts, 8);
+ *   pool.checkout()->add(1, 2);
+ *
+ * checkout() hands out a client that the calling thread owns until the
+ * returned Handle goes out of scope, which checks it back in.  Clients stay
+ * connected while checked in, so a call only pays for connecting when every
+ * idle client is in use; taking an idle client is a lock-free pop.
+ *
+ * At most maxConnectionsPerHost clients are connected to each host.  When
+ * every host is at the limit, checkout() waits for a client to be checked
+ * in.  Idle clients are handed out in turn from each host, and a client
+ * whose connection was closed by the server, or has unread data, is
+ * discarded rather than handed out.
+ *
+ * prewarm() connects clients in the background ahead of expected traffic, so
+ * that the first calls do not wait for handshakes.
+ *
+ * A client is discarded rather than checked in if its handle goes out of
+ * scope while an exception is thrown, since its connection may be in the
+ * middle of a call; Handle::discard() does the same explicitly.
+ *
+ * Client must be constructible from a std::shared_ptr<TProtocol>, as
+ * generated clients are.  The pool must outlive its handles.
+ */
+template <class Client>
+class TClientPool {
+public:
+  typedef std::function<std::shared_ptr<transport::TSocket>(const std::string& host, int port)>
+      SocketFactory;
+
+  /**
+   * A client checked out of the pool.
+   */
+  class Handle {
+  public:
+    Handle() : pool_(nullptr), connection_(nullptr), uncaught_(0) {}
+
+    Handle(Handle&& other)
+      : pool_(other.pool_), connection_(other.connection_), uncaught_(other.uncaught_) {
+      other.connection_ = nullptr;
+    }
+
+    Handle& operator=(Handle&& other) {
+      if (this != &other) {
+        reset();
+        pool_ = other.pool_;
+        connection_ = other.connection_;
+        uncaught_ = other.uncaught_;
+        other.connection_ = nullptr;
+      }
+      return *this;
+    }
+
+    Handle(const Handle&) = delete;
+    Handle& operator=(const Handle&) = delete;
+
+    ~Handle() { reset(); }
+
+    Client* operator->() const { return connection_->client.get(); }
+    Client& operator*() const { return *connection_->client; }
+    Client* get() const { return connection_ ? connection_->client.get() : nullptr; }
+
+    explicit operator bool() const { return connection_ != nullptr; }
+
+    /**
+     * @return the socket under the client's transport
+     */
+    std::shared_ptr<transport::TSocket> getSocket() const { return connection_->socket; }
+
+    /**
+     * Closes the connection instead of checking the client back in.
+     */
+    void discard() {
+      if (connection_) {
+        pool_->discard(connection_);
+        connection_ = nullptr;
+      }
+    }
+
+    /**
+     * Checks the client back in, unless an exception thrown since checkout()
+     * is unwinding the stack.
+     */
+    void reset() {
+      if (connection_) {
+        if (uncaughtExceptions() > uncaught_) {
+          pool_->discard(connection_);
+        } else {
+          pool_->checkin(connection_);
+        }
+        connection_ = nullptr;
+      }
+    }
+
+  private:
+    friend class TClientPool;
+
+    Handle(TClientPool* pool, typename TClientPool::Connection* connection)
+      : pool_(pool), connection_(connection), uncaught_(uncaughtExceptions()) {}
+
+    static int uncaughtExceptions() {
+#if __cplusplus >= 201703L
+      return std::uncaught_exceptions();
+#else
+      return std::uncaught_exception() ? 1 : 0;
+#endif
+    }
+
+    TClientPool* pool_;
+    typename TClientPool::Connection* connection_;
+    /// Exceptions already in flight when the client was checked out
+    int uncaught_;
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param hosts                 list of pairs of host name and port
+   * @param maxConnectionsPerHost the most clients connected to one host
+   * @param transportFactory      wraps each socket, e.g. TFramedTransportFactory
+   * @param protocolFactory       makes the protocol of each client
+   */
+  TClientPool(const std::vector<std::pair<std::string, int> >& hosts,
+              size_t maxConnectionsPerHost,
+              std::shared_ptr<transport::TTransportFactory> transportFactory
+              = std::make_shared<transport::TTransportFactory>(),
+              std::shared_ptr<protocol::TProtocolFactory> protocolFactory
+              = std::make_shared<protocol::TBinaryProtocolFactory>())
+    : transportFactory_(transportFactory),
+      protocolFactory_(protocolFactory),
+      maxConnectionsPerHost_(maxConnectionsPerHost),
+      connTimeout_(0),
+      recvTimeout_(0),
+      sendTimeout_(0),
+      checkoutTimeout_(0),
+      fastOpen_(false),
+      next_(0),
+      waiters_(0),
+      generation_(0),
+      stopping_(false) {
+    if (hosts.empty() || maxConnectionsPerHost == 0) {
+      throw transport::TTransportException(transport::TTransportException::BAD_ARGS,
+                                           "TClientPool: no hosts or connections");
+    }
+    for (const auto& host : hosts) {
+      hosts_.emplace_back(new Host(host.first, host.second, maxConnectionsPerHost));
+    }
+  }
+
+  ~TClientPool() {
+    stopping_ = true;
+    if (prewarmer_.joinable()) {
+      prewarmer_.join();
+    }
+    for (auto& host : hosts_) {
+      for (size_t i = 0; i < maxConnectionsPerHost_; ++i) {
+        delete host->idle[i].exchange(nullptr);
+      }
+    }
+  }
+
+  TClientPool(const TClientPool&) = delete;
+  TClientPool& operator=(const TClientPool&) = delete;
+
+  /**
+   * Sets how sockets are created, e.g. with a TSSLSocketFactory.  Not thread
+   * safe, call before the first checkout().
+   */
+  void setSocketFactory(const SocketFactory& factory) { socketFactory_ = factory; }
+
+  /** Sets the connect timeout of new connections, in milliseconds. */
+  void setConnTimeout(int ms) { connTimeout_ = ms; }
+
+  /** Sets the receive timeout of new connections, in milliseconds. */
+  void setRecvTimeout(int ms) { recvTimeout_ = ms; }
+
+  /** Sets the send timeout of new connections, in milliseconds. */
+  void setSendTimeout(int ms) { sendTimeout_ = ms; }
+
+  /**
+   * Sets how long checkout() waits when every host is at the limit, in
+   * milliseconds; 0 waits as long as it takes (default).
+   */
+  void setCheckoutTimeout(int64_t ms) { checkoutTimeout_ = ms; }
+
+  /** Sets whether new connections use TCP Fast Open, see TSocket::setFastOpen(). */
+  void setFastOpen(bool fastOpen) { fastOpen_ = fastOpen; }
+
+  /**
+   * Connects clients to every host in a background thread until each has
+   * connectionsPerHost of them, or the limit, and checks them in.  A host
+   * that cannot be connected to is skipped.  Returns at once; a previous
+   * prewarm() that is still connecting is waited for first.
+   */
+  void prewarm(size_t connectionsPerHost) {
+    if (prewarmer_.joinable()) {
+      prewarmer_.join();
+    }
+    size_t target = std::min(connectionsPerHost, maxConnectionsPerHost_);
+    prewarmer_ = std::thread([this, target] {
+      for (size_t index = 0; index < hosts_.size(); ++index) {
+        Host& host = *hosts_[index];
+        while (!stopping_) {
+          size_t count = host.connections.load();
+          if (count >= target) {
+            break;
+          }
+          if (!host.connections.compare_exchange_weak(count, count + 1)) {
+            continue;
+          }
+          Connection* connection;
+          try {
+            connection = connect(index);
+          } catch (const transport::TTransportException&) {
+            --host.connections;
+            break;
+          }
+          checkin(connection);
+        }
+      }
+    });
+  }
+
+  /**
+   * Hands out a connected client.
+   *
+   * @throws TTransportException NOT_OPEN if no host could be connected to
+   *         and none has clients to wait for, TIMED_OUT if the checkout timeout passed
+   */
+  Handle checkout() {
+    Connection* connection = tryCheckout();
+    if (connection) {
+      return Handle(this, connection);
+    }
+
+    // Every host is at the limit or down; wait for a checkin or a discard.  waiters_
+    // is raised before trying again and wake() looks at it after its push,
+    // so either this thread finds the client, or generation_ changes.
+    ++waiters_;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::chrono::steady_clock::time_point deadline
+        = std::chrono::steady_clock::now() + std::chrono::milliseconds(checkoutTimeout_);
+    try {
+      for (;;) {
+        uint64_t seen;
+        {
+          concurrency::Synchronized s(monitor_);
+          seen = generation_;
+        }
+        connection = tryCheckout();
+        if (connection) {
+          break;
+        }
+        concurrency::Synchronized s(monitor_);
+        while (generation_ == seen) {
+          if (checkoutTimeout_ == 0) {
+            monitor_.waitForever();
+          } else if (monitor_.waitForTime(deadline) == THRIFT_ETIMEDOUT) {
+            throw transport::TTransportException(transport::TTransportException::TIMED_OUT,
+                                                 "TClientPool::checkout: timed out");
+          }
+        }
+      }
+    } catch (...) {
+      --waiters_;
+      throw;
+    }
+    --waiters_;
+    return Handle(this, connection);
+  }
+
+  /**
+   * @return how many clients are connected to host number i, idle or not
+   */
+  size_t getConnectionCount(size_t i) const { return hosts_.at(i)->connections.load(); }
+
+  /**
+   * @return how many clients are idle, over all hosts
+   */
+  size_t getIdleCount() const {
+    size_t count = 0;
+    for (const auto& host : hosts_) {
+      for (size_t i = 0; i < maxConnectionsPerHost_; ++i) {
+        if (host->idle[i].load(std::memory_order_relaxed)) {
+          ++count;
+        }
+      }
+    }
+    return count;
+  }
+
+private:
+  struct Connection {
+    size_t host;
+    std::shared_ptr<transport::TSocket> socket;
+    std::shared_ptr<Client> client;
+  };
+
+  struct Host {
+    Host(const std::string& n, int p, size_t slots)
+      : name(n), port(p), connections(0), idle(new std::atomic<Connection*>[slots]) {
+      for (size_t i = 0; i < slots; ++i) {
+        idle[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    std::string name;
+    int port;
+    /// Clients connected, idle or checked out, at most maxConnectionsPerHost_
+    std::atomic<size_t> connections;
+    /// Idle clients; a slot holds one or is null, so taking one is an exchange
+    std::unique_ptr<std::atomic<Connection*>[]> idle;
+  };
+
+  /// Takes an idle client, or connects a new one if a host is below the limit
+  Connection* tryCheckout() {
+    size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < hosts_.size(); ++i) {
+      size_t index = (start + i) % hosts_.size();
+      while (Connection* connection = pop(*hosts_[index])) {
+        if (connection->socket->isReusable()) {
+          return connection;
+        }
+        discard(connection);
+      }
+    }
+
+    std::exception_ptr lastError;
+    bool anyAtLimit = false;
+    for (size_t i = 0; i < hosts_.size(); ++i) {
+      size_t index = (start + i) % hosts_.size();
+      Host& host = *hosts_[index];
+      size_t count = host.connections.load();
+      do {
+        if (count >= maxConnectionsPerHost_) {
+          break;
+        }
+      } while (!host.connections.compare_exchange_weak(count, count + 1));
+      if (count >= maxConnectionsPerHost_) {
+        anyAtLimit = true;
+        continue;
+      }
+      try {
+        return connect(index);
+      } catch (...) {
+        --host.connections;
+        lastError = std::current_exception();
+      }
+    }
+    // A client of a host at the limit will be checked in, so only fail when
+    // there is none to wait for
+    if (lastError && !anyAtLimit) {
+      std::rethrow_exception(lastError);
+    }
+    return nullptr;
+  }
+
+  Connection* pop(Host& host) {
+    for (size_t i = 0; i < maxConnectionsPerHost_; ++i) {
+      if (host.idle[i].load(std::memory_order_relaxed)) {
+        Connection* connection = host.idle[i].exchange(nullptr, std::memory_order_acquire);
+        if (connection) {
+          return connection;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  Connection* connect(size_t index) {
+    const Host& host = *hosts_[index];
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->host = index;
+    connection->socket = socketFactory_
+                             ? socketFactory_(host.name, host.port)
+                             : std::make_shared<transport::TSocket>(host.name, host.port);
+    connection->socket->setConnTimeout(connTimeout_);
+    connection->socket->setRecvTimeout(recvTimeout_);
+    connection->socket->setSendTimeout(sendTimeout_);
+    if (fastOpen_) {
+      connection->socket->setFastOpen(true);
+    }
+    connection->socket->open();
+    std::shared_ptr<transport::TTransport> transport
+        = transportFactory_->getTransport(connection->socket);
+    connection->client = std::make_shared<Client>(protocolFactory_->getProtocol(transport));
+    return connection.release();
+  }
+
+  void checkin(Connection* connection) {
+    if (!connection->socket->isReusable()) {
+      discard(connection);
+      return;
+    }
+    // A host never has more clients than slots, so there is a free one
+    Host& host = *hosts_[connection->host];
+    for (size_t i = 0;; i = (i + 1) % maxConnectionsPerHost_) {
+      Connection* expected = nullptr;
+      if (host.idle[i].compare_exchange_strong(expected, connection, std::memory_order_release)) {
+        break;
+      }
+    }
+    wake();
+  }
+
+  void discard(Connection* connection) {
+    --hosts_[connection->host]->connections;
+    delete connection;
+    wake();
+  }
+
+  /// Notifies checkout() calls waiting for a client, if there are any
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load() > 0) {
+      concurrency::Synchronized s(monitor_);
+      ++generation_;
+      monitor_.notifyAll();
+    }
+  }
+
+  std::vector<std::unique_ptr<Host> > hosts_;
+  std::shared_ptr<transport::TTransportFactory> transportFactory_;
+  std::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  SocketFactory socketFactory_;
+  size_t maxConnectionsPerHost_;
+  int connTimeout_;
+  int recvTimeout_;
+  int sendTimeout_;
+  int64_t checkoutTimeout_;
+  bool fastOpen_;
+  std::atomic<size_t> next_;
+  std::atomic<int> waiters_;
+  concurrency::Monitor monitor_;
+  /// Changed by wake() under monitor_
+  uint64_t generation_;
+  std::atomic<bool> stopping_;
+  std::thread prewarmer_;
+};
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_TCLIENTPOOL_H_
@@ -0,0 +1,443 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_THEDGEDCLIENT_H_
+#define _THRIFT_ASYNC_THEDGEDCLIENT_H_ 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <thrift/async/TClientPool.h>
+#include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TTransportException.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+namespace detail {
+
+/// The value returned by one attempt of a call
+template <typename R>
+class THedgedResult {
+public:
+  template <typename F, typename Client>
+  void run(F& f, Client& client) {
+    value_.reset(new R(f(client)));
+  }
+  R get() { return std::move(*value_); }
+
+private:
+  std::unique_ptr<R> value_;
+};
+
+template <>
+class THedgedResult<void> {
+public:
+  template <typename F, typename Client>
+  void run(F& f, Client& client) {
+    f(client);
+  }
+  void get() {}
+};
+}
+
+/**
+ * Calls a TClientPool of generated clients, sending a backup ("hedged")
+ * request to the pool when the first one is slow, and retrying calls that
+ * fail, for the methods that are declared idempotent, e.g.
+ *
+ *   THedgedClient<CalculatorClient> hedged(pool, threadManager);
+ *   hedged.addIdempotentMethod("add");
+ *   int32_t sum = hedged.call("add", [](CalculatorClient& c) { return c.add(1, 2); });
+ *
+ * An idempotent call is made on a client checked out of the pool, by a
+ * thread of the ThreadManager.  When no response came within the hedge
+ * delay, the same call is made on another client, usually connected to
+ * another host; the first response is returned and the other call is
+ * cancelled by shutting its connection down.  When a call fails before any
+ * response, i.e. with a TTransportException, it is made again at once.
+ * Either way there are at most maxAttempts calls.  Any other exception,
+ * such as one declared in the IDL or a TApplicationException, is the
+ * server's response and is thrown by call() as it is.  The hedge delay is
+ * a percentile of the latency of the recent calls of the method, hedges
+ * included, so that only the slowest calls are hedged.
+ *
+ * Any other method is called once, on the calling thread.
+ *
+ * Attempts run concurrently, so f must not write to shared variables; it
+ * should return what the call returns, e.g. a string filled in by a
+ * generated method.  The ThreadManager needs enough workers for every
+ * attempt in flight.
+ */
+template <class Client>
+class THedgedClient {
+public:
+  struct Stats {
+    Stats() : calls(0), hedges(0), hedgeWins(0), retries(0) {}
+
+    /// Calls of idempotent methods
+    uint64_t calls;
+    /// Backup calls made because the first call was slow
+    uint64_t hedges;
+    /// Calls that a backup call answered first
+    uint64_t hedgeWins;
+    /// Calls made again because an attempt failed
+    uint64_t retries;
+  };
+
+  THedgedClient(std::shared_ptr<TClientPool<Client> > pool,
+                std::shared_ptr<concurrency::ThreadManager> threadManager)
+    : pool_(pool),
+      threadManager_(threadManager),
+      latencies_(std::make_shared<Latencies>()),
+      maxAttempts_(2),
+      defaultHedgeDelay_(0),
+      minHedgeDelay_(std::chrono::milliseconds(1)) {}
+
+  /**
+   * Declares that a method may be called more than once for one call, e.g.
+   * because it only reads.
+   *
+   * @param name the method name, as passed to call()
+   */
+  void addIdempotentMethod(const std::string& name) {
+    concurrency::Guard g(mutex_);
+    idempotentMethods_.insert(name);
+  }
+
+  /**
+   * Get whether a method is hedged and retried, see addIdempotentMethod().
+   */
+  bool isIdempotentMethod(const std::string& name) const {
+    concurrency::Guard g(mutex_);
+    return idempotentMethods_.find(name) != idempotentMethods_.end();
+  }
+
+  /** Sets the most calls made for one call of an idempotent method (default 2). */
+  void setMaxAttempts(int attempts) { maxAttempts_ = std::max(1, attempts); }
+
+  /** Sets the percentile of the latency to hedge after, 0 to 100 (default 95). */
+  void setHedgePercentile(double percentile) {
+    latencies_->setPercentile(std::min(100.0, std::max(0.0, percentile)));
+  }
+
+  /**
+   * Sets the hedge delay of a method whose latency is not known yet, in
+   * milliseconds; 0 does not hedge such calls (default).
+   */
+  void setDefaultHedgeDelay(int ms) { defaultHedgeDelay_ = std::chrono::milliseconds(ms); }
+
+  /** Sets the shortest hedge delay, in milliseconds (default 1). */
+  void setMinHedgeDelay(int ms) { minHedgeDelay_ = std::chrono::milliseconds(ms); }
+
+  /**
+   * Calls a method.
+   *
+   * @param method the method name, to look up whether it is idempotent
+   * @param f      makes the call on the client it is given
+   * @return what f returns
+   * @throws what the first attempt to get a response threw, or what the
+   *         last attempt threw if none got a response
+   */
+  template <typename F>
+  auto call(const std::string& method, F f) -> decltype(f(std::declval<Client&>())) {
+    typedef decltype(f(std::declval<Client&>())) R;
+    if (!isIdempotentMethod(method)) {
+      typename TClientPool<Client>::Handle client = pool_->checkout();
+      detail::THedgedResult<R> result;
+      result.run(f, *client);
+      return result.get();
+    }
+
+    std::shared_ptr<Race<R, F> > race = std::make_shared<Race<R, F> >(f);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::microseconds delay = hedgeDelay(method);
+    concurrency::Synchronized s(race->monitor);
+    launch(race);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + delay;
+    bool hedged = false;
+    while (race->winner < 0) {
+      if (race->pending == 0) {
+        if (static_cast<int>(race->attempts.size()) >= maxAttempts_) {
+          std::rethrow_exception(race->error);
+        }
+        ++stats_.retries;
+        launch(race);
+      } else if (static_cast<int>(race->attempts.size()) < maxAttempts_ && delay.count() > 0) {
+        if (race->monitor.waitForTime(deadline) == THRIFT_ETIMEDOUT && race->winner < 0) {
+          ++stats_.hedges;
+          hedged = true;
+          launch(race);
+          deadline = std::chrono::steady_clock::now() + delay;
+        }
+      } else {
+        race->monitor.waitForever();
+      }
+    }
+    ++stats_.calls;
+    if (hedged && race->winner > 0) {
+      ++stats_.hedgeWins;
+    }
+    // What the caller waited, so that slow attempts that lost count too
+    latencies_->record(method, std::chrono::steady_clock::now() - start);
+
+    // The others would only take up a connection and a thread
+    for (size_t i = 0; i < race->attempts.size(); ++i) {
+      if (static_cast<int>(i) != race->winner) {
+        race->attempts[i]->cancel();
+      }
+    }
+    if (race->thrown) {
+      std::rethrow_exception(race->thrown);
+    }
+    return race->result.get();
+  }
+
+  /**
+   * @return counts of the calls of idempotent methods so far
+   */
+  Stats getStats() const {
+    Stats stats;
+    stats.calls = stats_.calls;
+    stats.hedges = stats_.hedges;
+    stats.hedgeWins = stats_.hedgeWins;
+    stats.retries = stats_.retries;
+    return stats;
+  }
+
+private:
+  /// One call made for a call(), which can be cancelled from another thread
+  class Attempt {
+  public:
+    Attempt() : finished_(false), cancelled_(false) {}
+
+    /// Sets the socket to shut down on cancel(), false if already cancelled
+    bool start(const std::shared_ptr<transport::TSocket>& socket) {
+      concurrency::Guard g(mutex_);
+      socket_ = socket;
+      return !cancelled_;
+    }
+
+    /// Must be called before the connection is checked in or closed
+    void finish() {
+      concurrency::Guard g(mutex_);
+      finished_ = true;
+    }
+
+    void cancel() {
+      concurrency::Guard g(mutex_);
+      cancelled_ = true;
+      if (socket_ && !finished_) {
+        // The call in progress fails, and its connection is discarded
+        ::shutdown(socket_->getSocketFD(), THRIFT_SHUT_RDWR);
+      }
+    }
+
+  private:
+    concurrency::Mutex mutex_;
+    std::shared_ptr<transport::TSocket> socket_;
+    bool finished_;
+    bool cancelled_;
+  };
+
+  /// Finishes an attempt when it goes out of scope
+  class AttemptSentry {
+  public:
+    explicit AttemptSentry(Attempt& attempt) : attempt_(attempt) {}
+    ~AttemptSentry() { attempt_.finish(); }
+
+  private:
+    Attempt& attempt_;
+  };
+
+  /// The attempts of one call(), shared with the threads that make them
+  template <typename R, typename F>
+  struct Race {
+    explicit Race(const F& fn) : f(fn), pending(0), winner(-1) {}
+
+    F f;
+    concurrency::Monitor monitor;
+    std::vector<std::shared_ptr<Attempt> > attempts;
+    /// Attempts that have not finished
+    int pending;
+    /// Index of the attempt that got a response first, -1 until one has
+    int winner;
+    detail::THedgedResult<R> result;
+    /// The exception the server answered the winner with, if any
+    std::exception_ptr thrown;
+    /// The last transport error of an attempt
+    std::exception_ptr error;
+  };
+
+  /// Starts an attempt of race, race->monitor must be held
+  template <typename R, typename F>
+  void launch(std::shared_ptr<Race<R, F> > race) {
+    std::shared_ptr<Attempt> attempt = std::make_shared<Attempt>();
+    int index = static_cast<int>(race->attempts.size());
+    race->attempts.push_back(attempt);
+    ++race->pending;
+    std::shared_ptr<TClientPool<Client> > pool = pool_;
+    threadManager_->add(concurrency::FunctionRunner::create([=] {
+      try {
+        typename TClientPool<Client>::Handle client = pool->checkout();
+        // Declared after the handle, so the attempt finishes before the
+        // connection is checked in or discarded
+        AttemptSentry sentry(*attempt);
+        if (!attempt->start(client.getSocket())) {
+          concurrency::Synchronized s(race->monitor);
+          --race->pending;
+          return;
+        }
+        detail::THedgedResult<R> result;
+        F f = race->f;
+        result.run(f, *client);
+
+        concurrency::Synchronized s(race->monitor);
+        --race->pending;
+        if (race->winner < 0) {
+          race->winner = index;
+          race->result = std::move(result);
+        }
+        race->monitor.notifyAll();
+      } catch (const transport::TTransportException&) {
+        // No response; worth another attempt
+        concurrency::Synchronized s(race->monitor);
+        --race->pending;
+        race->error = std::current_exception();
+        race->monitor.notifyAll();
+      } catch (...) {
+        // A response, if not the one hoped for
+        concurrency::Synchronized s(race->monitor);
+        --race->pending;
+        if (race->winner < 0) {
+          race->winner = index;
+          race->thrown = std::current_exception();
+        }
+        race->monitor.notifyAll();
+      }
+    }));
+  }
+
+  /// The latencies of the last calls of each method, shared with the attempts
+  class Latencies {
+  public:
+    Latencies() : percentile_(95), windowSize_(256) {}
+
+    void setPercentile(double percentile) {
+      concurrency::Guard g(mutex_);
+      percentile_ = percentile;
+    }
+
+    /// Adds a latency sample of method
+    void record(const std::string& method, std::chrono::steady_clock::duration latency) {
+      concurrency::Guard g(mutex_);
+      Window& window = windows_[method];
+      int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+      if (window.samplesUs.size() < windowSize_) {
+        window.samplesUs.push_back(us);
+      } else {
+        window.samplesUs[window.next] = us;
+        window.next = (window.next + 1) % windowSize_;
+      }
+
+      // Sorting a copy of the window on every call would cost more than it saves
+      if (++window.sinceUpdate >= 16 && window.samplesUs.size() >= 32) {
+        window.sinceUpdate = 0;
+        std::vector<int64_t> sorted(window.samplesUs);
+        size_t rank = static_cast<size_t>(percentile_ / 100 * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        window.percentileUs = sorted[rank];
+        window.known = true;
+      }
+    }
+
+    /// Gets the latency percentile of method, false if not known yet
+    bool get(const std::string& method, std::chrono::microseconds& latency) const {
+      concurrency::Guard g(mutex_);
+      typename std::map<std::string, Window>::const_iterator it = windows_.find(method);
+      if (it == windows_.end() || !it->second.known) {
+        return false;
+      }
+      latency = std::chrono::microseconds(it->second.percentileUs);
+      return true;
+    }
+
+  private:
+    struct Window {
+      Window() : next(0), sinceUpdate(0), percentileUs(0), known(false) {}
+
+      std::vector<int64_t> samplesUs;
+      size_t next;
+      size_t sinceUpdate;
+      int64_t percentileUs;
+      bool known;
+    };
+
+    mutable concurrency::Mutex mutex_;
+    std::map<std::string, Window> windows_;
+    double percentile_;
+    size_t windowSize_;
+  };
+
+  /// How long to wait before hedging a call of method, 0 not to hedge
+  std::chrono::microseconds hedgeDelay(const std::string& method) const {
+    std::chrono::microseconds latency;
+    if (!latencies_->get(method, latency)) {
+      return defaultHedgeDelay_;
+    }
+    return std::max<std::chrono::microseconds>(minHedgeDelay_, latency);
+  }
+
+  struct AtomicStats {
+    AtomicStats() : calls(0), hedges(0), hedgeWins(0), retries(0) {}
+
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> hedges;
+    std::atomic<uint64_t> hedgeWins;
+    std::atomic<uint64_t> retries;
+  };
+
+  std::shared_ptr<TClientPool<Client> > pool_;
+  std::shared_ptr<concurrency::ThreadManager> threadManager_;
+  mutable concurrency::Mutex mutex_;
+  std::set<std::string> idempotentMethods_;
+  std::shared_ptr<Latencies> latencies_;
+  int maxAttempts_;
+  std::chrono::microseconds defaultHedgeDelay_;
+  std::chrono::microseconds minHedgeDelay_;
+  AtomicStats stats_;
+};
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_THEDGEDCLIENT_H_
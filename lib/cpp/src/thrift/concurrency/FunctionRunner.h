@@ -21,6 +21,7 @@
 #define _THRIFT_CONCURRENCY_FUNCTION_RUNNER_H 1
 
 #include <thrift/concurrency/Thread.h>
+#include <functional>
 #include <memory>
 
 namespace apache {
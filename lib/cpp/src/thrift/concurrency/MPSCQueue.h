@@ -0,0 +1,106 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_CONCURRENCY_MPSCQUEUE_H_
+#define _THRIFT_CONCURRENCY_MPSCQUEUE_H_ 1
+
+#include <atomic>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+/**
+ * Unbounded multi-producer, single-consumer FIFO queue.
+ *
+ * push() may be called from any number of threads and never blocks: it is a
+ * single atomic exchange.  pop() and empty() may only be called from one
+ * consumer thread at a time.  An element whose push() has not returned yet
+ * may not be visible to the consumer; a producer that needs to wake the
+ * consumer must do so after push() returns.
+ *
+ * This is Dmitry Vyukov's node-based MPSC queue.  T must be default
+ * constructible.
+ */
+template <typename T>
+class MPSCQueue {
+public:
+  MPSCQueue() : head_(new Node()), tail_(head_.load(std::memory_order_relaxed)) {}
+
+  ~MPSCQueue() {
+    T value;
+    while (pop(value)) {
+    }
+    delete tail_;
+  }
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  /**
+   * Appends value to the queue.  Thread safe.
+   */
+  void push(T value) {
+    Node* node = new Node(std::move(value));
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  /**
+   * Removes the oldest element, consumer thread only.
+   *
+   * @return false if there was nothing to remove
+   */
+  bool pop(T& value) {
+    Node* next = tail_->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    value = std::move(next->value);
+    delete tail_;
+    tail_ = next;
+    return true;
+  }
+
+  /**
+   * @return true if pop() would find nothing, consumer thread only
+   */
+  bool empty() const { return tail_->next.load(std::memory_order_acquire) == nullptr; }
+
+private:
+  struct Node {
+    Node() : next(nullptr), value() {}
+    explicit Node(T v) : next(nullptr), value(std::move(v)) {}
+
+    std::atomic<Node*> next;
+    T value;
+  };
+
+  /// Most recently pushed node, where producers append
+  std::atomic<Node*> head_;
+
+  /// Node before the oldest element, owned by the consumer
+  Node* tail_;
+};
+}
+}
+} // apache::thrift::concurrency
+
+#endif // #ifndef _THRIFT_CONCURRENCY_MPSCQUEUE_H_
@@ -24,6 +24,9 @@ namespace thrift {
 namespace concurrency {
 
 void Thread::threadMain(std::shared_ptr<Thread> thread) {
+  if (thread->prologue_) {
+    thread->prologue_();
+  }
   thread->setState(started);
   thread->runnable()->run();
 
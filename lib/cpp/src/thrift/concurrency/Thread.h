@@ -20,6 +20,7 @@
 #ifndef _THRIFT_CONCURRENCY_THREAD_H_
 #define _THRIFT_CONCURRENCY_THREAD_H_ 1
 
+#include <functional>
 #include <memory>
 #include <thread>
 
@@ -158,8 +159,15 @@ public:
    */
   std::shared_ptr<Runnable> runnable() const { return _runnable; }
 
+  /**
+   * Sets a function that the new thread calls before it runs the runnable,
+   * e.g. to configure its CPU affinity.  Must be called before start().
+   */
+  void setPrologue(const std::function<void()>& prologue) { prologue_ = prologue; }
+
 private:
   std::shared_ptr<Runnable> _runnable;
+  std::function<void()> prologue_;
   std::unique_ptr<std::thread> thread_;
   Monitor monitor_;
   STATE state_;
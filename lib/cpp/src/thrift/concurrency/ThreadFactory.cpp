@@ -20,21 +20,200 @@
 #include <thrift/thrift-config.h>
 
 #include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/Exception.h>
+#include <thrift/Thrift.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <memory>
+#include <sstream>
+
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// From <linux/mempolicy.h>, which not every libc ships
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
 
 namespace apache {
 namespace thrift {
 namespace concurrency {
 
+ThreadFactory::ThreadFactory(const ThreadFactory& other)
+  : detached_(other.detached_),
+    cpus_(other.cpus_),
+    pinEachThread_(other.pinEachThread_),
+    localMemory_(other.localMemory_),
+    schedulingPolicy_(other.schedulingPolicy_),
+    schedulingPriority_(other.schedulingPriority_),
+    nextCpu_(other.nextCpu_.load()) {
+}
+
+ThreadFactory& ThreadFactory::operator=(const ThreadFactory& other) {
+  detached_ = other.detached_;
+  cpus_ = other.cpus_;
+  pinEachThread_ = other.pinEachThread_;
+  localMemory_ = other.localMemory_;
+  schedulingPolicy_ = other.schedulingPolicy_;
+  schedulingPriority_ = other.schedulingPriority_;
+  nextCpu_ = other.nextCpu_.load();
+  return *this;
+}
+
 std::shared_ptr<Thread> ThreadFactory::newThread(std::shared_ptr<Runnable> runnable) const {
   std::shared_ptr<Thread> result = std::make_shared<Thread>(isDetached(), runnable);
+  if (hasThreadSettings()) {
+    std::shared_ptr<const ThreadFactory> settings = std::make_shared<ThreadFactory>(*this);
+    std::vector<int> cpus = nextCpus();
+    result->setPrologue([settings, cpus]() { settings->configureThread(cpus); });
+  }
   runnable->thread(result);
   return result;
 }
 
+void ThreadFactory::configureCurrentThread() const {
+  if (hasThreadSettings()) {
+    configureThread(nextCpus());
+  }
+}
+
 Thread::id_t ThreadFactory::getCurrentThreadId() const {
   return std::this_thread::get_id();
 }
+
+bool ThreadFactory::hasThreadSettings() const {
+  return !cpus_.empty() || localMemory_ || schedulingPolicy_ >= 0;
+}
+
+std::vector<int> ThreadFactory::nextCpus() const {
+  if (!pinEachThread_ || cpus_.empty()) {
+    return cpus_;
+  }
+  return std::vector<int>(1, cpus_[nextCpu_++ % cpus_.size()]);
+}
+
+void ThreadFactory::configureThread(const std::vector<int>& cpus) const {
+#ifdef __linux__
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+      GlobalOutput.perror("ThreadFactory: pthread_setaffinity_np() ", ret);
+    }
+  }
+#ifdef SYS_set_mempolicy
+  if (localMemory_ && 0 != syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0)) {
+    GlobalOutput.perror("ThreadFactory: set_mempolicy() ", errno);
+  }
+#endif
+#else
+  THRIFT_UNUSED_VARIABLE(cpus);
+#endif
+
+#ifdef HAVE_SCHED_H
+  if (schedulingPolicy_ >= 0) {
+    struct sched_param sp;
+    std::memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = schedulingPriority_;
+    int ret = pthread_setschedparam(pthread_self(), schedulingPolicy_, &sp);
+    if (ret != 0) {
+      GlobalOutput.perror("ThreadFactory: pthread_setschedparam() ", ret);
+    }
+  }
+#endif
+}
+
+std::vector<int> ThreadFactory::getAvailableCpus() {
+  std::vector<int> result;
+#ifdef __linux__
+  cpu_set_t set;
+  if (0 == sched_getaffinity(0, sizeof(set), &set)) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        result.push_back(cpu);
+      }
+    }
+    return result;
+  }
+#endif
+  for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) {
+    result.push_back(static_cast<int>(cpu));
+  }
+  return result;
+}
+
+std::vector<int> ThreadFactory::getNumaNodeCpus(int node) {
+  std::vector<int> result;
+#ifdef __linux__
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  std::ifstream in(path.str().c_str());
+  std::string list;
+  if (node >= 0 && std::getline(in, list)) {
+    // A list of ranges such as "0-3,8-11"
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+      int first = 0;
+      int last = 0;
+      char dash = 0;
+      std::istringstream parse(range);
+      if (!(parse >> first)) {
+        continue;
+      }
+      if (!(parse >> dash >> last) || dash != '-') {
+        last = first;
+      }
+      for (int cpu = first; cpu <= last; ++cpu) {
+        result.push_back(cpu);
+      }
+    }
+    return result;
+  }
+#endif
+  throw InvalidArgumentException();
+}
+
+int ThreadFactory::getNumaNodeOfCpu(int cpu) {
+#ifdef __linux__
+  std::ostringstream path;
+  path << "/sys/devices/system/cpu/cpu" << cpu;
+  DIR* dir = ::opendir(path.str().c_str());
+  if (dir == nullptr) {
+    return -1;
+  }
+  int node = -1;
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0'
+        && entry->d_name[4] <= '9') {
+      node = std::atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  ::closedir(dir);
+  return node;
+#else
+  THRIFT_UNUSED_VARIABLE(cpu);
+  return -1;
+#endif
+}
 }
 }
 } // apache::thrift::concurrency
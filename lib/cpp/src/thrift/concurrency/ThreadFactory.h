@@ -22,7 +22,10 @@
 
 #include <thrift/concurrency/Thread.h>
 
+#include <atomic>
 #include <memory>
+#include <vector>
+
 namespace apache {
 namespace thrift {
 namespace concurrency {
@@ -41,7 +44,17 @@ public:
    *
    * By default threads are not joinable.
    */
-  ThreadFactory(bool detached = true) : detached_(detached) { }
+  ThreadFactory(bool detached = true)
+    : detached_(detached),
+      pinEachThread_(false),
+      localMemory_(false),
+      schedulingPolicy_(-1),
+      schedulingPriority_(0),
+      nextCpu_(0) {}
+
+  ThreadFactory(const ThreadFactory& other);
+
+  ThreadFactory& operator=(const ThreadFactory& other);
 
   ~ThreadFactory() = default;
 
@@ -55,18 +68,107 @@ public:
    */
   void setDetached(bool detached) { detached_ = detached; }
 
+  /**
+   * Restricts new threads to the given CPUs.  Each thread may run on all of
+   * them unless setPinEachThread() is set.  An empty set (the default) leaves
+   * the affinity alone.  Only applied on Linux.
+   */
+  void setCpuSet(const std::vector<int>& cpus) { cpus_ = cpus; }
+
+  /**
+   * Gets the CPUs new threads are restricted to.
+   */
+  const std::vector<int>& getCpuSet() const { return cpus_; }
+
+  /**
+   * Restricts new threads to the CPUs of a NUMA node, see setCpuSet().
+   *
+   * @throws InvalidArgumentException if the node is not known
+   */
+  void setNumaNode(int node) { setCpuSet(getNumaNodeCpus(node)); }
+
+  /**
+   * Sets whether each new thread is pinned to a single CPU of the CPU set,
+   * taking the CPUs in turn, rather than allowed on all of them.
+   */
+  void setPinEachThread(bool pinEachThread) { pinEachThread_ = pinEachThread; }
+
+  bool getPinEachThread() const { return pinEachThread_; }
+
+  /**
+   * Sets whether new threads allocate memory on the NUMA node they are
+   * running on, whatever the memory policy of the process is.  Together with
+   * a CPU set within one node this keeps the buffers a thread allocates on
+   * that node.  Only applied on Linux.
+   */
+  void setLocalMemory(bool localMemory) { localMemory_ = localMemory; }
+
+  bool getLocalMemory() const { return localMemory_; }
+
+  /**
+   * Sets the scheduling policy (e.g. SCHED_FIFO) and priority of new threads.
+   * A negative policy (the default) leaves them alone.  Only applied where
+   * POSIX thread scheduling is available.
+   */
+  void setSchedulingPolicy(int policy, int priority = 0) {
+    schedulingPolicy_ = policy;
+    schedulingPriority_ = priority;
+  }
+
+  int getSchedulingPolicy() const { return schedulingPolicy_; }
+
   /**
    * Create a new thread.
    */
   std::shared_ptr<Thread> newThread(std::shared_ptr<Runnable> runnable) const;
 
+  /**
+   * Applies the CPU, memory and scheduling settings to the calling thread, as
+   * if it had been created by this factory.  Settings that fail to apply are
+   * logged and skipped.
+   */
+  void configureCurrentThread() const;
+
   /**
    * Gets the current thread id or unknown_thread_id if the current thread is not a thrift thread
    */
   Thread::id_t getCurrentThreadId() const;
 
+  /**
+   * Gets the CPUs the process may run on, in ascending order; empty if not
+   * known.
+   */
+  static std::vector<int> getAvailableCpus();
+
+  /**
+   * Gets the CPUs of a NUMA node, in ascending order.
+   *
+   * @throws InvalidArgumentException if the node is not known
+   */
+  static std::vector<int> getNumaNodeCpus(int node);
+
+  /**
+   * Gets the NUMA node of a CPU, or -1 if not known.
+   */
+  static int getNumaNodeOfCpu(int cpu);
+
 private:
+  // Whether there is anything for configureThread() to do
+  bool hasThreadSettings() const;
+
+  // Applies the settings to the calling thread, with the given CPUs
+  void configureThread(const std::vector<int>& cpus) const;
+
+  // Returns the CPUs for the next thread
+  std::vector<int> nextCpus() const;
+
   bool detached_;
+  std::vector<int> cpus_;
+  bool pinEachThread_;
+  bool localMemory_;
+  int schedulingPolicy_;
+  int schedulingPriority_;
+  mutable std::atomic<unsigned> nextCpu_;
 };
 
 }
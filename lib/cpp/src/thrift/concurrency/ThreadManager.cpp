@@ -23,6 +23,7 @@
 #include <thrift/concurrency/Exception.h>
 #include <thrift/concurrency/Monitor.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <stdexcept>
@@ -59,6 +60,11 @@ public:
       idleCount_(0),
       pendingTaskCountMax_(0),
       expiredCount_(0),
+      schedulingPolicy_(ThreadManager::FIFO),
+      queueDelayTarget_(std::chrono::milliseconds(5)),
+      queueDelayInterval_(std::chrono::milliseconds(100)),
+      minQueueDelay_(std::chrono::steady_clock::duration::max()),
+      queueOverloaded_(false),
       state_(ThreadManager::UNINITIALIZED),
       monitor_(&mutex_),
       maxMonitor_(&mutex_),
@@ -132,7 +138,28 @@ public:
 
   void setExpireCallback(ExpireCallback expireCallback) override;
 
+  void setSchedulingPolicy(SchedulingPolicy policy) override;
+
+  SchedulingPolicy getSchedulingPolicy() const override {
+    Guard g(mutex_);
+    return schedulingPolicy_;
+  }
+
+  void setQueueDelayTarget(int64_t targetMs, int64_t intervalMs) override;
+
+  bool isQueueOverloaded() const override {
+    Guard g(mutex_);
+    return queueOverloaded_;
+  }
+
 private:
+  /**
+   * Dequeues the task to run next according to the scheduling policy and
+   * marks it EXECUTING, or TIMEDOUT if it is to be dropped instead.  The
+   * caller must hold mutex_ and make sure tasks_ is not empty.
+   */
+  shared_ptr<ThreadManager::Task> nextTask();
+
   /**
    * Remove one or more expired tasks.
    * \param[in]  justOne  if true, try to remove just one task and return
@@ -157,6 +184,14 @@ private:
   size_t pendingTaskCountMax_;
   size_t expiredCount_;
   ExpireCallback expireCallback_;
+  SchedulingPolicy schedulingPolicy_;
+
+  // Queue delay tracking for CODEL and ADAPTIVE_LIFO
+  std::chrono::steady_clock::duration queueDelayTarget_;
+  std::chrono::steady_clock::duration queueDelayInterval_;
+  std::chrono::steady_clock::duration minQueueDelay_;
+  std::chrono::steady_clock::time_point queueIntervalEnd_;
+  bool queueOverloaded_;
 
   ThreadManager::STATE state_;
   shared_ptr<ThreadFactory> threadFactory_;
@@ -182,7 +217,8 @@ public:
 
   Task(shared_ptr<Runnable> runnable, uint64_t expiration = 0ULL)
     : runnable_(runnable),
-      state_(WAITING) {
+      state_(WAITING),
+      enqueueTime_(std::chrono::steady_clock::now()) {
         if (expiration != 0ULL) {
           expireTime_.reset(new std::chrono::steady_clock::time_point(std::chrono::steady_clock::now() + std::chrono::milliseconds(expiration)));
         }
@@ -201,11 +237,27 @@ public:
 
   const unique_ptr<std::chrono::steady_clock::time_point> & getExpireTime() const { return expireTime_; }
 
+  /**
+   * How long the task has been waiting to run.
+   */
+  std::chrono::steady_clock::duration getSojournTime(std::chrono::steady_clock::time_point now) const {
+    return now - enqueueTime_;
+  }
+
+  /**
+   * Deadline order: tasks with an expiration time come first, earliest first.
+   */
+  static bool expiresBefore(const shared_ptr<Task>& a, const shared_ptr<Task>& b) {
+    return a->expireTime_ && (!b->expireTime_ || *a->expireTime_ < *b->expireTime_);
+  }
+
 private:
   shared_ptr<Runnable> runnable_;
   friend class ThreadManager::Worker;
+  friend class ThreadManager::Impl;
   STATE state_;
   unique_ptr<std::chrono::steady_clock::time_point> expireTime_;
+  std::chrono::steady_clock::time_point enqueueTime_;
 };
 
 class ThreadManager::Worker : public Runnable {
@@ -277,16 +329,7 @@ public:
 
       if (active) {
         if (!manager_->tasks_.empty()) {
-          task = manager_->tasks_.front();
-          manager_->tasks_.pop_front();
-          if (task->state_ == ThreadManager::Task::WAITING) {
-            // If the state is changed to anything other than EXECUTING or TIMEDOUT here
-            // then the execution loop needs to be changed below.
-            task->state_ =
-                (task->getExpireTime() && *(task->getExpireTime()) < std::chrono::steady_clock::now()) ?
-                    ThreadManager::Task::TIMEDOUT :
-                    ThreadManager::Task::EXECUTING;
-          }
+          task = manager_->nextTask();
         }
 
         /* If we have a pending task max and we just dropped below it, wakeup any
@@ -317,9 +360,11 @@ public:
           // Re-acquire the lock to proceed in the thread manager
           manager_->mutex_.lock();
 
-        } else if (manager_->expireCallback_) {
-          // The only other state the task could have been in is TIMEDOUT (see above)
-          manager_->expireCallback_(task->getRunnable());
+        } else {
+          // The only other state the task could have been in is TIMEDOUT (see nextTask())
+          if (manager_->expireCallback_) {
+            manager_->expireCallback_(task->getRunnable());
+          }
           manager_->expiredCount_++;
         }
       }
@@ -477,7 +522,13 @@ void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64
     }
   }
 
-  tasks_.push_back(std::make_shared<ThreadManager::Task>(value, expiration));
+  shared_ptr<ThreadManager::Task> task = std::make_shared<ThreadManager::Task>(value, expiration);
+  if (schedulingPolicy_ == ThreadManager::EDF && task->getExpireTime()) {
+    // Keep the queue sorted by deadline, after tasks with the same deadline
+    tasks_.insert(std::upper_bound(tasks_.begin(), tasks_.end(), task, &Task::expiresBefore), task);
+  } else {
+    tasks_.push_back(task);
+  }
 
   // If idle thread is available notify it, otherwise all worker threads are
   // running and will get around to this task in time.
@@ -553,6 +604,68 @@ void ThreadManager::Impl::setExpireCallback(ExpireCallback expireCallback) {
   expireCallback_ = expireCallback;
 }
 
+void ThreadManager::Impl::setSchedulingPolicy(SchedulingPolicy policy) {
+  Guard g(mutex_);
+  if (policy == ThreadManager::EDF && schedulingPolicy_ != ThreadManager::EDF) {
+    std::stable_sort(tasks_.begin(), tasks_.end(), &Task::expiresBefore);
+  }
+  schedulingPolicy_ = policy;
+  minQueueDelay_ = std::chrono::steady_clock::duration::max();
+  queueIntervalEnd_ = std::chrono::steady_clock::now() + queueDelayInterval_;
+  queueOverloaded_ = false;
+}
+
+void ThreadManager::Impl::setQueueDelayTarget(int64_t targetMs, int64_t intervalMs) {
+  if (targetMs <= 0 || intervalMs <= 0) {
+    throw InvalidArgumentException();
+  }
+  Guard g(mutex_);
+  queueDelayTarget_ = std::chrono::milliseconds(targetMs);
+  queueDelayInterval_ = std::chrono::milliseconds(intervalMs);
+}
+
+shared_ptr<ThreadManager::Task> ThreadManager::Impl::nextTask() {
+  const auto now = std::chrono::steady_clock::now();
+  const bool codel = schedulingPolicy_ == ThreadManager::CODEL
+                     || schedulingPolicy_ == ThreadManager::ADAPTIVE_LIFO;
+
+  if (codel) {
+    // The queue is overloaded if even the oldest task, which has waited the
+    // longest, waited more than the target at every dequeue in an interval
+    minQueueDelay_ = (std::min)(minQueueDelay_, tasks_.front()->getSojournTime(now));
+    if (now >= queueIntervalEnd_) {
+      queueOverloaded_ = minQueueDelay_ > queueDelayTarget_;
+      minQueueDelay_ = std::chrono::steady_clock::duration::max();
+      queueIntervalEnd_ = now + queueDelayInterval_;
+    }
+  }
+
+  shared_ptr<ThreadManager::Task> task;
+  if (schedulingPolicy_ == ThreadManager::ADAPTIVE_LIFO && queueOverloaded_) {
+    task = tasks_.back();
+    tasks_.pop_back();
+  } else {
+    task = tasks_.front();
+    tasks_.pop_front();
+  }
+
+  if (codel && tasks_.empty()) {
+    // A queue that drains is not a standing queue
+    minQueueDelay_ = std::chrono::steady_clock::duration::zero();
+  }
+
+  if (task->state_ == ThreadManager::Task::WAITING) {
+    // If the state is changed to anything other than EXECUTING or TIMEDOUT here
+    // then the execution loop in Worker::run needs to be changed.
+    bool expired = task->getExpireTime() && *(task->getExpireTime()) < now;
+    bool shed = schedulingPolicy_ == ThreadManager::CODEL && queueOverloaded_
+                && task->getSojournTime(now) > 2 * queueDelayTarget_;
+    task->state_ = (expired || shed) ? ThreadManager::Task::TIMEDOUT
+                                     : ThreadManager::Task::EXECUTING;
+  }
+  return task;
+}
+
 class SimpleThreadManager : public ThreadManager::Impl {
 
 public:
@@ -60,6 +60,40 @@ protected:
 public:
   typedef std::function<void(std::shared_ptr<Runnable>)> ExpireCallback;
 
+  /**
+   * Order in which pending tasks are handed to worker threads
+   */
+  enum SchedulingPolicy {
+    /**
+     * In the order they were added
+     */
+    FIFO,
+
+    /**
+     * Earliest deadline first: by expiration time (see add()), so that under
+     * overload tasks that are about to expire run first and tasks that
+     * already have are dropped rather than run.  Tasks without an expiration
+     * run after all tasks that have one, in the order they were added.
+     */
+    EDF,
+
+    /**
+     * In the order they were added, but while the queue is overloaded (see
+     * setQueueDelayTarget()) tasks that have waited more than twice the
+     * target delay are dropped rather than run, as with CoDel.  Dropped tasks
+     * are reported to the expire callback and counted as expired.
+     */
+    CODEL,
+
+    /**
+     * In the order they were added, but most recently added first while the
+     * queue is overloaded (see setQueueDelayTarget()), so that the tasks that
+     * are run are the ones whose clients are most likely still waiting.
+     * Tasks are only dropped when they expire.
+     */
+    ADAPTIVE_LIFO
+  };
+
   virtual ~ThreadManager() = default;
 
   /**
@@ -158,6 +192,7 @@ public:
    * timeout = -1 : Return immediately if pending task count exceeds specified max
    * @param expiration when nonzero, the number of milliseconds the task is valid
    * to be run; if exceeded, the task will be dropped off the queue and not run.
+   * This is also the deadline by which tasks are ordered with EDF scheduling.
    *
    * @throws TooManyPendingTasksException Pending task count exceeds max pending task count
    */
@@ -190,6 +225,34 @@ public:
    */
   virtual void setExpireCallback(ExpireCallback expireCallback) = 0;
 
+  /**
+   * Set the order in which pending tasks are run.  The default is FIFO.
+   *
+   * @param policy the scheduling policy; tasks already pending are reordered.
+   */
+  virtual void setSchedulingPolicy(SchedulingPolicy policy) = 0;
+
+  /**
+   * Get the order in which pending tasks are run.
+   */
+  virtual SchedulingPolicy getSchedulingPolicy() const = 0;
+
+  /**
+   * Set when the queue counts as overloaded for the CODEL and ADAPTIVE_LIFO
+   * policies: when no task has waited less than targetMs to run during an
+   * interval of intervalMs.  A queue that empties, or only briefly holds tasks,
+   * is never overloaded however long it gets.  The defaults are 5 and 100.
+   *
+   * @throws InvalidArgumentException if either value is not positive
+   */
+  virtual void setQueueDelayTarget(int64_t targetMs, int64_t intervalMs) = 0;
+
+  /**
+   * Whether the queue was overloaded at the end of the last interval; only
+   * tracked for the CODEL and ADAPTIVE_LIFO policies.
+   */
+  virtual bool isQueueOverloaded() const = 0;
+
   static std::shared_ptr<ThreadManager> newThreadManager();
 
   /**
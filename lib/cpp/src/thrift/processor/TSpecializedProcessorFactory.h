@@ -0,0 +1,111 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TSPECIALIZEDPROCESSORFACTORY_H_
+#define _THRIFT_PROCESSOR_TSPECIALIZEDPROCESSORFACTORY_H_ 1
+
+#include <memory>
+#include <thrift/TProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * Processor factory that keeps a templated processor and its protocol
+ * factory in step.
+ *
+ * Services generated with "--gen cpp:templates" produce a ProcessorT<Protocol_>
+ * class.  TDispatchProcessorT::process() only takes the devirtualized
+ * processFast() path when both protocols handed to it by the server are
+ * exactly Protocol_; otherwise every readI32() etc. goes through
+ * TVirtualProtocol.  This factory instantiates ProcessorT_ with the concrete
+ * protocol type produced by ProtocolFactory_ (its ProtocolType typedef), so
+ * configuring a server with
+ *
+ *   auto factory = std::make_shared<TSpecializedProcessorFactory<CalculatorProcessorT> >(handler);
+ *   TThreadPoolServer server(factory,
+ *                            serverSocket,
+ *                            std::make_shared<TBufferedTransportFactory>(),
+ *                            factory->getProtocolFactory(),
+ *                            threadManager);
+ *
+ * drives the generated code end to end without virtual calls in the per-field
+ * loop.  The default protocol factory specializes on TBufferBase, which
+ * covers TBufferedTransport, TFramedTransport and the TMemoryBuffer used by
+ * TNonblockingServer for every connection, since their read and write fast
+ * paths are non-virtual.
+ *
+ * If the server hands the protocol factory a transport that is not a
+ * Transport_ (for example a raw TSocket), the protocol factory falls back to
+ * the generic protocol and the processor to its generic dispatch path, so the
+ * server stays correct, just not devirtualized.
+ */
+template <template <class> class ProcessorT_,
+          class ProtocolFactory_ = protocol::TBinaryProtocolFactoryT<transport::TBufferBase> >
+class TSpecializedProcessorFactory : public TProcessorFactory {
+public:
+  typedef typename ProtocolFactory_::ProtocolType Protocol;
+  typedef ProcessorT_<Protocol> Processor;
+
+  /**
+   * Constructor.
+   *
+   * @param[in] iface  the service handler shared by every connection
+   */
+  template <class Iface_>
+  explicit TSpecializedProcessorFactory(const std::shared_ptr<Iface_>& iface)
+    : processor_(new Processor(iface)), protocolFactory_(new ProtocolFactory_()) {}
+
+  /**
+   * Constructor.
+   *
+   * @param[in] iface            the service handler shared by every connection
+   * @param[in] protocolFactory  a preconfigured protocol factory, for example
+   *                             one with string or container size limits set
+   */
+  template <class Iface_>
+  TSpecializedProcessorFactory(const std::shared_ptr<Iface_>& iface,
+                               const std::shared_ptr<ProtocolFactory_>& protocolFactory)
+    : processor_(new Processor(iface)), protocolFactory_(protocolFactory) {}
+
+  std::shared_ptr<TProcessor> getProcessor(const TConnectionInfo&) override { return processor_; }
+
+  /**
+   * The specialized processor, e.g. to install a TProcessorEventHandler.
+   */
+  std::shared_ptr<Processor> getSpecializedProcessor() const { return processor_; }
+
+  /**
+   * The protocol factory to hand to the server as its input and output
+   * protocol factory.
+   */
+  std::shared_ptr<ProtocolFactory_> getProtocolFactory() const { return protocolFactory_; }
+
+private:
+  std::shared_ptr<Processor> processor_;
+  std::shared_ptr<ProtocolFactory_> protocolFactory_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TSPECIALIZEDPROCESSORFACTORY_H_
@@ -19,6 +19,12 @@
 
 #include <thrift/protocol/TBase64Utils.h>
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define THRIFT_BASE64_X86 1
+#include <immintrin.h>
+#define THRIFT_BASE64_TARGET(isa) __attribute__((target(isa)))
+#endif
+
 using std::string;
 
 namespace apache {
@@ -310,6 +316,264 @@ void base64_decode(uint8_t* buf, uint32_t len) {
     }
   }
 }
+
+/*
+ * Vectorized kernels.  Each one consumes as many whole blocks as it safely
+ * can and returns the number of input bytes consumed (and, via *written, the
+ * number of output bytes produced); the caller finishes the tail with the
+ * quantum routines above.
+ *
+ * The encoders and the decoder follow Wojciech Mula's and Daniel Lemire's
+ * "Faster Base64 Encoding and Decoding using AVX2 Instructions".  The decoders
+ * stop at the first block holding a character outside the base64 alphabet and
+ * leave it to base64_decode(), so that invalid input decodes exactly as it
+ * always has.
+ */
+
+typedef uint32_t (*Base64EncodeKernel)(const uint8_t* in, uint32_t len, uint8_t* out);
+typedef uint32_t (*Base64DecodeKernel)(const uint8_t* in, uint32_t len, uint8_t* out, uint32_t* written);
+
+static uint32_t base64_encode_scalar(const uint8_t*, uint32_t, uint8_t*) {
+  return 0;
+}
+
+static uint32_t base64_decode_scalar(const uint8_t*, uint32_t, uint8_t*, uint32_t* written) {
+  *written = 0;
+  return 0;
+}
+
+#ifdef THRIFT_BASE64_X86
+
+// Splits each 3 byte group of the first 12 bytes into four 6 bit indices,
+// then maps the indices to the alphabet.
+THRIFT_BASE64_TARGET("ssse3")
+static inline __m128i base64_encode_block_ssse3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i indices = _mm_or_si128(t1, t3);
+
+  __m128i offset = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  offset = _mm_or_si128(offset, _mm_and_si128(less, _mm_set1_epi8(13)));
+  const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                      '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(shift, offset), indices);
+}
+
+THRIFT_BASE64_TARGET("ssse3")
+static uint32_t base64_encode_ssse3(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint32_t consumed = 0;
+  // Each block loads 16 bytes but only encodes the first 12
+  while (len - consumed >= 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + consumed));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), base64_encode_block_ssse3(block));
+    consumed += 12;
+    out += 16;
+  }
+  return consumed;
+}
+
+// Returns false if the block holds a character outside the alphabet
+THRIFT_BASE64_TARGET("ssse3")
+static inline bool base64_decode_block_ssse3(__m128i in, __m128i* out) {
+  const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+  const __m128i loNibbles = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+  const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+  const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+  if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+    return false;
+  }
+
+  const __m128i eq2F = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+  const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+  const __m128i values = _mm_add_epi8(in, roll);
+
+  // Pack four 6 bit values into three bytes per 32 bit word, then squeeze out
+  // the unused fourth byte of every word
+  const __m128i mergedPairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  const __m128i merged = _mm_madd_epi16(mergedPairs, _mm_set1_epi32(0x00011000));
+  *out = _mm_shuffle_epi8(merged,
+                          _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  return true;
+}
+
+THRIFT_BASE64_TARGET("ssse3")
+static uint32_t base64_decode_ssse3(const uint8_t* in, uint32_t len, uint8_t* out, uint32_t* written) {
+  uint32_t consumed = 0;
+  uint32_t produced = 0;
+  // Each block stores 16 bytes of which 12 are valid; out may alias in (it
+  // never runs ahead of it), and keeping 8 more characters behind the block
+  // guarantees the 4 extra bytes stay inside the buffer.
+  while (len - consumed >= 24) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + consumed));
+    __m128i decoded;
+    if (!base64_decode_block_ssse3(block, &decoded)) {
+      break;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + produced), decoded);
+    consumed += 16;
+    produced += 12;
+  }
+  *written = produced;
+  return consumed;
+}
+
+THRIFT_BASE64_TARGET("avx2")
+static uint32_t base64_encode_avx2(const uint8_t* in, uint32_t len, uint8_t* out) {
+  const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                         'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  uint32_t consumed = 0;
+  // Each block encodes 24 bytes, 12 per lane; the upper lane loads 16 bytes
+  // starting at offset 12
+  while (len - consumed >= 28) {
+    const uint8_t* src = in + consumed;
+    __m256i block = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12)),
+        1);
+    block = _mm256_shuffle_epi8(block, shuffle);
+    const __m256i t0 = _mm256_and_si256(block, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(block, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i offset = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    offset = _mm256_or_si256(offset, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                        _mm256_add_epi8(_mm256_shuffle_epi8(shift, offset), indices));
+    consumed += 24;
+    out += 32;
+  }
+  return consumed + base64_encode_ssse3(in + consumed, len - consumed, out);
+}
+
+THRIFT_BASE64_TARGET("avx2")
+static uint32_t base64_decode_avx2(const uint8_t* in, uint32_t len, uint8_t* out, uint32_t* written) {
+  const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                         0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  uint32_t consumed = 0;
+  uint32_t produced = 0;
+  // Each block stores 32 bytes of which 24 are valid
+  while (len - consumed >= 48) {
+    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + consumed));
+    const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(block, 4), _mm256_set1_epi8(0x0f));
+    const __m256i loNibbles = _mm256_and_si256(block, _mm256_set1_epi8(0x0f));
+    const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+    const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+    if (!_mm256_testz_si256(lo, hi)) {
+      break;
+    }
+    const __m256i eq2F = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('/'));
+    const __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+    const __m256i values = _mm256_add_epi8(block, roll);
+    const __m256i mergedPairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const __m256i merged = _mm256_madd_epi16(mergedPairs, _mm256_set1_epi32(0x00011000));
+    const __m256i packed = _mm256_shuffle_epi8(merged, pack);
+    // Move the 12 valid bytes of the upper lane next to those of the lower one
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + produced),
+                        _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7)));
+    consumed += 32;
+    produced += 24;
+  }
+  uint32_t tail = 0;
+  consumed += base64_decode_ssse3(in + consumed, len - consumed, out + produced, &tail);
+  *written = produced + tail;
+  return consumed;
+}
+
+#endif // THRIFT_BASE64_X86
+
+static Base64EncodeKernel selectEncodeKernel() {
+#ifdef THRIFT_BASE64_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return base64_encode_avx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return base64_encode_ssse3;
+  }
+#endif
+  return base64_encode_scalar;
+}
+
+static Base64DecodeKernel selectDecodeKernel() {
+#ifdef THRIFT_BASE64_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return base64_decode_avx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return base64_decode_ssse3;
+  }
+#endif
+  return base64_decode_scalar;
+}
+
+uint32_t base64_encode_buffer(const uint8_t* in, uint32_t len, uint8_t* out) {
+  static const Base64EncodeKernel kernel = selectEncodeKernel();
+  uint32_t consumed = kernel(in, len, out);
+  uint8_t* dst = out + (consumed / 3) * 4;
+  while (len - consumed >= 3) {
+    base64_encode(in + consumed, 3, dst);
+    consumed += 3;
+    dst += 4;
+  }
+  if (len - consumed > 0) {
+    base64_encode(in + consumed, len - consumed, dst);
+    dst += len - consumed + 1;
+  }
+  return static_cast<uint32_t>(dst - out);
+}
+
+uint32_t base64_decode_buffer(uint8_t* buf, uint32_t len) {
+  static const Base64DecodeKernel kernel = selectDecodeKernel();
+  uint32_t produced = 0;
+  uint32_t consumed = kernel(buf, len, buf, &produced);
+  while (len - consumed >= 4) {
+    base64_decode(buf + consumed, 4);
+    for (uint32_t i = 0; i < 3; ++i) {
+      buf[produced++] = buf[consumed + i];
+    }
+    consumed += 4;
+  }
+  // A single leftover character cannot encode a byte
+  if (len - consumed > 1) {
+    uint32_t tail = len - consumed - 1;
+    base64_decode(buf + consumed, len - consumed);
+    for (uint32_t i = 0; i < tail; ++i) {
+      buf[produced++] = buf[consumed + i];
+    }
+  }
+  return produced;
+}
 }
 }
 } // apache::thrift::protocol
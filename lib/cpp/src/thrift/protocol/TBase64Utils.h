@@ -38,6 +38,29 @@ void base64_encode(const uint8_t* in, uint32_t len, uint8_t* buf);
 // len is number of bytes to consume from input (must be 2, 3, or 4)
 // no '=' padding should be included in the input
 void base64_decode(uint8_t* buf, uint32_t len);
+
+// number of base64 characters produced by base64_encode_buffer() for len
+// input bytes (no '=' padding)
+inline uint32_t base64_encoded_size(uint32_t len) {
+  return (len / 3) * 4 + (len % 3 ? len % 3 + 1 : 0);
+}
+
+// Bulk variants of the above.  These process a whole buffer per call and use
+// SSSE3 or AVX2 when the CPU supports them (selected at runtime), falling back
+// to the 3/4 byte quantum routines otherwise.  The output is identical to
+// calling base64_encode()/base64_decode() quantum by quantum.
+
+// in must be at least len bytes
+// out must be a buffer of at least base64_encoded_size(len) bytes and may not
+// overlap in; the data is not padded with '='
+// returns the number of characters written to out
+uint32_t base64_encode_buffer(const uint8_t* in, uint32_t len, uint8_t* out);
+
+// buf must contain len base64 encoded values, without '=' padding
+// buf will be changed to contain the output bytes
+// a single trailing character (which cannot encode a byte) is ignored
+// returns the number of bytes decoded into buf
+uint32_t base64_decode_buffer(uint8_t* buf, uint32_t len);
 }
 }
 } // apache::thrift::protocol
@@ -189,6 +189,9 @@ typedef TBinaryProtocolT<TTransport, TNetworkLittleEndian> TLEBinaryProtocol;
 template <class Transport_, class ByteOrder_ = TNetworkBigEndian>
 class TBinaryProtocolFactoryT : public TProtocolFactory {
 public:
+  /// The protocol type handed out when the transport is a Transport_
+  typedef TBinaryProtocolT<Transport_, ByteOrder_> ProtocolType;
+
   TBinaryProtocolFactoryT()
     : string_limit_(0), container_limit_(0), strict_read_(false), strict_write_(true) {}
 
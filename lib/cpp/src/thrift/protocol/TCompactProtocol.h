@@ -228,6 +228,9 @@ typedef TCompactProtocolT<TTransport> TCompactProtocol;
 template <class Transport_>
 class TCompactProtocolFactoryT : public TProtocolFactory {
 public:
+  /// The protocol type handed out when the transport is a Transport_
+  typedef TCompactProtocolT<Transport_> ProtocolType;
+
   TCompactProtocolFactoryT() : string_limit_(0), container_limit_(0) {}
 
   TCompactProtocolFactoryT(int32_t string_limit, int32_t container_limit)
@@ -87,6 +87,10 @@ public:
   // these work with read headers
   const StringToStringMap& getHeaders() const { return trans_->getHeaders(); }
 
+  void setClientTimeout(int64_t timeoutMs) { trans_->setClientTimeout(timeoutMs); }
+
+  int64_t getClientTimeout() const { return trans_->getClientTimeout(); }
+
   /**
    * Writing functions.
    */
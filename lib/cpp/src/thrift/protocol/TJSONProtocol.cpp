@@ -21,15 +21,25 @@
 
 #include <boost/locale.hpp>
 
+#include <algorithm>
+#include <cerrno>
+#include <clocale>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
-#include <locale>
-#include <sstream>
-#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define THRIFT_JSON_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 #include <thrift/protocol/TBase64Utils.h>
 #include <thrift/transport/TTransportException.h>
-#include <thrift/TToString.h>
 
 using namespace apache::thrift::transport;
 
@@ -294,6 +304,147 @@ static bool isLowSurrogate(uint16_t val) {
   return val >= 0xDC00 && val <= 0xDFFF;
 }
 
+#ifdef THRIFT_JSON_SSE2
+// Index of the lowest set bit of a non-zero movemask result
+static uint32_t lowestSetBit(uint32_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<uint32_t>(index);
+#else
+  return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+// Return the length of the run at the start of buf that can be written into a
+// JSON string as is, i.e. up to the first '"', '\\' or control character.
+static uint32_t jsonUnescapedWriteRun(const uint8_t* buf, uint32_t len) {
+  uint32_t i = 0;
+#ifdef THRIFT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8(static_cast<char>(kJSONStringDelimiter));
+  const __m128i backslash = _mm_set1_epi8(static_cast<char>(kJSONBackslash));
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    // Unsigned chunk <= 0x1F is max(chunk, 0x1F) == 0x1F
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                _mm_cmpeq_epi8(chunk, backslash)),
+                                   _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+    if (mask != 0) {
+      return i + lowestSetBit(mask);
+    }
+  }
+#endif
+  for (; i < len; ++i) {
+    uint8_t ch = buf[i];
+    if (ch < 0x20 || ch == kJSONStringDelimiter || ch == kJSONBackslash) {
+      break;
+    }
+  }
+  return i;
+}
+
+// Return the length of the run at the start of buf that readJSONString() can
+// copy as is, i.e. up to the first '"' or '\\'.
+static uint32_t jsonUnescapedReadRun(const uint8_t* buf, uint32_t len) {
+  uint32_t i = 0;
+#ifdef THRIFT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8(static_cast<char>(kJSONStringDelimiter));
+  const __m128i backslash = _mm_set1_epi8(static_cast<char>(kJSONBackslash));
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+    if (mask != 0) {
+      return i + lowestSetBit(mask);
+    }
+  }
+#endif
+  for (; i < len; ++i) {
+    if (buf[i] == kJSONStringDelimiter || buf[i] == kJSONBackslash) {
+      break;
+    }
+  }
+  return i;
+}
+
+// Write the decimal digits of value right-aligned into the buffer ending at
+// end, preceded by '-' if negative, and return a pointer to the first
+// character.  The buffer must have room for 21 characters.
+static char* formatDecimal(char* end, uint64_t value, bool negative) {
+  do {
+    *--end = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  if (negative) {
+    *--end = '-';
+  }
+  return end;
+}
+
+template <typename NumberType>
+static char* formatJSONInteger(char* end, NumberType num) {
+  if (std::numeric_limits<NumberType>::is_signed && num < 0) {
+    // Negate in unsigned arithmetic so that the minimum value does not overflow
+    return formatDecimal(end, 0 - static_cast<uint64_t>(static_cast<int64_t>(num)), true);
+  }
+  return formatDecimal(end, static_cast<uint64_t>(num), false);
+}
+
+static char* formatJSONInteger(char* end, bool num) {
+  *--end = num ? '1' : '0';
+  return end;
+}
+
+// Enumerations such as TMessageType have no numeric_limits; use the underlying
+// integer type.
+static char* formatJSONInteger(char* end, TMessageType num) {
+  return formatJSONInteger(end, static_cast<int32_t>(num));
+}
+
+// Parse the base 10 integer in str into num.  Returns false if str is not an
+// optionally signed sequence of digits or its value does not fit NumberType.
+template <typename NumberType>
+static bool parseJSONInteger(const std::string& str, NumberType& num) {
+  typedef std::numeric_limits<NumberType> limits;
+  const char* p = str.data();
+  const char* end = p + str.length();
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+  if (p == end) {
+    return false;
+  }
+  const uint64_t bound
+      = negative ? static_cast<uint64_t>(-(static_cast<int64_t>(limits::min()) + 1)) + 1
+                 : static_cast<uint64_t>(limits::max());
+  uint64_t value = 0;
+  for (; p != end; ++p) {
+    auto digit = static_cast<uint32_t>(static_cast<uint8_t>(*p) - '0');
+    if (digit > 9 || digit > bound || value > (bound - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  if (negative && value != 0) {
+    num = static_cast<NumberType>(-static_cast<int64_t>(value - 1) - 1);
+  } else {
+    num = static_cast<NumberType>(value);
+  }
+  return true;
+}
+
+// The decimal separator of the C locale, which snprintf() and strtod() honor.
+// JSON always uses '.', whatever the process locale is set to.
+static char localeDecimalPoint() {
+  const struct lconv* conv = localeconv();
+  return (conv && conv->decimal_point && conv->decimal_point[0]) ? conv->decimal_point[0] : '.';
+}
+
 /**
  * Class to serve as base JSON context and as base class for other context
  * implementations
@@ -416,12 +567,11 @@ void TJSONProtocol::popContext() {
 
 // Write the character ch as a JSON escape sequence ("\u00xx")
 uint32_t TJSONProtocol::writeJSONEscapeChar(uint8_t ch) {
-  trans_->write((const uint8_t*)kJSONEscapePrefix.c_str(),
-                static_cast<uint32_t>(kJSONEscapePrefix.length()));
-  uint8_t outCh = hexChar(ch >> 4);
-  trans_->write(&outCh, 1);
-  outCh = hexChar(ch);
-  trans_->write(&outCh, 1);
+  uint8_t escaped[6];
+  std::memcpy(escaped, kJSONEscapePrefix.data(), 4);
+  escaped[4] = hexChar(ch >> 4);
+  escaped[5] = hexChar(ch);
+  trans_->write(escaped, 6);
   return 6;
 }
 
@@ -429,8 +579,8 @@ uint32_t TJSONProtocol::writeJSONEscapeChar(uint8_t ch) {
 uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
   if (ch >= 0x30) {
     if (ch == kJSONBackslash) { // Only special character >= 0x30 is '\'
-      trans_->write(&kJSONBackslash, 1);
-      trans_->write(&kJSONBackslash, 1);
+      const uint8_t escaped[2] = {kJSONBackslash, kJSONBackslash};
+      trans_->write(escaped, 2);
       return 2;
     } else {
       trans_->write(&ch, 1);
@@ -443,8 +593,8 @@ uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
       trans_->write(&ch, 1);
       return 1;
     } else if (outCh > 1) {
-      trans_->write(&kJSONBackslash, 1);
-      trans_->write(&outCh, 1);
+      const uint8_t escaped[2] = {kJSONBackslash, outCh};
+      trans_->write(escaped, 2);
       return 2;
     } else {
       return writeJSONEscapeChar(ch);
@@ -453,15 +603,28 @@ uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
 }
 
 // Write out the contents of the string str as a JSON string, escaping
-// characters as appropriate.
+// characters as appropriate.  Runs of characters that need no escaping are
+// written with a single call to the transport.
 uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  const auto* bytes = (const uint8_t*)str.data();
+  auto len = static_cast<uint32_t>(str.length());
+  while (len > 0) {
+    uint32_t run = jsonUnescapedWriteRun(bytes, len);
+    if (run > 0) {
+      trans_->write(bytes, run);
+      result += run;
+      bytes += run;
+      len -= run;
+    }
+    if (len > 0) {
+      result += writeJSONChar(*bytes++);
+      --len;
+    }
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -473,23 +636,21 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  uint8_t b[4];
-  const auto* bytes = (const uint8_t*)str.c_str();
+  // Encode in chunks of whole 3 byte quanta so that every chunk but the last
+  // comes out unpadded and the transport sees one write per chunk
+  static const uint32_t kChunk = 3 * 1024;
+  uint8_t b[kChunk / 3 * 4];
+  const auto* bytes = (const uint8_t*)str.data();
   if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto len = static_cast<uint32_t>(str.length());
-  while (len >= 3) {
-    // Encode 3 bytes at a time
-    base64_encode(bytes, 3, b);
-    trans_->write(b, 4);
-    result += 4;
-    bytes += 3;
-    len -= 3;
-  }
-  if (len) { // Handle remainder
-    base64_encode(bytes, len, b);
-    trans_->write(b, len + 1);
-    result += len + 1;
+  while (len) {
+    uint32_t n = (std::min)(len, kChunk);
+    uint32_t encoded = base64_encode_buffer(bytes, n, b);
+    trans_->write(b, encoded);
+    result += encoded;
+    bytes += n;
+    len -= n;
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -500,31 +661,40 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
 template <typename NumberType>
 uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
   uint32_t result = context_->write(*trans_);
-  std::string val(to_string(num));
+  // Room for the quotes, a sign and the 20 digits of a 64 bit integer
+  char buf[24];
+  char* end = buf + sizeof(buf);
   bool escapeNum = context_->escapeNum();
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    *--end = kJSONStringDelimiter;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  char* begin = formatJSONInteger(end, num);
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    *--begin = kJSONStringDelimiter;
+    ++end;
   }
-  return result;
+  auto len = static_cast<uint32_t>(end - begin);
+  trans_->write((const uint8_t*)begin, len);
+  return result + len;
 }
 
 namespace {
+// Formats d with 17 significant digits, which always round-trips, without
+// going through an ostringstream.
 std::string doubleToString(double d) {
-  std::ostringstream str;
-  str.imbue(std::locale::classic());
-  const std::streamsize max_digits10 = 2 + std::numeric_limits<double>::digits10;
-  str.precision(max_digits10);
-  str << d;
-  return str.str();
+  char buf[32];
+  int len = std::snprintf(buf, sizeof(buf), "%.17g", d);
+  if (len < 0 || len >= static_cast<int>(sizeof(buf))) {
+    throw TProtocolException(TProtocolException::INVALID_DATA, "Failed to format double");
+  }
+  char point = localeDecimalPoint();
+  if (point != '.') {
+    char* p = static_cast<char*>(std::memchr(buf, point, static_cast<size_t>(len)));
+    if (p) {
+      *p = '.';
+    }
+  }
+  return std::string(buf, static_cast<size_t>(len));
 }
 }
 
@@ -734,7 +904,9 @@ uint32_t TJSONProtocol::readJSONEscapeChar(uint16_t* out) {
   return 4;
 }
 
-// Decodes a JSON string, including unescaping, and returns the string via str
+// Decodes a JSON string, including unescaping, and returns the string via str.
+// If the transport can lend out its buffer, runs without quotes or escapes are
+// appended in bulk.
 uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
   uint32_t result = (skipContext ? 0 : context_->read(reader_));
   result += readJSONSyntaxChar(kJSONStringDelimiter);
@@ -742,6 +914,20 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
   uint8_t ch;
   str.clear();
   while (true) {
+    uint32_t avail = 0;
+    const uint8_t* buf = reader_.borrow(&avail);
+    if (buf) {
+      uint32_t run = jsonUnescapedReadRun(buf, avail);
+      if (run > 0) {
+        if (!codeunits.empty()) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 low surrogate pair.");
+        }
+        str.append((const char*)buf, run);
+        reader_.consume(run);
+        result += run;
+      }
+    }
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -795,11 +981,14 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
 uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
   std::string tmp;
   uint32_t result = readJSONString(tmp);
-  auto* b = (uint8_t*)tmp.c_str();
   if (tmp.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto len = static_cast<uint32_t>(tmp.length());
   str.clear();
+  if (len == 0) {
+    return result;
+  }
+  auto* b = (uint8_t*)&tmp[0];
   // Ignore padding
   if (len >= 2)  {
     uint32_t bound = len - 2;
@@ -807,18 +996,10 @@ uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
       --len;
     }
   }
-  while (len >= 4) {
-    base64_decode(b, 4);
-    str.append((const char*)b, 3);
-    b += 4;
-    len -= 4;
-  }
-  // Don't decode if we hit the end or got a single leftover byte (invalid
-  // base64 but legal for skip of regular string type)
-  if (len > 1) {
-    base64_decode(b, len);
-    str.append((const char*)b, len - 1);
-  }
+  // Decode in place; a single leftover byte (invalid base64 but legal for
+  // skip of regular string type) is dropped
+  tmp.resize(base64_decode_buffer(b, len));
+  str.swap(tmp);
   return result;
 }
 
@@ -828,6 +1009,17 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
   uint32_t result = 0;
   str.clear();
   while (true) {
+    uint32_t avail = 0;
+    const uint8_t* buf = reader_.borrow(&avail);
+    if (buf) {
+      uint32_t run = 0;
+      while (run < avail && isJSONNumeric(buf[run])) {
+        ++run;
+      }
+      str.append((const char*)buf, run);
+      reader_.consume(run);
+      result += run;
+    }
     uint8_t ch = reader_.peek();
     if (!isJSONNumeric(ch)) {
       break;
@@ -840,15 +1032,27 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
 }
 
 namespace {
-template <typename T>
-T fromString(const std::string& s) {
-  T t;
-  std::istringstream str(s);
-  str.imbue(std::locale::classic());
-  str >> t;
-  if (str.bad() || !str.eof())
-    throw std::runtime_error(s);
-  return t;
+// Parses a double written by doubleToString() or any other JSON number.
+bool stringToDouble(const std::string& s, double& d) {
+  if (s.empty() || s.length() > 1024) {
+    return false;
+  }
+  char buf[1025];
+  std::memcpy(buf, s.data(), s.length());
+  buf[s.length()] = '\0';
+  char point = localeDecimalPoint();
+  for (char* p = buf; *p; ++p) {
+    // strtod() also accepts hex, "inf" and "nan"; JSON numbers are decimal
+    if (!isJSONNumeric(static_cast<uint8_t>(*p))) {
+      return false;
+    }
+    if (*p == '.') {
+      *p = point;
+    }
+  }
+  char* end = nullptr;
+  d = std::strtod(buf, &end);
+  return end == buf + s.length();
 }
 }
 
@@ -862,9 +1066,7 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
   }
   std::string str;
   result += readJSONNumericChars(str);
-  try {
-    num = fromString<NumberType>(str);
-  } catch (const std::runtime_error&) {
+  if (!parseJSONInteger(str, num)) {
     throw TProtocolException(TProtocolException::INVALID_DATA,
                              "Expected numeric value; got \"" + str + "\"");
   }
@@ -893,9 +1095,7 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Numeric data unexpectedly quoted");
       }
-      try {
-        num = fromString<double>(str);
-      } catch (const std::runtime_error&) {
+      if (!stringToDouble(str, num)) {
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Expected numeric value; got \"" + str + "\"");
       }
@@ -906,9 +1106,7 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
       readJSONSyntaxChar(kJSONStringDelimiter);
     }
     result += readJSONNumericChars(str);
-    try {
-      num = fromString<double>(str);
-    } catch (const std::runtime_error&) {
+    if (!stringToDouble(str, num)) {
       throw TProtocolException(TProtocolException::INVALID_DATA,
                                    "Expected numeric value; got \"" + str + "\"");
     }
@@ -1060,14 +1258,8 @@ uint32_t TJSONProtocol::readBool(bool& value) {
   return readJSONInteger(value);
 }
 
-// readByte() must be handled properly because boost::lexical cast sees int8_t
-// as a text type instead of an integer type
 uint32_t TJSONProtocol::readByte(int8_t& byte) {
-  auto tmp = (int16_t)byte;
-  uint32_t result = readJSONInteger(tmp);
-  assert(tmp < 256);
-  byte = (int8_t)tmp;
-  return result;
+  return readJSONInteger(byte);
 }
 
 uint32_t TJSONProtocol::readI16(int16_t& i16) {
@@ -267,6 +267,22 @@ public:
       return data_;
     }
 
+    /**
+     * Borrow whatever the transport already has buffered so that callers can
+     * scan it in bulk instead of a byte at a time.  Returns NULL if a byte has
+     * been peeked or the transport cannot lend out its buffer; otherwise *len
+     * holds the number of bytes available.  Must be followed by consume().
+     */
+    const uint8_t* borrow(uint32_t* len) {
+      if (hasData_) {
+        return nullptr;
+      }
+      *len = 1;
+      return trans_->borrow(nullptr, len);
+    }
+
+    void consume(uint32_t len) { trans_->consume(len); }
+
   private:
     TTransport* trans_;
     bool hasData_;
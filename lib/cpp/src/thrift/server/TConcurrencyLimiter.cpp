@@ -0,0 +1,213 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/server/TConcurrencyLimiter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Synchronized;
+
+const int64_t TConcurrencyLimiter::DEFAULT_INITIAL_LIMIT;
+const int64_t TConcurrencyLimiter::DEFAULT_MIN_LIMIT;
+const int64_t TConcurrencyLimiter::DEFAULT_MAX_LIMIT;
+
+// Weight of a new sample in the short term latency average
+static const double LATENCY_SMOOTHING = 0.2;
+
+// Weight of a new limit computed by the gradient algorithm
+static const double LIMIT_SMOOTHING = 0.2;
+
+TConcurrencyLimiter::TConcurrencyLimiter(Algorithm algorithm,
+                                         int64_t initialLimit,
+                                         int64_t minLimit,
+                                         int64_t maxLimit)
+  : algorithm_(algorithm),
+    minLimit_(minLimit),
+    maxLimit_(maxLimit),
+    limit_(0),
+    inFlight_(0),
+    limitValue_(0),
+    latencyUs_(0),
+    baselineUs_(0),
+    samples_(0),
+    drops_(0),
+    tolerance_(1.5),
+    thresholdUs_(0),
+    backoffRatio_(0.9),
+    baselineWindow_(600),
+    waiting_(0) {
+  if (minLimit < 1 || minLimit > maxLimit) {
+    throw std::invalid_argument("TConcurrencyLimiter: invalid limit range");
+  }
+  setLimit(static_cast<double>(initialLimit));
+}
+
+TConcurrencyLimiter::time_point TConcurrencyLimiter::onStart() {
+  inFlight_.fetch_add(1, std::memory_order_relaxed);
+  return std::chrono::steady_clock::now();
+}
+
+TConcurrencyLimiter::time_point TConcurrencyLimiter::waitAndStart() {
+  Synchronized s(slotMonitor_);
+  // Announce the wait before checking, so that onComplete() either frees the
+  // slot before the check or sees us waiting
+  ++waiting_;
+  while (inFlight_.load() >= getLimit()) {
+    slotMonitor_.wait();
+  }
+  --waiting_;
+  return onStart();
+}
+
+void TConcurrencyLimiter::onComplete(const time_point& start, Outcome outcome) {
+  // Sample the number in flight while this request still was
+  int64_t inFlight = inFlight_.fetch_sub(1);
+  if (outcome != IGNORED) {
+    int64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+    Guard g(mutex_);
+    update(latencyUs, inFlight, outcome == DROPPED, start);
+  }
+
+  // The limit may have grown too, so let every waiter check again
+  if (waiting_.load() > 0) {
+    Synchronized s(slotMonitor_);
+    slotMonitor_.notifyAll();
+  }
+}
+
+void TConcurrencyLimiter::addSample(int64_t latencyUs, int64_t inFlight) {
+  time_point start = std::chrono::steady_clock::now() - std::chrono::microseconds(latencyUs);
+  Guard g(mutex_);
+  update(latencyUs, inFlight, false, start);
+}
+
+void TConcurrencyLimiter::update(int64_t latencyUs,
+                                 int64_t inFlight,
+                                 bool dropped,
+                                 const time_point& start) {
+  if (dropped) {
+    ++drops_;
+  } else {
+    auto sample = static_cast<double>((std::max)(latencyUs, static_cast<int64_t>(1)));
+    if (samples_++ == 0) {
+      latencyUs_ = baselineUs_ = sample;
+    } else {
+      latencyUs_ += LATENCY_SMOOTHING * (sample - latencyUs_);
+      baselineUs_ += (sample - baselineUs_) / baselineWindow_;
+      // After a period of congestion the baseline has been dragged up; let it
+      // come back down quickly once latency has recovered
+      if (baselineUs_ > 2 * latencyUs_) {
+        baselineUs_ *= 0.95;
+      }
+    }
+  }
+
+  // Raise the limit only while it is being used
+  bool limited = 2 * inFlight >= static_cast<int64_t>(limitValue_);
+
+  if (algorithm_ == AIMD) {
+    double threshold = thresholdUs_ > 0 ? static_cast<double>(thresholdUs_)
+                                        : tolerance_ * baselineUs_;
+    if (dropped || static_cast<double>(latencyUs) > threshold) {
+      if (start >= lastBackoff_) {
+        lastBackoff_ = std::chrono::steady_clock::now();
+        setLimit(limitValue_ * backoffRatio_);
+      }
+    } else if (limited) {
+      setLimit(limitValue_ + 1);
+    }
+    return;
+  }
+
+  if (dropped) {
+    return;
+  }
+  double gradient = (std::max)(0.5, (std::min)(1.0, tolerance_ * baselineUs_ / latencyUs_));
+  double newLimit = limitValue_ * gradient + std::sqrt(limitValue_);
+  if (newLimit > limitValue_ && !limited) {
+    return;
+  }
+  setLimit(limitValue_ * (1 - LIMIT_SMOOTHING) + newLimit * LIMIT_SMOOTHING);
+}
+
+void TConcurrencyLimiter::setLimit(double limit) {
+  limitValue_ = (std::max)(static_cast<double>(minLimit_),
+                           (std::min)(static_cast<double>(maxLimit_), limit));
+  limit_.store(static_cast<int64_t>(limitValue_), std::memory_order_relaxed);
+}
+
+double TConcurrencyLimiter::getLatencyUs() const {
+  Guard g(mutex_);
+  return latencyUs_;
+}
+
+double TConcurrencyLimiter::getBaselineLatencyUs() const {
+  Guard g(mutex_);
+  return baselineUs_;
+}
+
+uint64_t TConcurrencyLimiter::getSampleCount() const {
+  Guard g(mutex_);
+  return samples_;
+}
+
+uint64_t TConcurrencyLimiter::getDropCount() const {
+  Guard g(mutex_);
+  return drops_;
+}
+
+void TConcurrencyLimiter::setTolerance(double tolerance) {
+  if (tolerance < 1.0) {
+    throw std::invalid_argument("TConcurrencyLimiter: tolerance must be at least 1");
+  }
+  Guard g(mutex_);
+  tolerance_ = tolerance;
+}
+
+void TConcurrencyLimiter::setLatencyThresholdUs(int64_t thresholdUs) {
+  Guard g(mutex_);
+  thresholdUs_ = thresholdUs;
+}
+
+void TConcurrencyLimiter::setBackoffRatio(double ratio) {
+  if (ratio < 0.5 || ratio >= 1.0) {
+    throw std::invalid_argument("TConcurrencyLimiter: backoff ratio must be in [0.5, 1)");
+  }
+  Guard g(mutex_);
+  backoffRatio_ = ratio;
+}
+
+void TConcurrencyLimiter::setBaselineWindow(uint32_t samples) {
+  if (samples == 0) {
+    throw std::invalid_argument("TConcurrencyLimiter: baseline window must not be empty");
+  }
+  Guard g(mutex_);
+  baselineWindow_ = samples;
+}
+}
+}
+} // apache::thrift::server
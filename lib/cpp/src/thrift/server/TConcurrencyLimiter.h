@@ -0,0 +1,202 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TCONCURRENCYLIMITER_H_
+#define _THRIFT_SERVER_TCONCURRENCYLIMITER_H_ 1
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Adjusts a concurrency limit to the observed processing latency.
+ *
+ * Servers report when they start processing a request with onStart() and
+ * when it is done with onComplete().  The limiter keeps a fast moving
+ * average of the latency and a slow moving baseline, and lowers the limit
+ * when the latency rises above the baseline (requests are queueing somewhere)
+ * and raises it while it does not.  The limit is only raised while at least
+ * half of it is in use, so that an idle server does not end up with a limit
+ * it has never been tested at.
+ *
+ * Two algorithms are provided:
+ *  - GRADIENT scales the limit by baseline / latency (between 0.5 and 1,
+ *    after the tolerance is applied) and adds the square root of the limit
+ *    as headroom for queueing, smoothing the result over several samples.
+ *  - AIMD adds one for each request that completes in time and multiplies
+ *    the limit by the backoff ratio when a request is too slow or dropped,
+ *    at most once for requests started under the same limit.
+ *
+ * A request is too slow for AIMD if it takes longer than the latency
+ * threshold or, if none is set, longer than the baseline times the tolerance.
+ *
+ * TServerFramework applies the limit to requests being processed, with
+ * waitAndStart(), and TNonblockingServer to active processors.  All methods
+ * are thread safe.
+ */
+class TConcurrencyLimiter {
+public:
+  typedef std::chrono::steady_clock::time_point time_point;
+
+  enum Algorithm { GRADIENT, AIMD };
+
+  /// How a request started with onStart() ended
+  enum Outcome {
+    /// Processed; its latency is sampled
+    SUCCESS,
+    /// Dropped because of overload; lowers the limit with AIMD
+    DROPPED,
+    /// Failed for a reason that says nothing about load (e.g. the client left)
+    IGNORED
+  };
+
+  static const int64_t DEFAULT_INITIAL_LIMIT = 20;
+  static const int64_t DEFAULT_MIN_LIMIT = 1;
+  static const int64_t DEFAULT_MAX_LIMIT = 1000;
+
+  /**
+   * Constructor.
+   *
+   * @param algorithm     how the limit is adjusted
+   * @param initialLimit  limit until samples say otherwise
+   * @param minLimit      lowest limit
+   * @param maxLimit      highest limit
+   * @throws std::invalid_argument if the limits are out of order or minLimit < 1
+   */
+  TConcurrencyLimiter(Algorithm algorithm = GRADIENT,
+                      int64_t initialLimit = DEFAULT_INITIAL_LIMIT,
+                      int64_t minLimit = DEFAULT_MIN_LIMIT,
+                      int64_t maxLimit = DEFAULT_MAX_LIMIT);
+
+  /**
+   * Records that processing of a request has started.
+   *
+   * @return the start time to pass to onComplete()
+   */
+  time_point onStart();
+
+  /**
+   * Waits until fewer requests than the limit are in flight, then records
+   * that processing of a request has started like onStart() does.
+   *
+   * @return the start time to pass to onComplete()
+   */
+  time_point waitAndStart();
+
+  /**
+   * Records that processing of a request started with onStart() has ended.
+   */
+  void onComplete(const time_point& start, Outcome outcome = SUCCESS);
+
+  /**
+   * Records a latency sample directly, for callers that keep track of the
+   * number of requests in flight themselves.
+   */
+  void addSample(int64_t latencyUs, int64_t inFlight);
+
+  /// Current limit.
+  int64_t getLimit() const { return limit_.load(std::memory_order_relaxed); }
+
+  /// Requests between onStart() and onComplete().
+  int64_t getInFlight() const { return inFlight_.load(std::memory_order_relaxed); }
+
+  Algorithm getAlgorithm() const { return algorithm_; }
+
+  int64_t getMinLimit() const { return minLimit_; }
+
+  int64_t getMaxLimit() const { return maxLimit_; }
+
+  /// Moving average of recent latencies, in microseconds.
+  double getLatencyUs() const;
+
+  /// Slowly moving latency baseline, in microseconds.
+  double getBaselineLatencyUs() const;
+
+  /// Number of latency samples taken.
+  uint64_t getSampleCount() const;
+
+  /// Number of requests reported as dropped.
+  uint64_t getDropCount() const;
+
+  /**
+   * Set how much slower than the baseline latency may get before it counts
+   * as congestion.  The default is 1.5.
+   */
+  void setTolerance(double tolerance);
+
+  /**
+   * Set a fixed latency above which AIMD backs off, instead of the baseline
+   * times the tolerance (0 == use the baseline).
+   */
+  void setLatencyThresholdUs(int64_t thresholdUs);
+
+  /// Set the factor AIMD multiplies the limit by when backing off (0.5 - 1).
+  void setBackoffRatio(double ratio);
+
+  /**
+   * Set the number of samples over which the baseline latency moves.  Larger
+   * windows make the limiter slower to accept a new normal.  Default 600.
+   */
+  void setBaselineWindow(uint32_t samples);
+
+private:
+  // Updates the limit with a sample, mutex_ must be held
+  void update(int64_t latencyUs, int64_t inFlight, bool dropped, const time_point& start);
+
+  // Stores limitValue_ clamped to the bounds and publishes it
+  void setLimit(double limit);
+
+  const Algorithm algorithm_;
+  const int64_t minLimit_;
+  const int64_t maxLimit_;
+
+  std::atomic<int64_t> limit_;
+  std::atomic<int64_t> inFlight_;
+
+  mutable apache::thrift::concurrency::Mutex mutex_;
+  double limitValue_;
+  double latencyUs_;
+  double baselineUs_;
+  uint64_t samples_;
+  uint64_t drops_;
+  double tolerance_;
+  int64_t thresholdUs_;
+  double backoffRatio_;
+  uint32_t baselineWindow_;
+
+  // Signalled by onComplete() while waitAndStart() callers wait for a slot
+  apache::thrift::concurrency::Monitor slotMonitor_;
+  std::atomic<int64_t> waiting_;
+
+  // Requests started before this were admitted under a limit AIMD has
+  // already backed off from
+  time_point lastBackoff_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TCONCURRENCYLIMITER_H_
@@ -18,6 +18,7 @@
  */
 
 #include <thrift/server/TConnectedClient.h>
+#include <thrift/transport/TBufferTransports.h>
 
 namespace apache {
 namespace thrift {
@@ -26,6 +27,8 @@ namespace server {
 using apache::thrift::TProcessor;
 using apache::thrift::protocol::TProtocol;
 using apache::thrift::server::TServerEventHandler;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransport;
 using apache::thrift::transport::TTransportException;
 using std::shared_ptr;
@@ -42,53 +45,137 @@ TConnectedClient::TConnectedClient(const shared_ptr<TProcessor>& processor,
     outputProtocol_(outputProtocol),
     eventHandler_(eventHandler),
     client_(client),
+    socket_(std::dynamic_pointer_cast<TSocket>(client)),
+    parkable_(false),
+    parked_(false),
+    contextCreated_(false),
     opaqueContext_(nullptr) {
+  // Parking a client between requests is only safe if nothing between the
+  // socket and the protocol reads ahead of the current request; framed
+  // transports (including THeaderTransport) read exactly one frame at a time
+  TTransport* transport = inputProtocol_->getTransport().get();
+  while (socket_ && transport && !parkable_) {
+    if (transport == socket_.get()) {
+      parkable_ = true;
+    } else if (auto* framed = dynamic_cast<TFramedTransport*>(transport)) {
+      transport = framed->getUnderlyingTransport().get();
+    } else {
+      transport = nullptr;
+    }
+  }
 }
 
 TConnectedClient::~TConnectedClient() = default;
 
 void TConnectedClient::run() {
-  if (eventHandler_) {
+  createContext();
+  while (processRequest()) {
+  }
+  cleanup();
+}
+
+bool TConnectedClient::runUntilIdle() {
+  createContext();
+  // A parked client is only run again once its socket is readable, and a
+  // closed connection is readable without any data pending; so read at least
+  // once to see the request or the end of the connection
+  bool readable = parked_;
+  parked_ = false;
+  for (;;) {
+    if (!readable && isIdle()) {
+      parked_ = true;
+      return true;
+    }
+    readable = false;
+    if (!processRequest()) {
+      break;
+    }
+  }
+  cleanup();
+  return false;
+}
+
+void TConnectedClient::abandon() {
+  cleanup();
+}
+
+void TConnectedClient::createContext() {
+  if (eventHandler_ && !contextCreated_) {
     opaqueContext_ = eventHandler_->createContext(inputProtocol_, outputProtocol_);
   }
+  contextCreated_ = true;
+}
+
+bool TConnectedClient::isIdle() {
+  if (!parkable_) {
+    return false;
+  }
+  try {
+    return !socket_->hasPendingDataToRead();
+  } catch (const TException&) {
+    // e.g. a TLS handshake that has not happened yet; let the processor
+    // read the request and deal with any errors
+    return false;
+  }
+}
+
+THRIFT_SOCKET TConnectedClient::getSocketFD() const {
+  return parkable_ ? socket_->getSocketFD() : THRIFT_INVALID_SOCKET;
+}
 
-  for (bool done = false; !done;) {
-    if (eventHandler_) {
-      eventHandler_->processContext(opaqueContext_, client_);
+bool TConnectedClient::processRequest() {
+  if (eventHandler_) {
+    eventHandler_->processContext(opaqueContext_, client_);
+  }
+
+  bool done = false;
+  TConcurrencyLimiter::time_point start;
+  bool started = false;
+  try {
+    if (concurrencyLimiter_) {
+      if (!inputProtocol_->getTransport()->peek()) {
+        return false;
+      }
+      start = concurrencyLimiter_->waitAndStart();
+      started = true;
     }
+    bool more = processor_->process(inputProtocol_, outputProtocol_, opaqueContext_);
+    if (started) {
+      started = false;
+      concurrencyLimiter_->onComplete(start);
+    }
+    if (!more) {
+      return false;
+    }
+  } catch (const TTransportException& ttx) {
+    switch (ttx.getType()) {
+      case TTransportException::END_OF_FILE:
+      case TTransportException::INTERRUPTED:
+      case TTransportException::TIMED_OUT:
+        // Client disconnected or was interrupted or did not respond within the receive timeout.
+        // No logging needed.  Done.
+        done = true;
+        break;
 
-    try {
-      if (!processor_->process(inputProtocol_, outputProtocol_, opaqueContext_)) {
+      default: {
+        // All other transport exceptions are logged.
+        // State of connection is unknown.  Done.
+        string errStr = string("TConnectedClient died: ") + ttx.what();
+        GlobalOutput(errStr.c_str());
+        done = true;
         break;
       }
-    } catch (const TTransportException& ttx) {
-      switch (ttx.getType()) {
-        case TTransportException::END_OF_FILE:
-        case TTransportException::INTERRUPTED:
-        case TTransportException::TIMED_OUT:
-          // Client disconnected or was interrupted or did not respond within the receive timeout.
-          // No logging needed.  Done.
-          done = true;
-          break;
-
-        default: {
-          // All other transport exceptions are logged.
-          // State of connection is unknown.  Done.
-          string errStr = string("TConnectedClient died: ") + ttx.what();
-          GlobalOutput(errStr.c_str());
-          done = true;
-          break;
-        }
-      }
-    } catch (const TException& tex) {
-      string errStr = string("TConnectedClient processing exception: ") + tex.what();
-      GlobalOutput(errStr.c_str());
-      // Disconnect from client, because we could not process the message.
-      done = true;
     }
+  } catch (const TException& tex) {
+    string errStr = string("TConnectedClient processing exception: ") + tex.what();
+    GlobalOutput(errStr.c_str());
+    // Disconnect from client, because we could not process the message.
+    done = true;
   }
-
-  cleanup();
+  if (started) {
+    concurrencyLimiter_->onComplete(start, TConcurrencyLimiter::IGNORED);
+  }
+  return !done;
 }
 
 void TConnectedClient::cleanup() {
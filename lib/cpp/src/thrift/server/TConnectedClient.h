@@ -23,7 +23,9 @@
 #include <memory>
 #include <thrift/TProcessor.h>
 #include <thrift/protocol/TProtocol.h>
+#include <thrift/server/TConcurrencyLimiter.h>
 #include <thrift/server/TServer.h>
+#include <thrift/transport/TSocket.h>
 #include <thrift/transport/TTransport.h>
 
 namespace apache {
@@ -78,6 +80,48 @@ public:
    */
   void run() override /* override */;
 
+  /**
+   * Drive the client like run() does, but only while it has requests
+   * waiting, so that servers can hold idle clients without a thread and call
+   * runUntilIdle() again once the socket is readable (see TIdleClientPoller).
+   *
+   * Clients are only ever idle if the client transport is a TSocket that
+   * the protocol reads from directly or through framed transports (including
+   * THeaderTransport); other transports such as TBufferedTransport may have
+   * read ahead, so those clients are driven until they are done.  Once it
+   * has returned idle, the next call reads a request (or the end of the
+   * connection) before the client can be idle again, so it must only be made
+   * once the socket is readable.
+   *
+   * \returns true if the client is idle and waiting for its next request,
+   *          false if it is done and cleanup() has been called
+   */
+  bool runUntilIdle();
+
+  /**
+   * Cleanup after an idle client that will not be run again, e.g. because
+   * the server is stopping.
+   */
+  void abandon();
+
+  /**
+   * \returns the socket to wait on while the client is idle, or
+   *          THRIFT_INVALID_SOCKET if it is never idle
+   */
+  THRIFT_SOCKET getSocketFD() const;
+
+  /**
+   * Report the processing time of each request to a concurrency limiter.
+   * The client then waits for each request to arrive, and for the limiter to
+   * allow one more request in flight, before calling processor->process, so
+   * that only its processing is timed.  Must be called before run().
+   *
+   * @param[in] limiter  the limiter, or null for none
+   */
+  void setConcurrencyLimiter(const std::shared_ptr<TConcurrencyLimiter>& limiter) {
+    concurrencyLimiter_ = limiter;
+  }
+
 protected:
   /**
    * Cleanup after a client.  This happens if the client disconnects,
@@ -92,11 +136,33 @@ protected:
   virtual void cleanup();
 
 private:
+  /**
+   * Call eventHandler->createContext if that has not been done yet.
+   */
+  void createContext();
+
+  /**
+   * Process one request.
+   * \returns false if the client is done
+   */
+  bool processRequest();
+
+  /**
+   * \returns true if the client can be parked and no request data is waiting
+   */
+  bool isIdle();
+
   std::shared_ptr<apache::thrift::TProcessor> processor_;
   std::shared_ptr<apache::thrift::protocol::TProtocol> inputProtocol_;
   std::shared_ptr<apache::thrift::protocol::TProtocol> outputProtocol_;
   std::shared_ptr<apache::thrift::server::TServerEventHandler> eventHandler_;
   std::shared_ptr<apache::thrift::transport::TTransport> client_;
+  std::shared_ptr<apache::thrift::transport::TSocket> socket_;
+  bool parkable_;
+  /// runUntilIdle() returned the client idle
+  bool parked_;
+  bool contextCreated_;
+  std::shared_ptr<TConcurrencyLimiter> concurrencyLimiter_;
 
   /**
    * Context acquired from the eventHandler_ if one exists.
@@ -0,0 +1,237 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/server/TIdleClientPoller.h>
+
+#include <errno.h>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::ThreadFactory;
+using std::shared_ptr;
+
+class TIdleClientPoller::Loop : public Runnable {
+public:
+  explicit Loop(TIdleClientPoller* poller) : poller_(poller) {}
+
+  void run() override { poller_->loop(); }
+
+private:
+  TIdleClientPoller* poller_;
+};
+
+TIdleClientPoller::TIdleClientPoller(const Dispatcher& dispatcher)
+  : dispatcher_(dispatcher), running_(false), pollFd_(-1), wakeFd_(-1) {
+}
+
+TIdleClientPoller::~TIdleClientPoller() {
+  stop();
+}
+
+bool TIdleClientPoller::isSupported() {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef __linux__
+
+void TIdleClientPoller::start() {
+  Guard g(mutex_);
+  if (running_) {
+    return;
+  }
+
+  pollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  if (pollFd_ < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TIdleClientPoller::start() epoll_create1() ", errno_copy);
+    throw TException("TIdleClientPoller: could not create epoll instance");
+  }
+  wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = wakeFd_;
+  if (wakeFd_ < 0 || ::epoll_ctl(pollFd_, EPOLL_CTL_ADD, wakeFd_, &event) < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TIdleClientPoller::start() eventfd() ", errno_copy);
+    if (wakeFd_ >= 0) {
+      ::close(wakeFd_);
+      wakeFd_ = -1;
+    }
+    ::close(pollFd_);
+    pollFd_ = -1;
+    throw TException("TIdleClientPoller: could not create wakeup eventfd");
+  }
+
+  running_ = true;
+  thread_ = ThreadFactory(false).newThread(std::make_shared<Loop>(this));
+  thread_->start();
+}
+
+void TIdleClientPoller::stop() {
+  std::map<THRIFT_SOCKET, shared_ptr<TConnectedClient> > abandoned;
+  {
+    Guard g(mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    uint64_t one = 1;
+    if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+      GlobalOutput.perror("TIdleClientPoller::stop() write() ", errno);
+    }
+  }
+  thread_->join();
+  thread_.reset();
+
+  {
+    Guard g(mutex_);
+    abandoned.swap(parked_);
+    ::close(pollFd_);
+    ::close(wakeFd_);
+    pollFd_ = wakeFd_ = -1;
+  }
+  for (auto& client : abandoned) {
+    client.second->abandon();
+  }
+}
+
+bool TIdleClientPoller::park(const shared_ptr<TConnectedClient>& client) {
+  THRIFT_SOCKET fd = client->getSocketFD();
+  if (fd == THRIFT_INVALID_SOCKET) {
+    return false;
+  }
+
+  Guard g(mutex_);
+  if (!running_) {
+    return false;
+  }
+  parked_[fd] = client;
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  event.data.fd = fd;
+  if (::epoll_ctl(pollFd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TIdleClientPoller::park() epoll_ctl() ", errno_copy);
+    parked_.erase(fd);
+    return false;
+  }
+  return true;
+}
+
+shared_ptr<TConnectedClient> TIdleClientPoller::unpark(THRIFT_SOCKET fd) {
+  shared_ptr<TConnectedClient> client;
+  auto it = parked_.find(fd);
+  if (it != parked_.end()) {
+    client = it->second;
+    parked_.erase(it);
+    // Deregister while holding the mutex, so that the client cannot be
+    // parked again on the same descriptor in the meantime
+    ::epoll_ctl(pollFd_, EPOLL_CTL_DEL, fd, nullptr);
+  }
+  return client;
+}
+
+void TIdleClientPoller::loop() {
+  const int MAX_EVENTS = 64;
+  struct epoll_event events[MAX_EVENTS];
+  std::vector<shared_ptr<TConnectedClient> > ready;
+
+  for (;;) {
+    int count = ::epoll_wait(pollFd_, events, MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      GlobalOutput.perror("TIdleClientPoller::loop() epoll_wait() ", errno);
+      return;
+    }
+
+    {
+      Guard g(mutex_);
+      if (!running_) {
+        return;
+      }
+      for (int i = 0; i < count; ++i) {
+        if (events[i].data.fd != wakeFd_) {
+          shared_ptr<TConnectedClient> client = unpark(events[i].data.fd);
+          if (client) {
+            ready.push_back(client);
+          }
+        }
+      }
+    }
+
+    for (auto& client : ready) {
+      try {
+        dispatcher_(client);
+      } catch (const std::exception& x) {
+        GlobalOutput.printf("TIdleClientPoller: dispatch failed: %s", x.what());
+        client->abandon();
+      }
+    }
+    ready.clear();
+  }
+}
+
+#else
+
+void TIdleClientPoller::start() {
+  throw TException("TIdleClientPoller: not supported on this platform");
+}
+
+void TIdleClientPoller::stop() {
+}
+
+bool TIdleClientPoller::park(const shared_ptr<TConnectedClient>&) {
+  return false;
+}
+
+void TIdleClientPoller::loop() {
+}
+
+shared_ptr<TConnectedClient> TIdleClientPoller::unpark(THRIFT_SOCKET) {
+  return shared_ptr<TConnectedClient>();
+}
+
+#endif
+
+size_t TIdleClientPoller::getParkedCount() const {
+  Guard g(mutex_);
+  return parked_.size();
+}
+}
+}
+} // apache::thrift::server
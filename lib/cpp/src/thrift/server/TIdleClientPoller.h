@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TIDLECLIENTPOLLER_H_
+#define _THRIFT_SERVER_TIDLECLIENTPOLLER_H_ 1
+
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/server/TConnectedClient.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Holds idle clients without a thread until they send their next request.
+ *
+ * A server that runs clients with TConnectedClient::runUntilIdle() parks
+ * each client it returns idle with park().  The poller waits for the client
+ * sockets to become readable (with epoll, on a thread of its own) and then
+ * hands each client to the dispatcher, which should arrange for
+ * runUntilIdle() to be called again.  A client is parked until its socket is
+ * readable once; a closed connection counts as readable.
+ *
+ * Only supported on Linux; see isSupported().
+ */
+class TIdleClientPoller {
+public:
+  typedef std::function<void(const std::shared_ptr<TConnectedClient>&)> Dispatcher;
+
+  /**
+   * Constructor.
+   *
+   * @param dispatcher  called on the poller thread with each client that has
+   *                    become readable; if it throws, the client is abandoned
+   */
+  explicit TIdleClientPoller(const Dispatcher& dispatcher);
+
+  ~TIdleClientPoller();
+
+  /**
+   * @return true if this platform supports parking clients
+   */
+  static bool isSupported();
+
+  /**
+   * Starts the poller thread.
+   *
+   * @throws TException if the platform is not supported or the poller cannot
+   *         be set up
+   */
+  void start();
+
+  /**
+   * Stops the poller thread and abandons all clients still parked.  Clients
+   * parked after this are refused.
+   */
+  void stop();
+
+  /**
+   * Parks an idle client.
+   *
+   * @return false if the client cannot be parked (it has no socket, or the
+   *         poller is not running); the caller still owns it then
+   */
+  bool park(const std::shared_ptr<TConnectedClient>& client);
+
+  /**
+   * @return the number of clients parked
+   */
+  size_t getParkedCount() const;
+
+private:
+  class Loop;
+
+  void loop();
+
+  // Stops watching fd and returns the client parked on it, mutex_ must be held
+  std::shared_ptr<TConnectedClient> unpark(THRIFT_SOCKET fd);
+
+  Dispatcher dispatcher_;
+  mutable apache::thrift::concurrency::Mutex mutex_;
+  std::map<THRIFT_SOCKET, std::shared_ptr<TConnectedClient> > parked_;
+  bool running_;
+  int pollFd_;
+  int wakeFd_;
+  std::shared_ptr<apache::thrift::concurrency::Thread> thread_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TIDLECLIENTPOLLER_H_
@@ -23,10 +23,13 @@
 #include <thrift/concurrency/Exception.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/protocol/THeaderProtocol.h>
 #include <thrift/transport/PlatformSocket.h>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 #ifdef HAVE_POLL_H
 #include <poll.h>
@@ -59,6 +62,10 @@
 
 #include <assert.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #ifdef HAVE_SCHED_H
 #include <sched.h>
 #endif
@@ -86,16 +93,25 @@ using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransportException;
 using std::shared_ptr;
 
-/// Three states for sockets: recv frame size, recv data, and send mode
-enum TSocketState { SOCKET_RECV_FRAMING, SOCKET_RECV, SOCKET_SEND };
+/// States for sockets: recv frame size, recv data, send mode, waiting
+/// for the kernel to finish with a response sent with MSG_ZEROCOPY, and
+/// waiting for the peer during a handshake
+enum TSocketState {
+  SOCKET_RECV_FRAMING,
+  SOCKET_RECV,
+  SOCKET_SEND,
+  SOCKET_SEND_WAIT,
+  SOCKET_HANDSHAKE
+};
 
 /**
- * Five states for the nonblocking server:
+ * States for the nonblocking server:
  *  1) initialize
  *  2) read 4 byte frame size
  *  3) read frame of data
  *  4) send back data (if any)
  *  5) force immediate connection close
+ *  6) complete the handshake of a new connection on the handshake threads
  */
 enum TAppState {
   APP_INIT,
@@ -103,7 +119,16 @@ enum TAppState {
   APP_READ_REQUEST,
   APP_WAIT_TASK,
   APP_SEND_RESULT,
-  APP_CLOSE_CONNECTION
+  APP_CLOSE_CONNECTION,
+  APP_HANDSHAKE
+};
+
+/// Where a handshake task left the handshake of a connection
+enum THandshakeResult {
+  HANDSHAKE_DONE,
+  HANDSHAKE_WANT_READ,
+  HANDSHAKE_WANT_WRITE,
+  HANDSHAKE_FAILED
 };
 
 /**
@@ -118,6 +143,9 @@ private:
   /// Server handle
   TNonblockingServer* server_;
 
+  /// Pool this connection was taken from, which also counts it as processing
+  ConnectionPool* pool_;
+
   /// TProcessor
   std::shared_ptr<TProcessor> processor_;
 
@@ -148,7 +176,7 @@ private:
   /// Read buffer size
   uint32_t readBufferSize_;
 
-  /// Write buffer
+  /// Write buffer (with a chained output transport, just the frame size)
   uint8_t* writeBuffer_;
 
   /// Write buffer size
@@ -169,6 +197,9 @@ private:
   /// Transport that processor writes to
   std::shared_ptr<TMemoryBuffer> outputTransport_;
 
+  /// Transport that processor writes to if the server uses chained buffers
+  std::shared_ptr<TChainedBuffer> chainedOutputTransport_;
+
   /// extra transport generated by transport factory (e.g. BufferedRouterTransport)
   std::shared_ptr<TTransport> factoryInputTransport_;
   std::shared_ptr<TTransport> factoryOutputTransport_;
@@ -185,12 +216,49 @@ private:
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// Transport and protocol used to look up the method name of a request
+  std::shared_ptr<TMemoryBuffer> peekTransport_;
+  std::shared_ptr<TProtocol> peekProtocol_;
+
+  /// Set to peekProtocol_ if client timeouts are read from its headers
+  std::shared_ptr<THeaderProtocol> peekHeaderProtocol_;
+
+  /// Limiter told about the request being processed, if any
+  std::shared_ptr<TConcurrencyLimiter> limiter_;
+
+  /// When processing of the request started
+  TConcurrencyLimiter::time_point processStart_;
+
+  /// Set by the handshake task before it hands the connection back
+  THandshakeResult handshakeResult_;
+
+  /// Tells limiter_ how processing of the request ended
+  void endProcessing(TConcurrencyLimiter::Outcome outcome) {
+    if (limiter_) {
+      limiter_->onComplete(processStart_, outcome);
+      limiter_.reset();
+    }
+  }
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
   /// Go into write mode
   void setWrite() { setFlags(EV_WRITE | EV_PERSIST); }
 
+  /**
+   * Wait for the completions of zero-copy sends, which the kernel reports
+   * as an error condition and libevent as readability.  Edge triggered
+   * where supported, so that a pipelined request does not make us spin.
+   */
+  void setZeroCopyWait() {
+#ifdef EV_ET
+    setFlags(EV_READ | EV_PERSIST | EV_ET);
+#else
+    setFlags(EV_READ | EV_PERSIST);
+#endif
+  }
+
   /// Set socket idle
   void setIdle() { setFlags(0); }
 
@@ -209,8 +277,44 @@ private:
    */
   void workSocket();
 
+  /**
+   * Called once the response has been sent: moves on to the next request
+   * if the kernel is done with the buffers of any zero-copy sends, or else
+   * waits for it, since the response buffer is reused for the next one.
+   */
+  void waitForZeroCopy();
+
+  /**
+   * Hands the connection to a handshake thread, which takes the handshake
+   * of the socket as far as it can and then calls transition().
+   */
+  void startHandshake();
+
+  /**
+   * Empty the output transport before processing a request.
+   *
+   * @param reserveFrameSize whether to leave room for the frame size at the
+   *                         start of the response.
+   */
+  void resetOutputBuffer(bool reserveFrameSize);
+
+  /**
+   * Decide whether a request is processed on the IO thread, and if not, when
+   * its task expires.
+   *
+   * @param buf the request as handed to the input transport.
+   * @param len the request size.
+   * @param expiration set to the task expiry in milliseconds: the server's
+   *                   task expire time, or the client timeout sent in the
+   *                   header if that is shorter.  0 means never.
+   * @return true if the request calls an inline method and should be
+   *         processed on the IO thread.
+   */
+  bool routeRequest(uint8_t* buf, uint32_t len, int64_t& expiration);
+
 public:
   class Task;
+  class HandshakeTask;
 
   /// Constructor
   TConnection(std::shared_ptr<TSocket> socket,
@@ -224,8 +328,13 @@ public:
     // Allocate input and output transports these only need to be allocated
     // once per TConnection (they don't need to be reallocated on init() call)
     inputTransport_.reset(new TMemoryBuffer(readBuffer_, readBufferSize_));
-    outputTransport_.reset(
-        new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+    if (server_->getChainedWriteBuffer()) {
+      chainedOutputTransport_.reset(
+          new TChainedBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+    } else {
+      outputTransport_.reset(
+          new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+    }
 
     tSocket_ =  socket;
 
@@ -292,7 +401,7 @@ public:
   void forceClose() {
     appState_ = APP_CLOSE_CONNECTION;
     if (!notifyIOThread()) {
-      server_->decrementActiveProcessors();
+      pool_->decrementActiveProcessors();
       close();
       throw TException("TConnection::forceClose: failed write on notify pipe");
     }
@@ -354,7 +463,7 @@ public:
     // Signal completion back to the libevent thread via a pipe
     if (!connection_->notifyIOThread()) {
       GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
-      connection_->server_->decrementActiveProcessors();
+      connection_->pool_->decrementActiveProcessors();
       connection_->close();
       throw TException("TNonblockingServer::Task::run: failed write on notify pipe");
     }
@@ -371,9 +480,39 @@ private:
   void* connectionContext_;
 };
 
+class TNonblockingServer::TConnection::HandshakeTask : public Runnable {
+public:
+  explicit HandshakeTask(TConnection* connection) : connection_(connection) {}
+
+  void run() override {
+    THandshakeResult result;
+    try {
+      bool wantWrite = false;
+      if (connection_->getTSocket()->advanceHandshake(wantWrite)) {
+        result = HANDSHAKE_DONE;
+      } else {
+        result = wantWrite ? HANDSHAKE_WANT_WRITE : HANDSHAKE_WANT_READ;
+      }
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TNonblockingServer: handshake failed: %s", x.what());
+      result = HANDSHAKE_FAILED;
+    }
+    connection_->handshakeResult_ = result;
+
+    if (!connection_->notifyIOThread()) {
+      GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
+      connection_->close();
+    }
+  }
+
+private:
+  TConnection* connection_;
+};
+
 void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
   ioThread_ = ioThread;
   server_ = ioThread->getServer();
+  pool_ = server_->getConnectionPool(ioThread);
   appState_ = APP_INIT;
   eventFlags_ = 0;
 
@@ -390,7 +529,11 @@ void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
 
   // get input/transports
   factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
-  factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport_);
+  std::shared_ptr<TTransport> outputTransport = outputTransport_;
+  if (chainedOutputTransport_) {
+    outputTransport = chainedOutputTransport_;
+  }
+  factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport);
 
   // Create protocol
   if (server_->getHeaderTransport()) {
@@ -410,6 +553,23 @@ void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
     connectionContext_ = nullptr;
   }
 
+  // Requests are only looked at before dispatch if some methods bypass the
+  // ThreadManager or if the client timeout sets their expiration
+  bool clientTimeouts = server_->getClientTimeoutExpiration() && server_->getHeaderTransport();
+  if (server_->hasInlineMethods() || clientTimeouts) {
+    if (!peekTransport_) {
+      peekTransport_.reset(new TMemoryBuffer());
+    }
+    peekProtocol_ = server_->getInputProtocolFactory()->getProtocol(
+        server_->getInputTransportFactory()->getTransport(peekTransport_));
+  } else {
+    peekProtocol_.reset();
+  }
+  peekHeaderProtocol_.reset();
+  if (clientTimeouts) {
+    peekHeaderProtocol_ = std::dynamic_pointer_cast<THeaderProtocol>(peekProtocol_);
+  }
+
   // Get the processor
   processor_ = server_->getProcessor(inputProtocol_, outputProtocol_, tSocket_);
 }
@@ -540,8 +700,13 @@ void TNonblockingServer::TConnection::workSocket() {
     }
 
     try {
-      left = writeBufferSize_ - writeBufferPos_;
-      sent = tSocket_->write_partial(writeBuffer_ + writeBufferPos_, left);
+      if (chainedOutputTransport_) {
+        // Everything left in the chain is the rest of the response
+        sent = chainedOutputTransport_->writePartialTo(*tSocket_);
+      } else {
+        left = writeBufferSize_ - writeBufferPos_;
+        sent = tSocket_->write_partial(writeBuffer_ + writeBufferPos_, left);
+      }
     } catch (TTransportException& te) {
       GlobalOutput.printf("TConnection::workSocket(): %s ", te.what());
       close();
@@ -555,11 +720,20 @@ void TNonblockingServer::TConnection::workSocket() {
 
     // We are done!
     if (writeBufferPos_ == writeBufferSize_) {
-      transition();
+      waitForZeroCopy();
     }
 
     return;
 
+  case SOCKET_SEND_WAIT:
+    waitForZeroCopy();
+    return;
+
+  case SOCKET_HANDSHAKE:
+    // The peer has answered, carry on with the handshake
+    startHandshake();
+    return;
+
   default:
     GlobalOutput.printf("Unexpected Socket State %d", socketState_);
     assert(0);
@@ -573,6 +747,39 @@ bool TNonblockingServer::getHeaderTransport() {
   return getOutputProtocolFactory() == nullptr;
 }
 
+bool TNonblockingServer::TConnection::routeRequest(uint8_t* buf,
+                                                    uint32_t len,
+                                                    int64_t& expiration) {
+  expiration = server_->getTaskExpireTime();
+  if (!peekProtocol_) {
+    return false;
+  }
+
+  // Parse the message header from a separate view of the request, so that the
+  // input transport still hands the whole request to the processor
+  peekTransport_->resetBuffer(buf, len);
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  try {
+    peekProtocol_->readMessageBegin(name, type, seqid);
+  } catch (const TException&) {
+    // Leave malformed requests to the processor
+    return false;
+  }
+  if (server_->isInlineMethod(name)) {
+    return true;
+  }
+
+  if (peekHeaderProtocol_) {
+    int64_t clientTimeout = peekHeaderProtocol_->getClientTimeout();
+    if (clientTimeout > 0 && (expiration == 0 || clientTimeout < expiration)) {
+      expiration = clientTimeout;
+    }
+  }
+  return false;
+}
+
 /**
  * This is called when the application transitions from one state into
  * another. This means that it has finished writing the data that it needed
@@ -586,27 +793,36 @@ void TNonblockingServer::TConnection::transition() {
   // Switch upon the state that we are currently in and move to a new state
   switch (appState_) {
 
-  case APP_READ_REQUEST:
+  case APP_READ_REQUEST: {
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
+    uint8_t* request;
+    uint32_t requestSize;
     if (server_->getHeaderTransport()) {
-      inputTransport_->resetBuffer(readBuffer_, readBufferPos_);
-      outputTransport_->resetBuffer();
+      request = readBuffer_;
+      requestSize = readBufferPos_;
+      inputTransport_->resetBuffer(request, requestSize);
+      resetOutputBuffer(false);
     } else {
       // We saved room for the framing size in case header transport needed it,
       // but just skip it for the non-header case
-      inputTransport_->resetBuffer(readBuffer_ + 4, readBufferPos_ - 4);
-      outputTransport_->resetBuffer();
+      request = readBuffer_ + 4;
+      requestSize = readBufferPos_ - 4;
+      inputTransport_->resetBuffer(request, requestSize);
 
       // Prepend four bytes of blank space to the buffer so we can
       // write the frame size there later.
-      outputTransport_->getWritePtr(4);
-      outputTransport_->wroteBytes(4);
+      resetOutputBuffer(true);
     }
 
-    server_->incrementActiveProcessors();
+    pool_->incrementActiveProcessors();
+    limiter_ = server_->getConcurrencyLimiter();
+    if (limiter_) {
+      processStart_ = limiter_->onStart();
+    }
 
-    if (server_->isThreadPoolProcessing()) {
+    int64_t expiration;
+    if (server_->isThreadPoolProcessing() && !routeRequest(request, requestSize, expiration)) {
       // We are setting up a Task to do this work and we will wait on it
 
       // Create task and dispatch to the thread manager
@@ -621,15 +837,15 @@ void TNonblockingServer::TConnection::transition() {
       setIdle();
 
       try {
-        server_->addTask(task);
+        ioThread_->addTask(task, expiration);
       } catch (IllegalStateException& ise) {
         // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
         GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
-        server_->decrementActiveProcessors();
+        pool_->decrementActiveProcessors();
         close();
       } catch (TimedOutException& to) {
         GlobalOutput.printf("[ERROR] TimedOutException: Server::process() %s", to.what());
-        server_->decrementActiveProcessors();
+        pool_->decrementActiveProcessors();
         close();
       }
 
@@ -646,23 +862,24 @@ void TNonblockingServer::TConnection::transition() {
             "TNonblockingServer transport error in "
             "process(): %s",
             ttx.what());
-        server_->decrementActiveProcessors();
+        pool_->decrementActiveProcessors();
         close();
         return;
       } catch (const std::exception& x) {
         GlobalOutput.printf("Server::process() uncaught exception: %s: %s",
                             typeid(x).name(),
                             x.what());
-        server_->decrementActiveProcessors();
+        pool_->decrementActiveProcessors();
         close();
         return;
       } catch (...) {
         GlobalOutput.printf("Server::process() unknown exception");
-        server_->decrementActiveProcessors();
+        pool_->decrementActiveProcessors();
         close();
         return;
       }
     }
+  }
     // fallthrough
 
   // Intentionally fall through here, the call to process has written into
@@ -673,9 +890,14 @@ void TNonblockingServer::TConnection::transition() {
     // into the outputTransport_, so we grab its contents and place them into
     // the writeBuffer_ for actual writing by the libevent thread
 
-    server_->decrementActiveProcessors();
+    pool_->decrementActiveProcessors();
+    endProcessing(TConcurrencyLimiter::SUCCESS);
     // Get the result of the operation
-    outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
+    if (chainedOutputTransport_) {
+      writeBufferSize_ = chainedOutputTransport_->available_read();
+    } else {
+      outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
+    }
 
     // If the function call generated return data, then move into the send
     // state and get going
@@ -686,9 +908,12 @@ void TNonblockingServer::TConnection::transition() {
       writeBufferPos_ = 0;
       socketState_ = SOCKET_SEND;
 
-      // Put the frame size into the write buffer
-      auto frameSize = (int32_t)htonl(writeBufferSize_ - 4);
-      memcpy(writeBuffer_, &frameSize, 4);
+      // Put the frame size into the write buffer (the header transport has
+      // already framed a chained response)
+      if (writeBuffer_ != nullptr) {
+        auto frameSize = (int32_t)htonl(writeBufferSize_ - 4);
+        memcpy(writeBuffer_, &frameSize, 4);
+      }
 
       // Socket into write mode
       appState_ = APP_SEND_RESULT;
@@ -719,6 +944,15 @@ void TNonblockingServer::TConnection::transition() {
   LABEL_APP_INIT:
   case APP_INIT:
 
+    // Complete the handshake of a new connection on the handshake threads
+    // before reading its first request
+    if (server_->getHandshakeThreadManager() && tSocket_->isHandshakePending()) {
+      appState_ = APP_HANDSHAKE;
+      socketState_ = SOCKET_HANDSHAKE;
+      startHandshake();
+      return;
+    }
+
     // Clear write buffer variables
     writeBuffer_ = nullptr;
     writeBufferPos_ = 0;
@@ -768,10 +1002,28 @@ void TNonblockingServer::TConnection::transition() {
     return;
 
   case APP_CLOSE_CONNECTION:
-    server_->decrementActiveProcessors();
+    pool_->decrementActiveProcessors();
+    // The task was drained on overload
+    endProcessing(TConcurrencyLimiter::DROPPED);
     close();
     return;
 
+  case APP_HANDSHAKE:
+    // A handshake task handed the connection back
+    switch (handshakeResult_) {
+    case HANDSHAKE_DONE:
+      goto LABEL_APP_INIT;
+    case HANDSHAKE_WANT_READ:
+      setRead();
+      return;
+    case HANDSHAKE_WANT_WRITE:
+      setWrite();
+      return;
+    default:
+      close();
+      return;
+    }
+
   default:
     GlobalOutput.printf("Unexpected Application State %d", appState_);
     assert(0);
@@ -834,11 +1086,58 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   }
 }
 
+void TNonblockingServer::TConnection::waitForZeroCopy() {
+  try {
+    if (tSocket_->getZeroCopyPending() > 0) {
+      if (socketState_ != SOCKET_SEND_WAIT) {
+        socketState_ = SOCKET_SEND_WAIT;
+        setZeroCopyWait();
+      }
+      return;
+    }
+  } catch (TTransportException& te) {
+    GlobalOutput.printf("TConnection::waitForZeroCopy(): %s ", te.what());
+    close();
+    return;
+  }
+  transition();
+}
+
+void TNonblockingServer::TConnection::startHandshake() {
+  // Leave the socket alone while the task has it
+  setIdle();
+  try {
+    server_->getHandshakeThreadManager()->add(std::make_shared<HandshakeTask>(this));
+  } catch (const TException& te) {
+    GlobalOutput.printf("TNonblockingServer: could not start handshake: %s", te.what());
+    close();
+  }
+}
+
+void TNonblockingServer::TConnection::resetOutputBuffer(bool reserveFrameSize) {
+  if (chainedOutputTransport_) {
+    chainedOutputTransport_->resetBuffer();
+    writeBuffer_ = nullptr;
+    if (reserveFrameSize) {
+      // Segments never move, so the frame size can be filled in in place
+      writeBuffer_ = chainedOutputTransport_->getWritePtr(4);
+      chainedOutputTransport_->wroteBytes(4);
+    }
+  } else {
+    outputTransport_->resetBuffer();
+    if (reserveFrameSize) {
+      outputTransport_->getWritePtr(4);
+      outputTransport_->wroteBytes(4);
+    }
+  }
+}
+
 /**
  * Closes a connection
  */
 void TNonblockingServer::TConnection::close() {
   setIdle();
+  endProcessing(TConcurrencyLimiter::IGNORED);
 
   if (serverEventHandler_) {
     serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
@@ -856,7 +1155,7 @@ void TNonblockingServer::TConnection::close() {
   processor_.reset();
 
   // Give this object back to the server that owns it
-  server_->returnConnection(this);
+  server_->returnConnection(this, pool_);
 }
 
 void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit, size_t writeLimit) {
@@ -868,21 +1167,20 @@ void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit,
 
   if (writeLimit > 0 && largestWriteBufferSize_ > writeLimit) {
     // just start over
-    outputTransport_->resetBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+    if (chainedOutputTransport_) {
+      chainedOutputTransport_->resetBuffer();
+      chainedOutputTransport_->releaseSpareSegments();
+    } else {
+      outputTransport_->resetBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+    }
     largestWriteBufferSize_ = 0;
   }
 }
 
 TNonblockingServer::~TNonblockingServer() {
-  // Close any active connections (moves them to the idle connection stack)
-  while (activeConnections_.size()) {
-    activeConnections_.front()->close();
-  }
-  // Clean up unused TConnection objects in connectionStack_
-  while (!connectionStack_.empty()) {
-    TConnection* connection = connectionStack_.top();
-    connectionStack_.pop();
-    delete connection;
+  clearConnectionPool(connectionPool_);
+  for (auto& ioThread : ioThreads_) {
+    clearConnectionPool(ioThread->connectionPool_);
   }
   // The TNonblockingIOThread objects have shared_ptrs to the Thread
   // objects and the Thread objects have shared_ptrs to the TNonblockingIOThread
@@ -894,53 +1192,86 @@ TNonblockingServer::~TNonblockingServer() {
   }
 }
 
+/**
+ * Closes the active connections of a pool (which moves them to its idle
+ * connection stack) and deletes the idle ones
+ */
+void TNonblockingServer::clearConnectionPool(ConnectionPool& pool) {
+  while (pool.active.size()) {
+    pool.active.front()->close();
+  }
+  while (!pool.stack.empty()) {
+    TConnection* connection = pool.stack.top();
+    pool.stack.pop();
+    delete connection;
+  }
+  pool.numIdleConnections = 0;
+}
+
+TNonblockingServer::ConnectionPool* TNonblockingServer::getConnectionPool(
+    TNonblockingIOThread* ioThread) {
+  return threadPerCore_ ? &ioThread->connectionPool_ : &connectionPool_;
+}
+
+size_t TNonblockingServer::sumConnectionPools(std::atomic<size_t> ConnectionPool::*counter) const {
+  size_t sum = (connectionPool_.*counter).load(std::memory_order_relaxed);
+  if (threadPerCore_) {
+    for (const auto& ioThread : ioThreads_) {
+      sum += (ioThread->connectionPool_.*counter).load(std::memory_order_relaxed);
+    }
+  }
+  return sum;
+}
+
 /**
  * Creates a new connection either by reusing an object off the stack or
  * by allocating a new one entirely
  */
-TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket) {
-  // Check the stack
-  Guard g(connMutex_);
-
-  // pick an IO thread to handle this connection -- currently round robin
-  assert(nextIOThread_ < ioThreads_.size());
-  int selectedThreadIdx = nextIOThread_;
-  nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket,
+                                                                      TNonblockingIOThread* acceptor) {
+  TNonblockingIOThread* ioThread = acceptor;
+  if (!threadPerCore_) {
+    // pick an IO thread to handle this connection -- currently round robin
+    uint32_t selectedThreadIdx = nextIOThread_++ % static_cast<uint32_t>(ioThreads_.size());
+    ioThread = ioThreads_[selectedThreadIdx].get();
+  }
+  ConnectionPool* pool = getConnectionPool(ioThread);
 
-  TNonblockingIOThread* ioThread = ioThreads_[selectedThreadIdx].get();
+  // Check the stack
+  Guard g(pool->mutex);
 
   // Check the connection stack to see if we can re-use
   TConnection* result = nullptr;
-  if (connectionStack_.empty()) {
+  if (pool->stack.empty()) {
     result = new TConnection(socket, ioThread);
-    ++numTConnections_;
+    ++pool->numTConnections;
   } else {
-    result = connectionStack_.top();
-    connectionStack_.pop();
+    result = pool->stack.top();
+    pool->stack.pop();
+    --pool->numIdleConnections;
     result->setSocket(socket);
     result->init(ioThread);
   }
-  activeConnections_.push_back(result);
+  pool->active.push_back(result);
   return result;
 }
 
 /**
  * Returns a connection to the stack
  */
-void TNonblockingServer::returnConnection(TConnection* connection) {
-  Guard g(connMutex_);
+void TNonblockingServer::returnConnection(TConnection* connection, ConnectionPool* pool) {
+  Guard g(pool->mutex);
 
-  activeConnections_.erase(std::remove(activeConnections_.begin(),
-                                       activeConnections_.end(),
-                                       connection),
-                           activeConnections_.end());
+  pool->active.erase(std::remove(pool->active.begin(), pool->active.end(), connection),
+                     pool->active.end());
 
-  if (connectionStackLimit_ && (connectionStack_.size() >= connectionStackLimit_)) {
+  if (connectionStackLimit_ && (pool->stack.size() >= connectionStackLimit_)) {
     delete connection;
-    --numTConnections_;
+    --pool->numTConnections;
   } else {
     connection->checkIdleBufferMemLimit(idleReadBufferLimit_, idleWriteBufferLimit_);
-    connectionStack_.push(connection);
+    pool->stack.push(connection);
+    ++pool->numIdleConnections;
   }
 }
 
@@ -948,16 +1279,33 @@ void TNonblockingServer::returnConnection(TConnection* connection) {
  * Server socket had something happen.  We accept all waiting client
  * connections on fd and assign TConnection objects to handle those requests.
  */
-void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
+void TNonblockingServer::handleEvent(TNonblockingIOThread* ioThread, THRIFT_SOCKET fd, short which) {
   (void)which;
+  const shared_ptr<TNonblockingServerTransport>& listenTransport = ioThread->getListenTransport();
   // Make sure that libevent didn't mess up the socket handles
-  assert(fd == serverSocket_);
+  assert(fd == listenTransport->getSocketFD());
+  (void)fd;
+
+  // Accept the new client sockets waiting, a batch at a time so that a
+  // connection storm does not starve the connections we already have
+  for (const std::shared_ptr<TSocket>& clientSocket :
+       listenTransport->acceptBatch(ACCEPT_BATCH_SIZE)) {
+#ifdef SO_BUSY_POLL
+    if (socketBusyPollUs_ > 0) {
+      int busyPollUs = socketBusyPollUs_;
+      if (-1 == setsockopt(clientSocket->getSocketFD(), SOL_SOCKET, SO_BUSY_POLL,
+                           const_cast_sockopt(&busyPollUs), sizeof(busyPollUs))
+          && !socketBusyPollFailed_.exchange(true)) {
+        GlobalOutput.perror("TNonblockingServer: setsockopt(SO_BUSY_POLL) ",
+                            THRIFT_GET_SOCKET_ERROR);
+      }
+    }
+#endif
 
-  // Going to accept a new client socket
-  std::shared_ptr<TSocket> clientSocket;
+    if (zeroCopyThreshold_ > 0) {
+      clientSocket->setZeroCopyThreshold(zeroCopyThreshold_);
+    }
 
-  clientSocket = serverTransport_->accept();
-  if (clientSocket) {
     // If we're overloaded, take action here
     if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
       Guard g(connMutex_);
@@ -965,24 +1313,25 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
       nTotalConnectionsDropped_++;
       if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
         clientSocket->close();
-        return;
+        continue;
       } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
-        if (!drainPendingTask()) {
+        const shared_ptr<ThreadManager>& threadManager = ioThread->getThreadManager();
+        if (!drainPendingTask(threadManager ? threadManager : threadManager_)) {
           // Nothing left to discard, so we drop connection instead.
           clientSocket->close();
-          return;
+          continue;
         }
       }
     }
 
     // Create a new TConnection for this client socket.
-    TConnection* clientConnection = createConnection(clientSocket);
+    TConnection* clientConnection = createConnection(clientSocket, ioThread);
 
     // Fail fast if we could not create a TConnection object
     if (clientConnection == nullptr) {
       GlobalOutput.printf("thriftServerEventHandler: failed TConnection factory");
       clientSocket->close();
-      return;
+      continue;
     }
 
     /*
@@ -995,9 +1344,10 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
      *
      * The IO thread #0 is the only one that handles these listen
      * events, so unless the connection has been assigned to thread #0
-     * we know it's not on our thread.
+     * we know it's not on our thread.  In thread-per-core mode every IO
+     * thread listens and keeps what it accepts.
      */
-    if (clientConnection->getIOThreadNumber() == 0) {
+    if (clientConnection->getIOThreadNumber() == ioThread->getThreadNumber()) {
       clientConnection->transition();
     } else {
       if (!clientConnection->notifyIOThread()) {
@@ -1024,21 +1374,23 @@ void TNonblockingServer::setThreadManager(std::shared_ptr<ThreadManager> threadM
         std::bind(&TNonblockingServer::expireClose,
                                      this,
                                      std::placeholders::_1));
-    threadPoolProcessing_ = true;
-  } else {
-    threadPoolProcessing_ = false;
   }
+  threadPoolProcessing_ = threadManager || ioThreadWorkers_ > 0;
 }
 
 bool TNonblockingServer::serverOverloaded() {
-  size_t activeConnections = numTConnections_ - connectionStack_.size();
-  if (numActiveProcessors_ > maxActiveProcessors_ || activeConnections > maxConnections_) {
+  size_t activeConnections = getNumActiveConnections();
+  size_t numActiveProcessors = getNumActiveProcessors();
+  size_t maxActiveProcessors = getActiveProcessorLimit();
+  // Every IO thread accepts in thread-per-core mode
+  Guard g(connMutex_);
+  if (numActiveProcessors > maxActiveProcessors || activeConnections > maxConnections_) {
     if (!overloaded_) {
       GlobalOutput.printf("TNonblockingServer: overload condition begun.");
       overloaded_ = true;
     }
   } else {
-    if (overloaded_ && (numActiveProcessors_ <= overloadHysteresis_ * maxActiveProcessors_)
+    if (overloaded_ && (numActiveProcessors <= overloadHysteresis_ * maxActiveProcessors)
         && (activeConnections <= overloadHysteresis_ * maxConnections_)) {
       GlobalOutput.printf(
           "TNonblockingServer: overload ended; "
@@ -1053,9 +1405,9 @@ bool TNonblockingServer::serverOverloaded() {
   return overloaded_;
 }
 
-bool TNonblockingServer::drainPendingTask() {
-  if (threadManager_) {
-    std::shared_ptr<Runnable> task = threadManager_->removeNextPending();
+bool TNonblockingServer::drainPendingTask(const shared_ptr<ThreadManager>& threadManager) {
+  if (threadManager) {
+    std::shared_ptr<Runnable> task = threadManager->removeNextPending();
     if (task) {
       TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
       assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
@@ -1088,21 +1440,69 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
 
   // set up the IO threads
   assert(ioThreads_.empty());
+  if (!numIOThreads_ && threadPerCore_) {
+    numIOThreads_ = (std::max)(std::thread::hardware_concurrency(), 1u);
+  }
   if (!numIOThreads_) {
     numIOThreads_ = DEFAULT_IO_THREADS;
   }
   // User-provided event-base doesn't works for multi-threaded servers
   assert(numIOThreads_ == 1 || !userEventBase_);
 
-  for (uint32_t id = 0; id < numIOThreads_; ++id) {
-    // the first IO thread also does the listening on server socket
-    THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+  std::vector<int> cpus;
+  if (threadPerCore_) {
+    cpus = ThreadFactory::getAvailableCpus();
+  }
 
+  for (uint32_t id = 0; id < numIOThreads_; ++id) {
     shared_ptr<TNonblockingIOThread> thread(
-        new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
+        new TNonblockingIOThread(this, id, THRIFT_INVALID_SOCKET, useHighPriorityIOThreads_));
+
+    // In thread-per-core mode each IO thread gets a CPU, and its workers the
+    // CPUs of the same NUMA node
+    shared_ptr<ThreadFactory> workerFactory = std::make_shared<ThreadFactory>();
+    if (!cpus.empty()) {
+      int cpu = cpus[id % cpus.size()];
+      thread->placement_ = std::make_shared<ThreadFactory>();
+      thread->placement_->setCpuSet(std::vector<int>(1, cpu));
+      thread->placement_->setLocalMemory(true);
+
+      int node = ThreadFactory::getNumaNodeOfCpu(cpu);
+      if (node >= 0) {
+        workerFactory->setNumaNode(node);
+      }
+      workerFactory->setLocalMemory(true);
+    }
+    if (ioThreadWorkers_ > 0) {
+      thread->threadManager_ = ThreadManager::newSimpleThreadManager(ioThreadWorkers_);
+      thread->threadManager_->threadFactory(workerFactory);
+      thread->threadManager_->setExpireCallback(
+          std::bind(&TNonblockingServer::expireClose, this, std::placeholders::_1));
+      thread->threadManager_->start();
+    }
+
+    // the first IO thread also does the listening on server socket, and in
+    // thread-per-core mode the others listen on peers of it
+    if (id == 0) {
+      thread->setListenTransport(serverTransport_);
+    } else if (threadPerCore_) {
+      shared_ptr<TNonblockingServerTransport> peer = serverTransport_->createPeerListener();
+      if (!peer) {
+        throw TException(
+            "TNonblockingServer: thread-per-core mode needs a server transport that can "
+            "create peer listeners, e.g. a TNonblockingServerSocket with setReusePort(true)");
+      }
+      thread->setListenTransport(peer);
+    }
     ioThreads_.push_back(thread);
   }
 
+  if (handshakeThreads_ > 0) {
+    handshakeThreadManager_ = ThreadManager::newSimpleThreadManager(handshakeThreads_);
+    handshakeThreadManager_->threadFactory(std::make_shared<ThreadFactory>());
+    handshakeThreadManager_->start();
+  }
+
   // Notify handler of the preServe event
   if (eventHandler_) {
     eventHandler_->preServe();
@@ -1154,6 +1554,14 @@ void TNonblockingServer::serve() {
     ioThreads_[i]->join();
     GlobalOutput.printf("TNonblocking: join done for IO thread #%d", i);
   }
+  for (auto& ioThread : ioThreads_) {
+    if (ioThread->threadManager_) {
+      ioThread->threadManager_->stop();
+    }
+  }
+  if (handshakeThreadManager_) {
+    handshakeThreadManager_->stop();
+  }
 }
 
 TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
@@ -1168,7 +1576,9 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
     eventBase_(nullptr),
     ownEventBase_(false),
     serverEvent_{},
-    notificationEvent_{} {
+    notificationEvent_{},
+    doorbellArmed_(true),
+    loopBroken_(false) {
   notificationPipeFDs_[0] = -1;
   notificationPipeFDs_[1] = -1;
 }
@@ -1177,18 +1587,29 @@ TNonblockingIOThread::~TNonblockingIOThread() {
   // make sure our associated thread is fully finished
   join();
 
+  if (threadManager_) {
+    threadManager_->stop();
+  }
+
   if (eventBase_ && ownEventBase_) {
     event_base_free(eventBase_);
     ownEventBase_ = false;
   }
 
-  if (listenSocket_ != THRIFT_INVALID_SOCKET) {
+  if (listenTransport_) {
+    listenTransport_->close();
+    listenSocket_ = THRIFT_INVALID_SOCKET;
+  } else if (listenSocket_ != THRIFT_INVALID_SOCKET) {
     if (0 != ::THRIFT_CLOSESOCKET(listenSocket_)) {
       GlobalOutput.perror("TNonblockingIOThread listenSocket_ close(): ", THRIFT_GET_SOCKET_ERROR);
     }
     listenSocket_ = THRIFT_INVALID_SOCKET;
   }
 
+  if (notificationPipeFDs_[1] == notificationPipeFDs_[0]) {
+    // an eventfd, see createNotificationPipe()
+    notificationPipeFDs_[1] = THRIFT_INVALID_SOCKET;
+  }
   for (auto notificationPipeFD : notificationPipeFDs_) {
     if (notificationPipeFD >= 0) {
       if (0 != ::THRIFT_CLOSESOCKET(notificationPipeFD)) {
@@ -1201,6 +1622,15 @@ TNonblockingIOThread::~TNonblockingIOThread() {
 }
 
 void TNonblockingIOThread::createNotificationPipe() {
+#ifdef __linux__
+  // An eventfd is both ends of the doorbell
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    GlobalOutput.perror("TNonblockingServer::createNotificationPipe eventfd() ", errno);
+    throw TException("can't create notification eventfd");
+  }
+  notificationPipeFDs_[0] = notificationPipeFDs_[1] = fd;
+#else
   if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, notificationPipeFDs_) == -1) {
     GlobalOutput.perror("TNonblockingServer::createNotificationPipe ", EVUTIL_SOCKET_ERROR());
     throw TException("can't create notification pipe");
@@ -1226,6 +1656,7 @@ void TNonblockingIOThread::createNotificationPipe() {
           "FD_CLOEXEC");
     }
   }
+#endif
 }
 
 /**
@@ -1254,7 +1685,7 @@ void TNonblockingIOThread::registerEvents() {
               listenSocket_,
               EV_READ | EV_PERSIST,
               TNonblockingIOThread::listenHandler,
-              server_);
+              this);
     event_base_set(eventBase_, &serverEvent_);
 
     // Add the event and start up the server
@@ -1287,85 +1718,24 @@ void TNonblockingIOThread::registerEvents() {
   GlobalOutput.printf("TNonblocking: IO thread #%d registered for notify.", number_);
 }
 
-bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
-  auto fd = getNotificationSendFD();
-  if (fd < 0) {
-    return false;
-  }
-
-  int ret = -1;
-  long kSize = sizeof(conn);
-  const char * pos = (const char *)const_cast_sockopt(&conn);
-
-#if defined(HAVE_POLL_H) || defined(HAVE_SYS_POLL_H)
-  struct pollfd pfd = {fd, POLLOUT, 0};
-
-  while (kSize > 0) {
-    pfd.revents = 0;
-    ret = poll(&pfd, 1, -1);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
-    }
-
-    if (pfd.revents & POLLHUP || pfd.revents & POLLERR) {
-      ::THRIFT_CLOSESOCKET(fd);
-      return false;
-    }
-
-    if (pfd.revents & POLLOUT) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
-
-        ::THRIFT_CLOSESOCKET(fd);
-        return false;
-      }
-
-      kSize -= ret;
-      pos += ret;
-    }
+void TNonblockingIOThread::addTask(std::shared_ptr<Runnable> task, int64_t expiration) {
+  if (threadManager_) {
+    threadManager_->add(task, 0LL, expiration);
+  } else {
+    server_->addTask(task, expiration);
   }
-#else
-  fd_set wfds, efds;
-
-  while (kSize > 0) {
-    FD_ZERO(&wfds);
-    FD_ZERO(&efds);
-    FD_SET(fd, &wfds);
-    FD_SET(fd, &efds);
-    ret = select(static_cast<int>(fd + 1), NULL, &wfds, &efds, NULL);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
-    }
-
-    if (FD_ISSET(fd, &efds)) {
-      ::THRIFT_CLOSESOCKET(fd);
-      return false;
-    }
-
-    if (FD_ISSET(fd, &wfds)) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
-
-        ::THRIFT_CLOSESOCKET(fd);
-        return false;
-      }
+}
 
-      kSize -= ret;
-      pos += ret;
-    }
+bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
+  completions_.push(conn);
+  // Pairs with the fence in armDoorbell(): either the IO thread finds conn
+  // after arming the doorbell, or we find the doorbell armed.  Only the
+  // first completion after the queue was drained rings it.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (doorbellArmed_.load(std::memory_order_relaxed)
+      && doorbellArmed_.exchange(false, std::memory_order_acq_rel)) {
+    return ringDoorbell();
   }
-#endif
-
   return true;
 }
 
@@ -1375,37 +1745,33 @@ void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void*
   assert(ioThread);
   (void)which;
 
-  while (true) {
-    TNonblockingServer::TConnection* connection = nullptr;
-    const int kSize = sizeof(connection);
-    long nBytes = recv(fd, cast_sockopt(&connection), kSize, 0);
-    if (nBytes == kSize) {
-      if (connection == nullptr) {
-        // this is the command to stop our thread, exit the handler!
-        ioThread->breakLoop(false);
-        return;
-      }
-      connection->transition();
-    } else if (nBytes > 0) {
-      // throw away these bytes and hope that next time we get a solid read
-      GlobalOutput.printf("notifyHandler: Bad read of %d bytes, wanted %d", nBytes, kSize);
-      ioThread->breakLoop(true);
-      return;
-    } else if (nBytes == 0) {
-      GlobalOutput.printf("notifyHandler: Notify socket closed!");
-      ioThread->breakLoop(false);
-      // exit the loop
-      break;
-    } else { // nBytes < 0
-      if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
-          && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
-        GlobalOutput.perror("TNonblocking: notifyHandler read() failed: ", THRIFT_GET_SOCKET_ERROR);
-        ioThread->breakLoop(true);
-        return;
-      }
-      // exit the loop
-      break;
-    }
+  // Reset the doorbell, the connections are in completions_
+#ifdef __linux__
+  uint64_t count;
+  long nBytes = ::read(fd, &count, sizeof(count));
+#else
+  char buf[64];
+  long nBytes;
+  while ((nBytes = recv(fd, buf, sizeof(buf), 0)) > 0) {
+  }
+#endif
+  if (nBytes == 0) {
+    GlobalOutput.printf("notifyHandler: Notify socket closed!");
+    ioThread->breakLoop(false);
+    return;
+  }
+  if (nBytes < 0 && THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
+      && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
+    GlobalOutput.perror("TNonblocking: notifyHandler read() failed: ", THRIFT_GET_SOCKET_ERROR);
+    ioThread->breakLoop(true);
+    return;
+  }
+
+  if (ioThread->drainCompletions(COMPLETION_BATCH_SIZE) == COMPLETION_BATCH_SIZE) {
+    // Let the other events of the loop have a turn before the next batch
+    ioThread->ringDoorbell();
+  } else if (!ioThread->loopBroken_) {
+    ioThread->armDoorbell();
   }
 }
 
@@ -1426,10 +1792,90 @@ void TNonblockingIOThread::breakLoop(bool error) {
     notify(nullptr);
   } else {
     // cause the loop to stop ASAP - even if it has things to do in it
+    loopBroken_ = true;
     event_base_loopbreak(eventBase_);
   }
 }
 
+bool TNonblockingIOThread::ringDoorbell() {
+  auto fd = getNotificationSendFD();
+  if (fd < 0) {
+    return false;
+  }
+  // A doorbell that cannot take more has already been rung
+#ifdef __linux__
+  uint64_t one = 1;
+  if (::write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    return false;
+  }
+#else
+  char c = 0;
+  if (send(fd, &c, 1, 0) < 0 && THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
+      && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+void TNonblockingIOThread::armDoorbell() {
+  doorbellArmed_.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  // Something queued before the doorbell was armed would not ring it
+  if (!completions_.empty() && doorbellArmed_.exchange(false, std::memory_order_acq_rel)) {
+    ringDoorbell();
+  }
+}
+
+size_t TNonblockingIOThread::drainCompletions(size_t limit) {
+  size_t count = 0;
+  TNonblockingServer::TConnection* connection = nullptr;
+  while (count < limit && !loopBroken_ && completions_.pop(connection)) {
+    ++count;
+    if (connection == nullptr) {
+      // this is the command to stop our thread
+      breakLoop(false);
+      break;
+    }
+    connection->transition();
+  }
+  return count;
+}
+
+void TNonblockingIOThread::runBusyPoll() {
+  const std::chrono::microseconds budget(server_->getBusyPollSpinUs());
+
+  while (!loopBroken_) {
+    // Poll until nothing has been found for the whole budget; while we poll
+    // completions need not ring the doorbell
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    while (!loopBroken_) {
+      doorbellArmed_.store(false, std::memory_order_relaxed);
+      if (drainCompletions(COMPLETION_BATCH_SIZE) > 0) {
+        deadline = std::chrono::steady_clock::now() + budget;
+      }
+      if (loopBroken_ || event_base_loop(eventBase_, EVLOOP_NONBLOCK) < 0
+          || event_base_got_break(eventBase_)) {
+        loopBroken_ = true;
+        break;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        break;
+      }
+    }
+    if (loopBroken_) {
+      break;
+    }
+
+    // Sleep until the doorbell rings, or anything else happens
+    armDoorbell();
+    if (event_base_loop(eventBase_, EVLOOP_ONCE) < 0 || event_base_got_break(eventBase_)) {
+      loopBroken_ = true;
+    }
+  }
+  doorbellArmed_.store(true, std::memory_order_relaxed);
+}
+
 void TNonblockingIOThread::setCurrentThreadHighPriority(bool value) {
 #ifdef HAVE_SCHED_H
   // Start out with a standard, low-priority setup for the sched params.
@@ -1466,12 +1912,20 @@ void TNonblockingIOThread::run() {
   if (useHighPriority_) {
     setCurrentThreadHighPriority(true);
   }
+  if (placement_) {
+    placement_->configureCurrentThread();
+  }
 
   if (eventBase_ != nullptr)
   {
     GlobalOutput.printf("TNonblockingServer: IO thread #%d entering loop...", number_);
     // Run libevent engine, never returns, invokes calls to eventHandler
-    event_base_loop(eventBase_, 0);
+    loopBroken_ = false;
+    if (server_->getBusyPollSpinUs() > 0) {
+      runBusyPoll();
+    } else {
+      event_base_loop(eventBase_, 0);
+    }
 
     if (useHighPriority_) {
       setCurrentThreadHighPriority(false);
@@ -21,10 +21,13 @@
 #define _THRIFT_SERVER_TNONBLOCKINGSERVER_H_ 1
 
 #include <thrift/Thrift.h>
+#include <atomic>
 #include <memory>
+#include <thrift/server/TConcurrencyLimiter.h>
 #include <thrift/server/TServer.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TChainedBuffer.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TNonblockingServerTransport.h>
 #include <thrift/concurrency/ThreadManager.h>
@@ -32,6 +35,9 @@
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/MPSCQueue.h>
+#include <algorithm>
+#include <set>
 #include <stack>
 #include <vector>
 #include <string>
@@ -48,6 +54,7 @@ namespace thrift {
 namespace server {
 
 using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TChainedBuffer;
 using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TNonblockingServerTransport;
 using apache::thrift::protocol::TProtocol;
@@ -116,10 +123,49 @@ private:
 
   friend class TNonblockingIOThread;
 
+  /**
+   * TConnection objects in use and held in reserve, and the counters kept
+   * about them.  The server has one shared by all IO threads, except in
+   * thread-per-core mode where each IO thread has its own.
+   */
+  struct ConnectionPool {
+    ConnectionPool() : numTConnections(0), numIdleConnections(0), numActiveProcessors(0) {}
+
+    void incrementActiveProcessors() { ++numActiveProcessors; }
+
+    void decrementActiveProcessors() {
+      size_t n = numActiveProcessors.load(std::memory_order_relaxed);
+      while (n > 0 && !numActiveProcessors.compare_exchange_weak(n, n - 1,
+                                                                 std::memory_order_relaxed)) {
+      }
+    }
+
+    /// Guards stack and active
+    Mutex mutex;
+
+    /// Connections not in use, see TNonblockingServer::connectionStackLimit_
+    std::stack<TConnection*> stack;
+
+    /// Connections in use, so that they can be cleaned up on destruction
+    std::vector<TConnection*> active;
+
+    /// Number of TConnection objects created
+    std::atomic<size_t> numTConnections;
+
+    /// Size of stack
+    std::atomic<size_t> numIdleConnections;
+
+    /// Number of connections processing or waiting to process
+    std::atomic<size_t> numActiveProcessors;
+  };
+
 private:
   /// Listen backlog
   static const int LISTEN_BACKLOG = 1024;
 
+  /// Most connections accepted per listen event
+  static const size_t ACCEPT_BATCH_SIZE = 64;
+
   /// Default limit on size of idle connection pool
   static const size_t CONNECTION_STACK_LIMIT = 1024;
 
@@ -172,16 +218,34 @@ private:
   std::vector<std::shared_ptr<TNonblockingIOThread> > ioThreads_;
 
   // Index of next IO Thread to be used (for round-robin)
-  uint32_t nextIOThread_;
+  std::atomic<uint32_t> nextIOThread_;
 
-  // Synchronizes access to connection stack and similar data
-  Mutex connMutex_;
+  /// If true, each IO thread accepts and keeps its own connections
+  bool threadPerCore_;
+
+  /// Number of workers in the ThreadManager of each IO thread (0 == none)
+  size_t ioThreadWorkers_;
 
-  /// Number of TConnection object we've created
-  size_t numTConnections_;
+  /// Number of threads that do the handshakes of new connections (0 == none)
+  size_t handshakeThreads_;
 
-  /// Number of Connections processing or waiting to process
-  size_t numActiveProcessors_;
+  /// Runs the handshakes of new connections, if handshakeThreads_ > 0
+  std::shared_ptr<ThreadManager> handshakeThreadManager_;
+
+  /// Microseconds an IO thread polls before it sleeps (0 == no busy-polling)
+  int64_t busyPollSpinUs_;
+
+  /// SO_BUSY_POLL for accepted sockets, in microseconds (0 == system default)
+  int socketBusyPollUs_;
+
+  /// Set once a failure to set SO_BUSY_POLL has been logged
+  std::atomic<bool> socketBusyPollFailed_;
+
+  // Synchronizes access to the overload state and counters
+  Mutex connMutex_;
+
+  /// Connections of all IO threads, unless in thread-per-core mode
+  ConnectionPool connectionPool_;
 
   /// Limit for how many TConnection objects to cache
   size_t connectionStackLimit_;
@@ -192,12 +256,21 @@ private:
   /// Limit for number of open connections
   size_t maxConnections_;
 
+  /// Adjusts the limit for active processors, if set
+  std::shared_ptr<TConcurrencyLimiter> concurrencyLimiter_;
+
   /// Limit for frame size
   size_t maxFrameSize_;
 
   /// Time in milliseconds before an unperformed task expires (0 == infinite).
   int64_t taskExpireTime_;
 
+  /**
+   * If true, tasks also expire once the client timeout sent in THeaderTransport
+   * headers has passed.
+   */
+  bool clientTimeoutExpiration_;
+
   /**
    * Hysteresis for overload state.  This is the fraction of the overload
    * value that needs to be reached before the overload state is cleared;
@@ -214,9 +287,24 @@ private:
    */
   size_t writeBufferDefaultSize_;
 
+  /**
+   * If true, responses are built in a TChainedBuffer with segments starting
+   * at writeBufferDefaultSize_ bytes rather than in a TMemoryBuffer.
+   */
+  bool chainedWriteBuffer_;
+
+  /// Smallest write sent with MSG_ZEROCOPY, 0 if none is
+  uint32_t zeroCopyThreshold_;
+
+  /**
+   * Names of methods that are run on the IO thread that read the request even
+   * when a ThreadManager is set.
+   */
+  std::set<std::string> inlineMethods_;
+
   /**
    * Max read buffer size for an idle TConnection.  When we place an idle
-   * TConnection into connectionStack_ or on every resizeBufferEveryN_ calls,
+   * TConnection into the connection stack or on every resizeBufferEveryN_ calls,
    * we will free the buffer (such that it will be reinitialized by the next
    * received frame) if it has exceeded this limit.  0 disables this check.
    */
@@ -224,7 +312,7 @@ private:
 
   /**
    * Max write buffer size for an idle connection.  When we place an idle
-   * TConnection into connectionStack_ or on every resizeBufferEveryN_ calls,
+   * TConnection into the connection stack or on every resizeBufferEveryN_ calls,
    * we insure that its write buffer is <= to this size; otherwise we
    * replace it with a new one of writeBufferDefaultSize_ bytes to insure that
    * idle connections don't hog memory. 0 disables this check.
@@ -246,22 +334,6 @@ private:
   /// Count of connections dropped on overload since server started
   uint64_t nTotalConnectionsDropped_;
 
-  /**
-   * This is a stack of all the objects that have been created but that
-   * are NOT currently in use. When we close a connection, we place it on this
-   * stack so that the object can be reused later, rather than freeing the
-   * memory and reallocating a new object later.
-   */
-  std::stack<TConnection*> connectionStack_;
-
-  /**
-   * This container holds pointers to all active connections. This container
-   * allows the server to clean up unlcosed connection objects at destruction,
-   * which in turn allows their transports, protocols, processors and handlers
-   * to deallocate and clean up correctly.
-   */
-  std::vector<TConnection*> activeConnections_;
-
   /*
   */
   std::shared_ptr<TNonblockingServerTransport> serverTransport_;
@@ -271,27 +343,35 @@ private:
    * client connections on listen socket fd and assign TConnection objects
    * to handle those requests.
    *
+   * @param ioThread the IO thread listening on fd.
    * @param which the event flag that triggered the handler.
    */
-  void handleEvent(THRIFT_SOCKET fd, short which);
+  void handleEvent(TNonblockingIOThread* ioThread, THRIFT_SOCKET fd, short which);
 
   void init() {
     serverSocket_ = THRIFT_INVALID_SOCKET;
     numIOThreads_ = DEFAULT_IO_THREADS;
     nextIOThread_ = 0;
+    threadPerCore_ = false;
+    ioThreadWorkers_ = 0;
+    handshakeThreads_ = 0;
+    busyPollSpinUs_ = 0;
+    socketBusyPollUs_ = 0;
+    socketBusyPollFailed_ = false;
     useHighPriorityIOThreads_ = false;
     userEventBase_ = nullptr;
     threadPoolProcessing_ = false;
-    numTConnections_ = 0;
-    numActiveProcessors_ = 0;
     connectionStackLimit_ = CONNECTION_STACK_LIMIT;
     maxActiveProcessors_ = MAX_ACTIVE_PROCESSORS;
     maxConnections_ = MAX_CONNECTIONS;
     maxFrameSize_ = MAX_FRAME_SIZE;
     taskExpireTime_ = 0;
+    clientTimeoutExpiration_ = false;
     overloadHysteresis_ = 0.8;
     overloadAction_ = T_OVERLOAD_NO_ACTION;
     writeBufferDefaultSize_ = WRITE_BUFFER_DEFAULT_SIZE;
+    chainedWriteBuffer_ = false;
+    zeroCopyThreshold_ = 0;
     idleReadBufferLimit_ = IDLE_READ_BUFFER_LIMIT;
     idleWriteBufferLimit_ = IDLE_WRITE_BUFFER_LIMIT;
     resizeBufferEveryN_ = RESIZE_BUFFER_EVERY_N;
@@ -403,6 +483,93 @@ public:
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
+  /**
+   * Set whether to run in thread-per-core mode, where the IO threads share
+   * nothing on the request path: each is pinned to a CPU of its own and
+   * allocates memory on its NUMA node (where supported, see ThreadFactory),
+   * accepts on a listener of its own, and keeps its connections,
+   * their buffers and processors, and its counters to itself.  The counters
+   * are added up only when they are read.  The server transport must be able
+   * to create peer listeners, e.g. a TNonblockingServerSocket with
+   * setReusePort(true).  If the number of IO threads is set to 0, one is
+   * started for each CPU.
+   *
+   * Requests are still handed to the ThreadManager if one is set; leave it
+   * unset to process them on the IO thread that read them, or see
+   * setIOThreadWorkers().  Must be set before serve() is called.
+   */
+  void setThreadPerCore(bool threadPerCore) { threadPerCore_ = threadPerCore; }
+
+  /** Return whether the server runs in thread-per-core mode. */
+  bool getThreadPerCore() const { return threadPerCore_; }
+
+  /**
+   * Give each IO thread a ThreadManager of its own with this many workers,
+   * which process the requests of that IO thread's connections instead of
+   * the server's ThreadManager.  In thread-per-core mode the workers run on
+   * the NUMA node of their IO thread and allocate memory there, so that a
+   * request and its buffers never cross nodes.  0 (the default) disables
+   * this.  Must be set before serve() is called.
+   */
+  void setIOThreadWorkers(size_t numWorkers) {
+    ioThreadWorkers_ = numWorkers;
+    threadPoolProcessing_ = threadManager_ || ioThreadWorkers_ > 0;
+  }
+
+  /** Return the number of workers each IO thread has. */
+  size_t getIOThreadWorkers() const { return ioThreadWorkers_; }
+
+  /**
+   * Do the handshakes of new connections, such as TLS handshakes with a
+   * TNonblockingSSLServerSocket, on this many threads of their own instead of
+   * on the IO threads, where each costs enough CPU to hold up the requests of
+   * every other connection of the thread.  The threads take a handshake as
+   * far as it goes without waiting for the client, while the IO thread
+   * waits for the socket in between, and connections only start reading
+   * requests once it is completed.  0 (the default) disables this.  Must be
+   * set before serve() is called.
+   */
+  void setHandshakeThreads(size_t numThreads) { handshakeThreads_ = numThreads; }
+
+  /** Return the number of threads that do handshakes. */
+  size_t getHandshakeThreads() const { return handshakeThreads_; }
+
+  /** Return the ThreadManager that does handshakes, null if none. */
+  std::shared_ptr<ThreadManager> getHandshakeThreadManager() const {
+    return handshakeThreadManager_;
+  }
+
+  /**
+   * Set busy-poll mode, which trades CPU for latency.  Instead of sleeping
+   * in the kernel as soon as it runs out of work, an IO thread keeps polling
+   * its sockets without blocking, and the queue through which workers hand
+   * back finished requests, for spinUs microseconds after it last found a
+   * finished request or was woken.  While it polls, workers hand requests
+   * back without ringing its doorbell, i.e. without a system call.
+   *
+   * Each polling IO thread keeps a CPU busy, so this is meant for servers
+   * with a CPU to spare per IO thread, e.g. in thread-per-core mode.
+   *
+   * Must be set before serve() is called.
+   *
+   * @param spinUs how long to poll before sleeping; 0 (the default) turns
+   *               busy-poll mode off.
+   * @param socketBusyPollUs if > 0, SO_BUSY_POLL is set to this on accepted
+   *               sockets where supported, so that reads poll the device
+   *               queue for this long before sleeping.  Raising it above
+   *               the net.core.busy_read sysctl needs CAP_NET_ADMIN.
+   */
+  void setBusyPoll(int64_t spinUs, int socketBusyPollUs = 0) {
+    busyPollSpinUs_ = (std::max)(spinUs, static_cast<int64_t>(0));
+    socketBusyPollUs_ = (std::max)(socketBusyPollUs, 0);
+  }
+
+  /** Return how long an IO thread polls before sleeping, 0 if it does not. */
+  int64_t getBusyPollSpinUs() const { return busyPollSpinUs_; }
+
+  /** Return the SO_BUSY_POLL set on accepted sockets, 0 if none. */
+  int getSocketBusyPollUs() const { return socketBusyPollUs_; }
+
   /**
    * Get the maximum number of unused TConnection we will hold in reserve.
    *
@@ -419,16 +586,58 @@ public:
 
   bool isThreadPoolProcessing() const { return threadPoolProcessing_; }
 
-  void addTask(std::shared_ptr<Runnable> task) {
-    threadManager_->add(task, 0LL, taskExpireTime_);
+  /**
+   * Mark a method as inline-safe: calls to it are processed right away on the
+   * IO thread that read the request instead of being handed to the
+   * ThreadManager, which saves the two thread switches of a round trip
+   * through a worker.  Only use this for methods that never block and finish
+   * quickly, since the IO thread serves no other connection meanwhile.  Has no
+   * effect without a ThreadManager, when every call is processed inline.
+   * Must be called before serve() is called.
+   *
+   * @param name the method name as it appears in the request, i.e.
+   *             "Service:method" when the processor is multiplexed.
+   */
+  void addInlineMethod(const std::string& name) { inlineMethods_.insert(name); }
+
+  /**
+   * Replace the set of inline-safe methods, see addInlineMethod().
+   *
+   * @param names the method names.
+   */
+  void setInlineMethods(const std::set<std::string>& names) { inlineMethods_ = names; }
+
+  /**
+   * Get whether a method is processed on the IO thread, see addInlineMethod().
+   *
+   * @param name the method name.
+   * @return true if calls to name are processed on the IO thread.
+   */
+  bool isInlineMethod(const std::string& name) const {
+    return !threadPoolProcessing_ || inlineMethods_.count(name) != 0;
   }
 
+  /**
+   * Get whether some methods bypass the ThreadManager.
+   *
+   * @return true if requests need to be routed by method name.
+   */
+  bool hasInlineMethods() const { return threadPoolProcessing_ && !inlineMethods_.empty(); }
+
+  void addTask(std::shared_ptr<Runnable> task, int64_t expiration) {
+    threadManager_->add(task, 0LL, expiration);
+  }
+
+  void addTask(std::shared_ptr<Runnable> task) { addTask(task, taskExpireTime_); }
+
   /**
    * Return the count of sockets currently connected to.
    *
    * @return count of connected sockets.
    */
-  size_t getNumConnections() const { return numTConnections_; }
+  size_t getNumConnections() const {
+    return sumConnectionPools(&ConnectionPool::numTConnections);
+  }
 
   /**
    * Return the count of sockets currently connected to.
@@ -442,7 +651,9 @@ public:
    *
    * @return count of idle connection objects.
    */
-  size_t getNumIdleConnections() const { return connectionStack_.size(); }
+  size_t getNumIdleConnections() const {
+    return sumConnectionPools(&ConnectionPool::numIdleConnections);
+  }
 
   /**
    * Return count of number of connections which are currently processing.
@@ -452,21 +663,15 @@ public:
    *
    * @return # of connections currently processing.
    */
-  size_t getNumActiveProcessors() const { return numActiveProcessors_; }
+  size_t getNumActiveProcessors() const {
+    return sumConnectionPools(&ConnectionPool::numActiveProcessors);
+  }
 
   /// Increment the count of connections currently processing.
-  void incrementActiveProcessors() {
-    Guard g(connMutex_);
-    ++numActiveProcessors_;
-  }
+  void incrementActiveProcessors() { connectionPool_.incrementActiveProcessors(); }
 
   /// Decrement the count of connections currently processing.
-  void decrementActiveProcessors() {
-    Guard g(connMutex_);
-    if (numActiveProcessors_ > 0) {
-      --numActiveProcessors_;
-    }
-  }
+  void decrementActiveProcessors() { connectionPool_.decrementActiveProcessors(); }
 
   /**
    * Get the maximum # of connections allowed before overload.
@@ -498,6 +703,44 @@ public:
     maxActiveProcessors_ = maxActiveProcessors;
   }
 
+  /**
+   * Get the maximum # of connections waiting in handler/task before overload
+   * that is currently in effect: the lower of the concurrency limiter's limit,
+   * if there is one, and getMaxActiveProcessors().
+   *
+   * @return current limit.
+   */
+  size_t getActiveProcessorLimit() const {
+    if (concurrencyLimiter_) {
+      return (std::min)(maxActiveProcessors_,
+                        static_cast<size_t>(concurrencyLimiter_->getLimit()));
+    }
+    return maxActiveProcessors_;
+  }
+
+  /**
+   * Get the concurrency limiter.
+   *
+   * @return the limiter, or null if there is none.
+   */
+  std::shared_ptr<TConcurrencyLimiter> getConcurrencyLimiter() const {
+    return concurrencyLimiter_;
+  }
+
+  /**
+   * Set a concurrency limiter to adjust the maximum # of active processors to
+   * the time requests take from being read to having been processed, which
+   * includes the time they wait for the ThreadManager.  setMaxActiveProcessors()
+   * remains the upper bound, and the overload hysteresis and action apply to
+   * the adjusted limit.  Tasks drained on overload count as dropped.  Must be
+   * set before serve() is called.
+   *
+   * @param limiter the limiter, or null to go back to the fixed limit.
+   */
+  void setConcurrencyLimiter(const std::shared_ptr<TConcurrencyLimiter>& limiter) {
+    concurrencyLimiter_ = limiter;
+  }
+
   /**
    * Get the maximum allowed frame size.
    *
@@ -562,12 +805,32 @@ public:
    */
   void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
 
+  /**
+   * Get whether tasks expire once the client timeout has passed.
+   *
+   * @return true if client timeouts bound task expiration.
+   */
+  bool getClientTimeoutExpiration() const { return clientTimeoutExpiration_; }
+
+  /**
+   * Set whether tasks expire once the client timeout sent with the request in
+   * THeaderTransport headers (see THeaderTransport::setClientTimeout()) has
+   * passed, as nobody would be waiting for the response any more.  The task
+   * expiration time, if set, still applies when it is shorter.  Only used
+   * with THeaderTransport; combined with the ThreadManager's EDF scheduling
+   * policy requests are run in order of their client's deadline.
+   *
+   * @param enable true to bound task expiration by client timeouts.
+   */
+  void setClientTimeoutExpiration(bool enable) { clientTimeoutExpiration_ = enable; }
+
   /**
    * Determine if the server is currently overloaded.
    * This function checks the maximums for open connections and connections
    * currently in processing, and sets an overload condition if they are
    * exceeded.  The overload will persist until both values are below the
-   * current hysteresis fraction of their maximums.
+   * current hysteresis fraction of their maximums.  Safe to call from any
+   * IO thread.
    *
    * @return true if an overload condition exists, false if not.
    */
@@ -577,7 +840,7 @@ public:
    *
    * @return true if a task was discarded, false if the wait queue was empty.
    */
-  bool drainPendingTask();
+  bool drainPendingTask() { return drainPendingTask(threadManager_); }
 
   /**
    * Get the starting size of a TConnection object's write buffer.
@@ -593,6 +856,43 @@ public:
    */
   void setWriteBufferDefaultSize(size_t size) { writeBufferDefaultSize_ = size; }
 
+  /**
+   * Get whether TConnection objects build responses in a TChainedBuffer.
+   *
+   * @return true if responses are built in a chain of buffer segments.
+   */
+  bool getChainedWriteBuffer() const { return chainedWriteBuffer_; }
+
+  /**
+   * Set whether TConnection objects build responses in a TChainedBuffer
+   * instead of a TMemoryBuffer.  The chained buffer never copies a response
+   * as it grows and sends it with gathered writes, which pays off for large
+   * responses.  Its first segment is getWriteBufferDefaultSize() bytes.
+   * Must be set before serve() is called.
+   *
+   * @param chained true to use a TChainedBuffer.
+   */
+  void setChainedWriteBuffer(bool chained) { chainedWriteBuffer_ = chained; }
+
+  /**
+   * Get the smallest write to a client sent without copying it.
+   *
+   * @return # bytes from which writes use MSG_ZEROCOPY, 0 if none do.
+   */
+  uint32_t getZeroCopyThreshold() const { return zeroCopyThreshold_; }
+
+  /**
+   * Set the smallest write to a client that is sent with MSG_ZEROCOPY, see
+   * TSocket::setZeroCopyThreshold().  A connection holds on to its response
+   * after sending it until the kernel reports it is done with it, and only
+   * then reads the next request.  Where zero-copy sends are not supported,
+   * responses are copied as usual.  Must be set before serve() is called.
+   *
+   * @param bytes # bytes from which writes use MSG_ZEROCOPY, 0 (the default)
+   *              for none.
+   */
+  void setZeroCopyThreshold(uint32_t bytes) { zeroCopyThreshold_ = bytes; }
+
   /**
    * Get the maximum size of read buffer allocated to idle TConnection objects.
    *
@@ -701,6 +1001,9 @@ public:
   bool getHeaderTransport();
 
 private:
+  /// Pops and discards the next task waiting in threadManager, if any.
+  bool drainPendingTask(const std::shared_ptr<ThreadManager>& threadManager);
+
   /**
    * Callback function that the threadmanager calls when a task reaches
    * its expiration time.  It is needed to clean up the expired connection.
@@ -719,7 +1022,7 @@ private:
    * @param addrLen the length of addr
    * @return pointer to initialized TConnection object.
    */
-  TConnection* createConnection(std::shared_ptr<TSocket> socket);
+  TConnection* createConnection(std::shared_ptr<TSocket> socket, TNonblockingIOThread* acceptor);
 
   /**
    * Returns a connection to pool or deletion.  If the connection pool
@@ -727,11 +1030,26 @@ private:
    * just delete it.
    *
    * @param connection the TConection being returned.
+   * @param pool the pool it was taken from.
    */
-  void returnConnection(TConnection* connection);
+  void returnConnection(TConnection* connection, ConnectionPool* pool);
+
+  /// Returns the pool for connections handled by ioThread.
+  ConnectionPool* getConnectionPool(TNonblockingIOThread* ioThread);
+
+  /// Adds up a counter over the connection pools.
+  size_t sumConnectionPools(std::atomic<size_t> ConnectionPool::*counter) const;
+
+  /// Closes the connections in use and frees those in reserve.
+  static void clearConnectionPool(ConnectionPool& pool);
 };
 
 class TNonblockingIOThread : public Runnable {
+  friend class TNonblockingServer;
+
+  /// Most completions transitioned per notification event
+  static const size_t COMPLETION_BATCH_SIZE = 256;
+
 public:
   // Creates an IO thread and sets up the event base.  The listenSocket should
   // be a valid FD on which listen() has already been called.  If the
@@ -752,6 +1070,17 @@ public:
   // Returns the number of this IO thread.
   int getThreadNumber() const { return number_; }
 
+  // Sets the transport that this thread accepts connections from.
+  void setListenTransport(const std::shared_ptr<TNonblockingServerTransport>& transport) {
+    listenTransport_ = transport;
+    listenSocket_ = transport->getSocketFD();
+  }
+
+  // Returns the transport that this thread accepts connections from, if any.
+  const std::shared_ptr<TNonblockingServerTransport>& getListenTransport() const {
+    return listenTransport_;
+  }
+
   // Returns the thread id associated with this object.  This should
   // only be called after the thread has been started.
   Thread::id_t getThreadId() const { return threadId_; }
@@ -771,6 +1100,12 @@ public:
   // Used by TConnection objects to indicate processing has finished.
   bool notify(TNonblockingServer::TConnection* conn);
 
+  // Returns the ThreadManager for requests read by this thread, if it has one.
+  const std::shared_ptr<ThreadManager>& getThreadManager() const { return threadManager_; }
+
+  // Hands a task to our ThreadManager, or else to the server's.
+  void addTask(std::shared_ptr<Runnable> task, int64_t expiration);
+
   // Enters the event loop and does not return until a call to stop().
   void run() override;
 
@@ -786,9 +1121,9 @@ public:
 private:
   /**
    * C-callable event handler for signaling task completion.  Provides a
-   * callback that libevent can understand that will read a connection
-   * object's address from a pipe and call connection->transition() for
-   * that object.
+   * callback that libevent can understand that will reset the doorbell and
+   * call connection->transition() for the connections queued by notify(),
+   * up to COMPLETION_BATCH_SIZE of them at a time.
    *
    * @param fd the descriptor the event occurred on.
    */
@@ -800,15 +1135,28 @@ private:
    *
    * @param fd the descriptor the event occurred on.
    * @param which the flags associated with the event.
-   * @param v void* callback arg where we placed TNonblockingServer's "this".
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
    */
   static void listenHandler(evutil_socket_t fd, short which, void* v) {
-    ((TNonblockingServer*)v)->handleEvent(fd, which);
+    auto* ioThread = (TNonblockingIOThread*)v;
+    ioThread->server_->handleEvent(ioThread, fd, which);
   }
 
   /// Exits the loop ASAP in case of shutdown or error.
   void breakLoop(bool error);
 
+  /// Runs the event loop in busy-poll mode, see TNonblockingServer::setBusyPoll()
+  void runBusyPoll();
+
+  /// Transitions up to limit connections from completions_, returns how many
+  size_t drainCompletions(size_t limit);
+
+  /// Wakes up the loop through the notification pipe
+  bool ringDoorbell();
+
+  /// Lets the next completion ring the doorbell, once completions_ is drained
+  void armDoorbell();
+
   /// Create the pipe used to notify I/O process of task completion.
   void createNotificationPipe();
 
@@ -831,6 +1179,18 @@ private:
   /// If listenSocket_ >= 0, adds an event on the event_base to accept conns
   THRIFT_SOCKET listenSocket_;
 
+  /// The transport listenSocket_ belongs to, if set with setListenTransport()
+  std::shared_ptr<TNonblockingServerTransport> listenTransport_;
+
+  /// Connections of this thread in thread-per-core mode
+  TNonblockingServer::ConnectionPool connectionPool_;
+
+  /// CPU and memory placement applied to the thread when it runs, if set
+  std::shared_ptr<ThreadFactory> placement_;
+
+  /// Workers for the requests read by this thread, see setIOThreadWorkers()
+  std::shared_ptr<ThreadManager> threadManager_;
+
   /// Sets a high scheduling priority when running
   bool useHighPriority_;
 
@@ -847,9 +1207,27 @@ private:
   /// Used with eventBase_ for task completion notification
   struct event notificationEvent_;
 
-  /// File descriptors for pipe used for task completion notification.
+  /// File descriptors for pipe used for task completion notification, the
+  /// same eventfd twice where supported.
   evutil_socket_t notificationPipeFDs_[2];
 
+  /**
+   * Connections to transition, handed over by notify(); nullptr asks the
+   * loop to stop.  The notification pipe does not carry them but is only a
+   * doorbell, rung when a connection is queued and doorbellArmed_ is set.
+   */
+  apache::thrift::concurrency::MPSCQueue<TNonblockingServer::TConnection*> completions_;
+
+  /**
+   * Set once the loop has drained completions_ and may wait for the
+   * doorbell; the first notify() after that clears it and rings.  Clear
+   * while the loop polls in busy-poll mode.
+   */
+  std::atomic<bool> doorbellArmed_;
+
+  /// Set when the loop has been asked to stop
+  bool loopBroken_;
+
   /// Actual IO Thread
   std::shared_ptr<Thread> thread_;
 };
@@ -154,13 +154,15 @@ void TServerFramework::serve() {
         outputProtocol = outputProtocolFactory_->getProtocol(outputTransport);
       }
 
-      newlyConnectedClient(shared_ptr<TConnectedClient>(
+      shared_ptr<TConnectedClient> pClient(
           new TConnectedClient(getProcessor(inputProtocol, outputProtocol, client),
                                inputProtocol,
                                outputProtocol,
                                eventHandler_,
                                client),
-          bind(&TServerFramework::disposeConnectedClient, this, std::placeholders::_1)));
+          bind(&TServerFramework::disposeConnectedClient, this, std::placeholders::_1));
+      pClient->setConcurrencyLimiter(getConcurrencyLimiter());
+      newlyConnectedClient(pClient);
 
     } catch (TTransportException& ttx) {
       releaseOneDescriptor("inputTransport", inputTransport);
@@ -212,6 +214,16 @@ void TServerFramework::setConcurrentClientLimit(int64_t newLimit) {
   }
 }
 
+shared_ptr<TConcurrencyLimiter> TServerFramework::getConcurrencyLimiter() const {
+  Synchronized sync(mon_);
+  return concurrencyLimiter_;
+}
+
+void TServerFramework::setConcurrencyLimiter(const shared_ptr<TConcurrencyLimiter>& limiter) {
+  Synchronized sync(mon_);
+  concurrencyLimiter_ = limiter;
+}
+
 void TServerFramework::stop() {
   // Order is important because serve() releases serverTransport_ when it is
   // interrupted, which closes the socket that interruptChildren uses.
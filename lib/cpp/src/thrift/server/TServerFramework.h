@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <thrift/TProcessor.h>
 #include <thrift/concurrency/Monitor.h>
+#include <thrift/server/TConcurrencyLimiter.h>
 #include <thrift/server/TConnectedClient.h>
 #include <thrift/server/TServer.h>
 #include <thrift/transport/TServerTransport.h>
@@ -121,6 +122,24 @@ public:
    */
   virtual void setConcurrentClientLimit(int64_t newLimit);
 
+  /**
+   * Get the concurrency limiter.
+   * \returns the concurrency limiter, or null if there is none
+   */
+  virtual std::shared_ptr<TConcurrencyLimiter> getConcurrencyLimiter() const;
+
+  /**
+   * Set a concurrency limiter to limit the number of requests processed at
+   * once, adjusted to their processing latency.  Connected clients wait for
+   * the limiter before processing each request, so idle connections do not
+   * count against its limit; the number of connections is only limited by
+   * setConcurrentClientLimit.  The limiter's state (current limit,
+   * latencies, samples) can be read from it at any time.  Clients accepted
+   * before this is called are not limited.
+   * \param[in]  limiter  the limiter, or null for none
+   */
+  virtual void setConcurrencyLimiter(const std::shared_ptr<TConcurrencyLimiter>& limiter);
+
 protected:
   /**
    * A client has connected.  The implementation is responsible for managing the
@@ -176,6 +195,11 @@ private:
    * The limit on the number of concurrent clients.
    */
   int64_t limit_;
+
+  /**
+   * Limits the number of requests being processed, if set.
+   */
+  std::shared_ptr<TConcurrencyLimiter> concurrencyLimiter_;
 };
 }
 }
@@ -17,12 +17,15 @@
  * under the License.
  */
 
+#include <stdexcept>
+#include <thrift/concurrency/FunctionRunner.h>
 #include <thrift/server/TThreadPoolServer.h>
 
 namespace apache {
 namespace thrift {
 namespace server {
 
+using apache::thrift::concurrency::FunctionRunner;
 using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::protocol::TProtocol;
 using apache::thrift::protocol::TProtocolFactory;
@@ -41,7 +44,8 @@ TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessorFactory>& proces
   : TServerFramework(processorFactory, serverTransport, transportFactory, protocolFactory),
     threadManager_(threadManager),
     timeout_(0),
-    taskExpiration_(0) {
+    taskExpiration_(0),
+    idleClientParking_(false) {
 }
 
 TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessor>& processor,
@@ -52,7 +56,8 @@ TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessor>& processor,
   : TServerFramework(processor, serverTransport, transportFactory, protocolFactory),
     threadManager_(threadManager),
     timeout_(0),
-    taskExpiration_(0) {
+    taskExpiration_(0),
+    idleClientParking_(false) {
 }
 
 TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessorFactory>& processorFactory,
@@ -70,7 +75,8 @@ TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessorFactory>& proces
                      outputProtocolFactory),
     threadManager_(threadManager),
     timeout_(0),
-    taskExpiration_(0) {
+    taskExpiration_(0),
+    idleClientParking_(false) {
 }
 
 TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessor>& processor,
@@ -88,13 +94,22 @@ TThreadPoolServer::TThreadPoolServer(const shared_ptr<TProcessor>& processor,
                      outputProtocolFactory),
     threadManager_(threadManager),
     timeout_(0),
-    taskExpiration_(0) {
+    taskExpiration_(0),
+    idleClientParking_(false) {
 }
 
 TThreadPoolServer::~TThreadPoolServer() = default;
 
 void TThreadPoolServer::serve() {
+  if (idleClientParking_) {
+    idlePoller_ = std::make_shared<TIdleClientPoller>(
+        std::bind(&TThreadPoolServer::dispatchClient, this, std::placeholders::_1));
+    idlePoller_->start();
+  }
   TServerFramework::serve();
+  if (idlePoller_) {
+    idlePoller_->stop();
+  }
   threadManager_->stop();
 }
 
@@ -119,8 +134,36 @@ TThreadPoolServer::getThreadManager() const {
   return threadManager_;
 }
 
+bool TThreadPoolServer::getIdleClientParking() const {
+  return idleClientParking_;
+}
+
+void TThreadPoolServer::setIdleClientParking(bool enable) {
+  if (enable && !TIdleClientPoller::isSupported()) {
+    throw std::invalid_argument("idle client parking is not supported on this platform");
+  }
+  idleClientParking_ = enable;
+}
+
 void TThreadPoolServer::onClientConnected(const shared_ptr<TConnectedClient>& pClient) {
-  threadManager_->add(pClient, getTimeout(), getTaskExpiration());
+  if (idlePoller_) {
+    dispatchClient(pClient);
+  } else {
+    threadManager_->add(pClient, getTimeout(), getTaskExpiration());
+  }
+}
+
+void TThreadPoolServer::dispatchClient(const shared_ptr<TConnectedClient>& pClient) {
+  threadManager_->add(FunctionRunner::create(std::bind(&TThreadPoolServer::runClient, this, pClient)),
+                      getTimeout(),
+                      getTaskExpiration());
+}
+
+void TThreadPoolServer::runClient(const shared_ptr<TConnectedClient>& pClient) {
+  if (pClient->runUntilIdle() && !idlePoller_->park(pClient)) {
+    // The server is stopping
+    pClient->abandon();
+  }
 }
 
 void TThreadPoolServer::onClientDisconnected(TConnectedClient*) {
@@ -22,6 +22,7 @@
 
 #include <atomic>
 #include <thrift/concurrency/ThreadManager.h>
+#include <thrift/server/TIdleClientPoller.h>
 #include <thrift/server/TServerFramework.h>
 
 namespace apache {
@@ -30,6 +31,12 @@ namespace server {
 
 /**
  * Manage clients using a thread pool.
+ *
+ * Each ThreadManager task serves a whole connection, or with idle client
+ * parking a connection until it goes idle.  Tasks therefore expire by
+ * setTaskExpiration() only: the client timeout a THeaderTransport client
+ * sends with each request is not known when the task is added, and is not
+ * used as a deadline here (see TNonblockingServer::setClientTimeoutExpiration()).
  */
 class TThreadPoolServer : public TServerFramework {
 public:
@@ -81,10 +88,35 @@ public:
   virtual void setTimeout(int64_t value);
 
   virtual int64_t getTaskExpiration() const;
+
+  /**
+   * Set the time in milliseconds within which a new connection must be picked
+   * up by a worker thread (0 == infinite), after which it is dropped.  With
+   * the ThreadManager's EDF scheduling policy connections are served in the
+   * order they would expire.
+   */
   virtual void setTaskExpiration(int64_t value);
 
   virtual std::shared_ptr<apache::thrift::concurrency::ThreadManager> getThreadManager() const;
 
+  virtual bool getIdleClientParking() const;
+
+  /**
+   * Set whether clients give their worker thread back between requests.
+   * Parked clients wait in a TIdleClientPoller and are added to the
+   * ThreadManager again when their next request arrives, so the number of
+   * workers needed scales with the number of requests being processed
+   * rather than with the number of open connections.  Each time a client
+   * goes back to work counts as a new task for the timeout and task
+   * expiration.  Clients whose transports cannot be parked (see
+   * TConnectedClient::runUntilIdle()) keep their worker as before.
+   *
+   * Must be set before serve() is called.
+   *
+   * \throws std::invalid_argument if the platform is not supported
+   */
+  virtual void setIdleClientParking(bool enable);
+
 protected:
   void onClientConnected(const std::shared_ptr<TConnectedClient>& pClient) override /* override */;
   void onClientDisconnected(TConnectedClient* pClient) override /* override */;
@@ -92,6 +124,19 @@ protected:
   std::shared_ptr<apache::thrift::concurrency::ThreadManager> threadManager_;
   std::atomic<int64_t> timeout_;
   std::atomic<int64_t> taskExpiration_;
+  std::atomic<bool> idleClientParking_;
+  std::shared_ptr<TIdleClientPoller> idlePoller_;
+
+private:
+  /**
+   * Add a task for the client to the ThreadManager.
+   */
+  void dispatchClient(const std::shared_ptr<TConnectedClient>& pClient);
+
+  /**
+   * Process requests from the client until it is done, or park it once idle.
+   */
+  void runClient(const std::shared_ptr<TConnectedClient>& pClient);
 };
 
 }
@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include <thrift/transport/TAddressCache.h>
+#include <thrift/transport/TTransportException.h>
+
+using std::string;
+using std::vector;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using concurrency::Guard;
+
+TAddressCache::TAddressCache(int ttlSeconds) : ttl_(ttlSeconds) {
+}
+
+bool TAddressCache::lookup(const string& host, int port, vector<Address>& addresses) {
+  Guard g(mutex_);
+  std::map<string, Entry>::iterator it = entries_.find(key(host, port));
+  if (it == entries_.end()) {
+    return false;
+  }
+  if (it->second.expires <= std::chrono::steady_clock::now()) {
+    entries_.erase(it);
+    return false;
+  }
+  addresses = it->second.addresses;
+  return true;
+}
+
+void TAddressCache::insert(const string& host, int port, const vector<Address>& addresses) {
+  Guard g(mutex_);
+  Entry& entry = entries_[key(host, port)];
+  entry.addresses = addresses;
+  entry.expires = std::chrono::steady_clock::now() + ttl_;
+}
+
+void TAddressCache::invalidate(const string& host, int port) {
+  Guard g(mutex_);
+  entries_.erase(key(host, port));
+}
+
+void TAddressCache::clear() {
+  Guard g(mutex_);
+  entries_.clear();
+}
+
+vector<TAddressCache::Address> TAddressCache::resolve(const string& host, int port) {
+  struct addrinfo hints, *res, *res0;
+  res = nullptr;
+  res0 = nullptr;
+  int error;
+  char portStr[sizeof("65535")];
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = PF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG;
+  sprintf(portStr, "%d", port);
+
+  error = getaddrinfo(host.c_str(), portStr, &hints, &res0);
+
+#ifdef _WIN32
+  if (error == WSANO_DATA) {
+    hints.ai_flags &= ~AI_ADDRCONFIG;
+    error = getaddrinfo(host.c_str(), portStr, &hints, &res0);
+  }
+#endif
+
+  if (error) {
+    string errStr = "TSocket::open() getaddrinfo() <Host: " + host + " Port: " + portStr + ">"
+                    + string(THRIFT_GAI_STRERROR(error));
+    GlobalOutput(errStr.c_str());
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "Could not resolve host for client socket.");
+  }
+
+  vector<Address> addresses;
+  for (res = res0; res; res = res->ai_next) {
+    if (res->ai_addrlen > sizeof(sockaddr_storage)) {
+      continue;
+    }
+    Address address;
+    std::memset(&address, 0, sizeof(address));
+    address.family = res->ai_family;
+    address.socktype = res->ai_socktype;
+    address.protocol = res->ai_protocol;
+    std::memcpy(&address.addr, res->ai_addr, res->ai_addrlen);
+    address.addrlen = static_cast<socklen_t>(res->ai_addrlen);
+    addresses.push_back(address);
+  }
+  freeaddrinfo(res0);
+  return addresses;
+}
+
+string TAddressCache::key(const string& host, int port) {
+  return host + ":" + std::to_string(port);
+}
+}
+}
+} // apache::thrift::transport
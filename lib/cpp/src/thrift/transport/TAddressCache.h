@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TADDRESSCACHE_H_
+#define _THRIFT_TRANSPORT_TADDRESSCACHE_H_ 1
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <thrift/Thrift.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/PlatformSocket.h>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Cache of the addresses that host names resolve to, which TSockets sharing
+ * it look up before calling getaddrinfo(), so that reconnecting does not
+ * wait for DNS.  Entries expire after a time to live, and a TSocket drops
+ * the entry of a host when it cannot connect to any of its addresses.
+ *
+ * Thread safe.
+ */
+class TAddressCache {
+public:
+  /// One result of getaddrinfo()
+  struct Address {
+    int family;
+    int socktype;
+    int protocol;
+    sockaddr_storage addr;
+    socklen_t addrlen;
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param ttlSeconds how long resolved addresses are used
+   */
+  explicit TAddressCache(int ttlSeconds = 60);
+
+  /**
+   * Gets the addresses of host and port, if they are cached and current.
+   *
+   * @return false if they need to be resolved
+   */
+  bool lookup(const std::string& host, int port, std::vector<Address>& addresses);
+
+  /**
+   * Caches the addresses of host and port.
+   */
+  void insert(const std::string& host, int port, const std::vector<Address>& addresses);
+
+  /**
+   * Drops the addresses of host and port, e.g. because none was reachable.
+   */
+  void invalidate(const std::string& host, int port);
+
+  /**
+   * Drops every entry.
+   */
+  void clear();
+
+  /**
+   * Resolves host and port with getaddrinfo().
+   *
+   * @throws TTransportException NOT_OPEN if the host could not be resolved
+   */
+  static std::vector<Address> resolve(const std::string& host, int port);
+
+private:
+  struct Entry {
+    std::vector<Address> addresses;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  static std::string key(const std::string& host, int port);
+
+  concurrency::Mutex mutex_;
+  std::map<std::string, Entry> entries_;
+  std::chrono::seconds ttl_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TADDRESSCACHE_H_
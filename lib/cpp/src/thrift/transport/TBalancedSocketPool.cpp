@@ -0,0 +1,482 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+
+#include <thrift/transport/TBalancedSocketPool.h>
+
+using std::pair;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using apache::thrift::concurrency::Guard;
+
+typedef std::chrono::steady_clock Clock;
+
+TBalancedSocketPool::Server::Server(const string& h, int p)
+  : host(h),
+    port(p),
+    latencyUs(0),
+    sampled(false),
+    inFlight(0),
+    consecutiveFailures(0),
+    evictedUntil() {
+}
+
+TBalancedSocketPool::TBalancedSocketPool(const vector<pair<string, int> >& servers)
+  : random_(std::random_device()()),
+    connTimeout_(0),
+    recvTimeout_(0),
+    sendTimeout_(0),
+    minIdleConnections_(1),
+    maxIdleConnections_(8),
+    maxConsecutiveFailures_(3),
+    evictionInterval_(10000),
+    slowFactor_(5.0),
+    latencyWeight_(0.2) {
+  if (servers.empty()) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TBalancedSocketPool: no servers");
+  }
+  for (const auto& server : servers) {
+    servers_.push_back(std::make_shared<Server>(server.first, server.second));
+  }
+}
+
+TBalancedSocketPool::~TBalancedSocketPool() = default;
+
+void TBalancedSocketPool::setSocketFactory(const SocketFactory& factory) {
+  Guard g(mutex_);
+  socketFactory_ = factory;
+}
+
+void TBalancedSocketPool::setConnTimeout(int ms) {
+  Guard g(mutex_);
+  connTimeout_ = ms;
+}
+
+void TBalancedSocketPool::setRecvTimeout(int ms) {
+  Guard g(mutex_);
+  recvTimeout_ = ms;
+}
+
+void TBalancedSocketPool::setSendTimeout(int ms) {
+  Guard g(mutex_);
+  sendTimeout_ = ms;
+}
+
+void TBalancedSocketPool::setMinIdleConnections(size_t count) {
+  Guard g(mutex_);
+  minIdleConnections_ = count;
+}
+
+void TBalancedSocketPool::setMaxIdleConnections(size_t count) {
+  Guard g(mutex_);
+  maxIdleConnections_ = count;
+}
+
+void TBalancedSocketPool::setMaxConsecutiveFailures(int count) {
+  Guard g(mutex_);
+  maxConsecutiveFailures_ = count;
+}
+
+void TBalancedSocketPool::setEvictionInterval(int ms) {
+  Guard g(mutex_);
+  evictionInterval_ = std::chrono::milliseconds(ms);
+}
+
+void TBalancedSocketPool::setSlowFactor(double factor) {
+  Guard g(mutex_);
+  slowFactor_ = factor;
+}
+
+void TBalancedSocketPool::setLatencyWeight(double weight) {
+  if (weight <= 0 || weight > 1) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TBalancedSocketPool::setLatencyWeight: weight out of range");
+  }
+  Guard g(mutex_);
+  latencyWeight_ = weight;
+}
+
+void TBalancedSocketPool::warmUp() {
+  for (const auto& server : servers_) {
+    size_t missing;
+    {
+      Guard g(mutex_);
+      if (server->evictedUntil > Clock::now() || server->idle.size() >= minIdleConnections_) {
+        continue;
+      }
+      missing = minIdleConnections_ - server->idle.size();
+    }
+    for (size_t i = 0; i < missing; ++i) {
+      shared_ptr<TSocket> socket;
+      try {
+        socket = connect(*server);
+      } catch (const TTransportException&) {
+        Guard g(mutex_);
+        fail(*server, Clock::now());
+        break;
+      }
+      Guard g(mutex_);
+      if (server->idle.size() < maxIdleConnections_) {
+        server->idle.push_back(socket);
+      }
+    }
+  }
+}
+
+vector<TBalancedSocketPool::ServerStats> TBalancedSocketPool::getServerStats() const {
+  Guard g(mutex_);
+  Clock::time_point now = Clock::now();
+  vector<ServerStats> result;
+  for (const auto& server : servers_) {
+    ServerStats stats;
+    stats.host = server->host;
+    stats.port = server->port;
+    stats.latencyUs = server->latencyUs;
+    stats.inFlight = server->inFlight;
+    stats.idleConnections = server->idle.size();
+    stats.consecutiveFailures = server->consecutiveFailures;
+    stats.evicted = server->evictedUntil > now;
+    result.push_back(stats);
+  }
+  return result;
+}
+
+TBalancedSocketPool::Lease TBalancedSocketPool::acquire() {
+  // Every server gets a chance before giving up
+  for (size_t attempt = 0; attempt < servers_.size(); ++attempt) {
+    Lease lease;
+    {
+      Guard g(mutex_);
+      lease.server = pick(Clock::now());
+      ++lease.server->inFlight;
+      while (!lease.server->idle.empty()) {
+        shared_ptr<TSocket> socket = lease.server->idle.back();
+        lease.server->idle.pop_back();
+        if (socket->isReusable()) {
+          lease.socket = socket;
+          lease.reused = true;
+          break;
+        }
+      }
+    }
+    if (lease.socket) {
+      return lease;
+    }
+
+    try {
+      lease.socket = connect(*lease.server);
+      return lease;
+    } catch (const TTransportException& e) {
+      GlobalOutput.printf("TBalancedSocketPool::acquire: %s:%d: %s",
+                          lease.server->host.c_str(),
+                          lease.server->port,
+                          e.what());
+      Guard g(mutex_);
+      --lease.server->inFlight;
+      fail(*lease.server, Clock::now());
+    }
+  }
+  throw TTransportException(TTransportException::NOT_OPEN,
+                            "TBalancedSocketPool::acquire: all connections failed");
+}
+
+void TBalancedSocketPool::respond(Lease& lease, int64_t latencyUs) {
+  Guard g(mutex_);
+  if (lease.responded) {
+    return;
+  }
+  lease.responded = true;
+
+  Server& server = *lease.server;
+  --server.inFlight;
+  server.consecutiveFailures = 0;
+  if (server.sampled) {
+    server.latencyUs += latencyWeight_ * (latencyUs - server.latencyUs);
+  } else {
+    server.latencyUs = static_cast<double>(latencyUs);
+    server.sampled = true;
+  }
+
+  // Compare with the median of the other servers that are known and in use,
+  // and never evict half of the servers or more for being slow
+  Clock::time_point now = Clock::now();
+  if (slowFactor_ <= 0 || servers_.size() < 3 || server.evictedUntil > now) {
+    return;
+  }
+  vector<double> others;
+  size_t evicted = 0;
+  for (const auto& other : servers_) {
+    if (other->evictedUntil > now) {
+      ++evicted;
+    } else if (other.get() != &server && other->sampled) {
+      others.push_back(other->latencyUs);
+    }
+  }
+  if (others.size() < 2 || (evicted + 1) * 2 > servers_.size()) {
+    return;
+  }
+  std::nth_element(others.begin(), others.begin() + others.size() / 2, others.end());
+  double median = others[others.size() / 2];
+  if (server.latencyUs > slowFactor_ * median) {
+    evict(server, now, "slow");
+  }
+}
+
+void TBalancedSocketPool::release(Lease& lease, Outcome outcome) {
+  if (!lease.server) {
+    return;
+  }
+  shared_ptr<TSocket> socket;
+  socket.swap(lease.socket);
+  {
+    Guard g(mutex_);
+    Server& server = *lease.server;
+    if (!lease.responded) {
+      --server.inFlight;
+    }
+    if (outcome == REUSABLE && socket && socket->isOpen()
+        && server.evictedUntil <= Clock::now() && server.idle.size() < maxIdleConnections_) {
+      server.idle.push_back(socket);
+      socket.reset();
+    } else if (outcome == FAILED) {
+      fail(server, Clock::now());
+    }
+  }
+  lease = Lease();
+
+  // Close a connection that was not kept without holding the mutex
+  if (socket) {
+    try {
+      socket->close();
+    } catch (const TTransportException&) {
+    }
+  }
+}
+
+shared_ptr<TBalancedSocketPool::Server> TBalancedSocketPool::pick(Clock::time_point now) {
+  vector<size_t> healthy;
+  size_t soonest = 0;
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    if (servers_[i]->evictedUntil <= now) {
+      healthy.push_back(i);
+    } else if (servers_[i]->evictedUntil < servers_[soonest]->evictedUntil) {
+      soonest = i;
+    }
+  }
+  if (healthy.empty()) {
+    // Better to try a server that may have recovered than to fail outright
+    return servers_[soonest];
+  }
+  if (healthy.size() == 1) {
+    return servers_[healthy[0]];
+  }
+
+  std::uniform_int_distribution<size_t> dist(0, healthy.size() - 1);
+  size_t i = dist(random_);
+  size_t j = dist(random_);
+  while (j == i) {
+    j = dist(random_);
+  }
+  const shared_ptr<Server>& a = servers_[healthy[i]];
+  const shared_ptr<Server>& b = servers_[healthy[j]];
+
+  // A server without a latency sample yet gets one first
+  if (a->sampled != b->sampled) {
+    return a->sampled ? b : a;
+  }
+  double costA = a->latencyUs * (a->inFlight + 1);
+  double costB = b->latencyUs * (b->inFlight + 1);
+  if (costA != costB) {
+    return costA < costB ? a : b;
+  }
+  return a->inFlight <= b->inFlight ? a : b;
+}
+
+void TBalancedSocketPool::fail(Server& server, Clock::time_point now) {
+  ++server.consecutiveFailures;
+  // The idle connections of a failing server are unlikely to be any good
+  server.idle.clear();
+  if (server.consecutiveFailures >= maxConsecutiveFailures_ && server.evictedUntil <= now) {
+    evict(server, now, "failing");
+  }
+}
+
+void TBalancedSocketPool::evict(Server& server, Clock::time_point now, const char* reason) {
+  GlobalOutput.printf("TBalancedSocketPool: evicting %s:%d (%s)",
+                      server.host.c_str(),
+                      server.port,
+                      reason);
+  server.evictedUntil = now + evictionInterval_;
+  server.idle.clear();
+  // When the server is picked again, it is measured afresh
+  server.sampled = false;
+  server.latencyUs = 0;
+}
+
+shared_ptr<TSocket> TBalancedSocketPool::connect(const Server& server) {
+  SocketFactory factory;
+  int connTimeout, recvTimeout, sendTimeout;
+  {
+    Guard g(mutex_);
+    factory = socketFactory_;
+    connTimeout = connTimeout_;
+    recvTimeout = recvTimeout_;
+    sendTimeout = sendTimeout_;
+  }
+  shared_ptr<TSocket> socket = factory ? factory(server.host, server.port)
+                                       : std::make_shared<TSocket>(server.host, server.port);
+  socket->setConnTimeout(connTimeout);
+  socket->setRecvTimeout(recvTimeout);
+  socket->setSendTimeout(sendTimeout);
+  socket->open();
+  return socket;
+}
+
+/**
+ * TBalancedSocket implementation.
+ *
+ */
+
+TBalancedSocket::TBalancedSocket(shared_ptr<TBalancedSocketPool> pool)
+  : pool_(pool), open_(false) {
+}
+
+TBalancedSocket::~TBalancedSocket() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+bool TBalancedSocket::peek() {
+  return lease_.socket && lease_.socket->peek();
+}
+
+void TBalancedSocket::open() {
+  open_ = true;
+  pool_->warmUp();
+}
+
+void TBalancedSocket::close() {
+  if (lease_.socket) {
+    finish(lease_.responded && !lease_.socket->hasPendingDataToRead()
+               ? TBalancedSocketPool::REUSABLE
+               : TBalancedSocketPool::BROKEN);
+  }
+  wBuf_.clear();
+  open_ = false;
+}
+
+uint32_t TBalancedSocket::read(uint8_t* buf, uint32_t len) {
+  if (!lease_.socket) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TBalancedSocket::read: no request sent");
+  }
+  uint32_t got;
+  try {
+    got = lease_.socket->read(buf, len);
+  } catch (const TTransportException&) {
+    finish(TBalancedSocketPool::FAILED);
+    throw;
+  }
+  if (got == 0) {
+    finish(TBalancedSocketPool::FAILED);
+    return 0;
+  }
+  if (!lease_.responded) {
+    int64_t latencyUs
+        = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent_).count();
+    pool_->respond(lease_, latencyUs);
+  }
+  return got;
+}
+
+void TBalancedSocket::write(const uint8_t* buf, uint32_t len) {
+  if (lease_.socket) {
+    // A new request; whatever was read of the last response is all there is,
+    // e.g. none for a oneway call
+    finish(lease_.socket->hasPendingDataToRead() ? TBalancedSocketPool::BROKEN
+                                                 : TBalancedSocketPool::REUSABLE);
+  }
+  wBuf_.insert(wBuf_.end(), buf, buf + len);
+}
+
+void TBalancedSocket::flush() {
+  if (wBuf_.empty()) {
+    return;
+  }
+  if (!open_) {
+    wBuf_.clear();
+    throw TTransportException(TTransportException::NOT_OPEN, "TBalancedSocket::flush: not open");
+  }
+
+  try {
+    for (int attempt = 0;; ++attempt) {
+      lease_ = pool_->acquire();
+      currentServer_ = lease_.server->host + ":" + std::to_string(lease_.server->port);
+      try {
+        lease_.socket->write(wBuf_.data(), static_cast<uint32_t>(wBuf_.size()));
+        lease_.socket->flush();
+        break;
+      } catch (const TTransportException&) {
+        // An idle connection may have been closed by the server meanwhile
+        bool retry = lease_.reused && attempt == 0;
+        finish(retry ? TBalancedSocketPool::BROKEN : TBalancedSocketPool::FAILED);
+        if (!retry) {
+          throw;
+        }
+      }
+    }
+  } catch (...) {
+    // The request failed; it must not go out ahead of the next one
+    wBuf_.clear();
+    throw;
+  }
+  wBuf_.clear();
+  sent_ = Clock::now();
+}
+
+uint32_t TBalancedSocket::readEnd() {
+  if (lease_.socket && lease_.responded) {
+    finish(lease_.socket->hasPendingDataToRead() ? TBalancedSocketPool::BROKEN
+                                                 : TBalancedSocketPool::REUSABLE);
+  }
+  return 0;
+}
+
+string TBalancedSocket::getCurrentServer() const {
+  return currentServer_;
+}
+
+void TBalancedSocket::finish(TBalancedSocketPool::Outcome outcome) {
+  pool_->release(lease_, outcome);
+}
+}
+}
+} // apache::thrift::transport
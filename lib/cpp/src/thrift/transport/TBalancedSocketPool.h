@@ -0,0 +1,289 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TBALANCEDSOCKETPOOL_H_
+#define _THRIFT_TRANSPORT_TBALANCEDSOCKETPOOL_H_ 1
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+class TBalancedSocket;
+
+/**
+ * Connections to a fleet of equivalent servers, shared by the TBalancedSocket
+ * transports of any number of clients and threads.
+ *
+ * Unlike TSocketPool, which fails over between servers when it is opened and
+ * then sticks to one connection, the pool picks a server for every request:
+ * it samples two servers at random and takes the one with the lower
+ * latency times requests in flight ("power of two choices"), where latency
+ * is a moving average of the time each server took to start responding.
+ * Connections are kept open between requests, up to a limit per server,
+ * and warmUp() opens them ahead of the first requests.
+ *
+ * A server is evicted, i.e. not picked, for the eviction interval after too
+ * many consecutive failures, or once its latency is more than the slow
+ * factor times the median of the others.  If every server is evicted, the
+ * one whose eviction ends first is picked anyway.
+ */
+class TBalancedSocketPool {
+public:
+  typedef std::function<std::shared_ptr<TSocket>(const std::string& host, int port)>
+      SocketFactory;
+
+  /// What the pool knows about a server, see getServerStats()
+  struct ServerStats {
+    std::string host;
+    int port;
+    /// Moving average of the time to the first byte of a response, 0 until known
+    double latencyUs;
+    /// Requests sent that have not been responded to
+    size_t inFlight;
+    /// Connections open and unused
+    size_t idleConnections;
+    int consecutiveFailures;
+    bool evicted;
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param servers list of pairs of host name and port
+   */
+  explicit TBalancedSocketPool(const std::vector<std::pair<std::string, int> >& servers);
+
+  ~TBalancedSocketPool();
+
+  /**
+   * Sets how sockets are created, e.g. with a TSSLSocketFactory.  By default
+   * they are plain TSockets.
+   */
+  void setSocketFactory(const SocketFactory& factory);
+
+  /** Sets the connect timeout of new connections, in milliseconds. */
+  void setConnTimeout(int ms);
+
+  /** Sets the receive timeout of new connections, in milliseconds. */
+  void setRecvTimeout(int ms);
+
+  /** Sets the send timeout of new connections, in milliseconds. */
+  void setSendTimeout(int ms);
+
+  /** Sets how many connections warmUp() opens to each server (default 1). */
+  void setMinIdleConnections(size_t count);
+
+  /** Sets how many unused connections are kept open per server (default 8). */
+  void setMaxIdleConnections(size_t count);
+
+  /** Sets how many failures in a row evict a server (default 3). */
+  void setMaxConsecutiveFailures(int count);
+
+  /** Sets how long an evicted server is not picked, in milliseconds (default 10000). */
+  void setEvictionInterval(int ms);
+
+  /**
+   * Sets how many times slower than the median a server may get before it
+   * is evicted; needs three servers or more.  0 disables this (default 5).
+   */
+  void setSlowFactor(double factor);
+
+  /**
+   * Sets the weight of a new sample in the moving averages of latency,
+   * between 0 and 1 (default 0.2).
+   *
+   * @throws TTransportException if the weight is out of range
+   */
+  void setLatencyWeight(double weight);
+
+  /**
+   * Opens connections to every server that is not evicted, until each has
+   * the minimum of idle connections.  Servers that cannot be reached count
+   * a failure.
+   */
+  void warmUp();
+
+  /**
+   * @return the state of each server
+   */
+  std::vector<ServerStats> getServerStats() const;
+
+private:
+  friend class TBalancedSocket;
+
+  struct Server {
+    Server(const std::string& h, int p);
+
+    std::string host;
+    int port;
+    double latencyUs;
+    bool sampled;
+    size_t inFlight;
+    int consecutiveFailures;
+    std::chrono::steady_clock::time_point evictedUntil;
+    std::vector<std::shared_ptr<TSocket> > idle;
+  };
+
+  /// A connection taken out of the pool for a request
+  struct Lease {
+    Lease() : reused(false), responded(false) {}
+
+    std::shared_ptr<Server> server;
+    std::shared_ptr<TSocket> socket;
+    /// Whether the connection was idle in the pool, rather than new
+    bool reused;
+    /// Whether respond() was called
+    bool responded;
+  };
+
+  /// How a lease is given back
+  enum Outcome {
+    REUSABLE,  ///< the connection can take another request
+    BROKEN,    ///< the connection must be closed, the server is not to blame
+    FAILED     ///< the connection must be closed and the server failed
+  };
+
+  /**
+   * Picks a server and takes a connection to it.
+   *
+   * @throws TTransportException NOT_OPEN if no server can be connected to
+   */
+  Lease acquire();
+
+  /// Records that the server started to respond after latencyUs
+  void respond(Lease& lease, int64_t latencyUs);
+
+  /// Gives a lease back
+  void release(Lease& lease, Outcome outcome);
+
+  /// Picks a server with power of two choices, mutex_ must be held
+  std::shared_ptr<Server> pick(std::chrono::steady_clock::time_point now);
+
+  /// Counts a failure of server, mutex_ must be held
+  void fail(Server& server, std::chrono::steady_clock::time_point now);
+
+  /// Evicts server until the eviction interval has passed, mutex_ must be held
+  void evict(Server& server, std::chrono::steady_clock::time_point now, const char* reason);
+
+  /// Opens a connection to server, without holding mutex_
+  std::shared_ptr<TSocket> connect(const Server& server);
+
+  mutable apache::thrift::concurrency::Mutex mutex_;
+  std::vector<std::shared_ptr<Server> > servers_;
+  std::mt19937 random_;
+  SocketFactory socketFactory_;
+  int connTimeout_;
+  int recvTimeout_;
+  int sendTimeout_;
+  size_t minIdleConnections_;
+  size_t maxIdleConnections_;
+  int maxConsecutiveFailures_;
+  std::chrono::milliseconds evictionInterval_;
+  double slowFactor_;
+  double latencyWeight_;
+};
+
+/**
+ * Client transport that sends each request to a server of a
+ * TBalancedSocketPool.
+ *
+ * A request is written to a buffer and sent on flush(), on a connection to
+ * the server the pool picks; the response is read from that connection.
+ * The connection goes back to the pool with readEnd(), or when the next
+ * request is written, so the transport is meant for one client that makes
+ * one call at a time, e.g. a generated client over a TFramedTransport or
+ * directly over this transport.  Each client thread needs its own.
+ *
+ * isOpen() is true between open() and close(); connections are opened as
+ * they are needed.
+ */
+class TBalancedSocket : public TVirtualTransport<TBalancedSocket> {
+public:
+  explicit TBalancedSocket(std::shared_ptr<TBalancedSocketPool> pool);
+
+  ~TBalancedSocket() override;
+
+  bool isOpen() const override { return open_; }
+
+  bool peek() override;
+
+  /**
+   * Allows requests to be sent, and warms up the pool.
+   */
+  void open() override;
+
+  /**
+   * Gives any connection back to the pool.
+   */
+  void close() override;
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+
+  void write(const uint8_t* buf, uint32_t len);
+
+  /**
+   * Sends the request written since the last flush() to a server.  A
+   * connection that was idle in the pool may have been closed by the
+   * server, so a request that cannot be written to one is sent again on a
+   * new connection, once.
+   *
+   * @throws TTransportException if the request could not be sent
+   */
+  void flush() override;
+
+  /**
+   * Ends the response, and gives the connection back to the pool.
+   */
+  uint32_t readEnd() override;
+
+  /**
+   * @return the host:port the last request was sent to, empty if none
+   */
+  std::string getCurrentServer() const;
+
+  const std::shared_ptr<TBalancedSocketPool>& getPool() const { return pool_; }
+
+private:
+  /// Gives the lease back to the pool, if there is one
+  void finish(TBalancedSocketPool::Outcome outcome);
+
+  std::shared_ptr<TBalancedSocketPool> pool_;
+  TBalancedSocketPool::Lease lease_;
+  std::vector<uint8_t> wBuf_;
+  std::chrono::steady_clock::time_point sent_;
+  std::string currentServer_;
+  bool open_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TBALANCEDSOCKETPOOL_H_
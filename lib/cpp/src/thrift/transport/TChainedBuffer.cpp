@@ -0,0 +1,329 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <thrift/transport/TChainedBuffer.h>
+#include <thrift/transport/TSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+const uint32_t TChainedBuffer::DEFAULT_SEGMENT_SIZE;
+const uint32_t TChainedBuffer::MAX_SEGMENT_SIZE;
+const uint32_t TChainedBuffer::MAX_SPARE_SEGMENTS;
+const uint32_t TChainedBuffer::MAX_WRITE_SEGMENTS;
+
+TChainedBuffer::TChainedBuffer(uint32_t segmentSize)
+  : segmentSize_((std::max)(segmentSize, static_cast<uint32_t>(1))),
+    nextSegmentSize_(segmentSize_),
+    writing_(false),
+    holdSent_(false),
+    readBytes_(0),
+    writtenBytes_(0) {
+  openWriteSegment(0);
+  setReadBuffer(wBase_, 0);
+}
+
+TChainedBuffer::~TChainedBuffer() {
+  for (auto& segment : segments_) {
+    releaseSegment(segment);
+  }
+  releaseSentSegments();
+  releaseSpareSegments();
+}
+
+uint8_t* TChainedBuffer::segmentEnd(size_t index) const {
+  const Segment& segment = segments_[index];
+  if (writing_ && index == segments_.size() - 1) {
+    return wBase_;
+  }
+  return segment.data + segment.length;
+}
+
+void TChainedBuffer::closeWriteSegment() {
+  if (writing_) {
+    Segment& back = segments_.back();
+    back.length = static_cast<uint32_t>(wBase_ - back.data);
+    writtenBytes_ += back.length;
+    writing_ = false;
+  }
+  if (segments_.empty()) {
+    return;
+  }
+  // Any further write must take the slow path and open a new segment
+  wBound_ = wBase_ = segmentEnd(segments_.size() - 1);
+}
+
+void TChainedBuffer::openWriteSegment(uint32_t len) {
+  closeWriteSegment();
+
+  Segment segment;
+  segment.length = 0;
+  if (len <= segmentSize_ && nextSegmentSize_ == segmentSize_ && !spare_.empty()) {
+    segment.data = spare_.back();
+    segment.capacity = segmentSize_;
+    spare_.pop_back();
+  } else {
+    segment.capacity = (std::max)(len, nextSegmentSize_);
+    segment.data = static_cast<uint8_t*>(std::malloc(segment.capacity));
+    if (segment.data == nullptr) {
+      throw std::bad_alloc();
+    }
+    if (nextSegmentSize_ < MAX_SEGMENT_SIZE) {
+      nextSegmentSize_ = (std::min)(nextSegmentSize_ * 2, MAX_SEGMENT_SIZE);
+    }
+  }
+
+  // The front segment's read pointers are not affected by push_back
+  segments_.push_back(segment);
+  writing_ = true;
+  setWriteBuffer(segment.data, segment.capacity);
+}
+
+void TChainedBuffer::releaseSegment(Segment& segment) {
+  if (segment.capacity == segmentSize_ && spare_.size() < MAX_SPARE_SEGMENTS) {
+    spare_.push_back(segment.data);
+  } else if (segment.capacity > 0) {
+    std::free(segment.data);
+  }
+  segment.data = nullptr;
+  segment.owner.reset();
+}
+
+void TChainedBuffer::popFront() {
+  Segment& front = segments_.front();
+  readBytes_ += static_cast<uint32_t>(segmentEnd(0) - front.data);
+  if (holdSent_) {
+    sent_.push_back(front);
+  } else {
+    releaseSegment(front);
+  }
+  segments_.pop_front();
+}
+
+bool TChainedBuffer::advanceRead() {
+  for (;;) {
+    // Correct rBound_, which goes stale while the front segment is written to
+    rBound_ = segmentEnd(0);
+    if (rBase_ < rBound_) {
+      return true;
+    }
+
+    if (segments_.size() == 1) {
+      if (!writing_) {
+        // Only an exhausted external blob or closed segment is left; start
+        // over with a fresh write segment behind it
+        openWriteSegment(0);
+        popFront();
+      } else {
+        // Everything written has been read, so rewind the write segment
+        Segment& front = segments_.front();
+        uint32_t length = static_cast<uint32_t>(wBase_ - front.data);
+        readBytes_ += length;
+        writtenBytes_ += length;
+        wBase_ = front.data;
+      }
+      setReadBuffer(wBase_, 0);
+      return false;
+    }
+
+    popFront();
+    setReadBuffer(segments_.front().data, static_cast<uint32_t>(segmentEnd(0) - segments_.front().data));
+  }
+}
+
+uint32_t TChainedBuffer::readSlow(uint8_t* buf, uint32_t len) {
+  uint32_t have = 0;
+  while (have < len && advanceRead()) {
+    uint32_t give = (std::min)(len - have, static_cast<uint32_t>(rBound_ - rBase_));
+    std::memcpy(buf + have, rBase_, give);
+    rBase_ += give;
+    have += give;
+  }
+  return have;
+}
+
+void TChainedBuffer::writeSlow(const uint8_t* buf, uint32_t len) {
+  // Fill what is left of the current segment, then move on to the next
+  for (;;) {
+    auto space = static_cast<uint32_t>(wBound_ - wBase_);
+    uint32_t give = (std::min)(space, len);
+    if (give > 0) {
+      std::memcpy(wBase_, buf, give);
+      wBase_ += give;
+      buf += give;
+      len -= give;
+    }
+    if (len == 0) {
+      return;
+    }
+    openWriteSegment(0);
+  }
+}
+
+const uint8_t* TChainedBuffer::borrowSlow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  // Only data within one segment can be lent out
+  if (advanceRead() && static_cast<ptrdiff_t>(*len) <= rBound_ - rBase_) {
+    *len = static_cast<uint32_t>(rBound_ - rBase_);
+    return rBase_;
+  }
+  return nullptr;
+}
+
+void TChainedBuffer::appendExternal(const uint8_t* buf,
+                                    uint32_t len,
+                                    std::shared_ptr<const void> owner) {
+  if (len < segmentSize_ || len <= static_cast<uint32_t>(wBound_ - wBase_)) {
+    write(buf, len);
+    return;
+  }
+
+  closeWriteSegment();
+  writtenBytes_ += len;
+
+  Segment segment;
+  segment.data = const_cast<uint8_t*>(buf);
+  segment.capacity = 0;
+  segment.length = len;
+  segment.owner = std::move(owner);
+  segments_.push_back(segment);
+
+  // Keep wBase_ pointing at the end of the chain, so that writes go to a new
+  // segment after the blob
+  wBound_ = wBase_ = segment.data + len;
+}
+
+uint8_t* TChainedBuffer::getWritePtr(uint32_t len) {
+  if (static_cast<uint32_t>(wBound_ - wBase_) < len) {
+    openWriteSegment(len);
+  }
+  return wBase_;
+}
+
+void TChainedBuffer::wroteBytes(uint32_t len) {
+  if (len > static_cast<uint32_t>(wBound_ - wBase_)) {
+    throw TTransportException("Client wrote more bytes than size of buffer.");
+  }
+  wBase_ += len;
+}
+
+uint32_t TChainedBuffer::available_read() const {
+  uint32_t avail = static_cast<uint32_t>(segmentEnd(0) - rBase_);
+  for (size_t i = 1; i < segments_.size(); ++i) {
+    avail += static_cast<uint32_t>(segmentEnd(i) - segments_[i].data);
+  }
+  return avail;
+}
+
+uint32_t TChainedBuffer::writePartialTo(TSocket& socket) {
+  if (!advanceRead()) {
+    return 0;
+  }
+
+  const uint8_t* bufs[MAX_WRITE_SEGMENTS];
+  uint32_t lens[MAX_WRITE_SEGMENTS];
+  bufs[0] = rBase_;
+  lens[0] = static_cast<uint32_t>(rBound_ - rBase_);
+  uint32_t count = 1;
+  for (size_t i = 1; i < segments_.size() && count < MAX_WRITE_SEGMENTS; ++i) {
+    bufs[count] = segments_[i].data;
+    lens[count] = static_cast<uint32_t>(segmentEnd(i) - segments_[i].data);
+    if (lens[count] > 0) {
+      ++count;
+    }
+  }
+
+  uint32_t sent = socket.writev_partial(bufs, lens, count);
+
+  // Consume what was sent, keeping the segments the kernel may still read
+  // from until resetBuffer()
+  holdSent_ = sent > 0 && socket.getZeroCopyPending() > 0;
+  uint32_t left = sent;
+  while (left > 0 && advanceRead()) {
+    uint32_t give = (std::min)(left, static_cast<uint32_t>(rBound_ - rBase_));
+    rBase_ += give;
+    left -= give;
+  }
+  holdSent_ = false;
+  return sent;
+}
+
+void TChainedBuffer::flushTo(TSocket& socket) {
+  while (advanceRead()) {
+    if (writePartialTo(socket) == 0) {
+      // This should only happen if the timeout set with SO_SNDTIMEO expired.
+      throw TTransportException(TTransportException::TIMED_OUT, "send timeout expired");
+    }
+  }
+  socket.waitForZeroCopy();
+  releaseSentSegments();
+}
+
+void TChainedBuffer::resetBuffer() {
+  closeWriteSegment();
+  while (!segments_.empty()) {
+    releaseSegment(segments_.back());
+    segments_.pop_back();
+  }
+  releaseSentSegments();
+  nextSegmentSize_ = segmentSize_;
+  readBytes_ = 0;
+  writtenBytes_ = 0;
+  openWriteSegment(0);
+  setReadBuffer(wBase_, 0);
+}
+
+void TChainedBuffer::releaseSentSegments() {
+  for (auto& segment : sent_) {
+    releaseSegment(segment);
+  }
+  sent_.clear();
+}
+
+void TChainedBuffer::releaseSpareSegments() {
+  for (auto data : spare_) {
+    std::free(data);
+  }
+  spare_.clear();
+}
+
+uint32_t TChainedBuffer::readEnd() {
+  uint32_t bytes = readBytes_ + static_cast<uint32_t>(rBase_ - segments_.front().data);
+  if (!advanceRead()) {
+    resetBuffer();
+  }
+  return bytes;
+}
+
+uint32_t TChainedBuffer::writeEnd() {
+  uint32_t bytes = writtenBytes_;
+  if (writing_) {
+    bytes += static_cast<uint32_t>(wBase_ - segments_.back().data);
+  }
+  return bytes;
+}
+}
+}
+} // apache::thrift::transport
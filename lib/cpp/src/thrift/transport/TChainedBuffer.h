@@ -0,0 +1,233 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCHAINEDBUFFER_H_
+#define _THRIFT_TRANSPORT_TCHAINEDBUFFER_H_ 1
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+class TSocket;
+
+/**
+ * A memory buffer made of a chain of separately allocated segments.
+ *
+ * TMemoryBuffer keeps its contents in one contiguous allocation which it
+ * doubles (and copies) as it fills up, so building a large message copies
+ * about twice its size and briefly needs three times its size in memory.
+ * TChainedBuffer instead appends a new segment whenever the current one is
+ * full and never moves data that has already been written.  Segments start at
+ * the size given to the constructor and double, up to MAX_SEGMENT_SIZE, as the
+ * buffer grows.
+ *
+ * The TBufferBase fast paths operate on one segment at a time: writes go to
+ * the last segment and reads come from the first, and only crossing a segment
+ * boundary takes the slow path.
+ *
+ * Data owned by someone else can be linked into the chain without copying
+ * with appendExternal(), and the contents can be sent to a TSocket with a
+ * single gathered write per call using writePartialTo() or flushTo().
+ *
+ * Pointers returned by getWritePtr() stay valid until the data they point to
+ * has been read or the buffer is reset, which lets a caller reserve space up
+ * front (e.g. for a frame size) and fill it in later.
+ */
+class TChainedBuffer : public TVirtualTransport<TChainedBuffer, TBufferBase> {
+public:
+  /// Default size of the first segment
+  static const uint32_t DEFAULT_SEGMENT_SIZE = 4096;
+
+  /// Segments grow by doubling up to this size
+  static const uint32_t MAX_SEGMENT_SIZE = 1024 * 1024;
+
+  /// Number of emptied segments kept for reuse
+  static const uint32_t MAX_SPARE_SEGMENTS = 4;
+
+  /// Maximum number of segments handed to a single gathered write
+  static const uint32_t MAX_WRITE_SEGMENTS = 64;
+
+  /**
+   * Constructor.
+   *
+   * @param segmentSize  size of the first segment; later ones double up to
+   *                     MAX_SEGMENT_SIZE (or segmentSize, if that is larger)
+   */
+  explicit TChainedBuffer(uint32_t segmentSize = DEFAULT_SEGMENT_SIZE);
+
+  ~TChainedBuffer() override;
+
+  TChainedBuffer(const TChainedBuffer&) = delete;
+  TChainedBuffer& operator=(const TChainedBuffer&) = delete;
+
+  bool isOpen() const override { return true; }
+
+  bool peek() override { return available_read() > 0; }
+
+  void open() override {}
+
+  void close() override {}
+
+  /**
+   * Links len bytes at buf into the chain without copying them.
+   *
+   * The memory must stay valid and unchanged until it has been read or the
+   * buffer is reset.  If owner is set, the buffer holds on to it until then,
+   * so passing the object that owns buf (e.g. a shared_ptr<std::string>)
+   * takes care of that.  Blobs shorter than a segment are simply copied,
+   * since a segment of their own would cost more than the copy.
+   */
+  void appendExternal(const uint8_t* buf,
+                      uint32_t len,
+                      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+
+  /**
+   * Returns a pointer to at least len contiguous bytes at the end of the
+   * buffer.  Call wroteBytes() once data has been written there.
+   */
+  uint8_t* getWritePtr(uint32_t len);
+
+  /**
+   * Informs the buffer that the caller has written len bytes into the space
+   * returned by getWritePtr().
+   */
+  void wroteBytes(uint32_t len);
+
+  /**
+   * Sends as much of the buffered data as the socket accepts in one gathered
+   * write and consumes it.  If the socket sent it with MSG_ZEROCOPY, the
+   * sent segments are kept until resetBuffer(), which must not be called
+   * before the socket has no zero-copy sends pending, and nothing must be
+   * written until then either.
+   *
+   * @return the number of bytes sent, 0 if the socket would block
+   * @throws TTransportException on socket errors, as TSocket::write_partial()
+   */
+  uint32_t writePartialTo(TSocket& socket);
+
+  /**
+   * Sends all buffered data to the socket, blocking as needed.
+   *
+   * @throws TTransportException on socket errors or if the send timeout expires
+   */
+  void flushTo(TSocket& socket);
+
+  /// Number of bytes that can be read.
+  uint32_t available_read() const;
+
+  /// Number of segments holding unread data.
+  uint32_t getSegmentCount() const { return static_cast<uint32_t>(segments_.size()); }
+
+  /**
+   * Discards all data.  Emptied segments are kept for reuse, up to
+   * MAX_SPARE_SEGMENTS of them.
+   */
+  void resetBuffer();
+
+  /// Frees the segments kept for reuse.
+  void releaseSpareSegments();
+
+  uint32_t readEnd() override;
+
+  uint32_t writeEnd() override;
+
+  /*
+   * TVirtualTransport provides a default implementation of readAll().
+   * We want to use the TBufferBase version instead.
+   */
+  uint32_t readAll(uint8_t* buf, uint32_t len) { return TBufferBase::readAll(buf, len); }
+
+protected:
+  uint32_t readSlow(uint8_t* buf, uint32_t len) override;
+
+  void writeSlow(const uint8_t* buf, uint32_t len) override;
+
+  const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len) override;
+
+private:
+  struct Segment {
+    uint8_t* data;
+    // Bytes allocated at data, 0 for external blobs
+    uint32_t capacity;
+    // Bytes written, not kept up to date for the segment being written to
+    uint32_t length;
+    // Keeps an external blob alive
+    std::shared_ptr<const void> owner;
+  };
+
+  // Data end of the segment at index
+  uint8_t* segmentEnd(size_t index) const;
+
+  // Stops writing into the last segment
+  void closeWriteSegment();
+
+  // Appends a new owned segment with room for at least len bytes and makes it
+  // the write segment
+  void openWriteSegment(uint32_t len);
+
+  // Moves the read pointers past any exhausted segments; returns false if
+  // there is nothing left to read.  The segments list is never left empty.
+  bool advanceRead();
+
+  // Drops the first segment
+  void popFront();
+
+  // Frees or recycles the storage of a segment
+  void releaseSegment(Segment& segment);
+
+  // Releases the segments kept for zero-copy sends
+  void releaseSentSegments();
+
+  std::deque<Segment> segments_;
+
+  // Emptied segments of segmentSize_ bytes
+  std::vector<uint8_t*> spare_;
+
+  // Segments sent with MSG_ZEROCOPY, which the kernel may still read from
+  std::vector<Segment> sent_;
+
+  // Size of the first segment
+  uint32_t segmentSize_;
+
+  // Size of the segment to allocate next
+  uint32_t nextSegmentSize_;
+
+  // Is wBase_ pointing into segments_.back()?
+  bool writing_;
+
+  // Are consumed segments moved to sent_ rather than released?
+  bool holdSent_;
+
+  // Bytes read from segments that have since been dropped or rewound, and
+  // bytes written to segments that have since been closed or rewound, since
+  // the last reset
+  uint32_t readBytes_;
+  uint32_t writtenBytes_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCHAINEDBUFFER_H_
@@ -395,10 +395,16 @@ void THeaderTransport::writeString(uint8_t*& ptr, const string& str) {
   ptr += strLen;
 }
 
+constexpr const char* THeaderTransport::CLIENT_TIMEOUT_HEADER;
+
 void THeaderTransport::setHeader(const string& key, const string& value) {
   writeHeaders_[key] = value;
 }
 
+void THeaderTransport::setClientTimeout(int64_t timeoutMs) {
+  setHeader(CLIENT_TIMEOUT_HEADER, std::to_string(timeoutMs));
+}
+
 uint32_t THeaderTransport::getMaxWriteHeadersSize() const {
   size_t maxWriteHeadersSize = 0;
   THeaderTransport::StringToStringMap::const_iterator it;
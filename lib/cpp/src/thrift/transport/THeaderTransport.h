@@ -21,6 +21,7 @@
 #define THRIFT_TRANSPORT_THEADERTRANSPORT_H_ 1
 
 #include <bitset>
+#include <cstdlib>
 #include <limits>
 #include <vector>
 #include <stdexcept>
@@ -160,6 +161,36 @@ public:
   // these work with read headers
   const StringToStringMap& getHeaders() const { return readHeaders_; }
 
+  /**
+   * Info header carrying how many milliseconds the client will wait for the
+   * response to a request.  TNonblockingServer can use it as the request's
+   * deadline, see TNonblockingServer::setClientTimeoutExpiration().
+   */
+  static constexpr const char* CLIENT_TIMEOUT_HEADER = "client_timeout";
+
+  /**
+   * Sends the client timeout (in milliseconds) with the next message.
+   */
+  void setClientTimeout(int64_t timeoutMs);
+
+  /**
+   * Gets the client timeout (in milliseconds) sent with the last message read,
+   * or 0 if there was none.  Inline so that servers which only see this
+   * transport through a factory need not link against it.
+   */
+  int64_t getClientTimeout() const {
+    auto it = readHeaders_.find(CLIENT_TIMEOUT_HEADER);
+    if (it == readHeaders_.end()) {
+      return 0;
+    }
+    char* end;
+    long long timeoutMs = strtoll(it->second.c_str(), &end, 10);
+    if (end == it->second.c_str() || *end != '\0' || timeoutMs < 0) {
+      return 0;
+    }
+    return static_cast<int64_t>(timeoutMs);
+  }
+
   // accessors for seqId
   int32_t getSequenceNumber() const { return seqId; }
   void setSequenceNumber(int32_t seqId) { this->seqId = seqId; }
@@ -67,6 +67,9 @@ public:
 
 protected:
   std::shared_ptr<TSocket> createSocket(THRIFT_SOCKET socket) override;
+  std::shared_ptr<TNonblockingServerSocket> copy() const override {
+    return std::make_shared<TNonblockingSSLServerSocket>(*this);
+  }
   std::shared_ptr<TSSLSocketFactory> factory_;
 };
 }
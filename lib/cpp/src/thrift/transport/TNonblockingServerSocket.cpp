@@ -52,6 +52,10 @@
 #define AF_LOCAL AF_UNIX
 #endif
 
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+#define THRIFT_HAVE_ACCEPT4 1
+#endif
+
 #ifndef SOCKOPT_CAST_T
 #ifndef _WIN32
 #define SOCKOPT_CAST_T void
@@ -88,7 +92,10 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port)
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    tcpDeferAccept_(0),
+    tcpFastOpen_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -103,7 +110,10 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port, int sendTimeout, in
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    tcpDeferAccept_(0),
+    tcpFastOpen_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -119,7 +129,10 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& address, int po
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    tcpDeferAccept_(0),
+    tcpFastOpen_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -135,7 +148,10 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& path)
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    tcpDeferAccept_(0),
+    tcpFastOpen_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -247,6 +263,22 @@ void TNonblockingServerSocket::listen() {
 #endif
   }
 
+  if (reusePort_ && path_.empty()) {
+#ifdef SO_REUSEPORT
+    if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEPORT, cast_sockopt(&one), sizeof(one))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() SO_REUSEPORT ", errno_copy);
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Could not set SO_REUSEPORT",
+                                errno_copy);
+    }
+#else
+    close();
+    throw TTransportException(TTransportException::NOT_OPEN, "SO_REUSEPORT is not supported");
+#endif
+  }
+
   // Set TCP buffer sizes
   if (tcpSendBuffer_ > 0) {
     if (-1 == setsockopt(serverSocket_,
@@ -278,6 +310,32 @@ void TNonblockingServerSocket::listen() {
     }
   }
 
+#ifdef TCP_DEFER_ACCEPT
+  if (path_.empty() && tcpDeferAccept_ > 0) {
+    if (-1 == setsockopt(serverSocket_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &tcpDeferAccept_,
+                         sizeof(tcpDeferAccept_))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() TCP_DEFER_ACCEPT ", errno_copy);
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Could not set TCP_DEFER_ACCEPT",
+                                errno_copy);
+    }
+  }
+#endif // #ifdef TCP_DEFER_ACCEPT
+
+  if (path_.empty() && tcpFastOpen_ > 0) {
+#ifdef TCP_FASTOPEN
+    if (-1 == setsockopt(serverSocket_, IPPROTO_TCP, TCP_FASTOPEN, cast_sockopt(&tcpFastOpen_),
+                         sizeof(tcpFastOpen_))) {
+      GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() TCP_FASTOPEN ",
+                          THRIFT_GET_SOCKET_ERROR);
+    }
+#else
+    GlobalOutput("TNonblockingServerSocket::listen() TCP_FASTOPEN is not supported on this platform");
+#endif
+  }
+
 #ifdef IPV6_V6ONLY
   if (res->ai_family == AF_INET6 && path_.empty()) {
     int zero = 0;
@@ -480,11 +538,10 @@ shared_ptr<TSocket> TNonblockingServerSocket::acceptImpl() {
   if (serverSocket_ == THRIFT_INVALID_SOCKET) {
     throw TTransportException(TTransportException::NOT_OPEN, "TNonblockingServerSocket not listening");
   }
-  
+
   struct sockaddr_storage clientAddress;
-  int size = sizeof(clientAddress);
-  THRIFT_SOCKET clientSocket
-      = ::accept(serverSocket_, (struct sockaddr*)&clientAddress, (socklen_t*)&size);
+  socklen_t size = sizeof(clientAddress);
+  THRIFT_SOCKET clientSocket = acceptSocket(&clientAddress, &size);
 
   if (clientSocket == THRIFT_INVALID_SOCKET) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
@@ -492,6 +549,46 @@ shared_ptr<TSocket> TNonblockingServerSocket::acceptImpl() {
     throw TTransportException(TTransportException::UNKNOWN, "accept()", errno_copy);
   }
 
+  return createClient(clientSocket, clientAddress, size);
+}
+
+std::vector<shared_ptr<TSocket> > TNonblockingServerSocket::acceptBatch(size_t maxCount) {
+  if (serverSocket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN, "TNonblockingServerSocket not listening");
+  }
+
+  std::vector<shared_ptr<TSocket> > clients;
+  while (clients.size() < maxCount) {
+    struct sockaddr_storage clientAddress;
+    socklen_t size = sizeof(clientAddress);
+    THRIFT_SOCKET clientSocket = acceptSocket(&clientAddress, &size);
+
+    if (clientSocket == THRIFT_INVALID_SOCKET) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy == THRIFT_EAGAIN || errno_copy == THRIFT_EWOULDBLOCK) {
+        break;
+      }
+      GlobalOutput.perror("TNonblockingServerSocket::acceptBatch() ::accept() ", errno_copy);
+      if (clients.empty()) {
+        throw TTransportException(TTransportException::UNKNOWN, "accept()", errno_copy);
+      }
+      break;
+    }
+    clients.push_back(createClient(clientSocket, clientAddress, size));
+  }
+  return clients;
+}
+
+THRIFT_SOCKET TNonblockingServerSocket::acceptSocket(struct sockaddr_storage* address,
+                                                     socklen_t* size) {
+#ifdef THRIFT_HAVE_ACCEPT4
+  return ::accept4(serverSocket_, (struct sockaddr*)address, size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  THRIFT_SOCKET clientSocket = ::accept(serverSocket_, (struct sockaddr*)address, size);
+  if (clientSocket == THRIFT_INVALID_SOCKET) {
+    return clientSocket;
+  }
+
   // Explicitly set this socket to NONBLOCK mode
   int flags = THRIFT_FCNTL(clientSocket, THRIFT_F_GETFL, 0);
   if (flags == -1) {
@@ -513,7 +610,13 @@ shared_ptr<TSocket> TNonblockingServerSocket::acceptImpl() {
                               "THRIFT_FCNTL(THRIFT_F_SETFL)",
                               errno_copy);
   }
+  return clientSocket;
+#endif
+}
 
+shared_ptr<TSocket> TNonblockingServerSocket::createClient(THRIFT_SOCKET clientSocket,
+                                                           const struct sockaddr_storage& address,
+                                                           socklen_t size) {
   shared_ptr<TSocket> client = createSocket(clientSocket);
   if (sendTimeout_ > 0) {
     client->setSendTimeout(sendTimeout_);
@@ -524,7 +627,7 @@ shared_ptr<TSocket> TNonblockingServerSocket::acceptImpl() {
   if (keepAlive_) {
     client->setKeepAlive(keepAlive_);
   }
-  client->setCachedAddress((sockaddr*)&clientAddress, size);
+  client->setCachedAddress((sockaddr*)&address, size);
 
   if (acceptCallback_)
     acceptCallback_(clientSocket);
@@ -532,6 +635,18 @@ shared_ptr<TSocket> TNonblockingServerSocket::acceptImpl() {
   return client;
 }
 
+shared_ptr<TNonblockingServerTransport> TNonblockingServerSocket::createPeerListener() {
+  if (!reusePort_ || !path_.empty() || serverSocket_ == THRIFT_INVALID_SOCKET) {
+    return shared_ptr<TNonblockingServerTransport>();
+  }
+  shared_ptr<TNonblockingServerSocket> peer = copy();
+  peer->port_ = listenPort_;
+  peer->serverSocket_ = THRIFT_INVALID_SOCKET;
+  peer->listening_ = false;
+  peer->listen();
+  return peer;
+}
+
 shared_ptr<TSocket> TNonblockingServerSocket::createSocket(THRIFT_SOCKET clientSocket) {
   return std::make_shared<TSocket>(clientSocket);
 }
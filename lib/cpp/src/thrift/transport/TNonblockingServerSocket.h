@@ -83,9 +83,33 @@ public:
 
   void setKeepAlive(bool keepAlive) { keepAlive_ = keepAlive; }
 
+  /**
+   * Set SO_REUSEPORT on the listening socket, which lets createPeerListener()
+   * open more listeners on the same port; the kernel then spreads incoming
+   * connections across them.  Only for TCP sockets, and only where the
+   * platform has SO_REUSEPORT.  Must be called before listen().
+   */
+  void setReusePort(bool reusePort) { reusePort_ = reusePort; }
+
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
+  /**
+   * Set TCP_DEFER_ACCEPT on the listening socket, so that a new connection
+   * is only reported once it has data to read, or after this many seconds.
+   * Spares the server the wakeups of connections that send nothing, e.g.
+   * port scans and reconnects that are abandoned.  0 (the default) disables
+   * it.  Linux only.  Must be called before listen().
+   */
+  void setTcpDeferAccept(int seconds) { tcpDeferAccept_ = seconds; }
+
+  /**
+   * Enable server-side TCP Fast Open with a queue of this many pending
+   * connections, which lets a returning client send its first request in
+   * the SYN.  0 (the default) disables it.  Must be called before listen().
+   */
+  void setTcpFastOpen(int queueLength) { tcpFastOpen_ = queueLength; }
+
   // listenCallback gets called just before listen, and after all Thrift
   // setsockopt calls have been made.  If you have custom setsockopt
   // things that need to happen on the listening socket, this is the place to do it.
@@ -106,11 +130,40 @@ public:
   void listen() override;
   void close() override;
 
+  /**
+   * Opens another socket listening on the same port, with the same settings.
+   * Requires setReusePort(true).
+   */
+  std::shared_ptr<TNonblockingServerTransport> createPeerListener() override;
+
+  /**
+   * Accepts until no connection is left waiting or maxCount have been
+   * accepted, with accept4() where available so that each socket comes back
+   * nonblocking and close-on-exec without further system calls.
+   */
+  std::vector<std::shared_ptr<TSocket> > acceptBatch(size_t maxCount) override;
+
 protected:
   std::shared_ptr<TSocket> acceptImpl() override;
   virtual std::shared_ptr<TSocket> createSocket(THRIFT_SOCKET client);
 
+  /**
+   * Returns a copy of this object for createPeerListener(); subclasses that
+   * create their own kind of socket override this to copy themselves.
+   */
+  virtual std::shared_ptr<TNonblockingServerSocket> copy() const {
+    return std::make_shared<TNonblockingServerSocket>(*this);
+  }
+
 private:
+  /// Accepts a nonblocking client socket, THRIFT_INVALID_SOCKET if accept() fails
+  THRIFT_SOCKET acceptSocket(struct sockaddr_storage* address, socklen_t* size);
+
+  /// Creates and sets up the TSocket for an accepted client socket
+  std::shared_ptr<TSocket> createClient(THRIFT_SOCKET clientSocket,
+                                        const struct sockaddr_storage& address,
+                                        socklen_t size);
+
   int port_;
   int listenPort_;
   std::string address_;
@@ -123,7 +176,10 @@ private:
   int retryDelay_;
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
+  int tcpDeferAccept_;
+  int tcpFastOpen_;
   bool keepAlive_;
+  bool reusePort_;
   bool listening_;
 
   socket_func_t listenCallback_;
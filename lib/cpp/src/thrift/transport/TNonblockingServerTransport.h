@@ -21,6 +21,7 @@
 #define _THRIFT_TRANSPORT_TNONBLOCKINGSERVERTRANSPORT_H_ 1
 
 #include <thrift/transport/TSocket.h>
+#include <vector>
 #include <thrift/transport/TTransportException.h>
 
 namespace apache {
@@ -63,6 +64,20 @@ public:
     return result;
   }
 
+  /**
+   * Accepts the connections waiting, up to maxCount of them, for a caller
+   * that was told the transport is readable.  Transports that cannot tell
+   * whether more connections are waiting accept one, as accept() does.
+   *
+   * @return the connections accepted, in order; empty if none was waiting
+   * @throws TTransportException if accepting failed before any connection
+   *         was accepted
+   */
+  virtual std::vector<std::shared_ptr<TSocket> > acceptBatch(size_t maxCount) {
+    (void)maxCount;
+    return std::vector<std::shared_ptr<TSocket> >(1, accept());
+  }
+
   /**
   * Utility method
   * 
@@ -76,6 +91,19 @@ public:
 
   virtual int getListenPort() = 0;
 
+  /**
+   * Creates another transport accepting connections for the same address, so
+   * that several threads can each accept on a listener of their own.  Must be
+   * called after listen(); the peer is returned listening.
+   *
+   * @return the peer, or an empty pointer if this transport cannot share its
+   *         address
+   * @throws TTransportException if the peer could not listen
+   */
+  virtual std::shared_ptr<TNonblockingServerTransport> createPeerListener() {
+    return std::shared_ptr<TNonblockingServerTransport>();
+  }
+
   /**
    * Closes this transport such that future calls to accept will do nothing.
    */
@@ -19,6 +19,7 @@
 
 #include <thrift/thrift-config.h>
 
+#include <algorithm>
 #include <cstring>
 #include <errno.h>
 #include <memory>
@@ -39,6 +40,7 @@
 
 #define OPENSSL_VERSION_NO_THREAD_ID_BEFORE    0x10000000L
 #define OPENSSL_ENGINE_CLEANUP_REQUIRED_BEFORE 0x10100000L
+#define OPENSSL_TICKET_KEY_EVP_CB_SINCE        0x30000000L
 
 #include <boost/shared_array.hpp>
 #include <openssl/opensslv.h>
@@ -46,6 +48,12 @@
 #include <openssl/engine.h>
 #endif
 #include <openssl/err.h>
+#if (OPENSSL_VERSION_NUMBER >= OPENSSL_TICKET_KEY_EVP_CB_SINCE)
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
@@ -162,6 +170,18 @@ static void buildErrors(string& message, int errno_copy = 0, int sslerrno = 0);
 static bool matchName(const char* host, const char* pattern, int size);
 static char uppercase(char c);
 
+// The SSLContext of an SSL_CTX
+static int contextIndex() {
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+// The client session cache key of an SSL
+static int sessionKeyIndex() {
+  static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
 // SSLContext implementation
 SSLContext::SSLContext(const SSLProtocol& protocol) {
   if (protocol == SSLTLS) {
@@ -194,6 +214,15 @@ SSLContext::SSLContext(const SSLProtocol& protocol) {
       SSL_CTX_set_options(ctx_, SSL_OP_NO_SSLv2);
       SSL_CTX_set_options(ctx_, SSL_OP_NO_SSLv3);   // THRIFT-3164
   }
+
+  sessionCapacity_ = 0;
+  ticketRotation_ = 0;
+  fullHandshakes_ = 0;
+  resumedHandshakes_ = 0;
+  ticketKeyRotations_ = 0;
+  ticketsRejected_ = 0;
+  // Lets the session callbacks find their way back here
+  SSL_CTX_set_ex_data(ctx_, contextIndex(), this);
 }
 
 SSLContext::~SSLContext() {
@@ -201,6 +230,12 @@ SSLContext::~SSLContext() {
     SSL_CTX_free(ctx_);
     ctx_ = nullptr;
   }
+  for (auto& session : sessions_) {
+    SSL_SESSION_free(session.second);
+  }
+  for (auto& key : ticketKeys_) {
+    OPENSSL_cleanse(&key, sizeof(key));
+  }
 }
 
 SSL* SSLContext::createSSL() {
@@ -213,6 +248,236 @@ SSL* SSLContext::createSSL() {
   return ssl;
 }
 
+void SSLContext::setClientSessionCacheSize(size_t capacity) {
+  Guard guard(sessionMutex_);
+  sessionCapacity_ = capacity;
+  while (sessions_.size() > sessionCapacity_) {
+    sessionIndex_.erase(sessions_.back().first);
+    SSL_SESSION_free(sessions_.back().second);
+    sessions_.pop_back();
+  }
+  if (capacity > 0) {
+    // OpenSSL's own cache is keyed by session id, which a client never knows
+    // in advance, so sessions are only kept by host:port here
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx_, newSessionCallback);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_new_cb(ctx_, nullptr);
+  }
+}
+
+void SSLContext::resumeSession(SSL* ssl, const string* key) {
+  SSL_set_ex_data(ssl, sessionKeyIndex(), const_cast<string*>(key));
+  Guard guard(sessionMutex_);
+  auto found = sessionIndex_.find(*key);
+  if (found != sessionIndex_.end()) {
+    sessions_.splice(sessions_.begin(), sessions_, found->second);
+    SSL_set_session(ssl, found->second->second);
+  }
+}
+
+void SSLContext::storeSession(const string& key, SSL_SESSION* session) {
+  Guard guard(sessionMutex_);
+  if (sessionCapacity_ == 0) {
+    SSL_SESSION_free(session);
+    return;
+  }
+  auto found = sessionIndex_.find(key);
+  if (found != sessionIndex_.end()) {
+    SSL_SESSION_free(found->second->second);
+    sessions_.erase(found->second);
+  }
+  sessions_.push_front(std::make_pair(key, session));
+  sessionIndex_[key] = sessions_.begin();
+  while (sessions_.size() > sessionCapacity_) {
+    sessionIndex_.erase(sessions_.back().first);
+    SSL_SESSION_free(sessions_.back().second);
+    sessions_.pop_back();
+  }
+}
+
+int SSLContext::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  auto context = static_cast<SSLContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+  auto key = static_cast<const string*>(SSL_get_ex_data(ssl, sessionKeyIndex()));
+  if (context == nullptr || key == nullptr) {
+    return 0;
+  }
+  // Returning 1 hands our reference to the session over to the cache
+  context->storeSession(*key, session);
+  return 1;
+}
+
+void SSLContext::enableTickets(int rotationSeconds) {
+  {
+    Guard guard(ticketMutex_);
+    ticketRotation_ = (std::max)(rotationSeconds, 0);
+  }
+  enableTicketCallback();
+}
+
+void SSLContext::addTicketKey(const string& key) {
+  TicketKey ticketKey;
+  if (key.size() != sizeof(ticketKey.name) + sizeof(ticketKey.aesKey) + sizeof(ticketKey.hmacKey)) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "addTicketKey: a ticket key must be 80 bytes");
+  }
+  const char* data = key.data();
+  memcpy(ticketKey.name, data, sizeof(ticketKey.name));
+  data += sizeof(ticketKey.name);
+  memcpy(ticketKey.aesKey, data, sizeof(ticketKey.aesKey));
+  data += sizeof(ticketKey.aesKey);
+  memcpy(ticketKey.hmacKey, data, sizeof(ticketKey.hmacKey));
+  ticketKey.created = time(nullptr);
+  {
+    Guard guard(ticketMutex_);
+    ticketKeys_.push_front(ticketKey);
+    if (ticketKeys_.size() > 2) {
+      OPENSSL_cleanse(&ticketKeys_.back(), sizeof(TicketKey));
+      ticketKeys_.pop_back();
+    }
+  }
+  OPENSSL_cleanse(&ticketKey, sizeof(ticketKey));
+  enableTicketCallback();
+}
+
+void SSLContext::enableTicketCallback() {
+  // A resumed session must have been established for the same purpose,
+  // which OpenSSL requires to be named when peers are verified
+  static const unsigned char sessionIdContext[] = "thrift";
+  SSL_CTX_set_session_id_context(ctx_, sessionIdContext, sizeof(sessionIdContext) - 1);
+  SSL_CTX_clear_options(ctx_, SSL_OP_NO_TICKET);
+#if (OPENSSL_VERSION_NUMBER >= OPENSSL_TICKET_KEY_EVP_CB_SINCE)
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_, ticketKeyCallback<EVP_MAC_CTX>);
+#else
+  SSL_CTX_set_tlsext_ticket_key_cb(ctx_, ticketKeyCallback<HMAC_CTX>);
+#endif
+}
+
+bool SSLContext::currentTicketKey(TicketKey& key) {
+  Guard guard(ticketMutex_);
+  time_t now = time(nullptr);
+  if (ticketKeys_.empty()
+      || (ticketRotation_ > 0 && now - ticketKeys_.front().created >= ticketRotation_)) {
+    TicketKey fresh;
+    if (RAND_bytes(fresh.name, sizeof(fresh.name)) != 1
+        || RAND_bytes(fresh.aesKey, sizeof(fresh.aesKey)) != 1
+        || RAND_bytes(fresh.hmacKey, sizeof(fresh.hmacKey)) != 1) {
+      return false;
+    }
+    fresh.created = now;
+    ticketKeys_.push_front(fresh);
+    OPENSSL_cleanse(&fresh, sizeof(fresh));
+    if (ticketKeys_.size() > 2) {
+      OPENSSL_cleanse(&ticketKeys_.back(), sizeof(TicketKey));
+      ticketKeys_.pop_back();
+    }
+    ++ticketKeyRotations_;
+  }
+  key = ticketKeys_.front();
+  return true;
+}
+
+int SSLContext::findTicketKey(const unsigned char* name, TicketKey& key) {
+  Guard guard(ticketMutex_);
+  time_t now = time(nullptr);
+  int rc = 1;
+  for (auto& held : ticketKeys_) {
+    if (memcmp(held.name, name, sizeof(held.name)) == 0) {
+      // A key seals tickets for one rotation, which are then good for one more
+      if (ticketRotation_ > 0 && now - held.created >= 2 * static_cast<time_t>(ticketRotation_)) {
+        return 0;
+      }
+      key = held;
+      return rc;
+    }
+    // Ask for a ticket under the current key
+    rc = 2;
+  }
+  return 0;
+}
+
+#if (OPENSSL_VERSION_NUMBER >= OPENSSL_TICKET_KEY_EVP_CB_SINCE)
+static int initTicketHmac(EVP_MAC_CTX* hmac, unsigned char* key, size_t size) {
+  OSSL_PARAM params[3];
+  params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key, size);
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+  params[2] = OSSL_PARAM_construct_end();
+  return EVP_MAC_CTX_set_params(hmac, params);
+}
+#else
+static int initTicketHmac(HMAC_CTX* hmac, unsigned char* key, size_t size) {
+  return HMAC_Init_ex(hmac, key, static_cast<int>(size), EVP_sha256(), nullptr);
+}
+#endif
+
+template <typename HmacContext>
+int SSLContext::ticketKeyCallback(SSL* ssl,
+                                  unsigned char* name,
+                                  unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipher,
+                                  HmacContext* hmac,
+                                  int enc) {
+  auto context = static_cast<SSLContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+  if (context == nullptr) {
+    return -1;
+  }
+
+  TicketKey key;
+  int rc;
+  if (enc) {
+    if (!context->currentTicketKey(key)) {
+      return -1;
+    }
+    memcpy(name, key.name, sizeof(key.name));
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+      OPENSSL_cleanse(&key, sizeof(key));
+      return -1;
+    }
+    rc = 1;
+  } else {
+    rc = context->findTicketKey(name, key);
+    if (rc == 0) {
+      // Falls back to a full handshake
+      ++context->ticketsRejected_;
+      return 0;
+    }
+#ifdef TLS1_3_VERSION
+    // TLS 1.3 clients use a ticket only once, so they need a new one each
+    // time, which OpenSSL only sends when asked to renew
+    if (SSL_version(ssl) >= TLS1_3_VERSION) {
+      rc = 2;
+    }
+#endif
+  }
+
+  if (EVP_CipherInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aesKey, iv, enc) != 1
+      || initTicketHmac(hmac, key.hmacKey, sizeof(key.hmacKey)) != 1) {
+    rc = -1;
+  }
+  OPENSSL_cleanse(&key, sizeof(key));
+  return rc;
+}
+
+void SSLContext::countHandshake(SSL* ssl) {
+  if (SSL_session_reused(ssl)) {
+    ++resumedHandshakes_;
+  } else {
+    ++fullHandshakes_;
+  }
+}
+
+SSLSessionStats SSLContext::getSessionStats() const {
+  SSLSessionStats stats;
+  stats.fullHandshakes = fullHandshakes_;
+  stats.resumedHandshakes = resumedHandshakes_;
+  stats.ticketKeyRotations = ticketKeyRotations_;
+  stats.ticketsRejected = ticketsRejected_;
+  Guard guard(sessionMutex_);
+  stats.cachedSessions = sessions_.size();
+  return stats;
+}
+
 // TSSLSocket implementation
 TSSLSocket::TSSLSocket(std::shared_ptr<SSLContext> ctx)
   : TSocket(), server_(false), ssl_(nullptr), ctx_(ctx) {
@@ -265,6 +530,8 @@ void TSSLSocket::init() {
   handshakeCompleted_ = false;
   readRetryCount_ = 0;
   eventSafe_ = false;
+  kernelTlsSend_ = false;
+  kernelTlsRecv_ = false;
 }
 
 bool TSSLSocket::isOpen() const {
@@ -379,6 +646,8 @@ void TSSLSocket::close() {
     SSL_free(ssl_);
     ssl_ = nullptr;
     handshakeCompleted_ = false;
+    kernelTlsSend_ = false;
+    kernelTlsRecv_ = false;
     ERR_remove_state(0);
   }
   TSocket::close();
@@ -471,6 +740,10 @@ void TSSLSocket::write(const uint8_t* buf, uint32_t len) {
   initializeHandshake();
   if (!checkHandshake())
     return;
+  if (kernelTlsSend_) {
+    writeKernelTls(buf, len);
+    return;
+  }
   // loop in case SSL_MODE_ENABLE_PARTIAL_WRITE is set in SSL_CTX.
   uint32_t written = 0;
   while (written < len) {
@@ -516,6 +789,9 @@ uint32_t TSSLSocket::write_partial(const uint8_t* buf, uint32_t len) {
   initializeHandshake();
   if (!checkHandshake())
     return 0;
+  if (kernelTlsSend_) {
+    return writeKernelTls(buf, len);
+  }
   // loop in case SSL_MODE_ENABLE_PARTIAL_WRITE is set in SSL_CTX.
   uint32_t written = 0;
   while (written < len) {
@@ -552,6 +828,44 @@ uint32_t TSSLSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return written;
 }
 
+uint32_t TSSLSocket::writev_partial(const uint8_t* const* bufs,
+                                    const uint32_t* lens,
+                                    uint32_t count) {
+  if (count == 0) {
+    return 0;
+  }
+  initializeHandshake();
+  if (!checkHandshake())
+    return 0;
+  if (!kernelTlsSend_) {
+    return write_partial(bufs[0], lens[0]);
+  }
+  for (;;) {
+    uint32_t bytes = TSocket::writev_partial(bufs, lens, count);
+    if (bytes > 0 || isLibeventSafe()) {
+      return bytes;
+    }
+    waitForEvent(false);
+  }
+}
+
+uint32_t TSSLSocket::writeKernelTls(const uint8_t* buf, uint32_t len) {
+  uint32_t written = 0;
+  while (written < len) {
+    uint32_t bytes = TSocket::write_partial(&buf[written], len - written);
+    if (bytes == 0) {
+      // The socket is nonblocking since the handshake
+      if (isLibeventSafe()) {
+        break;
+      }
+      waitForEvent(false);
+      continue;
+    }
+    written += bytes;
+  }
+  return written;
+}
+
 void TSSLSocket::flush() {
   // Don't throw exception if not open. Thrift servers close socket twice.
   if (ssl_ == nullptr) {
@@ -585,6 +899,10 @@ void TSSLSocket::initializeHandshakeParams() {
   ssl_ = ctx_->createSSL();
 
   SSL_set_fd(ssl_, static_cast<int>(socket_));
+  if (!server()) {
+    sessionKey_ = getHost() + ":" + to_string(getPort());
+    ctx_->resumeSession(ssl_, &sessionKey_);
+  }
 }
 
 bool TSSLSocket::checkHandshake() {
@@ -676,6 +994,25 @@ void TSSLSocket::initializeHandshake() {
   }
   authorize();
   handshakeCompleted_ = true;
+  ctx_->countHandshake(ssl_);
+
+#ifdef SSL_OP_ENABLE_KTLS
+  // Set up by OpenSSL during the handshake if SSL_OP_ENABLE_KTLS is set;
+  // OpenSSL 1.1.x has neither the option nor BIO_get_ktls_send/recv
+  kernelTlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+  kernelTlsRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
+}
+
+bool TSSLSocket::advanceHandshake(bool& wantWrite) {
+  // Returns at the first WANT_READ or WANT_WRITE if libevent safe
+  initializeHandshake();
+  wantWrite = !handshakeCompleted_ && SSL_want_write(ssl_);
+  return handshakeCompleted_;
+}
+
+bool TSSLSocket::isSessionReused() const {
+  return ssl_ != nullptr && SSL_session_reused(ssl_);
 }
 
 void TSSLSocket::authorize() {
@@ -940,6 +1277,36 @@ void TSSLSocketFactory::authenticate(bool required) {
   SSL_CTX_set_verify(ctx_->get(), mode, nullptr);
 }
 
+void TSSLSocketFactory::kernelTls(bool enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+  if (enable) {
+    SSL_CTX_set_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  } else {
+    SSL_CTX_clear_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  }
+#else
+  if (enable) {
+    GlobalOutput("TSSLSocketFactory::kernelTls: not supported by this OpenSSL version");
+  }
+#endif
+}
+
+void TSSLSocketFactory::clientSessionCache(size_t capacity) {
+  ctx_->setClientSessionCacheSize(capacity);
+}
+
+void TSSLSocketFactory::sessionTickets(int rotationSeconds) {
+  ctx_->enableTickets(rotationSeconds);
+}
+
+void TSSLSocketFactory::addTicketKey(const string& key) {
+  ctx_->addTicketKey(key);
+}
+
+SSLSessionStats TSSLSocketFactory::getSessionStats() const {
+  return ctx_->getSessionStats();
+}
+
 void TSSLSocketFactory::loadCertificate(const char* path, const char* format) {
   if (path == nullptr || format == nullptr) {
     throw TTransportException(TTransportException::BAD_ARGS,
@@ -24,6 +24,9 @@
 #include <thrift/transport/TSocket.h>
 
 #include <openssl/ssl.h>
+#include <atomic>
+#include <list>
+#include <map>
 #include <string>
 #include <thrift/concurrency/Mutex.h>
 
@@ -34,6 +37,17 @@ namespace transport {
 class AccessManager;
 class SSLContext;
 
+/**
+ * Handshake counts of the sockets sharing an SSLContext.
+ */
+struct SSLSessionStats {
+  uint64_t fullHandshakes;     // Handshakes that did a key exchange
+  uint64_t resumedHandshakes;  // Handshakes that resumed an earlier session
+  uint64_t cachedSessions;     // Client sessions held for resumption
+  uint64_t ticketKeyRotations; // Session ticket keys generated
+  uint64_t ticketsRejected;    // Tickets offered under a key no longer held
+};
+
 enum SSLProtocol {
   SSLTLS  = 0,  // Supports SSLv2 and SSLv3 handshake but only negotiates at TLSv1_0 or later.
 //SSLv2   = 1,  // HORRIBLY INSECURE!
@@ -78,9 +92,16 @@ public:
   void open() override;
   void close() override;
   bool hasPendingDataToRead() override;
+  bool isHandshakePending() const override { return !handshakeCompleted_; }
+  bool advanceHandshake(bool& wantWrite) override;
   uint32_t read(uint8_t* buf, uint32_t len) override;
   void write(const uint8_t* buf, uint32_t len) override;
   uint32_t write_partial(const uint8_t* buf, uint32_t len) override;
+  /**
+   * Records cannot be gathered from several buffers, so only the first one
+   * is written, unless the kernel encrypts the records.
+   */
+  uint32_t writev_partial(const uint8_t* const* bufs, const uint32_t* lens, uint32_t count) override;
   void flush() override;
   /**
   * Set whether to use client or server side SSL handshake protocol.
@@ -106,6 +127,23 @@ public:
    * Determines whether SSL Socket is libevent safe or not.
    */
   bool isLibeventSafe() const { return eventSafe_; }
+  /**
+   * Determines whether the kernel encrypts the records written (kTLS), in
+   * which case writes go to the socket as they would without TLS.  Known
+   * once the handshake is completed.
+   */
+  bool isKernelTlsSend() const { return kernelTlsSend_; }
+  /**
+   * Determines whether the kernel decrypts the records read (kTLS).  Reads
+   * still go through OpenSSL, which handles the messages other than data
+   * that TLS sends after the handshake, but it no longer decrypts.
+   */
+  bool isKernelTlsRecv() const { return kernelTlsRecv_; }
+  /**
+   * Determines whether the handshake resumed an earlier session rather than
+   * doing a full one.  Known once the handshake is completed.
+   */
+  bool isSessionReused() const;
 
 protected:
   /**
@@ -178,6 +216,16 @@ private:
   bool handshakeCompleted_;
   int readRetryCount_;
   bool eventSafe_;
+  bool kernelTlsSend_;
+  bool kernelTlsRecv_;
+  // The client session cache key of the connection, "host:port"
+  std::string sessionKey_;
+
+  /**
+   * Writes to a socket whose records the kernel encrypts, waiting for the
+   * socket as SSL_write would.
+   */
+  uint32_t writeKernelTls(const uint8_t* buf, uint32_t len);
 
   void init();
 };
@@ -254,6 +302,52 @@ public:
    * @param required Require peer to present valid certificate if true
    */
   virtual void authenticate(bool required);
+  /**
+   * Enable/Disable kernel TLS (kTLS).  Once the handshake is completed,
+   * OpenSSL hands the keys of the connection to the kernel, which then
+   * encrypts and decrypts the records, so that writes cost about what they
+   * do without TLS and can gather several buffers.  Where the kernel, the
+   * OpenSSL version or the cipher negotiated does not support it, the
+   * records are encrypted by OpenSSL as usual.  Disabled by default.
+   *
+   * @param enable Offload records to the kernel where possible if true
+   */
+  virtual void kernelTls(bool enable);
+  /**
+   * Enable/Disable the client session cache.  The session of the last
+   * connection to each host:port is kept, and the next connection to it
+   * offers that session, which the server may resume with an abbreviated
+   * handshake that skips the key exchange and certificate checks.  The
+   * least recently used hosts are dropped beyond capacity.  Disabled by
+   * default.
+   *
+   * @param capacity Number of host:port sessions kept, 0 to disable
+   */
+  virtual void clientSessionCache(size_t capacity);
+  /**
+   * Issue session tickets under keys of this factory, rotated every
+   * rotationSeconds.  A ticket sealed with the previous key is still
+   * accepted, and replaced with one under the current key, so tickets stay
+   * valid for one to two rotations.  Servers sharing their clients should
+   * share keys with addTicketKey() and a rotationSeconds of 0 instead.
+   * Without this OpenSSL seals tickets with a key of its own that never
+   * changes.
+   *
+   * @param rotationSeconds Lifetime of a key, 0 to never rotate
+   */
+  virtual void sessionTickets(int rotationSeconds);
+  /**
+   * Add a session ticket key, which becomes the one new tickets are sealed
+   * with.  Enables session tickets if sessionTickets() was not called.
+   *
+   * @param key 80 bytes: a 16 byte name, a 32 byte AES key and a 32 byte
+   *            HMAC key
+   */
+  virtual void addTicketKey(const std::string& key);
+  /**
+   * Returns the handshake counts of the sockets of this factory.
+   */
+  SSLSessionStats getSessionStats() const;
   /**
    * Load server certificate.
    *
@@ -353,8 +447,70 @@ public:
   SSL* createSSL();
   SSL_CTX* get() { return ctx_; }
 
+  /**
+   * Keeps the sessions of up to capacity host:port keys, 0 to disable.
+   */
+  void setClientSessionCacheSize(size_t capacity);
+  /**
+   * Offers the cached session of key, if any, on a client SSL before its
+   * handshake.  The new session of the connection is stored under key, which
+   * must stay valid as long as ssl.
+   */
+  void resumeSession(SSL* ssl, const std::string* key);
+  /**
+   * Seals session tickets with keys rotated every rotationSeconds.
+   */
+  void enableTickets(int rotationSeconds);
+  /**
+   * Adds an 80 byte ticket key, which becomes the current one.
+   */
+  void addTicketKey(const std::string& key);
+  /**
+   * Counts a completed handshake.
+   */
+  void countHandshake(SSL* ssl);
+  SSLSessionStats getSessionStats() const;
+
 private:
+  struct TicketKey {
+    unsigned char name[16];
+    unsigned char aesKey[32];
+    unsigned char hmacKey[32];
+    time_t created;
+  };
+  typedef std::list<std::pair<std::string, SSL_SESSION*> > SessionList;
+
   SSL_CTX* ctx_;
+
+  concurrency::Mutex sessionMutex_;
+  size_t sessionCapacity_;
+  // Most recently used first
+  SessionList sessions_;
+  std::map<std::string, SessionList::iterator> sessionIndex_;
+
+  concurrency::Mutex ticketMutex_;
+  int ticketRotation_;
+  // Current key first, then the previous one
+  std::list<TicketKey> ticketKeys_;
+
+  std::atomic<uint64_t> fullHandshakes_;
+  std::atomic<uint64_t> resumedHandshakes_;
+  std::atomic<uint64_t> ticketKeyRotations_;
+  std::atomic<uint64_t> ticketsRejected_;
+
+  void storeSession(const std::string& key, SSL_SESSION* session);
+  void enableTicketCallback();
+  bool currentTicketKey(TicketKey& key);
+  int findTicketKey(const unsigned char* name, TicketKey& key);
+
+  static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+  template <typename HmacContext>
+  static int ticketKeyCallback(SSL* ssl,
+                               unsigned char* name,
+                               unsigned char* iv,
+                               EVP_CIPHER_CTX* cipher,
+                               HmacContext* hmac,
+                               int enc);
 };
 
 /**
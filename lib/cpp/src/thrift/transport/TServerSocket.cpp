@@ -19,6 +19,7 @@
 
 #include <thrift/thrift-config.h>
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <stdexcept>
@@ -52,6 +53,10 @@
 #define AF_LOCAL AF_UNIX
 #endif
 
+#if defined(__linux__) && defined(SOCK_CLOEXEC)
+#define THRIFT_HAVE_ACCEPT4 1
+#endif
+
 #ifndef SOCKOPT_CAST_T
 #ifndef _WIN32
 #define SOCKOPT_CAST_T void
@@ -115,8 +120,12 @@ TServerSocket::TServerSocket(int port)
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    acceptBatchSize_(DEFAULT_ACCEPT_BATCH),
+    tcpDeferAccept_(1),
+    tcpFastOpen_(0),
     keepAlive_(false),
     listening_(false),
+    interruptPending_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
     childInterruptSockWriter_(THRIFT_INVALID_SOCKET) {
@@ -134,8 +143,12 @@ TServerSocket::TServerSocket(int port, int sendTimeout, int recvTimeout)
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    acceptBatchSize_(DEFAULT_ACCEPT_BATCH),
+    tcpDeferAccept_(1),
+    tcpFastOpen_(0),
     keepAlive_(false),
     listening_(false),
+    interruptPending_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
     childInterruptSockWriter_(THRIFT_INVALID_SOCKET) {
@@ -154,8 +167,12 @@ TServerSocket::TServerSocket(const string& address, int port)
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    acceptBatchSize_(DEFAULT_ACCEPT_BATCH),
+    tcpDeferAccept_(1),
+    tcpFastOpen_(0),
     keepAlive_(false),
     listening_(false),
+    interruptPending_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
     childInterruptSockWriter_(THRIFT_INVALID_SOCKET) {
@@ -174,8 +191,12 @@ TServerSocket::TServerSocket(const string& path)
     retryDelay_(0),
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
+    acceptBatchSize_(DEFAULT_ACCEPT_BATCH),
+    tcpDeferAccept_(1),
+    tcpFastOpen_(0),
     keepAlive_(false),
     listening_(false),
+    interruptPending_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
     childInterruptSockWriter_(THRIFT_INVALID_SOCKET) {
@@ -217,6 +238,10 @@ void TServerSocket::setTcpRecvBuffer(int tcpRecvBuffer) {
   tcpRecvBuffer_ = tcpRecvBuffer;
 }
 
+void TServerSocket::setAcceptBatchSize(int acceptBatchSize) {
+  acceptBatchSize_ = (std::max)(acceptBatchSize, 1);
+}
+
 void TServerSocket::setInterruptableChildren(bool enable) {
   if (listening_) {
     throw std::logic_error("setInterruptableChildren cannot be called after listen()");
@@ -355,8 +380,9 @@ void TServerSocket::listen() {
 
 // Defer accept
 #ifdef TCP_DEFER_ACCEPT
-  if (path_.empty()) {
-    if (-1 == setsockopt(serverSocket_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &one, sizeof(one))) {
+  if (path_.empty() && tcpDeferAccept_ > 0) {
+    if (-1 == setsockopt(serverSocket_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &tcpDeferAccept_,
+                         sizeof(tcpDeferAccept_))) {
       int errno_copy = THRIFT_GET_SOCKET_ERROR;
       GlobalOutput.perror("TServerSocket::listen() setsockopt() TCP_DEFER_ACCEPT ", errno_copy);
       close();
@@ -367,6 +393,18 @@ void TServerSocket::listen() {
   }
 #endif // #ifdef TCP_DEFER_ACCEPT
 
+  if (path_.empty() && tcpFastOpen_ > 0) {
+#ifdef TCP_FASTOPEN
+    if (-1 == setsockopt(serverSocket_, IPPROTO_TCP, TCP_FASTOPEN, cast_sockopt(&tcpFastOpen_),
+                         sizeof(tcpFastOpen_))) {
+      GlobalOutput.perror("TServerSocket::listen() setsockopt() TCP_FASTOPEN ",
+                          THRIFT_GET_SOCKET_ERROR);
+    }
+#else
+    GlobalOutput("TServerSocket::listen() TCP_FASTOPEN is not supported on this platform");
+#endif
+  }
+
 #ifdef IPV6_V6ONLY
   if (res->ai_family == AF_INET6 && path_.empty()) {
     int zero = 0;
@@ -539,67 +577,70 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
     throw TTransportException(TTransportException::NOT_OPEN, "TServerSocket not listening");
   }
 
-  struct THRIFT_POLLFD fds[2];
+  // Connections accepted with an earlier one are handed out without polling,
+  // unless an interrupt has to be reported first
+  if (accepted_.empty() || interruptPending_) {
+    struct THRIFT_POLLFD fds[2];
 
-  int maxEintrs = 5;
-  int numEintrs = 0;
+    int maxEintrs = 5;
+    int numEintrs = 0;
 
-  while (true) {
-    std::memset(fds, 0, sizeof(fds));
-    fds[0].fd = serverSocket_;
-    fds[0].events = THRIFT_POLLIN;
-    if (interruptSockReader_ != THRIFT_INVALID_SOCKET) {
-      fds[1].fd = interruptSockReader_;
-      fds[1].events = THRIFT_POLLIN;
-    }
-    /*
-      TODO: if THRIFT_EINTR is received, we'll restart the timeout.
-      To be accurate, we need to fix this in the future.
-     */
-    int ret = THRIFT_POLL(fds, 2, accTimeout_);
-
-    if (ret < 0) {
-      // error cases
-      if (THRIFT_GET_SOCKET_ERROR == THRIFT_EINTR && (numEintrs++ < maxEintrs)) {
-        // THRIFT_EINTR needs to be handled manually and we can tolerate
-        // a certain number
-        continue;
+    while (true) {
+      std::memset(fds, 0, sizeof(fds));
+      fds[0].fd = serverSocket_;
+      fds[0].events = THRIFT_POLLIN;
+      if (interruptSockReader_ != THRIFT_INVALID_SOCKET) {
+        fds[1].fd = interruptSockReader_;
+        fds[1].events = THRIFT_POLLIN;
       }
-      int errno_copy = THRIFT_GET_SOCKET_ERROR;
-      GlobalOutput.perror("TServerSocket::acceptImpl() THRIFT_POLL() ", errno_copy);
-      throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
-    } else if (ret > 0) {
-      // Check for an interrupt signal
-      if (interruptSockReader_ != THRIFT_INVALID_SOCKET && (fds[1].revents & THRIFT_POLLIN)) {
-        int8_t buf;
-        if (-1 == recv(interruptSockReader_, cast_sockopt(&buf), sizeof(int8_t), 0)) {
-          GlobalOutput.perror("TServerSocket::acceptImpl() recv() interrupt ",
-                              THRIFT_GET_SOCKET_ERROR);
+      /*
+        TODO: if THRIFT_EINTR is received, we'll restart the timeout.
+        To be accurate, we need to fix this in the future.
+       */
+      int ret = THRIFT_POLL(fds, 2, accepted_.empty() ? accTimeout_ : 0);
+
+      if (ret < 0) {
+        // error cases
+        if (THRIFT_GET_SOCKET_ERROR == THRIFT_EINTR && (numEintrs++ < maxEintrs)) {
+          // THRIFT_EINTR needs to be handled manually and we can tolerate
+          // a certain number
+          continue;
+        }
+        int errno_copy = THRIFT_GET_SOCKET_ERROR;
+        GlobalOutput.perror("TServerSocket::acceptImpl() THRIFT_POLL() ", errno_copy);
+        throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
+      } else if (ret > 0) {
+        // Check for an interrupt signal
+        if (interruptSockReader_ != THRIFT_INVALID_SOCKET && (fds[1].revents & THRIFT_POLLIN)) {
+          int8_t buf;
+          if (-1 == recv(interruptSockReader_, cast_sockopt(&buf), sizeof(int8_t), 0)) {
+            GlobalOutput.perror("TServerSocket::acceptImpl() recv() interrupt ",
+                                THRIFT_GET_SOCKET_ERROR);
+          }
+          interruptPending_ = false;
+          throw TTransportException(TTransportException::INTERRUPTED);
         }
-        throw TTransportException(TTransportException::INTERRUPTED);
-      }
 
-      // Check for the actual server socket being ready
-      if (fds[0].revents & THRIFT_POLLIN) {
+        // Check for the actual server socket being ready
+        if (fds[0].revents & THRIFT_POLLIN) {
+          acceptWaiting();
+          break;
+        }
+      } else if (!accepted_.empty()) {
+        // The interrupt has not arrived yet
         break;
+      } else {
+        GlobalOutput("TServerSocket::acceptImpl() THRIFT_POLL 0");
+        throw TTransportException(TTransportException::UNKNOWN);
       }
-    } else {
-      GlobalOutput("TServerSocket::acceptImpl() THRIFT_POLL 0");
-      throw TTransportException(TTransportException::UNKNOWN);
     }
   }
 
-  struct sockaddr_storage clientAddress;
-  int size = sizeof(clientAddress);
-  THRIFT_SOCKET clientSocket
-      = ::accept(serverSocket_, (struct sockaddr*)&clientAddress, (socklen_t*)&size);
-
-  if (clientSocket == THRIFT_INVALID_SOCKET) {
-    int errno_copy = THRIFT_GET_SOCKET_ERROR;
-    GlobalOutput.perror("TServerSocket::acceptImpl() ::accept() ", errno_copy);
-    throw TTransportException(TTransportException::UNKNOWN, "accept()", errno_copy);
-  }
+  Accepted next = accepted_.front();
+  accepted_.pop_front();
+  THRIFT_SOCKET clientSocket = next.socket;
 
+#ifndef THRIFT_HAVE_ACCEPT4
   // Make sure client socket is blocking
   int flags = THRIFT_FCNTL(clientSocket, THRIFT_F_GETFL, 0);
   if (flags == -1) {
@@ -621,6 +662,7 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
                               "THRIFT_FCNTL(THRIFT_F_SETFL)",
                               errno_copy);
   }
+#endif
 
   shared_ptr<TSocket> client = createSocket(clientSocket);
   if (sendTimeout_ > 0) {
@@ -632,7 +674,7 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
   if (keepAlive_) {
     client->setKeepAlive(keepAlive_);
   }
-  client->setCachedAddress((sockaddr*)&clientAddress, size);
+  client->setCachedAddress((sockaddr*)&next.address, next.size);
 
   if (acceptCallback_)
     acceptCallback_(clientSocket);
@@ -640,6 +682,42 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
   return client;
 }
 
+void TServerSocket::acceptWaiting() {
+  // The server socket is nonblocking, so this stops once none is waiting
+  while (accepted_.size() < static_cast<size_t>(acceptBatchSize_)) {
+    Accepted next;
+    next.size = sizeof(next.address);
+#ifdef THRIFT_HAVE_ACCEPT4
+    // Blocking, as the children expect
+    next.socket = ::accept4(serverSocket_, (struct sockaddr*)&next.address, &next.size,
+                            SOCK_CLOEXEC);
+#else
+    next.socket = ::accept(serverSocket_, (struct sockaddr*)&next.address, &next.size);
+#endif
+
+    if (next.socket == THRIFT_INVALID_SOCKET) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (!accepted_.empty()
+          && (errno_copy == THRIFT_EAGAIN || errno_copy == THRIFT_EWOULDBLOCK)) {
+        return;
+      }
+      GlobalOutput.perror("TServerSocket::acceptImpl() ::accept() ", errno_copy);
+      if (accepted_.empty()) {
+        throw TTransportException(TTransportException::UNKNOWN, "accept()", errno_copy);
+      }
+      return;
+    }
+    accepted_.push_back(next);
+  }
+}
+
+void TServerSocket::closeAccepted() {
+  for (const Accepted& next : accepted_) {
+    ::THRIFT_CLOSESOCKET(next.socket);
+  }
+  accepted_.clear();
+}
+
 shared_ptr<TSocket> TServerSocket::createSocket(THRIFT_SOCKET clientSocket) {
   if (interruptableChildren_) {
     return std::make_shared<TSocket>(clientSocket, pChildInterruptSockReader_);
@@ -660,6 +738,7 @@ void TServerSocket::notify(THRIFT_SOCKET notifySocket) {
 void TServerSocket::interrupt() {
   concurrency::Guard g(rwMutex_);
   if (interruptSockWriter_ != THRIFT_INVALID_SOCKET) {
+    interruptPending_ = true;
     notify(interruptSockWriter_);
   }
 }
@@ -673,6 +752,7 @@ void TServerSocket::interruptChildren() {
 
 void TServerSocket::close() {
   concurrency::Guard g(rwMutex_);
+  closeAccepted();
   if (serverSocket_ != THRIFT_INVALID_SOCKET) {
     shutdown(serverSocket_, THRIFT_SHUT_RDWR);
     ::THRIFT_CLOSESOCKET(serverSocket_);
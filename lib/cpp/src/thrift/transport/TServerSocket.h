@@ -21,6 +21,8 @@
 #define _THRIFT_TRANSPORT_TSERVERSOCKET_H_ 1
 
 #include <thrift/concurrency/Mutex.h>
+#include <atomic>
+#include <deque>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/transport/TServerTransport.h>
 
@@ -64,6 +66,7 @@ public:
   typedef std::function<void(THRIFT_SOCKET fd)> socket_func_t;
 
   const static int DEFAULT_BACKLOG = 1024;
+  const static int DEFAULT_ACCEPT_BATCH = 16;
 
   /**
    * Constructor.
@@ -112,6 +115,22 @@ public:
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
+  // Connections accepted at most per wakeup (default DEFAULT_ACCEPT_BATCH).
+  // Those waiting are accepted together until none is left and handed out
+  // by the following calls to accept() without polling again.
+  void setAcceptBatchSize(int acceptBatchSize);
+
+  // Seconds TCP_DEFER_ACCEPT waits for a new connection to send data before
+  // it is accepted anyway, so that accept() does not return connections
+  // with nothing to read yet (default 1, 0 disables).  Linux only.  Must be
+  // called before listen().
+  void setTcpDeferAccept(int seconds) { tcpDeferAccept_ = seconds; }
+
+  // Queue length for connections opened with TCP Fast Open, which lets a
+  // returning client send its first request in the SYN (default 0, which
+  // disables it).  Must be called before listen().
+  void setTcpFastOpen(int queueLength) { tcpFastOpen_ = queueLength; }
+
   // listenCallback gets called just before listen, and after all Thrift
   // setsockopt calls have been made.  If you have custom setsockopt
   // things that need to happen on the listening socket, this is the place to do it.
@@ -154,6 +173,19 @@ protected:
 private:
   void notify(THRIFT_SOCKET notifySock);
 
+  // A connection accepted but not handed out yet
+  struct Accepted {
+    THRIFT_SOCKET socket;
+    struct sockaddr_storage address;
+    socklen_t size;
+  };
+
+  // Accepts the connections waiting, up to acceptBatchSize_, into accepted_
+  void acceptWaiting();
+
+  // Closes the connections in accepted_
+  void closeAccepted();
+
   int port_;
   std::string address_;
   std::string path_;
@@ -166,8 +198,13 @@ private:
   int retryDelay_;
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
+  int acceptBatchSize_;
+  int tcpDeferAccept_;
+  int tcpFastOpen_;
   bool keepAlive_;
   bool listening_;
+  std::deque<Accepted> accepted_;                              // only touched by the accepting thread and close()
+  std::atomic<bool> interruptPending_;                         // accept() must not hand out accepted_ first
 
   concurrency::Mutex rwMutex_;                                 // thread-safe interrupt
   THRIFT_SOCKET interruptSockWriter_;                          // is notified on interrupt()
@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <string>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include <thrift/TOutput.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TShmServerTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using std::shared_ptr;
+
+namespace {
+
+void closeChildInterruptReader(THRIFT_SOCKET* sock) {
+  ::THRIFT_CLOSESOCKET(*sock);
+  delete sock;
+}
+}
+
+TShmServerTransport::TShmServerTransport(const std::string& path, uint32_t ringSize)
+  : path_(path),
+    ringSize_(ringSize),
+    maxSpinUs_(-1),
+    listener_(path),
+    childInterruptWriter_(THRIFT_INVALID_SOCKET) {
+}
+
+TShmServerTransport::~TShmServerTransport() {
+  close();
+}
+
+void TShmServerTransport::listen() {
+#ifndef __linux__
+  throw TTransportException(TTransportException::NOT_OPEN, "TShmServerTransport requires Linux");
+#endif
+  listener_.listen();
+
+  THRIFT_SOCKET sv[2];
+  if (-1 == THRIFT_SOCKETPAIR(AF_LOCAL, SOCK_STREAM, 0, sv)) {
+    GlobalOutput.perror("TShmServerTransport::listen() socketpair() childInterrupt",
+                        THRIFT_GET_SOCKET_ERROR);
+    childInterruptWriter_ = THRIFT_INVALID_SOCKET;
+    childInterruptReader_.reset();
+  } else {
+    childInterruptWriter_ = sv[1];
+    childInterruptReader_
+        = shared_ptr<THRIFT_SOCKET>(new THRIFT_SOCKET(sv[0]), closeChildInterruptReader);
+  }
+}
+
+shared_ptr<TTransport> TShmServerTransport::acceptImpl() {
+  shared_ptr<TSocket> control = std::dynamic_pointer_cast<TSocket>(listener_.accept());
+  if (!control) {
+    throw TTransportException(TTransportException::UNKNOWN, "TShmServerTransport: no socket");
+  }
+  shared_ptr<TShmTransport> transport
+      = TShmTransport::accept(control, ringSize_, childInterruptReader_);
+  if (maxSpinUs_ >= 0) {
+    transport->setMaxSpinUs(maxSpinUs_);
+  }
+  return transport;
+}
+
+void TShmServerTransport::interrupt() {
+  listener_.interrupt();
+}
+
+void TShmServerTransport::interruptChildren() {
+  if (childInterruptWriter_ != THRIFT_INVALID_SOCKET) {
+    int8_t byte = 0;
+    if (-1 == send(childInterruptWriter_, reinterpret_cast<const char*>(&byte), sizeof(int8_t), 0)) {
+      GlobalOutput.perror("TShmServerTransport::interruptChildren() send() ",
+                          THRIFT_GET_SOCKET_ERROR);
+    }
+  }
+}
+
+void TShmServerTransport::close() {
+  listener_.close();
+  if (childInterruptWriter_ != THRIFT_INVALID_SOCKET) {
+    ::THRIFT_CLOSESOCKET(childInterruptWriter_);
+  }
+  childInterruptWriter_ = THRIFT_INVALID_SOCKET;
+  childInterruptReader_.reset();
+}
+}
+}
+} // apache::thrift::transport
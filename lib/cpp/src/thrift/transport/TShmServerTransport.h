@@ -0,0 +1,79 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TSHMSERVERTRANSPORT_H_
+#define _THRIFT_TRANSPORT_TSHMSERVERTRANSPORT_H_ 1
+
+#include <memory>
+#include <string>
+
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TServerTransport.h>
+#include <thrift/transport/TShmTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Server transport for TShmTransport clients, for use with TSimpleServer,
+ * TThreadedServer and TThreadPoolServer.  Clients connect to a Unix domain
+ * socket, and each accepted connection gets a shared memory segment of its
+ * own.
+ */
+class TShmServerTransport : public TServerTransport {
+public:
+  /**
+   * @param path     The Unix domain socket path to listen on
+   * @param ringSize Bytes in each direction of a connection
+   */
+  TShmServerTransport(const std::string& path,
+                      uint32_t ringSize = TShmTransport::DEFAULT_RING_SIZE);
+
+  ~TShmServerTransport() override;
+
+  void listen() override;
+  void interrupt() override;
+  void interruptChildren() override;
+  void close() override;
+  THRIFT_SOCKET getSocketFD() override { return listener_.getSocketFD(); }
+
+  /// Sets the longest spin of accepted connections, see TShmTransport::setMaxSpinUs()
+  void setMaxSpinUs(int us) { maxSpinUs_ = us; }
+
+  const std::string& getPath() const { return path_; }
+
+protected:
+  std::shared_ptr<TTransport> acceptImpl() override;
+
+private:
+  std::string path_;
+  uint32_t ringSize_;
+  int maxSpinUs_;
+  TServerSocket listener_;
+
+  // Readable once interruptChildren() is called
+  THRIFT_SOCKET childInterruptWriter_;
+  std::shared_ptr<THRIFT_SOCKET> childInterruptReader_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TSHMSERVERTRANSPORT_H_
@@ -0,0 +1,617 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <thrift/TOutput.h>
+#include <thrift/transport/TShmTransport.h>
+#include <thrift/transport/TTransportException.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using std::shared_ptr;
+
+const uint32_t TShmTransport::DEFAULT_RING_SIZE;
+const int TShmTransport::DEFAULT_MAX_SPIN_US;
+
+#if ATOMIC_LLONG_LOCK_FREE != 2 || ATOMIC_INT_LOCK_FREE != 2
+#error "TShmTransport needs lock-free atomics, which work across processes"
+#endif
+
+namespace {
+
+const uint32_t SEGMENT_MAGIC = 0x54534d31; // "TSM1"
+const size_t CACHE_LINE = 64;
+
+// Tells the CPU that we are spin waiting
+inline void spinPause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Spinning only helps while the peer runs on another CPU
+int defaultMaxSpinUs() {
+  static const int us
+      = std::thread::hardware_concurrency() > 1 ? TShmTransport::DEFAULT_MAX_SPIN_US : 0;
+  return us;
+}
+
+#ifdef __linux__
+size_t pageAlign(size_t size) {
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return (size + page - 1) / page * page;
+}
+#endif
+
+void closeFd(int& fd) {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+}
+
+/**
+ * A single producer, single consumer byte ring.  head and tail count the
+ * bytes ever written and read, and each is only stored to by one side; they
+ * live on cache lines of their own so that the sides do not contend.
+ */
+struct TShmTransport::Ring {
+  alignas(CACHE_LINE) std::atomic<uint64_t> head;
+  alignas(CACHE_LINE) std::atomic<uint64_t> tail;
+  // Set by a reader (writer) about to sleep until head (tail) moves
+  alignas(CACHE_LINE) std::atomic<uint32_t> readerSleeping;
+  std::atomic<uint32_t> writerSleeping;
+};
+
+/**
+ * The start of the shared memory segment, followed by the data of ring 0,
+ * which the client writes, and then that of ring 1, which the server writes.
+ */
+struct TShmTransport::Segment {
+  uint32_t magic;
+  uint32_t ringSize;
+  uint32_t dataOffset;
+  // Set by side 0 (client) or 1 (server) when it closes
+  std::atomic<uint32_t> closed[2];
+  Ring rings[2];
+};
+
+TShmTransport::TShmTransport(const std::string& path)
+  : path_(path),
+    segment_(nullptr),
+    segmentSize_(0),
+    tx_(nullptr),
+    rx_(nullptr),
+    txData_(nullptr),
+    rxData_(nullptr),
+    ringMask_(0),
+    side_(0),
+    doorbell_(-1),
+    peerDoorbell_(-1),
+    txHead_(0),
+    rxTail_(0),
+    peerGone_(false),
+    recvTimeout_(0),
+    sendTimeout_(0),
+    maxSpinUs_(defaultMaxSpinUs()),
+    spinUs_(maxSpinUs_) {
+}
+
+TShmTransport::TShmTransport(shared_ptr<TSocket> control, shared_ptr<THRIFT_SOCKET> interruptListener)
+  : control_(control),
+    interruptListener_(interruptListener),
+    segment_(nullptr),
+    segmentSize_(0),
+    tx_(nullptr),
+    rx_(nullptr),
+    txData_(nullptr),
+    rxData_(nullptr),
+    ringMask_(0),
+    side_(1),
+    doorbell_(-1),
+    peerDoorbell_(-1),
+    txHead_(0),
+    rxTail_(0),
+    peerGone_(false),
+    recvTimeout_(0),
+    sendTimeout_(0),
+    maxSpinUs_(defaultMaxSpinUs()),
+    spinUs_(maxSpinUs_) {
+}
+
+TShmTransport::~TShmTransport() {
+  close();
+}
+
+bool TShmTransport::isOpen() const {
+  return segment_ != nullptr;
+}
+
+void TShmTransport::setMaxSpinUs(int us) {
+  maxSpinUs_ = (std::max)(us, 0);
+  spinUs_ = maxSpinUs_;
+}
+
+const std::string TShmTransport::getOrigin() const {
+  // Accepted connections only know the peer through the control socket
+  if (path_.empty() && control_) {
+    return "shm:" + control_->getOrigin();
+  }
+  return "shm:" + path_;
+}
+
+#ifdef __linux__
+
+shared_ptr<TShmTransport> TShmTransport::accept(shared_ptr<TSocket> control,
+                                                uint32_t ringSize,
+                                                shared_ptr<THRIFT_SOCKET> interruptListener) {
+  uint32_t size = 4096;
+  while (size < ringSize && size < (1u << 30)) {
+    size <<= 1;
+  }
+  size_t dataOffset = pageAlign(sizeof(Segment));
+  size_t segmentSize = dataOffset + 2 * static_cast<size_t>(size);
+
+  int fds[3] = {-1, -1, -1};
+  fds[0] = ::memfd_create("thrift-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  fds[1] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  fds[2] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0
+      || ::ftruncate(fds[0], static_cast<off_t>(segmentSize)) != 0
+      // A client that shrank the segment would crash us on the next access
+      || ::fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    for (int& fd : fds) {
+      closeFd(fd);
+    }
+    GlobalOutput.perror("TShmTransport::accept() memfd_create/eventfd ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "Could not create segment", errno_copy);
+  }
+
+  void* base = ::mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  if (base == MAP_FAILED) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    for (int& fd : fds) {
+      closeFd(fd);
+    }
+    GlobalOutput.perror("TShmTransport::accept() mmap ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "Could not map segment", errno_copy);
+  }
+  Segment* segment = new (base) Segment();
+  segment->ringSize = size;
+  segment->dataOffset = static_cast<uint32_t>(dataOffset);
+  segment->magic = SEGMENT_MAGIC;
+  ::munmap(base, segmentSize);
+
+  // The client gets the segment, its doorbell (fds[1]) and ours (fds[2])
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control_msg;
+  std::memset(&control_msg, 0, sizeof(control_msg));
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control_msg.buf;
+  msg.msg_controllen = sizeof(control_msg.buf);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (::sendmsg(control->getSocketFD(), &msg, MSG_NOSIGNAL) != 1) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    for (int& fd : fds) {
+      closeFd(fd);
+    }
+    GlobalOutput.perror("TShmTransport::accept() sendmsg ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "Could not send segment", errno_copy);
+  }
+
+  shared_ptr<TShmTransport> transport(new TShmTransport(control, interruptListener));
+  transport->attach(fds[0], fds[2], fds[1], 1);
+  return transport;
+}
+
+void TShmTransport::open() {
+  if (isOpen()) {
+    return;
+  }
+  control_.reset(new TSocket(path_));
+  control_->open();
+
+  char byte;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  int fds[3] = {-1, -1, -1};
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control_msg;
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control_msg.buf;
+  msg.msg_controllen = sizeof(control_msg.buf);
+
+  ssize_t got;
+  do {
+    got = ::recvmsg(control_->getSocketFD(), &msg, MSG_CMSG_CLOEXEC);
+  } while (got < 0 && THRIFT_GET_SOCKET_ERROR == THRIFT_EINTR);
+  int errno_copy = THRIFT_GET_SOCKET_ERROR;
+  struct cmsghdr* cmsg = got == 1 ? CMSG_FIRSTHDR(&msg) : nullptr;
+  if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+      && cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  }
+  if (fds[0] < 0) {
+    control_->close();
+    control_.reset();
+    if (got < 0) {
+      GlobalOutput.perror("TShmTransport::open() recvmsg ", errno_copy);
+    }
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TShmTransport::open() no segment from " + path_);
+  }
+  try {
+    attach(fds[0], fds[1], fds[2], 0);
+  } catch (const TTransportException&) {
+    control_->close();
+    control_.reset();
+    throw;
+  }
+}
+
+void TShmTransport::attach(int fd, int doorbell, int peerDoorbell, int side) {
+  doorbell_ = doorbell;
+  peerDoorbell_ = peerDoorbell;
+  side_ = side;
+
+  struct stat st;
+  void* base = MAP_FAILED;
+  if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Segment)) {
+    segmentSize_ = static_cast<size_t>(st.st_size);
+    base = ::mmap(nullptr, segmentSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  // The mapping keeps the segment alive
+  closeFd(fd);
+  if (base == MAP_FAILED) {
+    closeFd(doorbell_);
+    closeFd(peerDoorbell_);
+    throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport: could not map segment");
+  }
+
+  // The peer can change the header at any time, so read each field once
+  auto* segment = static_cast<Segment*>(base);
+  uint32_t size = segment->ringSize;
+  size_t dataOffset = segment->dataOffset;
+  if (segment->magic != SEGMENT_MAGIC || size == 0 || (size & (size - 1)) != 0
+      || dataOffset + 2 * static_cast<size_t>(size) > segmentSize_) {
+    ::munmap(base, segmentSize_);
+    closeFd(doorbell_);
+    closeFd(peerDoorbell_);
+    throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport: bad segment");
+  }
+
+  uint8_t* data = static_cast<uint8_t*>(base) + dataOffset;
+  tx_ = &segment->rings[side];
+  rx_ = &segment->rings[1 - side];
+  txData_ = data + side * static_cast<size_t>(size);
+  rxData_ = data + (1 - side) * static_cast<size_t>(size);
+  ringMask_ = size - 1;
+  txHead_ = tx_->head.load(std::memory_order_relaxed);
+  rxTail_ = rx_->tail.load(std::memory_order_relaxed);
+  peerGone_ = false;
+  segment_ = segment;
+}
+
+#else
+
+shared_ptr<TShmTransport> TShmTransport::accept(shared_ptr<TSocket>,
+                                                uint32_t,
+                                                shared_ptr<THRIFT_SOCKET>) {
+  throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport requires Linux");
+}
+
+void TShmTransport::open() {
+  throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport requires Linux");
+}
+
+void TShmTransport::attach(int, int, int, int) {
+}
+
+#endif
+
+void TShmTransport::close() {
+  if (segment_ != nullptr) {
+    // Like a socket, hand over what was written, flushed or not
+    tx_->head.store(txHead_, std::memory_order_release);
+    segment_->closed[side_].store(1, std::memory_order_seq_cst);
+    // Wake the peer whatever it waits for, so it finds us gone
+    uint64_t one = 1;
+    if (::write(peerDoorbell_, &one, sizeof(one)) < 0) {
+      // The peer is gone already, or will be woken by its pending count
+    }
+#ifdef __linux__
+    ::munmap(segment_, segmentSize_);
+#endif
+    segment_ = nullptr;
+    tx_ = rx_ = nullptr;
+    txData_ = rxData_ = nullptr;
+  }
+  closeFd(doorbell_);
+  closeFd(peerDoorbell_);
+  if (control_) {
+    control_->close();
+  }
+}
+
+bool TShmTransport::isPeerClosed() {
+  return peerGone_ || segment_->closed[1 - side_].load(std::memory_order_acquire) != 0;
+}
+
+void TShmTransport::wakePeer(Ring& ring, bool reader) {
+  // Pairs with the fence of the peer between announcing that it sleeps and
+  // checking the ring one last time: either it sees what we did, or we see
+  // it sleeping
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::atomic<uint32_t>& sleeping = reader ? ring.readerSleeping : ring.writerSleeping;
+  if (sleeping.load(std::memory_order_relaxed) != 0) {
+    uint64_t one = 1;
+    if (::write(peerDoorbell_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      GlobalOutput.perror("TShmTransport::wakePeer() write ", errno);
+    }
+  }
+}
+
+template <typename Ready>
+void TShmTransport::waitUntil(Ready ready, Ring& ring, bool reading, int timeoutMs) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+
+  // Spin while the peer is likely to answer soon; reading the clock is the
+  // expensive part, so only do it every so often
+  if (spinUs_ > 0) {
+    Clock::time_point spinEnd = start + std::chrono::microseconds(spinUs_);
+    for (uint32_t spins = 1;; ++spins) {
+      if (ready()) {
+        // Keep spinning about twice as long as waits take
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+        spinUs_ = (std::max)(spinUs_ - spinUs_ / 8, static_cast<int>(2 * waited.count()));
+        spinUs_ = (std::min)(spinUs_, maxSpinUs_);
+        return;
+      }
+      spinPause();
+      if ((spins & 63) == 0 && Clock::now() >= spinEnd) {
+        break;
+      }
+    }
+  } else if (ready()) {
+    return;
+  }
+
+  // Sleep on our doorbell, which the peer rings once it sees us sleeping
+  std::atomic<uint32_t>& sleeping = reading ? ring.readerSleeping : ring.writerSleeping;
+  sleeping.store(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (!ready()) {
+    int wait = -1;
+    if (timeoutMs > 0) {
+      auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+      wait = timeoutMs - static_cast<int>(spent.count());
+      if (wait <= 0) {
+        sleeping.store(0, std::memory_order_relaxed);
+        throw TTransportException(TTransportException::TIMED_OUT,
+                                  reading ? "TShmTransport read timed out"
+                                          : "TShmTransport write timed out");
+      }
+    }
+
+    struct THRIFT_POLLFD fds[3];
+    std::memset(fds, 0, sizeof(fds));
+    fds[0].fd = doorbell_;
+    fds[0].events = THRIFT_POLLIN;
+    fds[1].fd = control_->getSocketFD();
+    fds[1].events = THRIFT_POLLIN;
+    nfds_t count = 2;
+    if (interruptListener_) {
+      fds[2].fd = *interruptListener_;
+      fds[2].events = THRIFT_POLLIN;
+      count = 3;
+    }
+    int ret = THRIFT_POLL(fds, count, wait);
+    if (ret < 0) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      sleeping.store(0, std::memory_order_relaxed);
+      GlobalOutput.perror("TShmTransport::waitUntil() THRIFT_POLL() ", errno_copy);
+      throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
+    }
+    if (fds[0].revents & THRIFT_POLLIN) {
+      uint64_t rings;
+      if (::read(doorbell_, &rings, sizeof(rings)) < 0) {
+        // Drained by an earlier wakeup
+      }
+    }
+    if (fds[1].revents) {
+      // Nothing is ever sent on the control socket after the segment, so
+      // anything there means that the peer is gone
+      peerGone_ = true;
+    }
+    if (count == 3 && (fds[2].revents & THRIFT_POLLIN)) {
+      sleeping.store(0, std::memory_order_relaxed);
+      throw TTransportException(TTransportException::INTERRUPTED, "Interrupted");
+    }
+  }
+  sleeping.store(0, std::memory_order_relaxed);
+
+  // The peer took longer than we spun; spin half as long next time unless
+  // a little more spinning would have done
+  auto waited = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+  if (waited.count() <= maxSpinUs_) {
+    spinUs_ = (std::min)(maxSpinUs_, static_cast<int>(2 * waited.count()));
+  } else {
+    spinUs_ /= 2;
+  }
+}
+
+uint64_t TShmTransport::readable() {
+  uint64_t head = rx_->head.load(std::memory_order_acquire);
+  if (head - rxTail_ > static_cast<uint64_t>(ringMask_) + 1) {
+    corrupted();
+  }
+  return head - rxTail_;
+}
+
+uint64_t TShmTransport::writable() {
+  const uint64_t size = static_cast<uint64_t>(ringMask_) + 1;
+  uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+  if (txHead_ - tail > size) {
+    corrupted();
+  }
+  return size - (txHead_ - tail);
+}
+
+void TShmTransport::corrupted() {
+  peerGone_ = true;
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            "TShmTransport: peer corrupted the ring indices");
+}
+
+bool TShmTransport::peek() {
+  if (!isOpen()) {
+    return false;
+  }
+  flush();
+  waitUntil([this]() { return readable() != 0 || isPeerClosed(); }, *rx_, true, recvTimeout_);
+  return readable() != 0;
+}
+
+uint32_t TShmTransport::read(uint8_t* buf, uint32_t len) {
+  if (!isOpen()) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called read on non-open shm");
+  }
+  if (len == 0) {
+    return 0;
+  }
+  // The peer may be waiting for what we wrote before it answers
+  publish();
+
+  uint64_t available = readable();
+  if (available == 0) {
+    waitUntil([this]() { return readable() != 0 || isPeerClosed(); }, *rx_, true, recvTimeout_);
+    available = readable();
+    if (available == 0) {
+      return 0;
+    }
+  }
+
+  auto give = static_cast<uint32_t>((std::min)(available, static_cast<uint64_t>(len)));
+  uint32_t pos = static_cast<uint32_t>(rxTail_) & ringMask_;
+  uint32_t first = (std::min)(give, ringMask_ + 1 - pos);
+  std::memcpy(buf, rxData_ + pos, first);
+  std::memcpy(buf + first, rxData_, give - first);
+  rxTail_ += give;
+  rx_->tail.store(rxTail_, std::memory_order_release);
+  wakePeer(*rx_, false);
+  return give;
+}
+
+void TShmTransport::write(const uint8_t* buf, uint32_t len) {
+  if (!isOpen()) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called write on non-open shm");
+  }
+  while (len > 0) {
+    if (isPeerClosed()) {
+      throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport peer closed");
+    }
+    uint64_t room = writable();
+    if (room == 0) {
+      // Full: let the reader have it and wait for room
+      publish();
+      waitUntil([this]() { return writable() != 0 || isPeerClosed(); }, *tx_, false, sendTimeout_);
+      continue;
+    }
+
+    auto give = static_cast<uint32_t>((std::min)(room, static_cast<uint64_t>(len)));
+    uint32_t pos = static_cast<uint32_t>(txHead_) & ringMask_;
+    uint32_t first = (std::min)(give, ringMask_ + 1 - pos);
+    std::memcpy(txData_ + pos, buf, first);
+    std::memcpy(txData_, buf + first, give - first);
+    txHead_ += give;
+    buf += give;
+    len -= give;
+  }
+}
+
+void TShmTransport::publish() {
+  if (tx_->head.load(std::memory_order_relaxed) != txHead_) {
+    tx_->head.store(txHead_, std::memory_order_release);
+    wakePeer(*tx_, true);
+  }
+}
+
+void TShmTransport::flush() {
+  if (!isOpen()) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called flush on non-open shm");
+  }
+  publish();
+}
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,200 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TSHMTRANSPORT_H_
+#define _THRIFT_TRANSPORT_TSHMTRANSPORT_H_ 1
+
+#include <memory>
+#include <string>
+
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Transport between processes on the same host through shared memory.
+ *
+ * The client connects to a TShmServerTransport over a Unix domain socket,
+ * through which it receives a memory segment holding a ring buffer for each
+ * direction and an eventfd for each side to sleep on.  From then on data
+ * goes through the rings without system calls while both sides keep up, and
+ * the socket only tells either side when the other one went away.
+ *
+ * Writes are staged in the ring and handed to the peer by flush(), or as
+ * soon as the ring is full.  A side that finds nothing to read or no room to
+ * write spins for a while before it sleeps, and a side only rings the
+ * doorbell of a peer that is asleep.  How long it spins adapts to how long
+ * recent waits lasted, up to setMaxSpinUs().
+ *
+ * Unlike TSocket, a connection has one doorbell per side, so it must not be
+ * read from on one thread while being written to on another.
+ *
+ * Linux only: elsewhere open() and TShmServerTransport::listen() throw.
+ */
+class TShmTransport : public TVirtualTransport<TShmTransport> {
+public:
+  /// Size of each ring unless the server says otherwise
+  static const uint32_t DEFAULT_RING_SIZE = 1024 * 1024;
+
+  /// Longest spin before sleeping, in microseconds, unless there is only one CPU
+  static const int DEFAULT_MAX_SPIN_US = 50;
+
+  /**
+   * Constructs a client transport for the server listening at path.
+   *
+   * @param path The Unix domain socket path of the TShmServerTransport
+   */
+  TShmTransport(const std::string& path);
+
+  ~TShmTransport() override;
+
+  /**
+   * Sets the server end of an accepted connection up: creates its memory
+   * segment and sends it to the client over control.  Used by
+   * TShmServerTransport.
+   *
+   * @param control           The accepted Unix domain socket
+   * @param ringSize          Bytes in each ring, rounded up to a power of 2 of
+   *                          at least 4096
+   * @param interruptListener Socket that interrupts blocking reads and writes
+   *                          when readable, may be null
+   */
+  static std::shared_ptr<TShmTransport> accept(std::shared_ptr<TSocket> control,
+                                               uint32_t ringSize,
+                                               std::shared_ptr<THRIFT_SOCKET> interruptListener);
+
+  bool isOpen() const override;
+  bool peek() override;
+  void open() override;
+  void close() override;
+
+  /**
+   * Reads what is available, up to len bytes, waiting for at least one.
+   * \returns 0 once the peer closed and everything it sent was read
+   */
+  uint32_t read(uint8_t* buf, uint32_t len);
+  void write(const uint8_t* buf, uint32_t len);
+  void flush() override;
+
+  /**
+   * Milliseconds a read waits for data before it throws TIMED_OUT, 0 to
+   * wait forever (the default).
+   */
+  void setRecvTimeout(int ms) { recvTimeout_ = ms; }
+
+  /**
+   * Milliseconds a write waits for room in the ring before it throws
+   * TIMED_OUT, 0 to wait forever (the default).
+   */
+  void setSendTimeout(int ms) { sendTimeout_ = ms; }
+
+  /**
+   * Longest a side spins waiting before it sleeps, in microseconds.  0
+   * makes it sleep right away, which saves CPU at the cost of a wakeup per
+   * wait.  Defaults to DEFAULT_MAX_SPIN_US, or to 0 where only one CPU is
+   * online and spinning would keep the peer from running.
+   */
+  void setMaxSpinUs(int us);
+
+  /// The ring size, known once open
+  uint32_t getRingSize() const { return ringMask_ + 1; }
+
+  /// The Unix domain socket path of the server, empty for accepted connections
+  const std::string& getPath() const { return path_; }
+
+  const std::string getOrigin() const override;
+
+private:
+  struct Ring;
+  struct Segment;
+
+  TShmTransport(std::shared_ptr<TSocket> control,
+                std::shared_ptr<THRIFT_SOCKET> interruptListener);
+
+  /**
+   * Maps the segment in fd and takes the doorbells of this side and the
+   * other one.  Takes ownership of the descriptors.
+   */
+  void attach(int fd, int doorbell, int peerDoorbell, int side);
+
+  /// Makes what was written so far readable by the peer
+  void publish();
+
+  /// Waits until ready() holds, first spinning, then asleep
+  template <typename Ready>
+  void waitUntil(Ready ready, Ring& ring, bool reading, int timeoutMs);
+
+  /// Wakes the peer if it sleeps on ring as reader (or writer)
+  void wakePeer(Ring& ring, bool reader);
+
+  bool isPeerClosed();
+
+  /**
+   * Bytes the peer has written and we have not read, or room left for us
+   * to write.  The peer can write anything to its ring index, so both check
+   * it against the ring size.
+   *
+   * \throws TTransportException CORRUPTED_DATA if the index is out of range
+   */
+  uint64_t readable();
+  uint64_t writable();
+
+  /// Gives up on a peer that broke the ring protocol
+  void corrupted();
+
+  std::shared_ptr<TSocket> control_;
+  std::shared_ptr<THRIFT_SOCKET> interruptListener_;
+  std::string path_;
+
+  Segment* segment_;
+  size_t segmentSize_;
+  // The ring this side writes, and the one it reads
+  Ring* tx_;
+  Ring* rx_;
+  uint8_t* txData_;
+  uint8_t* rxData_;
+  uint32_t ringMask_;
+  int side_;
+
+  // eventfds this side sleeps on, and the peer sleeps on
+  int doorbell_;
+  int peerDoorbell_;
+
+  // Bytes written, of which the peer sees those up to tx_->head
+  uint64_t txHead_;
+  // Bytes read
+  uint64_t rxTail_;
+  // Set once the control socket reports the peer gone
+  bool peerGone_;
+
+  int recvTimeout_;
+  int sendTimeout_;
+  int maxSpinUs_;
+  // How long to spin in the next wait, adapted to recent waits
+  int spinUs_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TSHMTRANSPORT_H_
@@ -19,8 +19,11 @@
 
 #include <thrift/thrift-config.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <sstream>
+#include <vector>
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
@@ -42,6 +45,9 @@
 #include <unistd.h>
 #endif
 #include <fcntl.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/transport/TSocket.h>
@@ -66,6 +72,17 @@ inline SOCKOPT_CAST_T* cast_sockopt(T* v) {
   return reinterpret_cast<SOCKOPT_CAST_T*>(v);
 }
 
+static struct addrinfo toAddrinfo(const apache::thrift::transport::TAddressCache::Address& address) {
+  struct addrinfo res;
+  std::memset(&res, 0, sizeof(res));
+  res.ai_family = address.family;
+  res.ai_socktype = address.socktype;
+  res.ai_protocol = address.protocol;
+  res.ai_addr = const_cast<struct sockaddr*>(reinterpret_cast<const struct sockaddr*>(&address.addr));
+  res.ai_addrlen = address.addrlen;
+  return res;
+}
+
 using std::string;
 
 namespace apache {
@@ -89,7 +106,14 @@ TSocket::TSocket(const string& host, int port)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    connectAttemptDelay_(0),
+    fastOpen_(false),
+    zeroCopyThreshold_(0),
+    zeroCopyEnabled_(false),
+    zeroCopyCopied_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
 }
 
 TSocket::TSocket(const string& path)
@@ -104,7 +128,14 @@ TSocket::TSocket(const string& path)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    connectAttemptDelay_(0),
+    fastOpen_(false),
+    zeroCopyThreshold_(0),
+    zeroCopyEnabled_(false),
+    zeroCopyCopied_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
 
@@ -119,7 +150,14 @@ TSocket::TSocket()
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    connectAttemptDelay_(0),
+    fastOpen_(false),
+    zeroCopyThreshold_(0),
+    zeroCopyEnabled_(false),
+    zeroCopyCopied_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
 
@@ -134,7 +172,14 @@ TSocket::TSocket(THRIFT_SOCKET socket)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    connectAttemptDelay_(0),
+    fastOpen_(false),
+    zeroCopyThreshold_(0),
+    zeroCopyEnabled_(false),
+    zeroCopyCopied_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
   {
@@ -156,7 +201,14 @@ TSocket::TSocket(THRIFT_SOCKET socket, std::shared_ptr<THRIFT_SOCKET> interruptL
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    connectAttemptDelay_(0),
+    fastOpen_(false),
+    zeroCopyThreshold_(0),
+    zeroCopyEnabled_(false),
+    zeroCopyCopied_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
   {
@@ -190,6 +242,17 @@ try_again:
   return numBytesAvailable > 0;
 }
 
+bool TSocket::isReusable() {
+  if (!isOpen()) {
+    return false;
+  }
+  struct THRIFT_POLLFD fds[1];
+  std::memset(fds, 0, sizeof(fds));
+  fds[0].fd = socket_;
+  fds[0].events = THRIFT_POLLIN;
+  return THRIFT_POLL(fds, 1, 0) == 0;
+}
+
 bool TSocket::isOpen() const {
   return (socket_ != THRIFT_INVALID_SOCKET);
 }
@@ -249,24 +312,7 @@ bool TSocket::peek() {
   return (r > 0);
 }
 
-void TSocket::openConnection(struct addrinfo* res) {
-
-  if (isOpen()) {
-    return;
-  }
-
-  if (!path_.empty()) {
-    socket_ = socket(PF_UNIX, SOCK_STREAM, IPPROTO_IP);
-  } else {
-    socket_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-  }
-
-  if (socket_ == THRIFT_INVALID_SOCKET) {
-    int errno_copy = THRIFT_GET_SOCKET_ERROR;
-    GlobalOutput.perror("TSocket::open() socket() " + getSocketInfo(), errno_copy);
-    throw TTransportException(TTransportException::NOT_OPEN, "socket()", errno_copy);
-  }
-
+void TSocket::setSocketOptions() {
   // Send timeout
   if (sendTimeout_ > 0) {
     setSendTimeout(sendTimeout_);
@@ -301,6 +347,43 @@ void TSocket::openConnection(struct addrinfo* res) {
     setsockopt(socket_, IPPROTO_TCP, TCP_LOW_MIN_RTO, &one, sizeof(one));
   }
 #endif
+}
+
+void TSocket::openConnection(struct addrinfo* res) {
+
+  if (isOpen()) {
+    return;
+  }
+
+  if (!path_.empty()) {
+    socket_ = socket(PF_UNIX, SOCK_STREAM, IPPROTO_IP);
+  } else {
+    socket_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  }
+
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TSocket::open() socket() " + getSocketInfo(), errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "socket()", errno_copy);
+  }
+
+  setSocketOptions();
+
+  // Defer the handshake to the first write, which then goes in the SYN,
+  // if the kernel has a Fast Open cookie of the server
+  if (fastOpen_ && path_.empty()) {
+#ifdef TCP_FASTOPEN_CONNECT
+    int one = 1;
+    if (-1 == setsockopt(socket_, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, cast_sockopt(&one),
+                         sizeof(one))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TSocket::open() setsockopt() TCP_FASTOPEN_CONNECT " + getSocketInfo(),
+                          errno_copy);
+    }
+#else
+    GlobalOutput("TSocket::open() TCP_FASTOPEN_CONNECT is not supported on this platform");
+#endif
+  }
 
   // Set the socket to be non blocking for connect if a timeout exists
   int flags = THRIFT_FCNTL(socket_, THRIFT_F_GETFL, 0);
@@ -452,54 +535,211 @@ void TSocket::local_open() {
     throw TTransportException(TTransportException::BAD_ARGS, "Specified port is invalid");
   }
 
-  struct addrinfo hints, *res, *res0;
-  res = nullptr;
-  res0 = nullptr;
-  int error;
-  char port[sizeof("65535")];
-  std::memset(&hints, 0, sizeof(hints));
-  hints.ai_family = PF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
-  hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG;
-  sprintf(port, "%d", port_);
+  std::vector<TAddressCache::Address> addresses;
+  if (!addressCache_ || !addressCache_->lookup(host_, port_, addresses)) {
+    try {
+      addresses = TAddressCache::resolve(host_, port_);
+    } catch (TTransportException&) {
+      close();
+      throw;
+    }
+    if (addressCache_) {
+      addressCache_->insert(host_, port_, addresses);
+    }
+  }
+  if (addresses.empty()) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "Could not resolve host for client socket.");
+  }
 
-  error = getaddrinfo(host_.c_str(), port, &hints, &res0);
+  try {
+    if (connectAttemptDelay_ > 0 && addresses.size() > 1) {
+      raceConnections(addresses);
+      return;
+    }
 
-#ifdef _WIN32
-  if (error == WSANO_DATA) {
-    hints.ai_flags &= ~AI_ADDRCONFIG;
-    error = getaddrinfo(host_.c_str(), port, &hints, &res0);
+    // Cycle through all the returned addresses until one
+    // connects or push the exception up.
+    for (size_t i = 0; i < addresses.size(); ++i) {
+      struct addrinfo res = toAddrinfo(addresses[i]);
+      try {
+        openConnection(&res);
+        break;
+      } catch (TTransportException&) {
+        close();
+        if (i + 1 == addresses.size()) {
+          throw;
+        }
+      }
+    }
+  } catch (TTransportException&) {
+    // The host may have moved
+    if (addressCache_) {
+      addressCache_->invalidate(host_, port_);
+    }
+    throw;
   }
-#endif
+}
 
-  if (error) {
-    string errStr = "TSocket::open() getaddrinfo() " + getSocketInfo()
-                    + string(THRIFT_GAI_STRERROR(error));
-    GlobalOutput(errStr.c_str());
-    close();
-    throw TTransportException(TTransportException::NOT_OPEN,
-                              "Could not resolve host for client socket.");
+void TSocket::raceConnections(const std::vector<TAddressCache::Address>& addresses) {
+  typedef std::chrono::steady_clock Clock;
+
+  // Alternate between the address families, starting with the preferred one
+  std::vector<const TAddressCache::Address*> preferred, others, order;
+  for (const auto& address : addresses) {
+    (address.family == addresses[0].family ? preferred : others).push_back(&address);
+  }
+  for (size_t i = 0; i < std::max(preferred.size(), others.size()); ++i) {
+    if (i < preferred.size()) {
+      order.push_back(preferred[i]);
+    }
+    if (i < others.size()) {
+      order.push_back(others[i]);
+    }
   }
 
-  // Cycle through all the returned addresses until one
-  // connects or push the exception up.
-  for (res = res0; res; res = res->ai_next) {
-    try {
-      openConnection(res);
+  struct Attempt {
+    THRIFT_SOCKET fd;
+    const TAddressCache::Address* address;
+  };
+  std::vector<Attempt> attempts;
+  size_t next = 0;
+  int lastError = 0;
+  bool timedOut = false;
+  THRIFT_SOCKET winner = THRIFT_INVALID_SOCKET;
+  const TAddressCache::Address* winnerAddress = nullptr;
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(connTimeout_);
+  Clock::time_point nextStart;
+
+  // Starts connecting to the next address that can be tried
+  auto startNext = [&]() {
+    while (next < order.size()) {
+      const TAddressCache::Address& address = *order[next++];
+      THRIFT_SOCKET fd = socket(address.family, address.socktype, address.protocol);
+      if (fd == THRIFT_INVALID_SOCKET) {
+        lastError = THRIFT_GET_SOCKET_ERROR;
+        continue;
+      }
+      int flags = THRIFT_FCNTL(fd, THRIFT_F_GETFL, 0);
+      if (flags == -1 || THRIFT_FCNTL(fd, THRIFT_F_SETFL, flags | THRIFT_O_NONBLOCK) == -1) {
+        lastError = THRIFT_GET_SOCKET_ERROR;
+        ::THRIFT_CLOSESOCKET(fd);
+        continue;
+      }
+      if (connect(fd, reinterpret_cast<const struct sockaddr*>(&address.addr), address.addrlen)
+          == 0) {
+        winner = fd;
+        winnerAddress = &address;
+        return;
+      }
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy != THRIFT_EINPROGRESS && errno_copy != THRIFT_EWOULDBLOCK) {
+        lastError = errno_copy;
+        ::THRIFT_CLOSESOCKET(fd);
+        continue;
+      }
+      Attempt attempt = {fd, &address};
+      attempts.push_back(attempt);
+      nextStart = Clock::now() + std::chrono::milliseconds(connectAttemptDelay_);
+      return;
+    }
+  };
+
+  startNext();
+  while (winner == THRIFT_INVALID_SOCKET && !attempts.empty()) {
+    // Wake up to start the next attempt, or at the connect timeout
+    Clock::time_point wake = Clock::time_point::max();
+    if (next < order.size()) {
+      wake = nextStart;
+    }
+    if (connTimeout_ > 0 && deadline < wake) {
+      wake = deadline;
+    }
+    int timeout = -1;
+    if (wake != Clock::time_point::max()) {
+      timeout = static_cast<int>(
+          std::max<int64_t>(0,
+                            std::chrono::duration_cast<std::chrono::milliseconds>(
+                                wake - Clock::now() + std::chrono::microseconds(999))
+                                .count()));
+    }
+
+    std::vector<struct THRIFT_POLLFD> fds(attempts.size());
+    for (size_t i = 0; i < attempts.size(); ++i) {
+      std::memset(&fds[i], 0, sizeof(fds[i]));
+      fds[i].fd = attempts[i].fd;
+      fds[i].events = THRIFT_POLLOUT;
+    }
+    int ret = THRIFT_POLL(fds.data(), static_cast<int>(fds.size()), timeout);
+    if (ret < 0) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      lastError = errno_copy;
       break;
-    } catch (TTransportException&) {
-      if (res->ai_next) {
-        close();
+    }
+    if (ret == 0) {
+      if (connTimeout_ > 0 && Clock::now() >= deadline) {
+        timedOut = true;
+        break;
+      }
+      // The attempts so far are slow, race another one
+      startNext();
+      continue;
+    }
+
+    bool failed = false;
+    for (size_t i = attempts.size(); i-- > 0;) {
+      if (!fds[i].revents || winner != THRIFT_INVALID_SOCKET) {
+        continue;
+      }
+      int val;
+      socklen_t len = sizeof(val);
+      if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, cast_sockopt(&val), &len) == -1) {
+        val = THRIFT_GET_SOCKET_ERROR;
+      }
+      if (val == 0) {
+        winner = attempts[i].fd;
+        winnerAddress = attempts[i].address;
       } else {
-        close();
-        freeaddrinfo(res0); // cleanup on failure
-        throw;
+        lastError = val;
+        ::THRIFT_CLOSESOCKET(attempts[i].fd);
+        failed = true;
       }
+      attempts.erase(attempts.begin() + i);
+    }
+    // A refused attempt need not hold up the next one
+    if (failed && winner == THRIFT_INVALID_SOCKET) {
+      startNext();
     }
   }
 
-  // Free address structure memory
-  freeaddrinfo(res0);
+  for (const auto& attempt : attempts) {
+    ::THRIFT_CLOSESOCKET(attempt.fd);
+  }
+  if (winner == THRIFT_INVALID_SOCKET) {
+    if (timedOut) {
+      string errStr = "TSocket::open() timed out " + getSocketInfo();
+      GlobalOutput(errStr.c_str());
+      throw TTransportException(TTransportException::NOT_OPEN, "open() timed out");
+    }
+    GlobalOutput.perror("TSocket::open() connect() " + getSocketInfo(), lastError);
+    throw TTransportException(TTransportException::NOT_OPEN, "connect() failed", lastError);
+  }
+
+  socket_ = winner;
+  setSocketOptions();
+
+  // Set socket back to normal mode (blocking)
+  int flags = THRIFT_FCNTL(socket_, THRIFT_F_GETFL, 0);
+  if (flags == -1 || THRIFT_FCNTL(socket_, THRIFT_F_SETFL, flags & ~THRIFT_O_NONBLOCK) == -1) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TSocket::open() THRIFT_FCNTL " + getSocketInfo(), errno_copy);
+    close();
+    throw TTransportException(TTransportException::NOT_OPEN, "THRIFT_FCNTL() failed", errno_copy);
+  }
+  setCachedAddress(reinterpret_cast<const sockaddr*>(&winnerAddress->addr), winnerAddress->addrlen);
 }
 
 void TSocket::close() {
@@ -508,6 +748,10 @@ void TSocket::close() {
     ::THRIFT_CLOSESOCKET(socket_);
   }
   socket_ = THRIFT_INVALID_SOCKET;
+  zeroCopyEnabled_ = false;
+  zeroCopyCopied_ = false;
+  zeroCopySent_ = 0;
+  zeroCopyCompleted_ = 0;
 }
 
 void TSocket::setSocketFD(THRIFT_SOCKET socket) {
@@ -651,6 +895,7 @@ void TSocket::write(const uint8_t* buf, uint32_t len) {
     }
     sent += b;
   }
+  waitForZeroCopy();
 }
 
 uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
@@ -667,7 +912,24 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   flags |= MSG_NOSIGNAL;
 #endif // ifdef MSG_NOSIGNAL
 
+  bool zeroCopy = useZeroCopy(len);
+#ifdef MSG_ZEROCOPY
+  if (zeroCopy) {
+    flags |= MSG_ZEROCOPY;
+  }
+#endif
+
   int b = static_cast<int>(send(socket_, const_cast_sockopt(buf + sent), len - sent, flags));
+#ifdef MSG_ZEROCOPY
+  if (zeroCopy && b < 0 && retryWithoutZeroCopy()) {
+    zeroCopy = false;
+    b = static_cast<int>(send(socket_, const_cast_sockopt(buf + sent), len - sent,
+                              flags & ~MSG_ZEROCOPY));
+  }
+#endif
+  if (zeroCopy && b > 0) {
+    ++zeroCopySent_;
+  }
 
   if (b < 0) {
     if (THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN) {
@@ -692,6 +954,193 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return b;
 }
 
+uint32_t TSocket::writev_partial(const uint8_t* const* bufs, const uint32_t* lens, uint32_t count) {
+  if (count == 0) {
+    return 0;
+  }
+#ifdef _WIN32
+  return write_partial(bufs[0], lens[0]);
+#else
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called write on non-open socket");
+  }
+
+  const uint32_t kMaxBuffers = 64;
+  struct iovec iov[kMaxBuffers];
+  count = (std::min)(count, kMaxBuffers);
+  for (uint32_t i = 0; i < count; ++i) {
+    iov[i].iov_base = const_cast<uint8_t*>(bufs[i]);
+    iov[i].iov_len = lens[i];
+  }
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif // ifdef MSG_NOSIGNAL
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    total += lens[i];
+  }
+  bool zeroCopy = useZeroCopy(total);
+#ifdef MSG_ZEROCOPY
+  if (zeroCopy) {
+    flags |= MSG_ZEROCOPY;
+  }
+#endif
+
+  auto b = static_cast<int>(sendmsg(socket_, &msg, flags));
+#ifdef MSG_ZEROCOPY
+  if (zeroCopy && b < 0 && retryWithoutZeroCopy()) {
+    zeroCopy = false;
+    b = static_cast<int>(sendmsg(socket_, &msg, flags & ~MSG_ZEROCOPY));
+  }
+#endif
+  if (zeroCopy && b > 0) {
+    ++zeroCopySent_;
+  }
+
+  if (b < 0) {
+    if (THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN) {
+      return 0;
+    }
+    // Fail on a send error
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TSocket::writev_partial() sendmsg() " + getSocketInfo(), errno_copy);
+
+    if (errno_copy == THRIFT_EPIPE || errno_copy == THRIFT_ECONNRESET
+        || errno_copy == THRIFT_ENOTCONN) {
+      throw TTransportException(TTransportException::NOT_OPEN, "write() sendmsg()", errno_copy);
+    }
+
+    throw TTransportException(TTransportException::UNKNOWN, "write() sendmsg()", errno_copy);
+  }
+
+  // Fail on blocked send
+  if (b == 0) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Socket sendmsg returned 0.");
+  }
+  return b;
+#endif
+}
+
+bool TSocket::useZeroCopy(size_t len) {
+  if (zeroCopyThreshold_ == 0 || len < zeroCopyThreshold_ || zeroCopyCopied_) {
+    return false;
+  }
+  if (zeroCopyEnabled_) {
+    return true;
+  }
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+  int one = 1;
+  if (0 == setsockopt(socket_, SOL_SOCKET, SO_ZEROCOPY, const_cast_sockopt(&one), sizeof(one))) {
+    zeroCopyEnabled_ = true;
+    return true;
+  }
+  GlobalOutput.perror("TSocket::useZeroCopy() setsockopt() SO_ZEROCOPY " + getSocketInfo(),
+                      THRIFT_GET_SOCKET_ERROR);
+#else
+  GlobalOutput("TSocket::useZeroCopy() MSG_ZEROCOPY is not supported on this platform");
+#endif
+  zeroCopyThreshold_ = 0;
+  return false;
+}
+
+bool TSocket::retryWithoutZeroCopy() {
+  int errno_copy = THRIFT_GET_SOCKET_ERROR;
+  if (errno_copy == EOPNOTSUPP) {
+    // The socket does not take MSG_ZEROCOPY, e.g. with kernel TLS
+    zeroCopyThreshold_ = 0;
+    return true;
+  }
+  // Out of memory to pin the pages with
+  return errno_copy == ENOBUFS;
+}
+
+uint32_t TSocket::getZeroCopyPending() {
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+  while (zeroCopySent_ != zeroCopyCompleted_) {
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + CMSG_SPACE(sizeof(sockaddr_in6))];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy != THRIFT_EAGAIN && errno_copy != THRIFT_EWOULDBLOCK) {
+        GlobalOutput.perror("TSocket::getZeroCopyPending() recvmsg() " + getSocketInfo(),
+                            errno_copy);
+        throw TTransportException(TTransportException::UNKNOWN, "recvmsg()", errno_copy);
+      }
+      // No completion has arrived; make sure none is held up by a dead socket
+      int error = 0;
+      socklen_t errorLen = sizeof(error);
+      if (0 == getsockopt(socket_, SOL_SOCKET, SO_ERROR, cast_sockopt(&error), &errorLen)
+          && error != 0) {
+        throw TTransportException(TTransportException::NOT_OPEN, "zero-copy send failed", error);
+      }
+      break;
+    }
+
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+            || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+        continue;
+      }
+      const auto* err = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+      if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+        continue;
+      }
+      // Sends ee_info to ee_data, numbered from 0 in the order they were made
+      zeroCopyCompleted_ += err->ee_data - err->ee_info + 1;
+      if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        // The kernel copied after all, e.g. over loopback; copying up front
+        // is cheaper than pinning pages for nothing
+        zeroCopyCopied_ = true;
+      }
+    }
+  }
+#endif
+  return zeroCopySent_ - zeroCopyCompleted_;
+}
+
+void TSocket::waitForZeroCopy() {
+  if (zeroCopySent_ == zeroCopyCompleted_) {
+    return;
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(sendTimeout_);
+  while (getZeroCopyPending() > 0) {
+    // Completions are reported as an error condition, which poll() always
+    // watches for
+    struct THRIFT_POLLFD fds[1];
+    std::memset(fds, 0, sizeof(fds));
+    fds[0].fd = socket_;
+    int timeout = -1;
+    if (sendTimeout_ > 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0) {
+        throw TTransportException(TTransportException::TIMED_OUT,
+                                  "zero-copy completion timeout expired");
+      }
+      timeout = static_cast<int>(left);
+    }
+    int ret = THRIFT_POLL(fds, 1, timeout);
+    if (ret < 0 && THRIFT_GET_SOCKET_ERROR != THRIFT_EINTR) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TSocket::waitForZeroCopy() THRIFT_POLL() " + getSocketInfo(),
+                          errno_copy);
+      throw TTransportException(TTransportException::UNKNOWN, "THRIFT_POLL()", errno_copy);
+    }
+  }
+}
+
 std::string TSocket::getHost() {
   return host_;
 }
@@ -803,6 +1252,22 @@ void TSocket::setKeepAlive(bool keepAlive) {
   }
 }
 
+void TSocket::setConnectAttemptDelay(int ms) {
+  connectAttemptDelay_ = ms;
+}
+
+void TSocket::setZeroCopyThreshold(uint32_t bytes) {
+  zeroCopyThreshold_ = bytes;
+}
+
+void TSocket::setFastOpen(bool fastOpen) {
+  fastOpen_ = fastOpen;
+}
+
+void TSocket::setAddressCache(std::shared_ptr<TAddressCache> cache) {
+  addressCache_ = cache;
+}
+
 void TSocket::setMaxRecvRetries(int maxRecvRetries) {
   maxRecvRetries_ = maxRecvRetries;
 }
@@ -20,8 +20,11 @@
 #ifndef _THRIFT_TRANSPORT_TSOCKET_H_
 #define _THRIFT_TRANSPORT_TSOCKET_H_ 1
 
+#include <memory>
 #include <string>
+#include <vector>
 
+#include <thrift/transport/TAddressCache.h>
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
 #include <thrift/transport/TServerSocket.h>
@@ -113,6 +116,36 @@ public:
    */
   virtual bool hasPendingDataToRead();
 
+  /**
+   * Determines whether the socket has a handshake to complete before it
+   * carries data, as TSSLSocket does.
+   */
+  virtual bool isHandshakePending() const { return false; }
+
+  /**
+   * Takes a pending handshake as far as it goes without waiting for the
+   * peer, where the socket is non-blocking.
+   *
+   * \param wantWrite set to whether to wait for the socket to be writable,
+   *                  rather than readable, before calling again
+   * \returns true once the handshake is completed
+   * \throws TTransportException if the handshake failed
+   */
+  virtual bool advanceHandshake(bool& wantWrite) {
+    wantWrite = false;
+    return true;
+  }
+
+  /**
+   * Determines whether a connection kept open between requests can be used
+   * for another one: it must be open and have nothing to read, as anything
+   * readable means that the peer closed it or that data was left unread.
+   *
+   * This call does not block, unlike peek() on a socket with nothing to read.
+   * \returns true if the connection can be reused
+   */
+  bool isReusable();
+
   /**
    * Reads from the underlying socket.
    * \returns the number of bytes read or 0 indicates EOF
@@ -135,6 +168,30 @@ public:
    */
   virtual uint32_t write_partial(const uint8_t* buf, uint32_t len);
 
+  /**
+   * Writes count buffers to the underlying socket with a single gathering
+   * send (sendmsg) and returns the number of bytes sent, which may end part
+   * way through any of the buffers.  Errors are reported as by
+   * write_partial().  On platforms without gathering sends only the first
+   * buffer is written.
+   */
+  virtual uint32_t writev_partial(const uint8_t* const* bufs, const uint32_t* lens, uint32_t count);
+
+  /**
+   * Reads the completions of zero-copy sends that have arrived.
+   * \returns the number of zero-copy sends whose buffers the kernel may
+   *          still read from
+   * \throws TTransportException if the socket failed
+   */
+  uint32_t getZeroCopyPending();
+
+  /**
+   * Waits until the kernel is done with the buffers of every zero-copy send,
+   * at most the send timeout.
+   * \throws TTransportException TIMED_OUT if the send timeout expired
+   */
+  void waitForZeroCopy();
+
   /**
    * Get the host that the socket is connected to
    *
@@ -194,6 +251,47 @@ public:
    */
   void setSendTimeout(int ms);
 
+  /**
+   * Set how long open() waits for a connection to one address of the host
+   * before it also starts connecting to the next, in milliseconds.  The
+   * addresses are raced alternating between IPv6 and IPv4 ("Happy
+   * Eyeballs", RFC 8305), the first connection wins and the others are
+   * closed, so a dead address only costs this delay.  0 tries one address
+   * after the other, each until the connect timeout (default).  250 is the
+   * delay the RFC recommends.
+   */
+  void setConnectAttemptDelay(int ms);
+
+  /**
+   * Use TCP Fast Open on open(), so that the first request written goes in
+   * the SYN instead of waiting a round trip for the handshake.  Once the
+   * kernel holds a Fast Open cookie of the server, open() returns without
+   * connecting and errors connecting surface on the first write or read;
+   * until then, and on platforms without TCP_FASTOPEN_CONNECT, open()
+   * connects as usual.  Not used when addresses are raced, since that needs
+   * the handshakes.  Off by default.
+   */
+  void setFastOpen(bool fastOpen);
+
+  /**
+   * Send writes of at least this many bytes with MSG_ZEROCOPY where
+   * supported, so that the kernel sends from the caller's pages instead of
+   * copying them.  This pays off for writes of hundreds of kilobytes and
+   * more.  Since the kernel reads the pages until the data is acknowledged,
+   * write() waits for the sends to complete before returning, while after
+   * write_partial() and writev_partial() the caller must leave the buffers
+   * alone until getZeroCopyPending() returns 0.  When the kernel reports
+   * that it copied anyway, e.g. over loopback, the socket stops trying.
+   * 0 turns zero-copy sends off (default).
+   */
+  void setZeroCopyThreshold(uint32_t bytes);
+
+  /**
+   * Set a cache of resolved addresses to use on open(), which may be shared
+   * by many sockets.  By default every open() resolves the host.
+   */
+  void setAddressCache(std::shared_ptr<TAddressCache> cache);
+
   /**
    * Set the max number of recv retries in case of an THRIFT_EAGAIN
    * error
@@ -333,6 +431,28 @@ protected:
   /** Recv EGAIN retries */
   int maxRecvRetries_;
 
+  /** Delay before racing the next address in ms, 0 to connect serially */
+  int connectAttemptDelay_;
+
+  /** Fast Open on */
+  bool fastOpen_;
+
+  /** Smallest write sent with MSG_ZEROCOPY, 0 if none is */
+  uint32_t zeroCopyThreshold_;
+
+  /** Whether SO_ZEROCOPY is set on socket_ */
+  bool zeroCopyEnabled_;
+
+  /** Whether the kernel reported copying a zero-copy send */
+  bool zeroCopyCopied_;
+
+  /** Number of zero-copy sends made and completed on socket_ */
+  uint32_t zeroCopySent_;
+  uint32_t zeroCopyCompleted_;
+
+  /** Cache of resolved addresses, may be empty */
+  std::shared_ptr<TAddressCache> addressCache_;
+
   /** Cached peer address */
   union {
     sockaddr_in ipv4;
@@ -345,6 +465,18 @@ protected:
 private:
   void unix_open();
   void local_open();
+
+  /** Applies the socket options to socket_, called by open */
+  void setSocketOptions();
+
+  /** Whether a write of len bytes is sent with MSG_ZEROCOPY */
+  bool useZeroCopy(size_t len);
+
+  /** Whether a failed zero-copy send is to be made again with a copy */
+  bool retryWithoutZeroCopy();
+
+  /** Connects to the first of the addresses to answer, called by open */
+  void raceConnections(const std::vector<TAddressCache::Address>& addresses);
 };
 }
 }
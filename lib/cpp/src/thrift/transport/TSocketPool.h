@@ -63,6 +63,8 @@ public:
 /**
  * TCP Socket implementation of the TTransport interface.
  *
+ * Connects to one of a list of servers, failing over when opened.  To spread
+ * requests over all of them, see TBalancedSocketPool.
  */
 class TSocketPool : public TSocket {
 
@@ -25,6 +25,7 @@
 #include <math.h>
 #include <memory>
 #include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/protocol/TJSONProtocol.h"
 #include "thrift/transport/TBufferTransports.h"
 #include "gen-cpp/DebugProtoTest_types.h"
 
@@ -156,6 +157,35 @@ int main() {
     cout << " Read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
 
+  {
+    buf->resetBuffer();
+    TJSONProtocol prot(buf);
+    double elapsed = 0.0;
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      ooe.write(&prot);
+    }
+    elapsed = timer.frame();
+    cout << "Write JSON: " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
+  buf->getBuffer(&data, &datasize);
+
+  {
+    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    TJSONProtocol prot(buf2);
+    OneOfEach ooe2;
+    double elapsed = 0.0;
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      ooe2.read(&prot);
+    }
+    elapsed = timer.frame();
+    cout << " Read JSON: " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
 
   data = nullptr;
   datasize = 0;
@@ -239,6 +269,31 @@ int main() {
     cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
 
+  {
+    buf->resetBuffer();
+    TJSONProtocol prot(buf);
+    double elapsed = 0.0;
+    Timer timer;
+
+    listDoublePerf.write(&prot);
+    elapsed = timer.frame();
+    cout << "Double write JSON: " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
+  buf->getBuffer(&data, &datasize);
+
+  {
+    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    TJSONProtocol prot(buf2);
+    ListDoublePerf listDoublePerf2;
+    double elapsed = 0.0;
+    Timer timer;
+
+    listDoublePerf2.read(&prot);
+    elapsed = timer.frame();
+    cout << " Double read JSON: " << num / (1000 * elapsed) << " kHz" << endl;
+  }
+
 
   return 0;
 }
@@ -341,3 +341,53 @@ BOOST_AUTO_TEST_CASE(test_json_unicode_escaped_missing_hi_surrogate) {
   BOOST_CHECK_THROW(ooe2.read(proto.get()),
     apache::thrift::protocol::TProtocolException);
 }
+
+static std::shared_ptr<TJSONProtocol> jsonReader(const std::string& json) {
+  // Keep the terminating NUL, which ends the number being read
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(static_cast<uint32_t>(json.size() + 1)));
+  buffer->write(reinterpret_cast<const uint8_t*>(json.c_str()), static_cast<uint32_t>(json.size() + 1));
+  return std::shared_ptr<TJSONProtocol>(new TJSONProtocol(buffer));
+}
+
+BOOST_AUTO_TEST_CASE(test_json_integer_bounds) {
+  int8_t i8;
+  jsonReader("127")->readByte(i8);
+  BOOST_CHECK_EQUAL(127, i8);
+  jsonReader("-128")->readByte(i8);
+  BOOST_CHECK_EQUAL(-128, i8);
+  int16_t i16;
+  jsonReader("32767")->readI16(i16);
+  BOOST_CHECK_EQUAL(32767, i16);
+  jsonReader("-32768")->readI16(i16);
+  BOOST_CHECK_EQUAL(-32768, i16);
+  int32_t i32;
+  jsonReader("2147483647")->readI32(i32);
+  BOOST_CHECK_EQUAL(2147483647, i32);
+  jsonReader("-2147483648")->readI32(i32);
+  BOOST_CHECK_EQUAL(-2147483647 - 1, i32);
+  bool b;
+  jsonReader("1")->readBool(b);
+  BOOST_CHECK(b);
+  jsonReader("0")->readBool(b);
+  BOOST_CHECK(!b);
+}
+
+BOOST_AUTO_TEST_CASE(test_json_integer_overflow) {
+  using apache::thrift::protocol::TProtocolException;
+  int8_t i8;
+  BOOST_CHECK_THROW(jsonReader("128")->readByte(i8), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("-129")->readByte(i8), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("256")->readByte(i8), TProtocolException);
+  int16_t i16;
+  BOOST_CHECK_THROW(jsonReader("32768")->readI16(i16), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("-32769")->readI16(i16), TProtocolException);
+  int32_t i32;
+  BOOST_CHECK_THROW(jsonReader("2147483648")->readI32(i32), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("-2147483649")->readI32(i32), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("99999999999999999999")->readI32(i32), TProtocolException);
+  bool b;
+  BOOST_CHECK_THROW(jsonReader("2")->readBool(b), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("5")->readBool(b), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("10")->readBool(b), TProtocolException);
+  BOOST_CHECK_THROW(jsonReader("-1")->readBool(b), TProtocolException);
+}
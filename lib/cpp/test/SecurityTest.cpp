@@ -24,6 +24,7 @@
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
 #include <memory>
+#include <thrift/transport/TChainedBuffer.h>
 #include <thrift/transport/TSSLServerSocket.h>
 #include <thrift/transport/TSSLSocket.h>
 #include <thrift/transport/TTransport.h>
@@ -32,6 +33,8 @@
 #include <signal.h>
 #endif
 
+using apache::thrift::transport::SSLSessionStats;
+using apache::thrift::transport::TChainedBuffer;
 using apache::thrift::transport::TSSLServerSocket;
 using apache::thrift::transport::TServerTransport;
 using apache::thrift::transport::TSSLSocket;
@@ -275,4 +278,110 @@ BOOST_AUTO_TEST_CASE(ssl_security_matrix)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ssl_kernel_tls)
+{
+    // Data must get through whether or not the kernel takes the records over.
+    // Without the tls kernel module, or with an OpenSSL built without kTLS,
+    // the handshake leaves both directions in user space and this only covers
+    // the fallback; the messages below show which path was taken.
+    shared_ptr<TSSLSocketFactory> pServerSocketFactory(new TSSLSocketFactory());
+    pServerSocketFactory->loadCertificate(certFile("server.crt").string().c_str());
+    pServerSocketFactory->loadPrivateKey(certFile("server.key").string().c_str());
+    pServerSocketFactory->server(true);
+    pServerSocketFactory->kernelTls(true);
+    TSSLServerSocket serverSocket("localhost", 0, pServerSocketFactory);
+    serverSocket.listen();
+
+    std::vector<uint8_t> payload(1024 * 1024);
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 13);
+    }
+
+    boost::thread echo([&serverSocket, &payload]() {
+        shared_ptr<TSSLSocket> accepted = std::dynamic_pointer_cast<TSSLSocket>(serverSocket.accept());
+        std::vector<uint8_t> request(payload.size());
+        accepted->readAll(&request[0], static_cast<uint32_t>(request.size()));
+        BOOST_TEST_MESSAGE(boost::format("SRV kTLS send %1% recv %2%")
+                           % accepted->isKernelTlsSend() % accepted->isKernelTlsRecv());
+        // Gathered from several segments when the kernel encrypts
+        TChainedBuffer response(64 * 1024);
+        response.write(&request[0], static_cast<uint32_t>(request.size()));
+        response.flushTo(*accepted);
+        accepted->close();
+    });
+
+    shared_ptr<TSSLSocketFactory> pClientSocketFactory(new TSSLSocketFactory());
+    pClientSocketFactory->loadTrustedCertificates(certFile("CA.pem").string().c_str());
+    pClientSocketFactory->authenticate(true);
+    pClientSocketFactory->kernelTls(true);
+    shared_ptr<TSSLSocket> client = pClientSocketFactory->createSocket("localhost", serverSocket.getPort());
+    client->open();
+    client->write(&payload[0], static_cast<uint32_t>(payload.size()));
+    client->flush();
+    std::vector<uint8_t> received(payload.size());
+    client->readAll(&received[0], static_cast<uint32_t>(received.size()));
+    BOOST_TEST_MESSAGE(boost::format("CLI kTLS send %1% recv %2%")
+                       % client->isKernelTlsSend() % client->isKernelTlsRecv());
+    BOOST_CHECK(received == payload);
+    client->close();
+    echo.join();
+}
+
+BOOST_AUTO_TEST_CASE(ssl_session_resumption)
+{
+    shared_ptr<TSSLSocketFactory> pServerSocketFactory(new TSSLSocketFactory());
+    pServerSocketFactory->loadCertificate(certFile("server.crt").string().c_str());
+    pServerSocketFactory->loadPrivateKey(certFile("server.key").string().c_str());
+    pServerSocketFactory->server(true);
+    pServerSocketFactory->sessionTickets(3600);
+    TSSLServerSocket serverSocket("localhost", 0, pServerSocketFactory);
+    serverSocket.listen();
+
+    const int connections = 3;
+    boost::thread echo([&serverSocket]() {
+        for (int i = 0; i < connections; ++i)
+        {
+            shared_ptr<TTransport> accepted = serverSocket.accept();
+            uint8_t byte;
+            accepted->readAll(&byte, 1);
+            accepted->write(&byte, 1);
+            accepted->flush();
+            accepted->close();
+        }
+    });
+
+    shared_ptr<TSSLSocketFactory> pClientSocketFactory(new TSSLSocketFactory());
+    pClientSocketFactory->loadTrustedCertificates(certFile("CA.pem").string().c_str());
+    pClientSocketFactory->authenticate(true);
+    pClientSocketFactory->clientSessionCache(16);
+    for (int i = 0; i < connections; ++i)
+    {
+        shared_ptr<TSSLSocket> client = pClientSocketFactory->createSocket("localhost", serverSocket.getPort());
+        client->open();
+        uint8_t byte = static_cast<uint8_t>(i);
+        client->write(&byte, 1);
+        client->flush();
+        // The ticket of the connection arrives with the response under TLS 1.3
+        client->readAll(&byte, 1);
+        BOOST_CHECK_EQUAL(i, byte);
+        BOOST_CHECK_EQUAL(i > 0, client->isSessionReused());
+        client->close();
+    }
+    echo.join();
+
+    SSLSessionStats clientStats = pClientSocketFactory->getSessionStats();
+    BOOST_CHECK_EQUAL(1u, clientStats.fullHandshakes);
+    BOOST_CHECK_EQUAL(static_cast<uint64_t>(connections - 1), clientStats.resumedHandshakes);
+    BOOST_CHECK_EQUAL(1u, clientStats.cachedSessions);
+
+    SSLSessionStats serverStats = pServerSocketFactory->getSessionStats();
+    BOOST_CHECK_EQUAL(1u, serverStats.fullHandshakes);
+    BOOST_CHECK_EQUAL(static_cast<uint64_t>(connections - 1), serverStats.resumedHandshakes);
+    BOOST_CHECK_EQUAL(1u, serverStats.ticketKeyRotations);
+    BOOST_CHECK_EQUAL(0u, serverStats.ticketsRejected);
+
+    BOOST_CHECK_THROW(pServerSocketFactory->addTicketKey("short"), TTransportException);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
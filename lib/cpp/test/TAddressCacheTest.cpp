@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <thrift/transport/TAddressCache.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <memory>
+#include <vector>
+#include "TTransportCheckThrow.h"
+
+using apache::thrift::transport::TAddressCache;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+
+namespace {
+
+// The IPv4 loopback address of port
+TAddressCache::Address loopback(int port) {
+  std::vector<TAddressCache::Address> addresses = TAddressCache::resolve("127.0.0.1", port);
+  BOOST_REQUIRE(!addresses.empty());
+  return addresses[0];
+}
+
+int closedPort() {
+  TServerSocket closed("127.0.0.1", 0);
+  closed.listen();
+  return closed.getPort();
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TAddressCacheTest)
+
+BOOST_AUTO_TEST_CASE(test_lookup) {
+  TAddressCache cache(60);
+  std::vector<TAddressCache::Address> addresses;
+  BOOST_CHECK(!cache.lookup("example", 80, addresses));
+
+  cache.insert("example", 80, std::vector<TAddressCache::Address>(1, loopback(80)));
+  BOOST_CHECK(cache.lookup("example", 80, addresses));
+  BOOST_CHECK_EQUAL(addresses.size(), 1u);
+  BOOST_CHECK(!cache.lookup("example", 81, addresses));
+
+  cache.invalidate("example", 80);
+  BOOST_CHECK(!cache.lookup("example", 80, addresses));
+
+  TAddressCache expired(0);
+  expired.insert("example", 80, std::vector<TAddressCache::Address>(1, loopback(80)));
+  BOOST_CHECK(!expired.lookup("example", 80, addresses));
+}
+
+BOOST_AUTO_TEST_CASE(test_open_from_cache) {
+  TServerSocket server("127.0.0.1", 0);
+  server.listen();
+  int port = server.getPort();
+
+  // The host name is only known to the cache
+  shared_ptr<TAddressCache> cache(new TAddressCache(60));
+  cache->insert("cached.invalid", port, std::vector<TAddressCache::Address>(1, loopback(port)));
+  TSocket socket("cached.invalid", port);
+  socket.setAddressCache(cache);
+  socket.open();
+  BOOST_CHECK(socket.isOpen());
+  server.accept();
+}
+
+BOOST_AUTO_TEST_CASE(test_race_addresses) {
+  TServerSocket server("127.0.0.1", 0);
+  server.listen();
+  int port = server.getPort();
+
+  shared_ptr<TAddressCache> cache(new TAddressCache(60));
+  std::vector<TAddressCache::Address> addresses;
+  addresses.push_back(loopback(closedPort()));
+  addresses.push_back(loopback(port));
+  cache->insert("race.invalid", port, addresses);
+
+  TSocket socket("race.invalid", port);
+  socket.setAddressCache(cache);
+  socket.setConnTimeout(1000);
+  socket.setConnectAttemptDelay(50);
+  socket.open();
+  BOOST_CHECK(socket.isOpen());
+  BOOST_CHECK_EQUAL(socket.getPeerPort(), port);
+  server.accept();
+
+  // When no address answers, the cached ones are dropped
+  addresses.pop_back();
+  addresses.push_back(loopback(closedPort()));
+  cache->insert("dead.invalid", port, addresses);
+  TSocket dead("dead.invalid", port);
+  dead.setAddressCache(cache);
+  dead.setConnectAttemptDelay(50);
+  TTRANSPORT_CHECK_THROW(dead.open(), TTransportException::NOT_OPEN);
+  BOOST_CHECK(!cache->lookup("dead.invalid", port, addresses));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
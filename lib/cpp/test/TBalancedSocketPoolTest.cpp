@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <thrift/transport/TBalancedSocketPool.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TTransportCheckThrow.h"
+
+using apache::thrift::transport::TBalancedSocket;
+using apache::thrift::transport::TBalancedSocketPool;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+
+namespace {
+
+// Echoes every 4 byte request on every connection it accepts
+class EchoServer {
+public:
+  EchoServer() : socket_("localhost", 0), accepted_(0) {
+    socket_.listen();
+    acceptor_ = std::thread([this] {
+      try {
+        for (;;) {
+          shared_ptr<TTransport> conn = socket_.accept();
+          ++accepted_;
+          connections_.push_back(std::thread([conn] {
+            try {
+              uint8_t buf[4];
+              for (;;) {
+                conn->readAll(buf, sizeof(buf));
+                conn->write(buf, sizeof(buf));
+                conn->flush();
+              }
+            } catch (const TTransportException&) {
+            }
+          }));
+        }
+      } catch (const TTransportException&) {
+      }
+    });
+  }
+
+  ~EchoServer() {
+    socket_.interrupt();
+    socket_.interruptChildren();
+    acceptor_.join();
+    for (auto& connection : connections_) {
+      connection.join();
+    }
+  }
+
+  int port() { return socket_.getPort(); }
+  int accepted() const { return accepted_; }
+
+private:
+  TServerSocket socket_;
+  std::atomic<int> accepted_;
+  std::thread acceptor_;
+  std::vector<std::thread> connections_;
+};
+
+void call(TBalancedSocket& socket, uint32_t value) {
+  socket.write(reinterpret_cast<const uint8_t*>(&value), sizeof(value));
+  socket.flush();
+  uint32_t reply = 0;
+  socket.readAll(reinterpret_cast<uint8_t*>(&reply), sizeof(reply));
+  socket.readEnd();
+  BOOST_CHECK_EQUAL(value, reply);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TBalancedSocketPoolTest)
+
+BOOST_AUTO_TEST_CASE(test_connections_reused) {
+  EchoServer server1, server2;
+  std::vector<std::pair<std::string, int> > servers;
+  servers.push_back(std::make_pair("localhost", server1.port()));
+  servers.push_back(std::make_pair("localhost", server2.port()));
+  shared_ptr<TBalancedSocketPool> pool(new TBalancedSocketPool(servers));
+
+  TBalancedSocket socket(pool);
+  socket.open();
+  for (uint32_t i = 0; i < 50; ++i) {
+    call(socket, i);
+  }
+  socket.close();
+
+  // One call at a time needs at most the warm connection to each server
+  BOOST_CHECK_EQUAL(server1.accepted() + server2.accepted(), 2);
+  for (const auto& stats : pool->getServerStats()) {
+    BOOST_CHECK_EQUAL(stats.inFlight, 0u);
+    BOOST_CHECK_EQUAL(stats.idleConnections, 1u);
+    BOOST_CHECK(!stats.evicted);
+    BOOST_CHECK_GT(stats.latencyUs, 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_failing_server_evicted) {
+  EchoServer server;
+  int closedPort;
+  {
+    TServerSocket closed("localhost", 0);
+    closed.listen();
+    closedPort = closed.getPort();
+  }
+  std::vector<std::pair<std::string, int> > servers;
+  servers.push_back(std::make_pair("localhost", server.port()));
+  servers.push_back(std::make_pair("localhost", closedPort));
+  shared_ptr<TBalancedSocketPool> pool(new TBalancedSocketPool(servers));
+  pool->setMaxConsecutiveFailures(1);
+
+  TBalancedSocket socket(pool);
+  socket.open();
+  for (uint32_t i = 0; i < 10; ++i) {
+    call(socket, i);
+  }
+  BOOST_CHECK_EQUAL(socket.getCurrentServer(), "localhost:" + std::to_string(server.port()));
+
+  std::vector<TBalancedSocketPool::ServerStats> stats = pool->getServerStats();
+  BOOST_CHECK(!stats[0].evicted);
+  BOOST_CHECK(stats[1].evicted);
+}
+
+BOOST_AUTO_TEST_CASE(test_failed_request_dropped) {
+  int port;
+  {
+    TServerSocket closed("localhost", 0);
+    closed.listen();
+    port = closed.getPort();
+  }
+  std::vector<std::pair<std::string, int> > servers;
+  servers.push_back(std::make_pair("localhost", port));
+  shared_ptr<TBalancedSocketPool> pool(new TBalancedSocketPool(servers));
+
+  TBalancedSocket socket(pool);
+  socket.open();
+  socket.write(reinterpret_cast<const uint8_t*>("AAAA"), 4);
+  TTRANSPORT_CHECK_THROW(socket.flush(), TTransportException::NOT_OPEN);
+
+  // Once the server is back only the next request reaches it
+  TServerSocket server("localhost", port);
+  server.listen();
+  socket.write(reinterpret_cast<const uint8_t*>("BBBB"), 4);
+  socket.flush();
+  shared_ptr<TTransport> conn = server.accept();
+  uint8_t buf[4];
+  conn->readAll(buf, sizeof(buf));
+  BOOST_CHECK_EQUAL(std::string(reinterpret_cast<char*>(buf), sizeof(buf)), "BBBB");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  BOOST_CHECK(!std::dynamic_pointer_cast<TSocket>(conn)->hasPendingDataToRead());
+
+  socket.close();
+  server.close();
+}
+
+BOOST_AUTO_TEST_CASE(test_read_without_request) {
+  std::vector<std::pair<std::string, int> > servers;
+  servers.push_back(std::make_pair("localhost", 0));
+  shared_ptr<TBalancedSocketPool> pool(new TBalancedSocketPool(servers));
+  TTRANSPORT_CHECK_THROW(pool->setLatencyWeight(2), TTransportException::BAD_ARGS);
+
+  TBalancedSocket socket(pool);
+  uint8_t buf[1];
+  TTRANSPORT_CHECK_THROW(socket.read(buf, 1), TTransportException::NOT_OPEN);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TChainedBuffer.h>
+#include <thrift/transport/TSocket.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+BOOST_AUTO_TEST_SUITE(TChainedBufferTest)
+
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::transport::TChainedBuffer;
+using apache::thrift::transport::TSocket;
+using std::shared_ptr;
+using std::string;
+
+BOOST_AUTO_TEST_CASE(test_read_write_across_segments) {
+  TChainedBuffer uut(64);
+  const uint32_t maxSize = 65536;
+  std::vector<uint8_t> buf(maxSize);
+  std::vector<uint8_t> verify(maxSize);
+
+  for (uint32_t i = 0; i < maxSize; ++i) {
+    buf[i] = static_cast<uint8_t>(i * 7);
+  }
+
+  uint32_t total = 0;
+  for (uint32_t i = 1; i < maxSize; i *= 2) {
+    uut.write(&buf[0], i);
+    total += i;
+  }
+  BOOST_CHECK(uut.getSegmentCount() > 1);
+  BOOST_CHECK_EQUAL(total, uut.available_read());
+  BOOST_CHECK_EQUAL(total, uut.writeEnd());
+
+  for (uint32_t i = 1; i < maxSize; i *= 2) {
+    BOOST_CHECK_EQUAL(i, uut.read(&verify[0], i));
+    BOOST_CHECK_EQUAL(0, ::memcmp(&verify[0], &buf[0], i));
+  }
+  BOOST_CHECK_EQUAL(0u, uut.available_read());
+  BOOST_CHECK_EQUAL(total, uut.readEnd());
+  BOOST_CHECK_EQUAL(1u, uut.getSegmentCount());
+}
+
+BOOST_AUTO_TEST_CASE(test_borrow_consume) {
+  TChainedBuffer uut(16);
+  const uint8_t data[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  uut.write(data, 36);
+
+  // Borrowing is limited to one segment
+  uint32_t len = 4;
+  const uint8_t* borrowed = uut.borrow(nullptr, &len);
+  BOOST_REQUIRE(borrowed != nullptr);
+  BOOST_CHECK_EQUAL(16u, len);
+  BOOST_CHECK_EQUAL(0, ::memcmp(borrowed, data, 16));
+  uut.consume(16);
+
+  len = 4;
+  borrowed = uut.borrow(nullptr, &len);
+  BOOST_REQUIRE(borrowed != nullptr);
+  BOOST_CHECK_EQUAL(0, ::memcmp(borrowed, data + 16, len));
+
+  len = 100;
+  BOOST_CHECK(uut.borrow(nullptr, &len) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_append_external) {
+  TChainedBuffer uut(16);
+  shared_ptr<string> blob(new string(1000, 'x'));
+  std::weak_ptr<string> watch(blob);
+
+  uut.write((const uint8_t*)"head", 4);
+  uut.appendExternal((const uint8_t*)blob->data(), static_cast<uint32_t>(blob->size()), blob);
+  uut.write((const uint8_t*)"tail", 4);
+  blob.reset();
+
+  // The buffer keeps the blob alive until it has been read
+  BOOST_CHECK(!watch.expired());
+  BOOST_CHECK_EQUAL(1008u, uut.available_read());
+
+  uint8_t out[1008];
+  BOOST_CHECK_EQUAL(1008u, uut.read(out, 1008));
+  BOOST_CHECK_EQUAL(0, ::memcmp(out, "head", 4));
+  BOOST_CHECK_EQUAL(string(1000, 'x'), string((const char*)out + 4, 1000));
+  BOOST_CHECK_EQUAL(0, ::memcmp(out + 1004, "tail", 4));
+  BOOST_CHECK(watch.expired());
+}
+
+BOOST_AUTO_TEST_CASE(test_write_ptr_is_stable) {
+  TChainedBuffer uut(16);
+  uint8_t* reserved = uut.getWritePtr(4);
+  uut.wroteBytes(4);
+
+  std::vector<uint8_t> payload(10000, 0x5a);
+  uut.write(&payload[0], static_cast<uint32_t>(payload.size()));
+  ::memcpy(reserved, "SIZE", 4);
+
+  uint8_t out[4];
+  uut.read(out, 4);
+  BOOST_CHECK_EQUAL(0, ::memcmp(out, "SIZE", 4));
+}
+
+BOOST_AUTO_TEST_CASE(test_protocol_roundtrip) {
+  shared_ptr<TChainedBuffer> trans(new TChainedBuffer(8));
+  TBinaryProtocolT<TChainedBuffer> prot(trans);
+
+  const string big(5000, 'q');
+  prot.writeI32(42);
+  prot.writeString(big);
+  prot.writeDouble(2.5);
+
+  int32_t i32;
+  string str;
+  double dub;
+  prot.readI32(i32);
+  prot.readString(str);
+  prot.readDouble(dub);
+  BOOST_CHECK_EQUAL(42, i32);
+  BOOST_CHECK_EQUAL(big, str);
+  BOOST_CHECK_EQUAL(2.5, dub);
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(test_flush_to_socket) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  TSocket sock(fds[0]);
+
+  TChainedBuffer uut(32);
+  std::vector<uint8_t> payload(20000);
+  for (size_t i = 0; i < payload.size(); ++i) {
+    payload[i] = static_cast<uint8_t>(i);
+  }
+  uut.write(&payload[0], 100);
+  uut.appendExternal(&payload[100], 5000);
+  uut.write(&payload[5100], static_cast<uint32_t>(payload.size() - 5100));
+
+  std::vector<uint8_t> received;
+  while (uut.available_read() > 0) {
+    BOOST_REQUIRE(uut.writePartialTo(sock) > 0);
+    uint8_t chunk[65536];
+    ssize_t got = ::read(fds[1], chunk, sizeof(chunk));
+    BOOST_REQUIRE(got > 0);
+    received.insert(received.end(), chunk, chunk + got);
+  }
+  while (received.size() < payload.size()) {
+    uint8_t chunk[65536];
+    ssize_t got = ::read(fds[1], chunk, sizeof(chunk));
+    BOOST_REQUIRE(got > 0);
+    received.insert(received.end(), chunk, chunk + got);
+  }
+  BOOST_CHECK(received == payload);
+
+  sock.close();
+  ::close(fds[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
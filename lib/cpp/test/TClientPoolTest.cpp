@@ -0,0 +1,377 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <thrift/TApplicationException.h>
+#include <thrift/async/TClientPool.h>
+#include <thrift/async/THedgedClient.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/transport/TServerSocket.h>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "TTransportCheckThrow.h"
+
+using apache::thrift::TApplicationException;
+using apache::thrift::async::TClientPool;
+using apache::thrift::async::THedgedClient;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+
+namespace {
+
+// Echoes every 4 byte request on every connection it accepts, after a delay
+class EchoServer {
+public:
+  explicit EchoServer(int delayMs = 0) : socket_("localhost", 0), accepted_(0) {
+    socket_.listen();
+    acceptor_ = std::thread([this, delayMs] {
+      try {
+        for (;;) {
+          shared_ptr<TTransport> conn = socket_.accept();
+          ++accepted_;
+          connections_.push_back(std::thread([conn, delayMs] {
+            try {
+              uint8_t buf[4];
+              for (;;) {
+                conn->readAll(buf, sizeof(buf));
+                std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+                conn->write(buf, sizeof(buf));
+                conn->flush();
+              }
+            } catch (const TTransportException&) {
+            }
+          }));
+        }
+      } catch (const TTransportException&) {
+      }
+    });
+  }
+
+  ~EchoServer() {
+    socket_.interrupt();
+    socket_.interruptChildren();
+    acceptor_.join();
+    for (auto& connection : connections_) {
+      connection.join();
+    }
+  }
+
+  int port() { return socket_.getPort(); }
+  int accepted() const { return accepted_; }
+
+private:
+  TServerSocket socket_;
+  std::atomic<int> accepted_;
+  std::thread acceptor_;
+  std::vector<std::thread> connections_;
+};
+
+// Constructed from a protocol like a generated client
+class EchoClient {
+public:
+  explicit EchoClient(shared_ptr<TProtocol> prot) : prot_(prot) {}
+
+  int32_t echo(int32_t value) {
+    prot_->writeI32(value);
+    prot_->getTransport()->flush();
+    int32_t reply;
+    prot_->readI32(reply);
+    return reply;
+  }
+
+  // Sends a request without reading the response
+  void send(int32_t value) {
+    prot_->writeI32(value);
+    prot_->getTransport()->flush();
+  }
+
+private:
+  shared_ptr<TProtocol> prot_;
+};
+
+typedef TClientPool<EchoClient> EchoClientPool;
+
+std::vector<std::pair<std::string, int> > hostsOf(EchoServer& server) {
+  return std::vector<std::pair<std::string, int> >(1, std::make_pair("localhost", server.port()));
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TClientPoolTest)
+
+BOOST_AUTO_TEST_CASE(test_clients_reused) {
+  EchoServer server;
+  EchoClientPool pool(hostsOf(server), 4);
+  for (int32_t i = 0; i < 20; ++i) {
+    BOOST_CHECK_EQUAL(pool.checkout()->echo(i), i);
+  }
+  BOOST_CHECK_EQUAL(server.accepted(), 1);
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 1u);
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 1u);
+
+  // Checked out clients are not shared
+  {
+    EchoClientPool::Handle a = pool.checkout();
+    EchoClientPool::Handle b = pool.checkout();
+    BOOST_CHECK(a.get() != b.get());
+    BOOST_CHECK_EQUAL(pool.getIdleCount(), 0u);
+  }
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_unread_response_discarded) {
+  EchoServer server;
+  EchoClientPool pool(hostsOf(server), 4);
+  pool.checkout()->send(1);
+  // Once the echo arrives the idle client is no good
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  BOOST_CHECK_EQUAL(pool.checkout()->echo(2), 2);
+  BOOST_CHECK_EQUAL(server.accepted(), 2);
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_limit) {
+  EchoServer server;
+  EchoClientPool pool(hostsOf(server), 2);
+  pool.setCheckoutTimeout(50);
+  {
+    EchoClientPool::Handle a = pool.checkout();
+    EchoClientPool::Handle b = pool.checkout();
+    TTRANSPORT_CHECK_THROW(pool.checkout(), TTransportException::TIMED_OUT);
+
+    // A waiting checkout gets the client checked in by another thread
+    pool.setCheckoutTimeout(0);
+    std::thread other([&a] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      a.reset();
+    });
+    BOOST_CHECK_EQUAL(pool.checkout()->echo(3), 3);
+    other.join();
+  }
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 2u);
+
+  std::vector<std::thread> threads;
+  std::atomic<int> errors(0);
+  for (int t = 0; t < 8; ++t) {
+    threads.push_back(std::thread([&pool, &errors, t] {
+      for (int32_t i = 0; i < 100; ++i) {
+        if (pool.checkout()->echo(t * 1000 + i) != t * 1000 + i) {
+          ++errors;
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+  BOOST_CHECK_LE(server.accepted(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_unreachable_host) {
+  int closedPort;
+  {
+    TServerSocket closed("localhost", 0);
+    closed.listen();
+    closedPort = closed.getPort();
+  }
+  EchoClientPool pool(std::vector<std::pair<std::string, int> >(
+                          1, std::make_pair("localhost", closedPort)),
+                      1);
+  TTRANSPORT_CHECK_THROW(pool.checkout(), TTransportException::NOT_OPEN);
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_unreachable_host_waits_for_checkin) {
+  int closedPort;
+  {
+    TServerSocket closed("localhost", 0);
+    closed.listen();
+    closedPort = closed.getPort();
+  }
+  EchoServer server;
+  std::vector<std::pair<std::string, int> > hosts;
+  hosts.push_back(std::make_pair("localhost", closedPort));
+  hosts.push_back(std::make_pair("localhost", server.port()));
+  EchoClientPool pool(hosts, 1);
+  pool.setCheckoutTimeout(50);
+  {
+    EchoClientPool::Handle a = pool.checkout();
+    BOOST_CHECK_EQUAL(a->echo(1), 1);
+
+    // The only other host is down, so wait for the client at the limit
+    TTRANSPORT_CHECK_THROW(pool.checkout(), TTransportException::TIMED_OUT);
+
+    pool.setCheckoutTimeout(0);
+    std::thread other([&a] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      a.reset();
+    });
+    BOOST_CHECK_EQUAL(pool.checkout()->echo(2), 2);
+    other.join();
+  }
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 0u);
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(1), 1u);
+  BOOST_CHECK_EQUAL(server.accepted(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_discarded_on_exception) {
+  EchoServer server;
+  EchoClientPool pool(hostsOf(server), 4);
+  try {
+    EchoClientPool::Handle a = pool.checkout();
+    a->echo(1);
+    throw std::runtime_error("call failed");
+  } catch (const std::runtime_error&) {
+  }
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 0u);
+
+  // A handle checked out while unwinding is checked in as usual
+  struct CheckoutOnUnwind {
+    explicit CheckoutOnUnwind(EchoClientPool& p) : pool(p) {}
+    ~CheckoutOnUnwind() { pool.checkout()->echo(2); }
+    EchoClientPool& pool;
+  };
+  try {
+    CheckoutOnUnwind guard(pool);
+    throw std::runtime_error("call failed");
+  } catch (const std::runtime_error&) {
+  }
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_prewarm) {
+  EchoServer server;
+  EchoClientPool pool(hostsOf(server), 4);
+  pool.setFastOpen(true);
+  pool.prewarm(3);
+  for (int i = 0; i < 100 && pool.getIdleCount() < 3; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 3u);
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 3u);
+
+  // At most the limit, counting the clients already there
+  pool.prewarm(10);
+  for (int i = 0; i < 100 && pool.getIdleCount() < 4; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 4u);
+
+  // The server defers accepting until a request arrives
+  for (int32_t i = 0; i < 4; ++i) {
+    BOOST_CHECK_EQUAL(pool.checkout()->echo(i), i);
+  }
+  BOOST_CHECK_EQUAL(pool.getConnectionCount(0), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(test_hedged_calls) {
+  EchoServer slow(300), fast;
+  std::vector<std::pair<std::string, int> > hosts;
+  hosts.push_back(std::make_pair("localhost", slow.port()));
+  hosts.push_back(std::make_pair("localhost", fast.port()));
+  shared_ptr<EchoClientPool> pool(new EchoClientPool(hosts, 2));
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(std::make_shared<ThreadFactory>());
+  threadManager->start();
+
+  THedgedClient<EchoClient> hedged(pool, threadManager);
+  hedged.addIdempotentMethod("echo");
+  hedged.setDefaultHedgeDelay(20);
+  for (int32_t i = 0; i < 4; ++i) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BOOST_CHECK_EQUAL(hedged.call("echo", [i](EchoClient& c) { return c.echo(i); }), i);
+    BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(250));
+  }
+  THedgedClient<EchoClient>::Stats stats = hedged.getStats();
+  BOOST_CHECK_EQUAL(stats.calls, 4u);
+  BOOST_CHECK_GE(stats.hedges, 1u);
+  BOOST_CHECK_EQUAL(stats.hedges, stats.hedgeWins);
+
+  // Other methods are called once, wherever the pool says
+  int32_t reply = 0;
+  hedged.call("send", [&reply](EchoClient& c) { reply = c.echo(5); });
+  BOOST_CHECK_EQUAL(reply, 5);
+  BOOST_CHECK_EQUAL(hedged.getStats().calls, 4u);
+
+  threadManager->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_hedged_retries) {
+  // Breaks the first connection after reading its request, then echoes
+  TServerSocket socket("localhost", 0);
+  socket.listen();
+  std::thread server([&socket] {
+    try {
+      uint8_t buf[4];
+      shared_ptr<TTransport> first = socket.accept();
+      first->readAll(buf, sizeof(buf));
+      first->close();
+      shared_ptr<TTransport> conn = socket.accept();
+      for (;;) {
+        conn->readAll(buf, sizeof(buf));
+        conn->write(buf, sizeof(buf));
+        conn->flush();
+      }
+    } catch (const TTransportException&) {
+    }
+  });
+  shared_ptr<EchoClientPool> pool(new EchoClientPool(
+      std::vector<std::pair<std::string, int> >(1, std::make_pair("localhost", socket.getPort())),
+      1));
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(std::make_shared<ThreadFactory>());
+  threadManager->start();
+
+  THedgedClient<EchoClient> hedged(pool, threadManager);
+  hedged.addIdempotentMethod("echo");
+  std::atomic<int> attempts(0);
+  BOOST_CHECK_EQUAL(hedged.call("echo", [&attempts](EchoClient& c) {
+    ++attempts;
+    return c.echo(7);
+  }), 7);
+  BOOST_CHECK_EQUAL(attempts, 2);
+  BOOST_CHECK_EQUAL(hedged.getStats().retries, 1u);
+
+  // An exception other than a TTransportException is the response
+  attempts = 0;
+  BOOST_CHECK_THROW(hedged.call("echo", [&attempts](EchoClient& c) -> int32_t {
+    ++attempts;
+    c.echo(8);
+    throw TApplicationException(TApplicationException::INTERNAL_ERROR, "declared");
+  }), TApplicationException);
+  BOOST_CHECK_EQUAL(attempts, 1);
+  BOOST_CHECK_EQUAL(hedged.getStats().retries, 1u);
+  BOOST_CHECK_EQUAL(hedged.getStats().calls, 2u);
+
+  threadManager->stop();
+  socket.interrupt();
+  socket.interruptChildren();
+  server.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,223 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <thrift/TProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/server/TConcurrencyLimiter.h>
+#include <thrift/server/TThreadedServer.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/TTransportUtils.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+BOOST_AUTO_TEST_SUITE(TConcurrencyLimiterTest)
+
+using apache::thrift::TProcessor;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::server::TConcurrencyLimiter;
+using apache::thrift::server::TThreadedServer;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TTransportFactory;
+using std::shared_ptr;
+
+BOOST_AUTO_TEST_CASE(test_gradient_grows_while_used) {
+  TConcurrencyLimiter uut(TConcurrencyLimiter::GRADIENT, 10, 1, 100);
+  for (int i = 0; i < 200; ++i) {
+    uut.addSample(1000, uut.getLimit());
+  }
+  BOOST_CHECK_EQUAL(100, uut.getLimit());
+  BOOST_CHECK_EQUAL(200u, uut.getSampleCount());
+  BOOST_CHECK_CLOSE(1000.0, uut.getBaselineLatencyUs(), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_gradient_idle_does_not_grow) {
+  TConcurrencyLimiter uut(TConcurrencyLimiter::GRADIENT, 10, 1, 100);
+  for (int i = 0; i < 200; ++i) {
+    uut.addSample(1000, 1);
+  }
+  BOOST_CHECK_EQUAL(10, uut.getLimit());
+}
+
+BOOST_AUTO_TEST_CASE(test_gradient_shrinks_on_latency) {
+  TConcurrencyLimiter uut(TConcurrencyLimiter::GRADIENT, 50, 5, 100);
+  for (int i = 0; i < 50; ++i) {
+    uut.addSample(1000, uut.getLimit());
+  }
+  int64_t before = uut.getLimit();
+  for (int i = 0; i < 50; ++i) {
+    uut.addSample(10000, uut.getLimit());
+  }
+  BOOST_CHECK(uut.getLimit() < before / 2);
+  BOOST_CHECK(uut.getLimit() >= 5);
+  BOOST_CHECK(uut.getLatencyUs() > 5000);
+}
+
+BOOST_AUTO_TEST_CASE(test_aimd) {
+  TConcurrencyLimiter uut(TConcurrencyLimiter::AIMD, 10, 2, 100);
+  uut.setLatencyThresholdUs(5000);
+  for (int i = 0; i < 5; ++i) {
+    uut.addSample(1000, uut.getLimit());
+  }
+  BOOST_CHECK_EQUAL(15, uut.getLimit());
+
+  // Requests started before a backoff do not back off again
+  TConcurrencyLimiter::time_point first = uut.onStart();
+  TConcurrencyLimiter::time_point second = uut.onStart();
+  BOOST_CHECK_EQUAL(2, uut.getInFlight());
+  uut.onComplete(first, TConcurrencyLimiter::DROPPED);
+  uut.onComplete(second, TConcurrencyLimiter::DROPPED);
+  BOOST_CHECK_EQUAL(13, uut.getLimit());
+  BOOST_CHECK_EQUAL(2u, uut.getDropCount());
+  BOOST_CHECK_EQUAL(0, uut.getInFlight());
+
+  // One started after it does
+  uut.onComplete(uut.onStart(), TConcurrencyLimiter::DROPPED);
+  BOOST_CHECK_EQUAL(12, uut.getLimit());
+}
+
+BOOST_AUTO_TEST_CASE(test_ignored_is_not_sampled) {
+  TConcurrencyLimiter uut;
+  uut.onComplete(uut.onStart(), TConcurrencyLimiter::IGNORED);
+  BOOST_CHECK_EQUAL(0u, uut.getSampleCount());
+  BOOST_CHECK_EQUAL(0, uut.getInFlight());
+  BOOST_CHECK_EQUAL(TConcurrencyLimiter::DEFAULT_INITIAL_LIMIT, uut.getLimit());
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_arguments) {
+  BOOST_CHECK_THROW(TConcurrencyLimiter(TConcurrencyLimiter::AIMD, 10, 0, 100),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(TConcurrencyLimiter(TConcurrencyLimiter::AIMD, 10, 20, 10),
+                    std::invalid_argument);
+  TConcurrencyLimiter uut;
+  BOOST_CHECK_THROW(uut.setBackoffRatio(1.0), std::invalid_argument);
+  BOOST_CHECK_THROW(uut.setTolerance(0.5), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_wait_and_start) {
+  TConcurrencyLimiter uut(TConcurrencyLimiter::AIMD, 1, 1, 1);
+  TConcurrencyLimiter::time_point first = uut.waitAndStart();
+
+  std::atomic<bool> started(false);
+  std::thread waiter([&uut, &started]() {
+    TConcurrencyLimiter::time_point second = uut.waitAndStart();
+    started = true;
+    uut.onComplete(second);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  BOOST_CHECK(!started);
+  BOOST_CHECK_EQUAL(1, uut.getInFlight());
+
+  uut.onComplete(first, TConcurrencyLimiter::IGNORED);
+  waiter.join();
+  BOOST_CHECK(started);
+  BOOST_CHECK_EQUAL(0, uut.getInFlight());
+}
+
+#ifndef _WIN32
+namespace {
+
+// Answers each string with the same string
+class EchoProcessor : public TProcessor {
+public:
+  bool process(shared_ptr<TProtocol> in, shared_ptr<TProtocol> out, void*) override {
+    std::string value;
+    in->readString(value);
+    out->writeString(value);
+    out->getTransport()->flush();
+    return true;
+  }
+};
+
+void echo(const shared_ptr<TSocket>& socket, const std::string& value) {
+  TBinaryProtocol protocol(socket);
+  protocol.writeString(value);
+  socket->flush();
+  std::string echoed;
+  protocol.readString(echoed);
+  BOOST_CHECK_EQUAL(value, echoed);
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_idle_clients_do_not_use_the_limit) {
+  std::string path = "/tmp/thrift-limiter-" + std::to_string(getpid());
+  unlink(path.c_str());
+  shared_ptr<TConcurrencyLimiter> limiter(new TConcurrencyLimiter(TConcurrencyLimiter::GRADIENT, 2));
+  TThreadedServer server(shared_ptr<TProcessor>(new EchoProcessor),
+                         shared_ptr<TServerSocket>(new TServerSocket(path)),
+                         shared_ptr<TTransportFactory>(new TTransportFactory),
+                         shared_ptr<TBinaryProtocolFactory>(new TBinaryProtocolFactory));
+  server.setConcurrencyLimiter(limiter);
+  std::thread serving([&server]() { server.serve(); });
+
+  // More persistent clients than the limit, all connected before any of
+  // them sends a request
+  std::vector<shared_ptr<TSocket> > clients;
+  for (int i = 0; i < 6; ++i) {
+    shared_ptr<TSocket> client;
+    for (int attempt = 0; !client && attempt < 200; ++attempt) {
+      try {
+        client.reset(new TSocket(path));
+        client->open();
+      } catch (const TTransportException&) {
+        client.reset();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+    BOOST_REQUIRE(client);
+    clients.push_back(client);
+  }
+  for (int i = 0; i < 200 && server.getConcurrentClientCount() < 6; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  BOOST_CHECK_EQUAL(6, server.getConcurrentClientCount());
+
+  for (auto& client : clients) {
+    echo(client, "ping");
+  }
+  // Each request completes on the server just after its response is sent
+  for (int i = 0; i < 200 && limiter->getSampleCount() < 6; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  BOOST_CHECK_EQUAL(6u, limiter->getSampleCount());
+  BOOST_CHECK_EQUAL(0, limiter->getInFlight());
+
+  for (auto& client : clients) {
+    client->close();
+  }
+  server.stop();
+  serving.join();
+  unlink(path.c_str());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -143,6 +143,7 @@ private:
 
   struct Runner : public apache::thrift::concurrency::Runnable {
     int port;
+    size_t handshakeThreads;
     std::shared_ptr<event_base> userEventBase;
     std::shared_ptr<TProcessor> processor;
     std::shared_ptr<server::TNonblockingServer> server;
@@ -151,7 +152,7 @@ private:
     std::shared_ptr<transport::TNonblockingSSLServerSocket> socket;
     Mutex mutex_;
 
-    Runner():port(0) {
+    Runner():port(0), handshakeThreads(0) {
       listenHandler.reset(new ListenEventHandler(&mutex_));
     }
 
@@ -176,6 +177,7 @@ private:
         server.reset(new server::TNonblockingServer(processor, socket));
 	      server->setServerEventHandler(listenHandler);
         server->setNumIOThreads(1);
+        server->setHandshakeThreads(handshakeThreads);
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -196,7 +198,9 @@ private:
   };
 
 protected:
-  Fixture() : processor(new test::ParentServiceProcessor(std::make_shared<Handler>())) {}
+  Fixture()
+    : handshakeThreads(0),
+      processor(new test::ParentServiceProcessor(std::make_shared<Handler>())) {}
 
   ~Fixture() {
     if (server) {
@@ -214,6 +218,7 @@ protected:
   int startServer(int port) {
     std::shared_ptr<Runner> runner(new Runner);
     runner->port = port;
+    runner->handshakeThreads = handshakeThreads;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
 
@@ -239,6 +244,8 @@ protected:
     return strings.size() == 1 && !(strings[0].compare("foo"));
   }
 
+  size_t handshakeThreads;
+
 private:
   std::shared_ptr<event_base> userEventBase_;
   std::shared_ptr<test::ParentServiceProcessor> processor;
@@ -283,4 +290,31 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(handshake_threads, Fixture) {
+  handshakeThreads = 2;
+  startServer(0);
+  int port = server->getListenPort();
+  BOOST_CHECK_EQUAL(2u, server->getHandshakeThreads());
+
+  // Clients stuck in their handshake, more of them than there are handshake
+  // threads, hold up neither the IO thread nor the handshake threads.  Some
+  // send nothing, some send the first byte of a TLS record and then stall,
+  // and some send garbage.
+  std::vector<std::shared_ptr<transport::TSocket> > stalled;
+  for (size_t i = 0; i < 4 * handshakeThreads; ++i) {
+    std::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    if (i % 3 == 1) {
+      socket->write((const uint8_t*)"\x16", 1);
+    } else if (i % 3 == 2) {
+      socket->write((const uint8_t*)"GET / HTTP/1.0\r\n\r\n", 18);
+    }
+    stalled.push_back(socket);
+  }
+  BOOST_CHECK(canCommunicate(port));
+  for (auto& socket : stalled) {
+    socket->close();
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -20,9 +20,11 @@
 #define BOOST_TEST_MODULE TNonblockingServerTest
 #include <boost/test/unit_test.hpp>
 #include <memory>
+#include <thread>
 
 #include "thrift/concurrency/Monitor.h"
 #include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
 #include "thrift/server/TNonblockingServer.h"
 #include "thrift/transport/TNonblockingServerSocket.h"
 
@@ -36,6 +38,7 @@ using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::concurrency::Runnable;
 using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::server::TServerEventHandler;
 using std::make_shared;
@@ -48,9 +51,19 @@ struct Handler : public test::ParentServiceIf {
   void getStrings(std::vector<std::string>& _return) override { _return = strings_; }
   std::vector<std::string> strings_;
 
+  // record the threads that ran these calls
+  int32_t incrementGeneration() override {
+    incrementThread_ = std::this_thread::get_id();
+    return 0;
+  }
+  int32_t getGeneration() override {
+    getThread_ = std::this_thread::get_id();
+    return 0;
+  }
+  std::thread::id incrementThread_;
+  std::thread::id getThread_;
+
   // dummy overrides not used in this test
-  int32_t incrementGeneration() override { return 0; }
-  int32_t getGeneration() override { return 0; }
   void getDataWait(std::string&, const int32_t) override {}
   void onewayWait() override {}
   void exceptionWait(const std::string&) override {}
@@ -80,14 +93,28 @@ private:
     shared_ptr<server::TNonblockingServer> server;
     shared_ptr<ListenEventHandler> listenHandler;
     shared_ptr<transport::TNonblockingServerSocket> socket;
+    shared_ptr<ThreadManager> threadManager;
+    std::vector<std::string> inlineMethods;
+    size_t threadPerCoreThreads;
+    size_t ioThreadWorkers;
+    int64_t busyPollSpinUs;
+    uint32_t zeroCopyThreshold;
+    bool chainedWriteBuffer;
+    std::thread::id serveThread;
     Mutex mutex_;
 
     Runner() {
       port = 0;
+      threadPerCoreThreads = 0;
+      ioThreadWorkers = 0;
+      busyPollSpinUs = 0;
+      zeroCopyThreshold = 0;
+      chainedWriteBuffer = false;
       listenHandler.reset(new ListenEventHandler(&mutex_));
     }
 
     void run() override {
+      serveThread = std::this_thread::get_id();
       // When binding to explicit port, allow retrying to workaround bind failures on ports in use
       int retryCount = port ? 10 : 0;
       startServer(retryCount);
@@ -105,10 +132,25 @@ private:
       try {
         socket.reset(new transport::TNonblockingServerSocket(port));
         server.reset(new server::TNonblockingServer(processor, socket));
+        if (threadPerCoreThreads) {
+          socket->setReusePort(true);
+          server->setThreadPerCore(true);
+          server->setNumIOThreads(threadPerCoreThreads);
+        }
+        server->setIOThreadWorkers(ioThreadWorkers);
+        server->setBusyPoll(busyPollSpinUs);
+        server->setZeroCopyThreshold(zeroCopyThreshold);
+        server->setChainedWriteBuffer(chainedWriteBuffer);
         server->setServerEventHandler(listenHandler);
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
+        if (threadManager) {
+          server->setThreadManager(threadManager);
+        }
+        for (const auto& method : inlineMethods) {
+          server->addInlineMethod(method);
+        }
         server->serve();
       } catch (const transport::TTransportException&) {
         if (retry_count > 0) {
@@ -126,7 +168,14 @@ private:
   };
 
 protected:
-  Fixture() : processor(new test::ParentServiceProcessor(make_shared<Handler>())) {}
+  Fixture()
+    : threadPerCoreThreads_(0),
+      ioThreadWorkers_(0),
+      busyPollSpinUs_(0),
+      zeroCopyThreshold_(0),
+      chainedWriteBuffer_(false),
+      handler(make_shared<Handler>()),
+      processor(new test::ParentServiceProcessor(handler)) {}
 
   ~Fixture() {
     if (server) {
@@ -135,8 +184,27 @@ protected:
     if (thread) {
       thread->join();
     }
+    if (threadManager_) {
+      threadManager_->stop();
+    }
   }
 
+  void setThreadManager(shared_ptr<ThreadManager> threadManager) {
+    threadManager_ = threadManager;
+  }
+
+  void addInlineMethod(const std::string& name) { inlineMethods_.push_back(name); }
+
+  void setThreadPerCore(size_t numIOThreads) { threadPerCoreThreads_ = numIOThreads; }
+
+  void setIOThreadWorkers(size_t numWorkers) { ioThreadWorkers_ = numWorkers; }
+
+  void setBusyPoll(int64_t spinUs) { busyPollSpinUs_ = spinUs; }
+
+  void setZeroCopyThreshold(uint32_t bytes) { zeroCopyThreshold_ = bytes; }
+
+  void setChainedWriteBuffer(bool chained) { chainedWriteBuffer_ = chained; }
+
   void setEventBase(event_base* user_event_base) {
     userEventBase_.reset(user_event_base, EventDeleter());
   }
@@ -146,6 +214,13 @@ protected:
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->threadManager = threadManager_;
+    runner->inlineMethods = inlineMethods_;
+    runner->threadPerCoreThreads = threadPerCoreThreads_;
+    runner->ioThreadWorkers = ioThreadWorkers_;
+    runner->busyPollSpinUs = busyPollSpinUs_;
+    runner->zeroCopyThreshold = zeroCopyThreshold_;
+    runner->chainedWriteBuffer = chainedWriteBuffer_;
 
     shared_ptr<ThreadFactory> threadFactory(
         new ThreadFactory(false));
@@ -154,9 +229,31 @@ protected:
     runner->readyBarrier();
 
     server = runner->server;
+    serveThread = runner->serveThread;
     return runner->port;
   }
 
+  // Sends several large responses in a row on one connection
+  bool canSendLargeResponses(int serverPort) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+    std::string large(4 * 1024 * 1024, 'x');
+    for (size_t i = 0; i < large.size(); ++i) {
+      large[i] = static_cast<char>('a' + i % 26);
+    }
+    client.addString(large);
+    for (int i = 0; i < 5; ++i) {
+      std::vector<std::string> strings;
+      client.getStrings(strings);
+      if (strings.size() != 1 || strings[0] != large) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   bool canCommunicate(int serverPort) {
     shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
     socket->open();
@@ -170,9 +267,20 @@ protected:
 
 private:
   shared_ptr<event_base> userEventBase_;
+  shared_ptr<ThreadManager> threadManager_;
+  std::vector<std::string> inlineMethods_;
+  size_t threadPerCoreThreads_;
+  size_t ioThreadWorkers_;
+  int64_t busyPollSpinUs_;
+  uint32_t zeroCopyThreshold_;
+  bool chainedWriteBuffer_;
+protected:
+  shared_ptr<Handler> handler;
+private:
   shared_ptr<test::ParentServiceProcessor> processor;
 protected:
   shared_ptr<server::TNonblockingServer> server;
+  std::thread::id serveThread;
 private:
   shared_ptr<apache::thrift::concurrency::Thread> thread;
 
@@ -212,4 +320,126 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(inline_methods, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  setThreadManager(threadManager);
+  addInlineMethod("getGeneration");
+  startServer(0);
+  BOOST_CHECK(server->isInlineMethod("getGeneration"));
+  BOOST_CHECK(!server->isInlineMethod("incrementGeneration"));
+
+  shared_ptr<transport::TSocket> socket(
+      new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+  client.getGeneration();
+  client.incrementGeneration();
+
+  // The single IO thread runs in the thread that called serve()
+  BOOST_CHECK(handler->getThread_ == serveThread);
+  BOOST_CHECK(handler->incrementThread_ != serveThread);
+  BOOST_CHECK(handler->incrementThread_ != std::thread::id());
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_per_core, Fixture) {
+  setThreadPerCore(4);
+  startServer(0);
+  BOOST_CHECK(server->getThreadPerCore());
+  BOOST_CHECK_EQUAL(server->getNumIOThreads(), 4u);
+
+  std::vector<shared_ptr<transport::TSocket> > sockets;
+  for (int i = 0; i < 16; ++i) {
+    shared_ptr<transport::TSocket> socket(
+        new transport::TSocket("localhost", server->getListenPort()));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+    client.incrementGeneration();
+    sockets.push_back(socket);
+  }
+
+  // The counters of the IO threads add up
+  BOOST_CHECK_EQUAL(server->getNumConnections(), 16u);
+  BOOST_CHECK_EQUAL(server->getNumActiveConnections(), 16u);
+  BOOST_CHECK_EQUAL(server->getNumActiveProcessors(), 0u);
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+}
+
+BOOST_FIXTURE_TEST_CASE(io_thread_workers, Fixture) {
+  setIOThreadWorkers(2);
+  startServer(0);
+  BOOST_CHECK_EQUAL(server->getIOThreadWorkers(), 2u);
+  BOOST_CHECK(server->isThreadPoolProcessing());
+  BOOST_CHECK(!server->getThreadManager());
+
+  shared_ptr<transport::TSocket> socket(
+      new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+  client.incrementGeneration();
+  client.getGeneration();
+
+  // There is no server ThreadManager, and the single IO thread runs in the
+  // thread that called serve(), so only its workers can have run the calls
+  BOOST_CHECK(handler->incrementThread_ != std::thread::id());
+  BOOST_CHECK(handler->incrementThread_ != serveThread);
+  BOOST_CHECK(handler->getThread_ != std::thread::id());
+  BOOST_CHECK(handler->getThread_ != serveThread);
+}
+
+BOOST_FIXTURE_TEST_CASE(io_thread_workers_per_core, Fixture) {
+  setThreadPerCore(2);
+  setIOThreadWorkers(1);
+  startServer(0);
+  BOOST_CHECK(server->isThreadPoolProcessing());
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+}
+
+BOOST_FIXTURE_TEST_CASE(busy_poll, Fixture) {
+  // A short budget, so that the IO thread also sleeps and is woken
+  setBusyPoll(50);
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  setThreadManager(threadManager);
+  startServer(0);
+  BOOST_CHECK_EQUAL(server->getBusyPollSpinUs(), 50);
+
+  shared_ptr<transport::TSocket> socket(
+      new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+  for (int i = 0; i < 100; ++i) {
+    client.addString("foo");
+    if (i % 10 == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(strings.size(), 100u);
+}
+
+// The first responses wait for their zero-copy completion before the next
+// request is read.  Over loopback the kernel reports that it copied them, so
+// the later ones on the connection are sent without MSG_ZEROCOPY.
+BOOST_FIXTURE_TEST_CASE(zero_copy, Fixture) {
+  setZeroCopyThreshold(64 * 1024);
+  startServer(0);
+  BOOST_CHECK_EQUAL(server->getZeroCopyThreshold(), 64u * 1024);
+  BOOST_CHECK(canSendLargeResponses(server->getListenPort()));
+}
+
+BOOST_FIXTURE_TEST_CASE(zero_copy_chained, Fixture) {
+  setZeroCopyThreshold(64 * 1024);
+  setChainedWriteBuffer(true);
+  startServer(0);
+  BOOST_CHECK(canSendLargeResponses(server->getListenPort()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,8 @@
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
+#include <ctime>
+#include <thrift/server/TIdleClientPoller.h>
 #include <thrift/server/TSimpleServer.h>
 #include <thrift/server/TThreadPoolServer.h>
 #include <thrift/server/TThreadedServer.h>
@@ -50,6 +52,7 @@ using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransport;
 using apache::thrift::transport::TTransportException;
 using apache::thrift::transport::TTransportFactory;
+using apache::thrift::server::TIdleClientPoller;
 using apache::thrift::server::TServer;
 using apache::thrift::server::TServerEventHandler;
 using apache::thrift::server::TSimpleServer;
@@ -534,3 +537,52 @@ BOOST_AUTO_TEST_CASE(test_concurrent_client_limit) {
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(TThreadPoolServerIntegrationTest,
+                         TServerIntegrationProcessorTestFixture<TThreadPoolServer>)
+
+BOOST_AUTO_TEST_CASE(test_idle_client_parking) {
+  if (!TIdleClientPoller::isSupported()) {
+    BOOST_TEST_MESSAGE("Idle client parking is not supported here");
+    return;
+  }
+  pServer->getThreadManager()->threadFactory(
+      shared_ptr<apache::thrift::concurrency::ThreadFactory>(
+          new apache::thrift::concurrency::ThreadFactory));
+  pServer->getThreadManager()->start();
+  pServer->setIdleClientParking(true);
+  startServer();
+
+  // More clients than the 4 workers, each parked after its request
+  std::vector<shared_ptr<TSocket> > sockets;
+  for (int i = 0; i < 10; ++i) {
+    shared_ptr<TSocket> pClientSock(new TSocket("localhost", getServerPort()),
+                                    autoSocketCloser);
+    pClientSock->open();
+    ParentServiceClient client(make_shared<TBinaryProtocol>(pClientSock));
+    client.incrementGeneration();
+    sockets.push_back(pClientSock);
+  }
+  BOOST_CHECK_EQUAL(10, pServer->getConcurrentClientCount());
+
+  // A closed client is removed rather than parked again
+  sockets.front()->close();
+  for (int i = 0; i < 500 && pServer->getConcurrentClientCount() > 9; ++i) {
+    boost::this_thread::sleep(milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(9, pServer->getConcurrentClientCount());
+
+  // Parked clients take no CPU
+  std::clock_t start = std::clock();
+  boost::this_thread::sleep(milliseconds(500));
+  double cpuMs = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+  BOOST_TEST_MESSAGE(boost::format("  %1% ms CPU while idle") % cpuMs);
+  BOOST_CHECK_LT(cpuMs, 100.0);
+
+  ParentServiceClient client(make_shared<TBinaryProtocol>(sockets.back()));
+  client.incrementGeneration();
+
+  stopServer();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -18,12 +18,16 @@
  */
 
 #include <boost/test/auto_unit_test.hpp>
+#include <thrift/transport/TChainedBuffer.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TServerSocket.h>
 #include <memory>
 #include "TTransportCheckThrow.h"
 #include <iostream>
+#include <thread>
+#include <vector>
 
+using apache::thrift::transport::TChainedBuffer;
 using apache::thrift::transport::TServerSocket;
 using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransport;
@@ -66,4 +70,71 @@ BOOST_AUTO_TEST_CASE(test_get_port) {
   BOOST_CHECK_EQUAL(888, sock1.getPort());
 }
 
+BOOST_AUTO_TEST_CASE(test_accept_batch) {
+  TServerSocket sock1("localhost", 0);
+  sock1.setAcceptBatchSize(4);
+  sock1.setTcpDeferAccept(0);
+  sock1.listen();
+  int port = sock1.getPort();
+
+  std::vector<shared_ptr<TSocket> > clients;
+  for (int i = 0; i < 9; ++i) {
+    clients.push_back(std::make_shared<TSocket>("localhost", port));
+    clients.back()->open();
+  }
+  for (int i = 0; i < 6; ++i) {
+    shared_ptr<TTransport> accepted = sock1.accept();
+    BOOST_CHECK(accepted->isOpen());
+  }
+
+  // An interrupt is reported before the connections accepted with the last
+  // batch are handed out
+  sock1.interrupt();
+  TTRANSPORT_CHECK_THROW(sock1.accept(), TTransportException::INTERRUPTED);
+  BOOST_CHECK(sock1.accept()->isOpen());
+  sock1.close();
+}
+
+BOOST_AUTO_TEST_CASE(test_zero_copy_write) {
+  TServerSocket sock1("localhost", 0);
+  sock1.setTcpDeferAccept(0);
+  sock1.listen();
+  TSocket clientSock("localhost", sock1.getPort());
+  clientSock.open();
+  shared_ptr<TSocket> accepted = std::dynamic_pointer_cast<TSocket>(sock1.accept());
+  accepted->setZeroCopyThreshold(64 * 1024);
+
+  std::vector<uint8_t> response(4 * 1024 * 1024);
+  for (size_t i = 0; i < response.size(); ++i) {
+    response[i] = static_cast<uint8_t>(i * 7);
+  }
+  std::vector<uint8_t> received(response.size());
+  for (int round = 0; round < 3; ++round) {
+    std::thread reader([&clientSock, &received] {
+      clientSock.readAll(received.data(), static_cast<uint32_t>(received.size()));
+    });
+    accepted->write(response.data(), static_cast<uint32_t>(response.size()));
+    // write() returns once the kernel is done with the buffer
+    BOOST_CHECK_EQUAL(accepted->getZeroCopyPending(), 0u);
+    reader.join();
+    BOOST_CHECK(received == response);
+  }
+  accepted->close();
+
+  // Segments of a chained buffer are kept until the kernel is done with them
+  TSocket chainedClient("localhost", sock1.getPort());
+  chainedClient.open();
+  accepted = std::dynamic_pointer_cast<TSocket>(sock1.accept());
+  accepted->setZeroCopyThreshold(64 * 1024);
+  TChainedBuffer chained(64 * 1024);
+  chained.write(response.data(), static_cast<uint32_t>(response.size()));
+  std::thread reader([&chainedClient, &received] {
+    chainedClient.readAll(received.data(), static_cast<uint32_t>(received.size()));
+  });
+  chained.flushTo(*accepted);
+  reader.join();
+  BOOST_CHECK(received == response);
+  sock1.close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,345 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifdef __linux__
+
+#include <boost/test/auto_unit_test.hpp>
+#include <thrift/TProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/server/TSimpleServer.h>
+#include <thrift/transport/TShmServerTransport.h>
+#include <thrift/transport/TShmTransport.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/TTransportUtils.h>
+#include "TTransportCheckThrow.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using apache::thrift::TProcessor;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::server::TSimpleServer;
+using apache::thrift::transport::TShmServerTransport;
+using apache::thrift::transport::TShmTransport;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TTransportFactory;
+using std::shared_ptr;
+
+namespace {
+
+std::string socketPath(const char* name) {
+  std::string path = "/tmp/thrift-shm-" + std::to_string(getpid()) + "-" + name;
+  unlink(path.c_str());
+  return path;
+}
+
+// open() waits for the server to send the segment, so accept on the side
+shared_ptr<TTransport> connect(TShmServerTransport& server, TShmTransport& client) {
+  shared_ptr<TTransport> accepted;
+  std::thread acceptor([&server, &accepted]() { accepted = server.accept(); });
+  client.open();
+  acceptor.join();
+  return accepted;
+}
+
+// Connects like TShmTransport does, but maps the segment it is sent to
+// write whatever it likes there, as a hostile client could
+class HostileClient {
+public:
+  // Where the ring indices live in the segment, see TShmTransport.cpp
+  static const size_t CLIENT_HEAD = 64;
+  static const size_t SERVER_TAIL = 256 + 64;
+
+  HostileClient(TShmServerTransport& server, const std::string& path)
+    : control_(new TSocket(path)), base_(MAP_FAILED), size_(0) {
+    control_->open();
+    accepted_ = server.accept();
+
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    int fds[3] = {-1, -1, -1};
+    union {
+      char buf[CMSG_SPACE(sizeof(fds))];
+      struct cmsghdr align;
+    } control_msg;
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control_msg.buf;
+    msg.msg_controllen = sizeof(control_msg.buf);
+    if (recvmsg(control_->getSocketFD(), &msg, MSG_CMSG_CLOEXEC) == 1) {
+      std::memcpy(fds, CMSG_DATA(CMSG_FIRSTHDR(&msg)), sizeof(fds));
+      struct stat st;
+      if (fstat(fds[0], &st) == 0) {
+        size_ = static_cast<size_t>(st.st_size);
+        base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+      }
+    }
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  ~HostileClient() {
+    if (base_ != MAP_FAILED) {
+      munmap(base_, size_);
+    }
+  }
+
+  bool isMapped() const { return base_ != MAP_FAILED; }
+
+  void store(size_t offset, uint64_t value) {
+    reinterpret_cast<std::atomic<uint64_t>*>(static_cast<uint8_t*>(base_) + offset)
+        ->store(value);
+  }
+
+  shared_ptr<TTransport> accepted() { return accepted_; }
+
+private:
+  shared_ptr<TSocket> control_;
+  shared_ptr<TTransport> accepted_;
+  void* base_;
+  size_t size_;
+};
+
+// Answers each string with the same string
+class EchoProcessor : public TProcessor {
+public:
+  bool process(shared_ptr<TProtocol> in, shared_ptr<TProtocol> out, void*) override {
+    std::string value;
+    in->readString(value);
+    out->writeString(value);
+    out->getTransport()->flush();
+    return true;
+  }
+};
+}
+
+BOOST_AUTO_TEST_SUITE(TShmTransportTest)
+
+BOOST_AUTO_TEST_CASE(test_roundtrip_larger_than_ring) {
+  std::string path = socketPath("roundtrip");
+  TShmServerTransport server(path, 4096);
+  // Spin even where there is a single CPU
+  server.setMaxSpinUs(20);
+  server.listen();
+
+  const uint32_t size = 1 << 20;
+  // Takes all of it in before answering, so that both directions fill up
+  std::thread echo([&server, size]() {
+    shared_ptr<TTransport> accepted = server.accept();
+    std::vector<uint8_t> buf(size);
+    accepted->readAll(buf.data(), size);
+    accepted->write(buf.data(), size);
+    accepted->flush();
+    accepted->close();
+  });
+
+  TShmTransport client(path);
+  client.setMaxSpinUs(20);
+  client.open();
+  BOOST_CHECK_EQUAL(4096u, client.getRingSize());
+
+  std::vector<uint8_t> sent(size);
+  for (size_t i = 0; i < sent.size(); ++i) {
+    sent[i] = static_cast<uint8_t>(i * 31 + i / 4096);
+  }
+  client.write(sent.data(), size);
+  client.flush();
+
+  std::vector<uint8_t> received(size);
+  client.readAll(received.data(), size);
+  BOOST_CHECK(sent == received);
+  uint8_t byte;
+  BOOST_CHECK_EQUAL(0u, client.read(&byte, 1));
+
+  client.close();
+  echo.join();
+  server.close();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_eof_on_peer_close) {
+  std::string path = socketPath("eof");
+  TShmServerTransport server(path);
+  server.listen();
+
+  TShmTransport client(path);
+  shared_ptr<TTransport> accepted = connect(server, client);
+
+  client.write(reinterpret_cast<const uint8_t*>("tail"), 4);
+  client.close();
+  BOOST_CHECK(!client.isOpen());
+
+  // What was sent before the close still arrives
+  uint8_t buf[8];
+  BOOST_CHECK_EQUAL(4u, accepted->read(buf, sizeof(buf)));
+  BOOST_CHECK_EQUAL(0u, accepted->read(buf, sizeof(buf)));
+  BOOST_CHECK(!accepted->peek());
+  TTRANSPORT_CHECK_THROW(accepted->write(buf, 1), TTransportException::NOT_OPEN);
+
+  accepted->close();
+  server.close();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_eof_on_peer_exit) {
+  std::string path = socketPath("exit");
+  TShmServerTransport server(path);
+  server.listen();
+
+  // A client that goes away without closing is seen through the socket
+  pid_t child = fork();
+  if (child == 0) {
+    TShmTransport client(path);
+    client.open();
+    _exit(0);
+  }
+  shared_ptr<TTransport> accepted = server.accept();
+  uint8_t buf[8];
+  BOOST_CHECK_EQUAL(0u, accepted->read(buf, sizeof(buf)));
+
+  accepted->close();
+  server.close();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_recv_timeout) {
+  std::string path = socketPath("timeout");
+  TShmServerTransport server(path);
+  server.listen();
+
+  TShmTransport client(path);
+  shared_ptr<TTransport> accepted = connect(server, client);
+
+  client.setRecvTimeout(50);
+  uint8_t buf[8];
+  TTRANSPORT_CHECK_THROW(client.read(buf, sizeof(buf)), TTransportException::TIMED_OUT);
+
+  client.close();
+  server.close();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_interrupt_children) {
+  std::string path = socketPath("interrupt");
+  TShmServerTransport server(path);
+  server.listen();
+
+  TShmTransport client(path);
+  shared_ptr<TTransport> accepted = connect(server, client);
+
+  std::thread interrupter([&server]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    server.interruptChildren();
+  });
+  uint8_t buf[8];
+  TTRANSPORT_CHECK_THROW(accepted->read(buf, sizeof(buf)), TTransportException::INTERRUPTED);
+  interrupter.join();
+
+  client.close();
+  server.close();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_hostile_ring_indices) {
+  std::string path = socketPath("hostile");
+  TShmServerTransport server(path, 4096);
+  server.listen();
+
+  HostileClient client(server, path);
+  BOOST_REQUIRE(client.isMapped());
+  shared_ptr<TTransport> accepted = client.accepted();
+
+  // Claims to have written far more than the ring holds, and to have read
+  // what the server never wrote
+  client.store(HostileClient::CLIENT_HEAD, uint64_t(1) << 40);
+  client.store(HostileClient::SERVER_TAIL, uint64_t(1) << 40);
+  uint8_t buf[8] = {0};
+  TTRANSPORT_CHECK_THROW(accepted->write(buf, sizeof(buf)), TTransportException::CORRUPTED_DATA);
+  TTRANSPORT_CHECK_THROW(accepted->read(buf, sizeof(buf)), TTransportException::CORRUPTED_DATA);
+
+  // The peer counts as gone from then on
+  TTRANSPORT_CHECK_THROW(accepted->write(buf, sizeof(buf)), TTransportException::NOT_OPEN);
+
+  accepted->close();
+  server.close();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_server) {
+  std::string path = socketPath("server");
+  shared_ptr<TShmServerTransport> serverTransport(new TShmServerTransport(path, 8192));
+  shared_ptr<TTransportFactory> transportFactory(new TTransportFactory);
+  shared_ptr<TBinaryProtocolFactory> protocolFactory(new TBinaryProtocolFactory);
+  TSimpleServer server(shared_ptr<TProcessor>(new EchoProcessor),
+                       serverTransport,
+                       transportFactory,
+                       protocolFactory);
+  std::thread serving([&server]() { server.serve(); });
+
+  // serve() listens on its own thread
+  shared_ptr<TShmTransport> transport;
+  for (int i = 0; i < 200 && !transport; ++i) {
+    try {
+      transport.reset(new TShmTransport(path));
+      transport->open();
+    } catch (const TTransportException&) {
+      transport.reset();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+  BOOST_REQUIRE(transport);
+
+  TBinaryProtocol protocol(transport);
+  for (size_t size : {0, 1, 100, 20000}) {
+    std::string value(size, 'x');
+    protocol.writeString(value);
+    transport->flush();
+    std::string echoed;
+    protocol.readString(echoed);
+    BOOST_CHECK(value == echoed);
+  }
+  transport->close();
+
+  server.stop();
+  serving.join();
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // __linux__
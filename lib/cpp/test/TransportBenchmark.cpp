@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Round trips between two threads over a Unix domain socket and over
+// TShmTransport, for payloads of a few sizes.
+//
+// Usage: TransportBenchmark [round trips per size]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TShmServerTransport.h>
+#include <thrift/transport/TShmTransport.h>
+#include <thrift/transport/TSocket.h>
+
+using namespace apache::thrift::transport;
+using std::cout;
+using std::endl;
+using std::shared_ptr;
+
+// Echoes messages of size bytes until the client goes away
+static void echo(shared_ptr<TServerTransport> server, uint32_t size) {
+  shared_ptr<TTransport> accepted = server->accept();
+  std::vector<uint8_t> buf(size);
+  try {
+    for (;;) {
+      accepted->readAll(buf.data(), size);
+      accepted->write(buf.data(), size);
+      accepted->flush();
+    }
+  } catch (const TTransportException&) {
+  }
+  accepted->close();
+}
+
+// Returns microseconds per round trip
+template <typename Client>
+static double roundTrips(shared_ptr<TServerTransport> server,
+                         Client& client,
+                         uint32_t size,
+                         int count) {
+  std::thread echoer(echo, server, size);
+  client.open();
+  std::vector<uint8_t> buf(size, 'x');
+
+  // Warm up, then measure
+  for (int i = 0; i < count / 10; ++i) {
+    client.write(buf.data(), size);
+    client.flush();
+    client.readAll(buf.data(), size);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; ++i) {
+    client.write(buf.data(), size);
+    client.flush();
+    client.readAll(buf.data(), size);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  client.close();
+  echoer.join();
+  return std::chrono::duration<double, std::micro>(elapsed).count() / count;
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? std::atoi(argv[1]) : 20000;
+  std::string path = "/tmp/thrift-transport-benchmark-" + std::to_string(getpid());
+
+  for (uint32_t size : {64u, 4096u, 65536u}) {
+    unlink(path.c_str());
+    shared_ptr<TServerSocket> socketServer(new TServerSocket(path));
+    socketServer->listen();
+    TSocket socket(path);
+    double socketUs = roundTrips(socketServer, socket, size, count);
+    socketServer->close();
+
+    unlink(path.c_str());
+    shared_ptr<TShmServerTransport> shmServer(new TShmServerTransport(path));
+    shmServer->listen();
+    TShmTransport shm(path);
+    double shmUs = roundTrips(shmServer, shm, size, count);
+    shmServer->close();
+
+    cout << size << " bytes: Unix socket " << socketUs << " us, shm " << shmUs
+         << " us per round trip" << endl;
+  }
+  unlink(path.c_str());
+  return 0;
+}
@@ -78,6 +78,13 @@ int main(int argc, char** argv) {
       return 1;
     }
 
+    std::cout << "\t\tThreadFactory affinity test" << std::endl;
+
+    if (!threadFactoryTests.affinityTest()) {
+      std::cerr << "\t\ttThreadFactory affinity FAILED" << std::endl;
+      return 1;
+    }
+
     std::cout << "\t\tThreadFactory monitor timeout test" << std::endl;
 
     if (!threadFactoryTests.monitorTimeoutTest()) {
@@ -169,6 +176,27 @@ int main(int argc, char** argv) {
         return 1;
       }
 
+      std::cout << "\t\tThreadManager EDF test:" << std::endl;
+
+      if (!threadManagerTests.edfTest()) {
+        std::cerr << "\t\tThreadManager edfTest FAILED" << std::endl;
+        return 1;
+      }
+
+      std::cout << "\t\tThreadManager CoDel test:" << std::endl;
+
+      if (!threadManagerTests.codelTest()) {
+        std::cerr << "\t\tThreadManager codelTest FAILED" << std::endl;
+        return 1;
+      }
+
+      std::cout << "\t\tThreadManager adaptive LIFO test:" << std::endl;
+
+      if (!threadManagerTests.adaptiveLifoTest()) {
+        std::cerr << "\t\tThreadManager adaptiveLifoTest FAILED" << std::endl;
+        return 1;
+      }
+
       std::cout << "\t\tThreadManager load test: worker count: " << workerCount
                 << " task count: " << taskCount << " delay: " << delay << std::endl;
 
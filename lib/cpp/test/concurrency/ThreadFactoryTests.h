@@ -27,6 +27,10 @@
 #include <iostream>
 #include <vector>
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 namespace apache {
 namespace thrift {
 namespace concurrency {
@@ -207,6 +211,66 @@ public:
     return true;
   }
 
+  class AffinityTask : public Runnable {
+
+  public:
+    void run() override {
+#ifdef __linux__
+      cpu_set_t set;
+      if (0 == sched_getaffinity(0, sizeof(set), &set)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+          if (CPU_ISSET(cpu, &set)) {
+            _cpus.push_back(cpu);
+          }
+        }
+      }
+#endif
+    }
+
+    std::vector<int> _cpus;
+  };
+
+  /**
+   * Pin each thread to one of the available CPUs in turn and check that it
+   * ends up on that CPU.
+   */
+  bool affinityTest(size_t count = 4) {
+#ifdef __linux__
+    std::vector<int> cpus = ThreadFactory::getAvailableCpus();
+    if (cpus.empty()) {
+      std::cout << "\t\t\tNo CPUs available, skipped" << std::endl;
+      return true;
+    }
+
+    ThreadFactory threadFactory(false);
+    threadFactory.setCpuSet(cpus);
+    threadFactory.setPinEachThread(true);
+
+    for (size_t ix = 0; ix < count; ix++) {
+      shared_ptr<AffinityTask> task(new AffinityTask());
+      shared_ptr<Thread> thread = threadFactory.newThread(task);
+      thread->start();
+      thread->join();
+      if (task->_cpus.size() != 1 || task->_cpus[0] != cpus[ix % cpus.size()]) {
+        std::cout << "\t\t\tThread " << ix << " not pinned to CPU " << cpus[ix % cpus.size()]
+                  << std::endl;
+        return false;
+      }
+    }
+
+    // The process affinity is left alone
+    if (ThreadFactory::getAvailableCpus() != cpus) {
+      std::cout << "\t\t\tProcess affinity changed" << std::endl;
+      return false;
+    }
+#else
+    (void)count;
+#endif
+
+    std::cout << "\t\t\tSuccess!" << std::endl;
+    return true;
+  }
+
   /**
    * The only guarantee a monitor timeout can give you is that
    * it will take "at least" as long as the timeout, no less.
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <deque>
 #include <set>
+#include <vector>
 #include <iostream>
 #include <stdint.h>
 
@@ -629,6 +630,147 @@ public:
     threadManager.reset();
     return true;
   }
+
+  bool edfTest() {
+    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(0);
+    threadManager->threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    threadManager->start();
+    threadManager->setExpireCallback(expiredNotifier);
+    m_expired.clear();
+
+    Monitor doneMonitor;
+    size_t activeCount = 1;
+    shared_ptr<Runnable> late(new ThreadManagerTests::Task(doneMonitor, activeCount, 1));
+    shared_ptr<Runnable> early(new ThreadManagerTests::Task(doneMonitor, activeCount, 1));
+    shared_ptr<Runnable> noDeadline(new ThreadManagerTests::Task(doneMonitor, activeCount, 1));
+    shared_ptr<Runnable> sameDeadline(new ThreadManagerTests::Task(doneMonitor, activeCount, 1));
+
+    std::cout << "\t\t\t\tadd tasks in FIFO order, then switch to EDF.." << std::endl;
+
+    threadManager->add(noDeadline);
+    threadManager->add(late, 0, 10000);
+    threadManager->setSchedulingPolicy(ThreadManager::EDF);
+    if (threadManager->getSchedulingPolicy() != ThreadManager::EDF) {
+      std::cerr << "\t\t\t\t\texpected the EDF scheduling policy" << std::endl;
+      return false;
+    }
+
+    std::cout << "\t\t\t\tadd tasks with earlier deadlines.." << std::endl;
+
+    threadManager->add(early, 0, 1000);
+    threadManager->add(sameDeadline, 0, 1000);
+
+    EXPECT(threadManager->pendingTaskCount(), 4);
+
+    shared_ptr<Runnable> expected[] = {early, sameDeadline, late, noDeadline};
+    for (size_t i = 0; i < 4; ++i) {
+      if (threadManager->removeNextPending() != expected[i]) {
+        std::cerr << "\t\t\t\t\texpected pending tasks in deadline order" << std::endl;
+        return false;
+      }
+    }
+
+    std::cout << "\t\t\t\tadd expired task ahead of a later one, add worker to consume.." << std::endl;
+
+    threadManager->add(late, 0, 10000);
+    threadManager->add(early, 0, 1);
+    sleep_(50);  // make sure the earlier task has expired
+
+    threadManager->addWorker();
+    sleep_(100);  // make sure it has time to spin up and run both
+
+    if (m_expired.size() != 1 || m_expired.front() != early) {
+      std::cerr << "\t\t\t\t\texpected the earliest task to be expired" << std::endl;
+      return false;
+    }
+    m_expired.clear();
+
+    EXPECT(threadManager->pendingTaskCount(), 0);
+    EXPECT(threadManager->expiredTaskCount(), 1);
+
+    threadManager->stop();
+    return true;
+  }
+
+  class OrderTask : public Runnable {
+  public:
+    OrderTask(std::vector<int>& order, int id) : _order(order), _id(id) {}
+
+    void run() override { _order.push_back(_id); }
+
+    std::vector<int>& _order;
+    int _id;
+  };
+
+  bool codelTest() {
+    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(0);
+    threadManager->threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    threadManager->start();
+    threadManager->setExpireCallback(expiredNotifier);
+    threadManager->setQueueDelayTarget(5, 20);
+    threadManager->setSchedulingPolicy(ThreadManager::CODEL);
+    m_expired.clear();
+
+    std::cout << "\t\t\t\tadd tasks that wait past the target.." << std::endl;
+
+    std::vector<int> order;
+    for (int i = 0; i < 10; ++i) {
+      threadManager->add(shared_ptr<Runnable>(new OrderTask(order, i)));
+    }
+    sleep_(50);  // longer than the interval, and than twice the target
+
+    std::cout << "\t\t\t\tadd worker to shed them.." << std::endl;
+
+    threadManager->addWorker();
+    sleep_(100);
+
+    if (!threadManager->isQueueOverloaded()) {
+      std::cerr << "\t\t\t\t\texpected the queue to be overloaded" << std::endl;
+      return false;
+    }
+    EXPECT(m_expired.size(), 10);
+    EXPECT(threadManager->expiredTaskCount(), 10);
+    m_expired.clear();
+
+    std::cout << "\t\t\t\tadd task to an idle queue.." << std::endl;
+
+    threadManager->add(shared_ptr<Runnable>(new OrderTask(order, 10)));
+    sleep_(50);
+
+    threadManager->stop();
+    EXPECT(order.size(), 1);
+    EXPECT(m_expired.size(), 0);
+    return true;
+  }
+
+  bool adaptiveLifoTest() {
+    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(0);
+    threadManager->threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    threadManager->start();
+    threadManager->setQueueDelayTarget(5, 20);
+    threadManager->setSchedulingPolicy(ThreadManager::ADAPTIVE_LIFO);
+
+    std::cout << "\t\t\t\tadd tasks that wait past the target.." << std::endl;
+
+    std::vector<int> order;
+    for (int i = 0; i < 3; ++i) {
+      threadManager->add(shared_ptr<Runnable>(new OrderTask(order, i)));
+    }
+    sleep_(50);
+
+    std::cout << "\t\t\t\tadd worker to run them newest first.." << std::endl;
+
+    threadManager->addWorker();
+    sleep_(100);
+    threadManager->stop();
+
+    std::vector<int> expected = {2, 1, 0};
+    if (order != expected) {
+      std::cerr << "\t\t\t\t\texpected tasks to run newest first" << std::endl;
+      return false;
+    }
+    return true;
+  }
 };
 
 }
@@ -27,6 +27,7 @@
 
 #include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/concurrency/Monitor.h>
+#include <thrift/processor/TSpecializedProcessorFactory.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/server/TThreadedServer.h>
 #include <thrift/server/TThreadPoolServer.h>
@@ -42,6 +43,7 @@
 
 using namespace apache::thrift;
 using namespace apache::thrift::concurrency;
+using namespace apache::thrift::processor;
 using namespace apache::thrift::protocol;
 using namespace apache::thrift::server;
 using namespace apache::thrift::test;
@@ -908,6 +910,27 @@ DEFINE_SIMPLE_TESTS(TSimpleServer, Untemplated)
 DEFINE_NOFRAME_TESTS(TSimpleServer, Templated)
 DEFINE_NOFRAME_TESTS(TSimpleServer, Untemplated)
 
+/*
+ * TSpecializedProcessorFactory must hand out protocols of exactly the type its
+ * processor is specialized for, for every transport the servers use.
+ */
+BOOST_AUTO_TEST_CASE(specializedProcessorFactory) {
+  typedef TSpecializedProcessorFactory<ChildServiceProcessorT> Factory;
+  std::shared_ptr<EventLog> log(new EventLog);
+  std::shared_ptr<ChildHandler> handler(new ChildHandler(log));
+  std::shared_ptr<Factory> factory(new Factory(handler));
+
+  TConnectionInfo connInfo;
+  std::shared_ptr<TProcessor> processor = factory->getProcessor(connInfo);
+  BOOST_CHECK(dynamic_cast<ChildServiceProcessorT<TBinaryProtocolT<TBufferBase> >*>(processor.get()));
+  BOOST_CHECK(processor == factory->getSpecializedProcessor());
+
+  std::shared_ptr<TTransport> memory(new TMemoryBuffer);
+  std::shared_ptr<TTransport> framed(new TFramedTransport(memory));
+  BOOST_CHECK(dynamic_cast<Factory::Protocol*>(factory->getProtocolFactory()->getProtocol(memory).get()));
+  BOOST_CHECK(dynamic_cast<Factory::Protocol*>(factory->getProtocolFactory()->getProtocol(framed).get()));
+}
+
 // TODO: We should test TEventServer in the future.
 // For now, it is known not to work correctly with TProcessorEventHandler.
 #ifdef BOOST_TEST_DYN_LINK
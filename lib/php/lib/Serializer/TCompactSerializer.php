@@ -0,0 +1,81 @@
+<?php
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ * @package thrift.protocol
+ */
+
+namespace Thrift\Serializer;
+
+use Thrift\Transport\TMemoryBuffer;
+use Thrift\Protocol\TCompactProtocolAccelerated;
+use Thrift\Type\TMessageType;
+
+/**
+ * Utility class for serializing and deserializing
+ * a thrift object using TCompactProtocolAccelerated.
+ */
+class TCompactSerializer
+{
+    // Like thrift_protocol_write_binary, thrift_protocol_write_compact
+    // adds a begin message prefix, which is stripped again here so the
+    // result can be read by a plain TCompactProtocol.
+    public static function serialize($object)
+    {
+        $transport = new TMemoryBuffer();
+        $protocol = new TCompactProtocolAccelerated($transport);
+        if (function_exists('thrift_protocol_write_compact')) {
+            thrift_protocol_write_compact(
+                $protocol,
+                $object->getName(),
+                TMessageType::REPLY,
+                $object,
+                0
+            );
+
+            $protocol->readMessageBegin($unused_name, $unused_type, $unused_seqid);
+        } else {
+            $object->write($protocol);
+        }
+        $protocol->getTransport()->flush();
+
+        return $transport->getBuffer();
+    }
+
+    public static function deserialize($string_object, $class_name, $buffer_size = 8192)
+    {
+        $transport = new TMemoryBuffer();
+        $protocol = new TCompactProtocolAccelerated($transport);
+        if (function_exists('thrift_protocol_read_compact')) {
+            // TCompactProtocolAccelerated wraps our TMemoryBuffer in a TBufferedTransport,
+            // so write through the protocol's transport (see TBinarySerializer).
+            $protocol->writeMessageBegin('', TMessageType::REPLY, 0);
+            $protocolTransport = $protocol->getTransport();
+            $protocolTransport->write($string_object);
+            $protocolTransport->flush();
+
+            return thrift_protocol_read_compact($protocol, $class_name, $buffer_size);
+        } else {
+            $transport->write($string_object);
+            $object = new $class_name();
+            $object->read($protocol);
+
+            return $object;
+        }
+    }
+}
@@ -48,9 +48,13 @@
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 #define htonll(x) bswap_64(x)
 #define ntohll(x) bswap_64(x)
+#define htolell(x) x
+#define letohll(x) x
 #elif __BYTE_ORDER == __BIG_ENDIAN
 #define htonll(x) x
 #define ntohll(x) x
+#define htolell(x) bswap_64(x)
+#define letohll(x) bswap_64(x)
 #else
 #error Unknown __BYTE_ORDER
 #endif
@@ -85,10 +89,36 @@ const int8_t T_EXCEPTION = 3;
 const int INVALID_DATA = 1;
 const int BAD_VERSION = 4;
 
+// compact protocol
+const uint8_t COMPACT_PROTOCOL_ID = 0x82;
+const uint8_t COMPACT_VERSION = 1;
+const uint8_t COMPACT_VERSION_MASK = 0x1f;
+const uint8_t COMPACT_TYPE_BITS = 0x07;
+const int COMPACT_TYPE_SHIFT_AMOUNT = 5;
+
+enum CType {
+  CT_STOP           = 0x00,
+  CT_BOOLEAN_TRUE   = 0x01,
+  CT_BOOLEAN_FALSE  = 0x02,
+  CT_BYTE           = 0x03,
+  CT_I16            = 0x04,
+  CT_I32            = 0x05,
+  CT_I64            = 0x06,
+  CT_DOUBLE         = 0x07,
+  CT_BINARY         = 0x08,
+  CT_LIST           = 0x09,
+  CT_SET            = 0x0A,
+  CT_MAP            = 0x0B,
+  CT_STRUCT         = 0x0C
+};
+
 static zend_function_entry thrift_protocol_functions[] = {
   PHP_FE(thrift_protocol_write_binary, nullptr)
   PHP_FE(thrift_protocol_read_binary, nullptr)
   PHP_FE(thrift_protocol_read_binary_after_message_begin, nullptr)
+  PHP_FE(thrift_protocol_write_compact, nullptr)
+  PHP_FE(thrift_protocol_read_compact, nullptr)
+  PHP_FE(thrift_protocol_read_compact_after_message_begin, nullptr)
   {nullptr, nullptr, nullptr}
 };
 
@@ -219,6 +249,17 @@ public:
     write((const char*)&i, 1);
   }
 
+  void writeVarint(uint64_t n) {
+    char buf[10];
+    size_t wsize = 0;
+    while (n > 0x7f) {
+      buf[wsize++] = static_cast<char>((n & 0x7f) | 0x80);
+      n >>= 7;
+    }
+    buf[wsize++] = static_cast<char>(n);
+    write(buf, wsize);
+  }
+
   void writeString(const char* str, size_t len) {
     writeU32(len);
     write(str, len);
@@ -355,6 +396,18 @@ public:
     return (int32_t)ntohl(c);
   }
 
+  // Single byte reads are what varints are made of, so serve them straight
+  // from the buffer when possible
+  uint8_t readU8() {
+    if (buffer_used) {
+      --buffer_used;
+      return static_cast<uint8_t>(*buffer_ptr++);
+    }
+    uint8_t c;
+    readBytes(&c, 1);
+    return c;
+  }
+
 protected:
   void refill() {
     assert(buffer_used == 0);
@@ -397,6 +450,12 @@ static
 void binary_serialize(int8_t thrift_typeID, PHPOutputTransport& transport, zval* value, HashTable* fieldspec);
 static inline
 bool ttype_is_scalar(int8_t t);
+static
+void compact_deserialize_spec(zval* zthis, PHPInputTransport& transport, HashTable* spec);
+static
+void compact_serialize_spec(zval* zthis, PHPOutputTransport& transport, HashTable* spec);
+static
+void compact_serialize(int8_t thrift_typeID, PHPOutputTransport& transport, zval* value, HashTable* fieldspec);
 
 // Create a PHP object given a typename and call the ctor, optionally passing up to 2 arguments
 static
@@ -1024,127 +1083,806 @@ void binary_serialize_spec(zval* zthis, PHPOutputTransport& transport, HashTable
   transport.writeI8(T_STOP); // struct end
 }
 
-// 6 params: $transport $method_name $ttype $request_struct $seqID $strict_write
-PHP_FUNCTION(thrift_protocol_write_binary) {
-  zval *protocol;
-  zval *request_struct;
-  zend_string *method_name;
-  long msgtype, seqID;
-  zend_bool strict_write;
+static inline
+uint32_t i32ToZigzag(int32_t n) {
+  return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
 
-  if (zend_parse_parameters_ex(ZEND_PARSE_PARAMS_QUIET, ZEND_NUM_ARGS(), "oSlolb",
-    &protocol, &method_name, &msgtype,
-    &request_struct, &seqID, &strict_write) == FAILURE) {
-      return;
-  }
+static inline
+uint64_t i64ToZigzag(int64_t n) {
+  return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
 
-  try {
-    zval* spec = zend_read_static_property(Z_OBJCE_P(request_struct), "_TSPEC", sizeof("_TSPEC")-1, true);
-    if (spec) {
-      ZVAL_DEREF(spec);
+static inline
+int32_t zigzagToI32(uint32_t n) {
+  return static_cast<int32_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+static inline
+int64_t zigzagToI64(uint64_t n) {
+  return static_cast<int64_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+static
+uint64_t compact_read_varint64(PHPInputTransport& transport) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = transport.readU8();
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return result;
     }
+  }
+  throw_tprotocolexception("Variable-length int over 10 bytes.", INVALID_DATA);
+  return 0;
+}
 
-    if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
-      throw_tprotocolexception("Attempt serialize from non-Thrift object", INVALID_DATA);
+static
+uint32_t compact_read_varint32(PHPInputTransport& transport) {
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    uint8_t byte = transport.readU8();
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return result;
     }
+  }
+  throw_tprotocolexception("Variable-length int over 5 bytes.", INVALID_DATA);
+  return 0;
+}
 
-    PHPOutputTransport transport(protocol);
-    protocol_writeMessageBegin(protocol, method_name, (int32_t) msgtype, (int32_t) seqID);
-    binary_serialize_spec(request_struct, transport, Z_ARRVAL_P(spec));
-    transport.flush();
+static
+uint8_t compact_ctype(int8_t thrift_typeID) {
+  switch (thrift_typeID) {
+    case T_STOP:
+      return CT_STOP;
+    case T_BOOL:
+      return CT_BOOLEAN_TRUE;
+    case T_BYTE:
+      return CT_BYTE;
+    case T_I16:
+      return CT_I16;
+    case T_I32:
+      return CT_I32;
+    case T_U64:
+    case T_I64:
+      return CT_I64;
+    case T_DOUBLE:
+      return CT_DOUBLE;
+    case T_UTF8:
+    case T_UTF16:
+    case T_STRING:
+      return CT_BINARY;
+    case T_LIST:
+      return CT_LIST;
+    case T_SET:
+      return CT_SET;
+    case T_MAP:
+      return CT_MAP;
+    case T_STRUCT:
+      return CT_STRUCT;
+  };
 
-  } catch (const PHPExceptionWrapper& ex) {
-    // ex will be destructed, so copy to a zval that zend_throw_exception_object can take ownership of
-    zval myex;
-    ZVAL_COPY(&myex, ex);
-    zend_throw_exception_object(&myex);
-    RETURN_NULL();
-  } catch (const std::exception& ex) {
-    throw_zend_exception_from_std_exception(ex);
-    RETURN_NULL();
-  }
+  char errbuf[128];
+  snprintf(errbuf, 128, "Unknown thrift typeID %d", thrift_typeID);
+  throw_tprotocolexception(errbuf, INVALID_DATA);
+  return CT_STOP;
 }
 
+static
+int8_t compact_ttype(uint8_t ctype) {
+  switch (ctype & 0x0f) {
+    case CT_STOP:
+      return T_STOP;
+    case CT_BOOLEAN_TRUE:
+    case CT_BOOLEAN_FALSE:
+      return T_BOOL;
+    case CT_BYTE:
+      return T_BYTE;
+    case CT_I16:
+      return T_I16;
+    case CT_I32:
+      return T_I32;
+    case CT_I64:
+      return T_I64;
+    case CT_DOUBLE:
+      return T_DOUBLE;
+    case CT_BINARY:
+      return T_STRING;
+    case CT_LIST:
+      return T_LIST;
+    case CT_SET:
+      return T_SET;
+    case CT_MAP:
+      return T_MAP;
+    case CT_STRUCT:
+      return T_STRUCT;
+  };
 
-// 4 params: $transport $response_Typename $strict_read $buffer_size
-PHP_FUNCTION(thrift_protocol_read_binary) {
-  zval *protocol;
-  zend_string *obj_typename;
-  zend_bool strict_read;
-  size_t buffer_size = 8192;
+  char errbuf[128];
+  snprintf(errbuf, 128, "Unknown compact type %d", ctype & 0x0f);
+  throw_tprotocolexception(errbuf, INVALID_DATA);
+  return T_STOP;
+}
 
-  if (zend_parse_parameters(ZEND_NUM_ARGS(), "oSb|l", &protocol, &obj_typename, &strict_read, &buffer_size) == FAILURE) {
-    return;
+static
+void compact_write_collection_begin(PHPOutputTransport& transport, int8_t elemtype, uint32_t size) {
+  if (size <= 14) {
+    transport.writeI8(static_cast<int8_t>((size << 4) | compact_ctype(elemtype)));
+  } else {
+    transport.writeI8(static_cast<int8_t>(0xf0 | compact_ctype(elemtype)));
+    transport.writeVarint(size);
   }
+}
 
-  try {
-    PHPInputTransport transport(protocol, buffer_size);
-    int8_t messageType = 0;
-    int32_t sz = transport.readI32();
+static
+uint32_t compact_read_collection_begin(PHPInputTransport& transport, int8_t& elemtype) {
+  uint8_t size_and_type = transport.readU8();
+  uint32_t size = size_and_type >> 4;
+  elemtype = compact_ttype(size_and_type);
+  if (size == 15) {
+    size = compact_read_varint32(transport);
+  }
+  return size;
+}
 
-    if (sz < 0) {
-      // Check for correct version number
-      int32_t version = sz & VERSION_MASK;
-      if (version != VERSION_1) {
-        throw_tprotocolexception("Bad version identifier", BAD_VERSION);
+static
+void compact_skip_element(int8_t thrift_typeID, PHPInputTransport& transport) {
+  switch (thrift_typeID) {
+    case T_STOP:
+    case T_VOID:
+      return;
+    case T_STRUCT:
+      while (true) {
+        uint8_t header = transport.readU8(); // field delta and type
+        if ((header & 0x0f) == CT_STOP) break;
+        if (!(header >> 4)) {
+          compact_read_varint32(transport); // long form field number
+        }
+        int8_t ttype = compact_ttype(header);
+        if (ttype != T_BOOL) { // the value of bool fields is in the header
+          compact_skip_element(ttype, transport);
+        }
       }
-      messageType = (sz & 0x000000ff);
-      int32_t namelen = transport.readI32();
-      // skip the name string and the sequence ID, we don't care about those
-      transport.skip(namelen + 4);
-    } else {
-      if (strict_read) {
-        throw_tprotocolexception("No version identifier... old protocol client in strict mode?", BAD_VERSION);
-      } else {
-        // Handle pre-versioned input
-        transport.skip(sz); // skip string body
-        messageType = transport.readI8();
-        transport.skip(4); // skip sequence number
+      return;
+    case T_BOOL:
+    case T_BYTE:
+      transport.skip(1);
+      return;
+    case T_I16:
+    case T_I32:
+    case T_U64:
+    case T_I64:
+      compact_read_varint64(transport);
+      return;
+    case T_DOUBLE:
+      transport.skip(8);
+      return;
+    //case T_UTF7: // aliases T_STRING
+    case T_UTF8:
+    case T_UTF16:
+    case T_STRING:
+      transport.skip(compact_read_varint32(transport));
+      return;
+    case T_MAP: {
+      uint32_t size = compact_read_varint32(transport);
+      if (size) {
+        uint8_t types = transport.readU8();
+        int8_t keytype = compact_ttype(types >> 4);
+        int8_t valtype = compact_ttype(types);
+        for (uint32_t i = 0; i < size; ++i) {
+          compact_skip_element(keytype, transport);
+          compact_skip_element(valtype, transport);
+        }
       }
-    }
+    } return;
+    case T_LIST:
+    case T_SET: {
+      int8_t valtype;
+      uint32_t size = compact_read_collection_begin(transport, valtype);
+      for (uint32_t i = 0; i < size; ++i) {
+        compact_skip_element(valtype, transport);
+      }
+    } return;
+  };
 
-    if (messageType == T_EXCEPTION) {
-      zval ex;
-      createObject("\\Thrift\\Exception\\TApplicationException", &ex);
-      zval* spec = zend_read_static_property(Z_OBJCE(ex), "_TSPEC", sizeof("_TPSEC")-1, false);
+  char errbuf[128];
+  snprintf(errbuf, 128, "Unknown thrift typeID %d", thrift_typeID);
+  throw_tprotocolexception(errbuf, INVALID_DATA);
+}
+
+static
+void compact_deserialize(int8_t thrift_typeID, PHPInputTransport& transport, zval* return_value, HashTable* fieldspec) {
+  ZVAL_NULL(return_value);
+
+  switch (thrift_typeID) {
+    case T_STOP:
+    case T_VOID:
+      RETURN_NULL();
+      return;
+    case T_STRUCT: {
+      zval* val_ptr = zend_hash_str_find(fieldspec, "class", sizeof("class")-1);
+      if (val_ptr == nullptr) {
+        throw_tprotocolexception("no class type in spec", INVALID_DATA);
+        compact_skip_element(T_STRUCT, transport);
+        RETURN_NULL();
+      }
+
+      char* structType = Z_STRVAL_P(val_ptr);
+      // Create an object in PHP userland based on our spec
+      createObject(structType, return_value);
+      if (Z_TYPE_P(return_value) == IS_NULL) {
+        // unable to create class entry
+        compact_skip_element(T_STRUCT, transport);
+        RETURN_NULL();
+      }
+
+      zval* spec = zend_read_static_property(Z_OBJCE_P(return_value), "_TSPEC", sizeof("_TSPEC")-1, false);
       ZVAL_DEREF(spec);
       if (EG(exception)) {
         zend_object *ex = EG(exception);
         EG(exception) = nullptr;
         throw PHPExceptionWrapper(ex);
       }
-      binary_deserialize_spec(&ex, transport, Z_ARRVAL_P(spec));
-      throw PHPExceptionWrapper(&ex);
-    }
-
-    createObject(ZSTR_VAL(obj_typename), return_value);
-    zval* spec = zend_read_static_property(Z_OBJCE_P(return_value), "_TSPEC", sizeof("_TSPEC")-1, true);
-    if (spec) {
-      ZVAL_DEREF(spec);
+      if (Z_TYPE_P(spec) != IS_ARRAY) {
+        char errbuf[128];
+        snprintf(errbuf, 128, "spec for %s is wrong type: %d\n", structType, Z_TYPE_P(spec));
+        throw_tprotocolexception(errbuf, INVALID_DATA);
+        RETURN_NULL();
+      }
+      compact_deserialize_spec(return_value, transport, Z_ARRVAL_P(spec));
+      return;
+    } break;
+    case T_BOOL:
+      // Only reached for container elements, bool fields are decoded from
+      // the field header by compact_deserialize_spec
+      RETURN_BOOL(transport.readU8() == CT_BOOLEAN_TRUE);
+    //case T_I08: // same numeric value as T_BYTE
+    case T_BYTE:
+      RETURN_LONG(static_cast<int8_t>(transport.readU8()));
+    case T_I16:
+      RETURN_LONG(static_cast<int16_t>(zigzagToI32(compact_read_varint32(transport))));
+    case T_I32:
+      RETURN_LONG(zigzagToI32(compact_read_varint32(transport)));
+    case T_U64:
+    case T_I64:
+      RETURN_LONG(zigzagToI64(compact_read_varint64(transport)));
+    case T_DOUBLE: {
+      union {
+        uint64_t c;
+        double d;
+      } a;
+      transport.readBytes(&(a.c), 8);
+      a.c = letohll(a.c);
+      RETURN_DOUBLE(a.d);
     }
-    if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
-      throw_tprotocolexception("Attempt deserialize to non-Thrift object", INVALID_DATA);
+    //case T_UTF7: // aliases T_STRING
+    case T_UTF8:
+    case T_UTF16:
+    case T_STRING: {
+      uint32_t size = compact_read_varint32(transport);
+      if (size) {
+        // Read straight into the string that will be returned
+        zend_string* str = zend_string_alloc(size, 0);
+        try {
+          transport.readBytes(ZSTR_VAL(str), size);
+        } catch (...) {
+          zend_string_release(str);
+          throw;
+        }
+        ZSTR_VAL(str)[size] = '\0';
+        ZVAL_NEW_STR(return_value, str);
+      } else {
+        ZVAL_EMPTY_STRING(return_value);
+      }
+      return;
     }
-    binary_deserialize_spec(return_value, transport, Z_ARRVAL_P(spec));
-  } catch (const PHPExceptionWrapper& ex) {
-    // ex will be destructed, so copy to a zval that zend_throw_exception_object can ownership of
-    zval myex;
-    ZVAL_COPY(&myex, ex);
-    zval_dtor(return_value);
-    zend_throw_exception_object(&myex);
-    RETURN_NULL();
-  } catch (const std::exception& ex) {
-    throw_zend_exception_from_std_exception(ex);
-    RETURN_NULL();
-  }
-}
+    case T_MAP: { // array of key -> value
+      uint32_t size = compact_read_varint32(transport);
+      int8_t keytype = T_STOP, valtype = T_STOP;
+      if (size) {
+        uint8_t types = transport.readU8();
+        keytype = compact_ttype(types >> 4);
+        valtype = compact_ttype(types);
+      }
+      array_init(return_value);
 
-// 4 params: $transport $response_Typename $strict_read $buffer_size
-PHP_FUNCTION(thrift_protocol_read_binary_after_message_begin) {
-  zval *protocol;
-  zend_string *obj_typename;
-  zend_bool strict_read;
-  size_t buffer_size = 8192;
+      zval *val_ptr;
+      val_ptr = zend_hash_str_find(fieldspec, "key", sizeof("key")-1);
+      HashTable* keyspec = Z_ARRVAL_P(val_ptr);
+      val_ptr = zend_hash_str_find(fieldspec, "val", sizeof("val")-1);
+      HashTable* valspec = Z_ARRVAL_P(val_ptr);
+
+      for (uint32_t s = 0; s < size; ++s) {
+        zval key, value;
+
+        compact_deserialize(keytype, transport, &key, keyspec);
+        compact_deserialize(valtype, transport, &value, valspec);
+        if (Z_TYPE(key) == IS_LONG) {
+          zend_hash_index_update(Z_ARR_P(return_value), Z_LVAL(key), &value);
+        } else {
+          if (Z_TYPE(key) != IS_STRING) convert_to_string(&key);
+          zend_symtable_update(Z_ARR_P(return_value), Z_STR(key), &value);
+        }
+        zval_dtor(&key);
+      }
+      return; // return_value already populated
+    }
+    case T_LIST: { // array with autogenerated numeric keys
+      int8_t type;
+      uint32_t size = compact_read_collection_begin(transport, type);
+      zval *val_ptr = zend_hash_str_find(fieldspec, "elem", sizeof("elem")-1);
+      HashTable* elemspec = Z_ARRVAL_P(val_ptr);
+
+      array_init_size(return_value, size);
+      for (uint32_t s = 0; s < size; ++s) {
+        zval value;
+        compact_deserialize(type, transport, &value, elemspec);
+        zend_hash_next_index_insert(Z_ARR_P(return_value), &value);
+      }
+      return;
+    }
+    case T_SET: { // array of key -> TRUE
+      int8_t type;
+      uint32_t size = compact_read_collection_begin(transport, type);
+      zval *val_ptr = zend_hash_str_find(fieldspec, "elem", sizeof("elem")-1);
+      HashTable* elemspec = Z_ARRVAL_P(val_ptr);
+
+      array_init(return_value);
+
+      for (uint32_t s = 0; s < size; ++s) {
+        zval key, value;
+        ZVAL_TRUE(&value);
+
+        compact_deserialize(type, transport, &key, elemspec);
+
+        if (Z_TYPE(key) == IS_LONG) {
+          zend_hash_index_update(Z_ARR_P(return_value), Z_LVAL(key), &value);
+        } else {
+          if (Z_TYPE(key) != IS_STRING) convert_to_string(&key);
+          zend_symtable_update(Z_ARR_P(return_value), Z_STR(key), &value);
+        }
+        zval_dtor(&key);
+      }
+      return;
+    }
+  };
+
+  char errbuf[128];
+  snprintf(errbuf, 128, "Unknown thrift typeID %d", thrift_typeID);
+  throw_tprotocolexception(errbuf, INVALID_DATA);
+}
+
+static
+void compact_serialize_hashtable_key(int8_t keytype, PHPOutputTransport& transport, HashTable* ht, HashPosition& ht_pos, HashTable* spec) {
+  zend_string* key;
+  zend_ulong index = 0;
+
+  zval z;
+
+  int res = zend_hash_get_current_key_ex(ht, &key, &index, &ht_pos);
+  if (res == HASH_KEY_IS_STRING) {
+    ZVAL_STR_COPY(&z, key);
+  } else {
+    ZVAL_LONG(&z, index);
+  }
+  compact_serialize(keytype, transport, &z, spec);
+  zval_dtor(&z);
+}
+
+static
+void compact_serialize(int8_t thrift_typeID, PHPOutputTransport& transport, zval* value, HashTable* fieldspec) {
+  if (value) {
+    ZVAL_DEREF(value);
+  }
+  // At this point the field header (or container header) has already been
+  // written, so all we need to do is write the payload.
+  switch (thrift_typeID) {
+    case T_STOP:
+    case T_VOID:
+      return;
+    case T_STRUCT: {
+      if (Z_TYPE_P(value) != IS_OBJECT) {
+        throw_tprotocolexception("Attempt to send non-object type as a T_STRUCT", INVALID_DATA);
+      }
+      zval* spec = zend_read_static_property(Z_OBJCE_P(value), "_TSPEC", sizeof("_TSPEC")-1, true);
+      if (spec && Z_TYPE_P(spec) == IS_REFERENCE) {
+        ZVAL_DEREF(spec);
+      }
+      if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
+        throw_tprotocolexception("Attempt to send non-Thrift object as a T_STRUCT", INVALID_DATA);
+      }
+      compact_serialize_spec(value, transport, Z_ARRVAL_P(spec));
+    } return;
+    case T_BOOL:
+      // Only reached for container elements, bool fields are folded into
+      // the field header by compact_serialize_spec
+      if (!zval_is_bool(value)) convert_to_boolean(value);
+      transport.writeI8(Z_TYPE_INFO_P(value) == IS_TRUE ? CT_BOOLEAN_TRUE : CT_BOOLEAN_FALSE);
+      return;
+    case T_BYTE:
+      if (Z_TYPE_P(value) != IS_LONG) convert_to_long(value);
+      transport.writeI8(Z_LVAL_P(value));
+      return;
+    case T_I16:
+      if (Z_TYPE_P(value) != IS_LONG) convert_to_long(value);
+      transport.writeVarint(i32ToZigzag(static_cast<int16_t>(Z_LVAL_P(value))));
+      return;
+    case T_I32:
+      if (Z_TYPE_P(value) != IS_LONG) convert_to_long(value);
+      transport.writeVarint(i32ToZigzag(static_cast<int32_t>(Z_LVAL_P(value))));
+      return;
+    case T_I64:
+    case T_U64: {
+      int64_t l_data;
+#if defined(_LP64) || defined(_WIN64)
+      if (Z_TYPE_P(value) != IS_LONG) convert_to_long(value);
+      l_data = Z_LVAL_P(value);
+#else
+      if (Z_TYPE_P(value) != IS_DOUBLE) convert_to_double(value);
+      l_data = (int64_t)Z_DVAL_P(value);
+#endif
+      transport.writeVarint(i64ToZigzag(l_data));
+    } return;
+    case T_DOUBLE: {
+      union {
+        uint64_t c;
+        double d;
+      } a;
+      if (Z_TYPE_P(value) != IS_DOUBLE) convert_to_double(value);
+      a.d = Z_DVAL_P(value);
+      a.c = htolell(a.c);
+      transport.write((const char*)&a.c, 8);
+    } return;
+    case T_UTF8:
+    case T_UTF16:
+    case T_STRING:
+      if (Z_TYPE_P(value) != IS_STRING) convert_to_string(value);
+      transport.writeVarint(Z_STRLEN_P(value));
+      transport.write(Z_STRVAL_P(value), Z_STRLEN_P(value));
+      return;
+    case T_MAP: {
+      if (Z_TYPE_P(value) != IS_ARRAY) convert_to_array(value);
+      if (Z_TYPE_P(value) != IS_ARRAY) {
+        throw_tprotocolexception("Attempt to send an incompatible type as an array (T_MAP)", INVALID_DATA);
+      }
+      HashTable* ht = Z_ARRVAL_P(value);
+      zval* val_ptr;
+
+      val_ptr = zend_hash_str_find(fieldspec, "ktype", sizeof("ktype")-1);
+      if (Z_TYPE_P(val_ptr) != IS_LONG) convert_to_long(val_ptr);
+      uint8_t keytype = Z_LVAL_P(val_ptr);
+      val_ptr = zend_hash_str_find(fieldspec, "vtype", sizeof("vtype")-1);
+      if (Z_TYPE_P(val_ptr) != IS_LONG) convert_to_long(val_ptr);
+      uint8_t valtype = Z_LVAL_P(val_ptr);
+
+      val_ptr = zend_hash_str_find(fieldspec, "val", sizeof("val")-1);
+      HashTable* valspec = Z_ARRVAL_P(val_ptr);
+      HashTable* keyspec = Z_ARRVAL_P(zend_hash_str_find(fieldspec, "key", sizeof("key")-1));
+
+      uint32_t size = zend_hash_num_elements(ht);
+      if (size == 0) {
+        transport.writeI8(0);
+        return;
+      }
+      transport.writeVarint(size);
+      transport.writeI8(static_cast<int8_t>((compact_ctype(keytype) << 4) | compact_ctype(valtype)));
+
+      HashPosition key_ptr;
+      for (zend_hash_internal_pointer_reset_ex(ht, &key_ptr);
+           (val_ptr = zend_hash_get_current_data_ex(ht, &key_ptr)) != nullptr;
+           zend_hash_move_forward_ex(ht, &key_ptr)) {
+        compact_serialize_hashtable_key(keytype, transport, ht, key_ptr, keyspec);
+        compact_serialize(valtype, transport, val_ptr, valspec);
+      }
+    } return;
+    case T_LIST: {
+      if (Z_TYPE_P(value) != IS_ARRAY) convert_to_array(value);
+      if (Z_TYPE_P(value) != IS_ARRAY) {
+        throw_tprotocolexception("Attempt to send an incompatible type as an array (T_LIST)", INVALID_DATA);
+      }
+      HashTable* ht = Z_ARRVAL_P(value);
+      zval* val_ptr;
+
+      val_ptr = zend_hash_str_find(fieldspec, "etype", sizeof("etype")-1);
+      if (Z_TYPE_P(val_ptr) != IS_LONG) convert_to_long(val_ptr);
+      uint8_t valtype = Z_LVAL_P(val_ptr);
+
+      val_ptr = zend_hash_str_find(fieldspec, "elem", sizeof("elem")-1);
+      HashTable* valspec = Z_ARRVAL_P(val_ptr);
+
+      compact_write_collection_begin(transport, valtype, zend_hash_num_elements(ht));
+      HashPosition key_ptr;
+      for (zend_hash_internal_pointer_reset_ex(ht, &key_ptr);
+           (val_ptr = zend_hash_get_current_data_ex(ht, &key_ptr)) != nullptr;
+           zend_hash_move_forward_ex(ht, &key_ptr)) {
+        compact_serialize(valtype, transport, val_ptr, valspec);
+      }
+    } return;
+    case T_SET: {
+      if (Z_TYPE_P(value) != IS_ARRAY) convert_to_array(value);
+      if (Z_TYPE_P(value) != IS_ARRAY) {
+        throw_tprotocolexception("Attempt to send an incompatible type as an array (T_SET)", INVALID_DATA);
+      }
+      HashTable* ht = Z_ARRVAL_P(value);
+      zval* val_ptr;
+
+      val_ptr = zend_hash_str_find(fieldspec, "etype", sizeof("etype")-1);
+      HashTable* spec = Z_ARRVAL_P(zend_hash_str_find(fieldspec, "elem", sizeof("elem")-1));
+      if (Z_TYPE_P(val_ptr) != IS_LONG) convert_to_long(val_ptr);
+      uint8_t keytype = Z_LVAL_P(val_ptr);
+
+      compact_write_collection_begin(transport, keytype, zend_hash_num_elements(ht));
+      HashPosition key_ptr;
+      if(ttype_is_scalar(keytype)){
+        for (zend_hash_internal_pointer_reset_ex(ht, &key_ptr);
+             (val_ptr = zend_hash_get_current_data_ex(ht, &key_ptr)) != nullptr;
+             zend_hash_move_forward_ex(ht, &key_ptr)) {
+          compact_serialize_hashtable_key(keytype, transport, ht, key_ptr, spec);
+        }
+      } else {
+        for (zend_hash_internal_pointer_reset_ex(ht, &key_ptr);
+             (val_ptr = zend_hash_get_current_data_ex(ht, &key_ptr)) != nullptr;
+             zend_hash_move_forward_ex(ht, &key_ptr)) {
+          compact_serialize(keytype, transport, val_ptr, spec);
+        }
+      }
+    } return;
+  };
+
+  char errbuf[128];
+  snprintf(errbuf, 128, "Unknown thrift typeID %d", thrift_typeID);
+  throw_tprotocolexception(errbuf, INVALID_DATA);
+}
+
+static
+void compact_deserialize_spec(zval* zthis, PHPInputTransport& transport, HashTable* spec) {
+  zend_class_entry* ce = Z_OBJCE_P(zthis);
+  int16_t last_fieldno = 0;
+  while (true) {
+    uint8_t header = transport.readU8();
+    if ((header & 0x0f) == CT_STOP) {
+      validate_thrift_object(zthis);
+      return;
+    }
+
+    // Field numbers are stored as a delta from the previous field if it fits
+    // in the high nibble, and as a zigzag varint after the type otherwise
+    int16_t fieldno;
+    uint8_t delta = header >> 4;
+    if (delta) {
+      fieldno = last_fieldno + delta;
+    } else {
+      fieldno = static_cast<int16_t>(zigzagToI32(compact_read_varint32(transport)));
+    }
+    last_fieldno = fieldno;
+
+    int8_t ttype = compact_ttype(header);
+    zval* val_ptr = zend_hash_index_find(spec, fieldno);
+    if (val_ptr != nullptr) {
+      HashTable* fieldspec = Z_ARRVAL_P(val_ptr);
+      // pull the field name
+      val_ptr = zend_hash_str_find(fieldspec, "var", sizeof("var")-1);
+      char* varname = Z_STRVAL_P(val_ptr);
+
+      // and the type
+      val_ptr = zend_hash_str_find(fieldspec, "type", sizeof("type")-1);
+      if (Z_TYPE_P(val_ptr) != IS_LONG) convert_to_long(val_ptr);
+      int8_t expected_ttype = Z_LVAL_P(val_ptr);
+
+      if (ttypes_are_compatible(ttype, expected_ttype)) {
+        zval rv;
+        ZVAL_UNDEF(&rv);
+
+        if (ttype == T_BOOL) {
+          ZVAL_BOOL(&rv, (header & 0x0f) == CT_BOOLEAN_TRUE);
+        } else {
+          compact_deserialize(ttype, transport, &rv, fieldspec);
+        }
+        zend_update_property(ce, zthis, varname, strlen(varname), &rv);
+
+        zval_ptr_dtor(&rv);
+        continue;
+      }
+    }
+    if (ttype != T_BOOL) {
+      compact_skip_element(ttype, transport);
+    }
+  }
+}
+
+static
+void compact_serialize_spec(zval* zthis, PHPOutputTransport& transport, HashTable* spec) {
+
+  validate_thrift_object(zthis);
+
+  HashPosition key_ptr;
+  zval* val_ptr;
+  int16_t last_fieldno = 0;
+
+  for (zend_hash_internal_pointer_reset_ex(spec, &key_ptr);
+       (val_ptr = zend_hash_get_current_data_ex(spec, &key_ptr)) != nullptr;
+       zend_hash_move_forward_ex(spec, &key_ptr)) {
+
+    zend_ulong fieldno;
+    if (zend_hash_get_current_key_ex(spec, nullptr, &fieldno, &key_ptr) != HASH_KEY_IS_LONG) {
+      throw_tprotocolexception("Bad keytype in TSPEC (expected 'long')", INVALID_DATA);
+      return;
+    }
+    HashTable* fieldspec = Z_ARRVAL_P(val_ptr);
+
+    // field name
+    val_ptr = zend_hash_str_find(fieldspec, "var", sizeof("var")-1);
+    char* varname = Z_STRVAL_P(val_ptr);
+
+    // thrift type
+    val_ptr = zend_hash_str_find(fieldspec, "type", sizeof("type")-1);
+    if (Z_TYPE_P(val_ptr) != IS_LONG) convert_to_long(val_ptr);
+    int8_t ttype = Z_LVAL_P(val_ptr);
+
+    zval rv;
+    zval* prop = zend_read_property(Z_OBJCE_P(zthis), zthis, varname, strlen(varname), false, &rv);
+
+    if (Z_TYPE_P(prop) == IS_REFERENCE){
+      ZVAL_DEREF(prop);
+    }
+    if (Z_TYPE_P(prop) != IS_NULL) {
+      uint8_t ctype;
+      if (ttype == T_BOOL) {
+        // The value of a bool field goes into the field header
+        if (!zval_is_bool(prop)) convert_to_boolean(prop);
+        ctype = Z_TYPE_INFO_P(prop) == IS_TRUE ? CT_BOOLEAN_TRUE : CT_BOOLEAN_FALSE;
+      } else {
+        ctype = compact_ctype(ttype);
+      }
+
+      int16_t fid = static_cast<int16_t>(fieldno);
+      if (fid > last_fieldno && fid - last_fieldno <= 15) {
+        transport.writeI8(static_cast<int8_t>(((fid - last_fieldno) << 4) | ctype));
+      } else {
+        transport.writeI8(ctype);
+        transport.writeVarint(i32ToZigzag(fid));
+      }
+      last_fieldno = fid;
+
+      if (ttype != T_BOOL) {
+        compact_serialize(ttype, transport, prop, fieldspec);
+      }
+    }
+  }
+  transport.writeI8(CT_STOP); // struct end
+}
+
+static
+void compact_writeMessageBegin(PHPOutputTransport& transport, zend_string* method_name, int32_t msgtype, int32_t seqID) {
+  transport.writeI8(static_cast<int8_t>(COMPACT_PROTOCOL_ID));
+  transport.writeI8(static_cast<int8_t>(COMPACT_VERSION | ((msgtype & COMPACT_TYPE_BITS) << COMPACT_TYPE_SHIFT_AMOUNT)));
+  transport.writeVarint(static_cast<uint32_t>(seqID));
+  transport.writeVarint(ZSTR_LEN(method_name));
+  transport.write(ZSTR_VAL(method_name), ZSTR_LEN(method_name));
+}
+
+// 6 params: $transport $method_name $ttype $request_struct $seqID $strict_write
+PHP_FUNCTION(thrift_protocol_write_binary) {
+  zval *protocol;
+  zval *request_struct;
+  zend_string *method_name;
+  long msgtype, seqID;
+  zend_bool strict_write;
+
+  if (zend_parse_parameters_ex(ZEND_PARSE_PARAMS_QUIET, ZEND_NUM_ARGS(), "oSlolb",
+    &protocol, &method_name, &msgtype,
+    &request_struct, &seqID, &strict_write) == FAILURE) {
+      return;
+  }
+
+  try {
+    zval* spec = zend_read_static_property(Z_OBJCE_P(request_struct), "_TSPEC", sizeof("_TSPEC")-1, true);
+    if (spec) {
+      ZVAL_DEREF(spec);
+    }
+
+    if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
+      throw_tprotocolexception("Attempt serialize from non-Thrift object", INVALID_DATA);
+    }
+
+    PHPOutputTransport transport(protocol);
+    protocol_writeMessageBegin(protocol, method_name, (int32_t) msgtype, (int32_t) seqID);
+    binary_serialize_spec(request_struct, transport, Z_ARRVAL_P(spec));
+    transport.flush();
+
+  } catch (const PHPExceptionWrapper& ex) {
+    // ex will be destructed, so copy to a zval that zend_throw_exception_object can take ownership of
+    zval myex;
+    ZVAL_COPY(&myex, ex);
+    zend_throw_exception_object(&myex);
+    RETURN_NULL();
+  } catch (const std::exception& ex) {
+    throw_zend_exception_from_std_exception(ex);
+    RETURN_NULL();
+  }
+}
+
+
+// 4 params: $transport $response_Typename $strict_read $buffer_size
+PHP_FUNCTION(thrift_protocol_read_binary) {
+  zval *protocol;
+  zend_string *obj_typename;
+  zend_bool strict_read;
+  size_t buffer_size = 8192;
+
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "oSb|l", &protocol, &obj_typename, &strict_read, &buffer_size) == FAILURE) {
+    return;
+  }
+
+  try {
+    PHPInputTransport transport(protocol, buffer_size);
+    int8_t messageType = 0;
+    int32_t sz = transport.readI32();
+
+    if (sz < 0) {
+      // Check for correct version number
+      int32_t version = sz & VERSION_MASK;
+      if (version != VERSION_1) {
+        throw_tprotocolexception("Bad version identifier", BAD_VERSION);
+      }
+      messageType = (sz & 0x000000ff);
+      int32_t namelen = transport.readI32();
+      // skip the name string and the sequence ID, we don't care about those
+      transport.skip(namelen + 4);
+    } else {
+      if (strict_read) {
+        throw_tprotocolexception("No version identifier... old protocol client in strict mode?", BAD_VERSION);
+      } else {
+        // Handle pre-versioned input
+        transport.skip(sz); // skip string body
+        messageType = transport.readI8();
+        transport.skip(4); // skip sequence number
+      }
+    }
+
+    if (messageType == T_EXCEPTION) {
+      zval ex;
+      createObject("\\Thrift\\Exception\\TApplicationException", &ex);
+      zval* spec = zend_read_static_property(Z_OBJCE(ex), "_TSPEC", sizeof("_TPSEC")-1, false);
+      ZVAL_DEREF(spec);
+      if (EG(exception)) {
+        zend_object *ex = EG(exception);
+        EG(exception) = nullptr;
+        throw PHPExceptionWrapper(ex);
+      }
+      binary_deserialize_spec(&ex, transport, Z_ARRVAL_P(spec));
+      throw PHPExceptionWrapper(&ex);
+    }
+
+    createObject(ZSTR_VAL(obj_typename), return_value);
+    zval* spec = zend_read_static_property(Z_OBJCE_P(return_value), "_TSPEC", sizeof("_TSPEC")-1, true);
+    if (spec) {
+      ZVAL_DEREF(spec);
+    }
+    if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
+      throw_tprotocolexception("Attempt deserialize to non-Thrift object", INVALID_DATA);
+    }
+    binary_deserialize_spec(return_value, transport, Z_ARRVAL_P(spec));
+  } catch (const PHPExceptionWrapper& ex) {
+    // ex will be destructed, so copy to a zval that zend_throw_exception_object can ownership of
+    zval myex;
+    ZVAL_COPY(&myex, ex);
+    zval_dtor(return_value);
+    zend_throw_exception_object(&myex);
+    RETURN_NULL();
+  } catch (const std::exception& ex) {
+    throw_zend_exception_from_std_exception(ex);
+    RETURN_NULL();
+  }
+}
+
+// 4 params: $transport $response_Typename $strict_read $buffer_size
+PHP_FUNCTION(thrift_protocol_read_binary_after_message_begin) {
+  zval *protocol;
+  zend_string *obj_typename;
+  zend_bool strict_read;
+  size_t buffer_size = 8192;
 
   if (zend_parse_parameters(ZEND_NUM_ARGS(), "oSb|l", &protocol, &obj_typename, &strict_read, &buffer_size) == FAILURE) {
     return;
@@ -1169,4 +1907,135 @@ PHP_FUNCTION(thrift_protocol_read_binary_after_message_begin) {
   }
 }
 
+
+// 5 params: $transport $method_name $ttype $request_struct $seqID
+PHP_FUNCTION(thrift_protocol_write_compact) {
+  zval *protocol;
+  zval *request_struct;
+  zend_string *method_name;
+  long msgtype, seqID;
+
+  if (zend_parse_parameters_ex(ZEND_PARSE_PARAMS_QUIET, ZEND_NUM_ARGS(), "oSlol",
+    &protocol, &method_name, &msgtype,
+    &request_struct, &seqID) == FAILURE) {
+      return;
+  }
+
+  try {
+    zval* spec = zend_read_static_property(Z_OBJCE_P(request_struct), "_TSPEC", sizeof("_TSPEC")-1, true);
+    if (spec) {
+      ZVAL_DEREF(spec);
+    }
+
+    if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
+      throw_tprotocolexception("Attempt serialize from non-Thrift object", INVALID_DATA);
+    }
+
+    PHPOutputTransport transport(protocol);
+    compact_writeMessageBegin(transport, method_name, (int32_t) msgtype, (int32_t) seqID);
+    compact_serialize_spec(request_struct, transport, Z_ARRVAL_P(spec));
+    transport.flush();
+
+  } catch (const PHPExceptionWrapper& ex) {
+    // ex will be destructed, so copy to a zval that zend_throw_exception_object can take ownership of
+    zval myex;
+    ZVAL_COPY(&myex, ex);
+    zend_throw_exception_object(&myex);
+    RETURN_NULL();
+  } catch (const std::exception& ex) {
+    throw_zend_exception_from_std_exception(ex);
+    RETURN_NULL();
+  }
+}
+
+// 3 params: $transport $response_Typename $buffer_size
+PHP_FUNCTION(thrift_protocol_read_compact) {
+  zval *protocol;
+  zend_string *obj_typename;
+  size_t buffer_size = 8192;
+
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "oS|l", &protocol, &obj_typename, &buffer_size) == FAILURE) {
+    return;
+  }
+
+  try {
+    PHPInputTransport transport(protocol, buffer_size);
+
+    if (transport.readU8() != COMPACT_PROTOCOL_ID) {
+      throw_tprotocolexception("Bad protocol id in TCompact message", BAD_VERSION);
+    }
+    uint8_t version_and_type = transport.readU8();
+    if ((version_and_type & COMPACT_VERSION_MASK) != COMPACT_VERSION) {
+      throw_tprotocolexception("Bad version in TCompact message", BAD_VERSION);
+    }
+    int8_t messageType = (version_and_type >> COMPACT_TYPE_SHIFT_AMOUNT) & COMPACT_TYPE_BITS;
+    // skip the sequence ID and the name string, we don't care about those
+    compact_read_varint32(transport);
+    transport.skip(compact_read_varint32(transport));
+
+    if (messageType == T_EXCEPTION) {
+      zval ex;
+      createObject("\\Thrift\\Exception\\TApplicationException", &ex);
+      zval* spec = zend_read_static_property(Z_OBJCE(ex), "_TSPEC", sizeof("_TPSEC")-1, false);
+      ZVAL_DEREF(spec);
+      if (EG(exception)) {
+        zend_object *ex = EG(exception);
+        EG(exception) = nullptr;
+        throw PHPExceptionWrapper(ex);
+      }
+      compact_deserialize_spec(&ex, transport, Z_ARRVAL_P(spec));
+      throw PHPExceptionWrapper(&ex);
+    }
+
+    createObject(ZSTR_VAL(obj_typename), return_value);
+    zval* spec = zend_read_static_property(Z_OBJCE_P(return_value), "_TSPEC", sizeof("_TSPEC")-1, true);
+    if (spec) {
+      ZVAL_DEREF(spec);
+    }
+    if (!spec || Z_TYPE_P(spec) != IS_ARRAY) {
+      throw_tprotocolexception("Attempt deserialize to non-Thrift object", INVALID_DATA);
+    }
+    compact_deserialize_spec(return_value, transport, Z_ARRVAL_P(spec));
+  } catch (const PHPExceptionWrapper& ex) {
+    // ex will be destructed, so copy to a zval that zend_throw_exception_object can ownership of
+    zval myex;
+    ZVAL_COPY(&myex, ex);
+    zval_dtor(return_value);
+    zend_throw_exception_object(&myex);
+    RETURN_NULL();
+  } catch (const std::exception& ex) {
+    throw_zend_exception_from_std_exception(ex);
+    RETURN_NULL();
+  }
+}
+
+// 3 params: $transport $response_Typename $buffer_size
+PHP_FUNCTION(thrift_protocol_read_compact_after_message_begin) {
+  zval *protocol;
+  zend_string *obj_typename;
+  size_t buffer_size = 8192;
+
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "oS|l", &protocol, &obj_typename, &buffer_size) == FAILURE) {
+    return;
+  }
+
+  try {
+    PHPInputTransport transport(protocol, buffer_size);
+
+    createObject(ZSTR_VAL(obj_typename), return_value);
+    zval* spec = zend_read_static_property(Z_OBJCE_P(return_value), "_TSPEC", sizeof("_TSPEC")-1, false);
+    ZVAL_DEREF(spec);
+    compact_deserialize_spec(return_value, transport, Z_ARRVAL_P(spec));
+  } catch (const PHPExceptionWrapper& ex) {
+    // ex will be destructed, so copy to a zval that zend_throw_exception_object can take ownership of
+    zval myex;
+    ZVAL_COPY(&myex, ex);
+    zend_throw_exception_object(&myex);
+    RETURN_NULL();
+  } catch (const std::exception& ex) {
+    throw_zend_exception_from_std_exception(ex);
+    RETURN_NULL();
+  }
+}
+
 #endif /* PHP_VERSION_ID >= 70000 */
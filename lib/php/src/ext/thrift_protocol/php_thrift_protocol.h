@@ -22,6 +22,9 @@
 PHP_FUNCTION(thrift_protocol_write_binary);
 PHP_FUNCTION(thrift_protocol_read_binary);
 PHP_FUNCTION(thrift_protocol_read_binary_after_message_begin);
+PHP_FUNCTION(thrift_protocol_write_compact);
+PHP_FUNCTION(thrift_protocol_read_compact);
+PHP_FUNCTION(thrift_protocol_read_compact_after_message_begin);
 
 extern zend_module_entry thrift_protocol_module_entry;
 #define phpext_thrift_protocol_ptr &thrift_protocol_module_entry
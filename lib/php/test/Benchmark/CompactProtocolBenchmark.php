@@ -0,0 +1,140 @@
+<?php
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ * @package thrift.test
+ */
+
+/*
+ * Compares the compact protocol implemented in PHP with the one in the
+ * thrift_protocol extension (and the binary protocol, for reference).
+ *
+ * Depends on the ThriftTest stubs generated by "make stubs":
+ *
+ * lib/php/test$ make stubs
+ * lib/php/test$ php -d extension=../src/ext/thrift_protocol/modules/thrift_protocol.so \
+ *   Benchmark/CompactProtocolBenchmark.php [iterations]
+ */
+
+use Thrift\Protocol\TBinaryProtocol;
+use Thrift\Protocol\TBinaryProtocolAccelerated;
+use Thrift\Protocol\TCompactProtocol;
+use Thrift\Protocol\TCompactProtocolAccelerated;
+use Thrift\Transport\TMemoryBuffer;
+use Thrift\Type\TMessageType;
+
+/** @var \Composer\Autoload\ClassLoader $loader */
+$loader = require __DIR__ . '/../../../../vendor/autoload.php';
+$loader->addPsr4('', __DIR__ . '/../packages/php');
+
+$iterations = isset($argv[1]) ? (int)$argv[1] : 10000;
+
+$xtructs = array();
+for ($i = 0; $i < 20; $i++) {
+    $xtructs[] = new \ThriftTest\Xtruct(array(
+        'string_thing' => str_repeat('s', $i * 10),
+        'byte_thing' => $i,
+        'i32_thing' => $i * -1000,
+        'i64_thing' => $i << 40,
+    ));
+}
+$object = new \ThriftTest\Insanity(array(
+    'userMap' => array(\ThriftTest\Numberz::ONE => 1, \ThriftTest\Numberz::FIVE => 5, \ThriftTest\Numberz::EIGHT => 8),
+    'xtructs' => $xtructs,
+));
+$name = $object->getName();
+
+function bench($label, $iterations, $fn)
+{
+    $start = microtime(true);
+    for ($i = 0; $i < $iterations; $i++) {
+        $fn();
+    }
+    $elapsed = microtime(true) - $start;
+    printf("%-40s %10.2f ms %12.0f ops/s\n", $label, $elapsed * 1000, $iterations / $elapsed);
+}
+
+// Messages to read back, written once up front
+$transport = new TMemoryBuffer();
+$protocol = new TBinaryProtocol($transport);
+$protocol->writeMessageBegin($name, TMessageType::REPLY, 0);
+$object->write($protocol);
+$binaryMessage = $transport->getBuffer();
+
+$transport = new TMemoryBuffer();
+$protocol = new TCompactProtocol($transport);
+$protocol->writeMessageBegin($name, TMessageType::REPLY, 0);
+$object->write($protocol);
+$compactMessage = $transport->getBuffer();
+
+printf("%d iterations, message size: binary %d bytes, compact %d bytes\n\n",
+    $iterations, strlen($binaryMessage), strlen($compactMessage));
+
+bench('binary, write', $iterations, function () use ($object, $name) {
+    $protocol = new TBinaryProtocol(new TMemoryBuffer());
+    $protocol->writeMessageBegin($name, TMessageType::REPLY, 0);
+    $object->write($protocol);
+    $protocol->writeMessageEnd();
+});
+
+bench('compact, write', $iterations, function () use ($object, $name) {
+    $protocol = new TCompactProtocol(new TMemoryBuffer());
+    $protocol->writeMessageBegin($name, TMessageType::REPLY, 0);
+    $object->write($protocol);
+    $protocol->writeMessageEnd();
+});
+
+bench('binary, read', $iterations, function () use ($binaryMessage) {
+    $protocol = new TBinaryProtocol(new TMemoryBuffer($binaryMessage));
+    $protocol->readMessageBegin($fname, $mtype, $seqid);
+    $result = new \ThriftTest\Insanity();
+    $result->read($protocol);
+});
+
+bench('compact, read', $iterations, function () use ($compactMessage) {
+    $protocol = new TCompactProtocol(new TMemoryBuffer($compactMessage));
+    $protocol->readMessageBegin($fname, $mtype, $seqid);
+    $result = new \ThriftTest\Insanity();
+    $result->read($protocol);
+});
+
+if (!function_exists('thrift_protocol_write_compact')) {
+    echo "\nthrift_protocol extension not loaded, skipping accelerated protocols\n";
+    exit(0);
+}
+
+bench('accelerated binary, write', $iterations, function () use ($object, $name) {
+    $protocol = new TBinaryProtocolAccelerated(new TMemoryBuffer());
+    thrift_protocol_write_binary($protocol, $name, TMessageType::REPLY, $object, 0, true);
+});
+
+bench('accelerated compact, write', $iterations, function () use ($object, $name) {
+    $protocol = new TCompactProtocolAccelerated(new TMemoryBuffer());
+    thrift_protocol_write_compact($protocol, $name, TMessageType::REPLY, $object, 0);
+});
+
+bench('accelerated binary, read', $iterations, function () use ($binaryMessage) {
+    $protocol = new TBinaryProtocolAccelerated(new TMemoryBuffer($binaryMessage));
+    thrift_protocol_read_binary($protocol, '\ThriftTest\Insanity', true);
+});
+
+bench('accelerated compact, read', $iterations, function () use ($compactMessage) {
+    $protocol = new TCompactProtocolAccelerated(new TMemoryBuffer($compactMessage));
+    thrift_protocol_read_compact($protocol, '\ThriftTest\Insanity');
+});
@@ -0,0 +1,113 @@
+<?php
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ * @package thrift.test
+ */
+
+namespace Test\Thrift\Protocol;
+
+use PHPUnit\Framework\TestCase;
+use Thrift\Protocol\TCompactProtocol;
+use Thrift\Serializer\TCompactSerializer;
+use Thrift\Transport\TMemoryBuffer;
+
+require __DIR__ . '/../../../../vendor/autoload.php';
+
+/***
+ * This test suite depends on running the compiler against the
+ * standard ThriftTest.thrift file:
+ *
+ * lib/php/test$ ../../../compiler/cpp/thrift --gen php -r \
+ *   --out ./packages ../../../test/ThriftTest.thrift
+ *
+ * @runTestsInSeparateProcesses
+ */
+class CompactSerializerTest extends TestCase
+{
+    public function setUp()
+    {
+        /** @var \Composer\Autoload\ClassLoader $loader */
+        $loader = require __DIR__ . '/../../../../vendor/autoload.php';
+        $loader->addPsr4('', __DIR__ . '/../packages/php');
+    }
+
+    private static function largeDeltas()
+    {
+        return new \ThriftTest\LargeDeltas(array(
+            'b1' => new \ThriftTest\Bools(array('im_true' => true, 'im_false' => false)),
+            'b1000' => new \ThriftTest\Bools(array('im_true' => false, 'im_false' => true)),
+            'check_true' => true,
+            'check_false' => false,
+            'vertwo2000' => new \ThriftTest\VersioningTestV2(array(
+                'begin_in_both' => -1,
+                'newint' => -123456,
+                'newbyte' => -128,
+                'newshort' => -32768,
+                'newlong' => PHP_INT_MIN,
+                'newdouble' => -1.5e300,
+                'newstruct' => new \ThriftTest\Bonk(array('message' => 'm', 'type' => 7)),
+                'newlist' => array(1, -2, 3),
+                'newset' => array(4 => true, 5 => true),
+                'newmap' => array(6 => 7, -8 => 9),
+                'newstring' => str_repeat('x', 300),
+                'end_in_both' => 2147483647,
+            )),
+            'a_set2500' => array('a' => true, 'b' => true),
+            'big_numbers' => range(-20, 20),
+        ));
+    }
+
+    public function testCompactSerializer()
+    {
+        $struct = new \ThriftTest\Xtruct(array('string_thing' => 'abc'));
+        $serialized = TCompactSerializer::serialize($struct, 'ThriftTest\\Xtruct');
+        $deserialized = TCompactSerializer::deserialize($serialized, 'ThriftTest\\Xtruct');
+        $this->assertEquals($struct, $deserialized);
+    }
+
+    public function testCompactSerializerLargeDeltas()
+    {
+        $struct = self::largeDeltas();
+        $serialized = TCompactSerializer::serialize($struct);
+        $deserialized = TCompactSerializer::deserialize($serialized, 'ThriftTest\\LargeDeltas');
+        $this->assertEquals($struct, $deserialized);
+    }
+
+    /**
+     * The native and the pure PHP implementation must agree on the wire format.
+     */
+    public function testCompactSerializerMatchesTCompactProtocol()
+    {
+        if (!function_exists('thrift_protocol_write_compact')) {
+            $this->markTestSkipped('The thrift_protocol extension is not loaded.');
+        }
+
+        $struct = self::largeDeltas();
+
+        $transport = new TMemoryBuffer();
+        $struct->write(new TCompactProtocol($transport));
+        $this->assertEquals($transport->getBuffer(), TCompactSerializer::serialize($struct));
+
+        $transport = new TMemoryBuffer(TCompactSerializer::serialize($struct));
+        $deserialized = new \ThriftTest\LargeDeltas();
+        $deserialized->read(new TCompactProtocol($transport));
+        $this->assertEquals($struct, $deserialized);
+    }
+}